@@ -1,2 +1,5 @@
 @echo off
-cl /nologo /Zi /I ..\include /std:c11 cube.c /link user32.lib gdi32.lib opengl32.lib
\ No newline at end of file
+cl /nologo /Zi /I ..\include /std:c11 cube.c /link user32.lib gdi32.lib opengl32.lib
+rem dirt.bmp decoded, mipped and block compressed once, and the shaders: cube.pak
+cl /nologo /O2 ..\..\common\cook.c
+cook -bc cube.pak dirt.bmp cube.vert cube.frag
@@ -5,18 +5,43 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "glextloader.c"
-#include "matrix.c"
+#include "../../common/mat4.h"
+#include "../../common/pacing.c"
+#include "../../common/texloader.c"
+#include "../../common/mip.c"
+#include "../../common/bc.c"
+#include "../../common/pack.c"
+#include "../../common/progcache.c"
 
 static BOOL Running = FALSE;
 static HGLRC OpenGLRC = NULL;
-static DWORD lastTime = 0;
+static double lastTime = 0.0;
 static float  Angle = 0.0f;
 static unsigned int VBO = 0;
 static unsigned int VAO = 0;
 static unsigned int shaderProgram = 0;
-static unsigned int vertexShader = 0;
-static unsigned int fragmentShader = 0;
 static GLuint texture = 0;
+static TEXTURELOADER Loader; // dirt.bmp decodes on a worker, see ../common/texloader.c
+static PACK Pack; // cube.pak, cooked by build.bat (../common/cook.c); not there: the loose files
+static BOOL CompressTextures = FALSE; // BC1 / BC3 uploads, set once the context says it has S3TC
+
+// the Frame block in cube.vert, std140: three mat4 back to back, no padding. One glBufferSubData a
+// frame, the driver's layout is checked against this once (CheckProgramBlock)
+typedef struct {
+    mat4 projection;
+    mat4 view;
+    mat4 model;
+} FRAMEUNIFORMS;
+
+static PROGRAMINFO ProgramInfo; // the linked program's uniforms and blocks, asked once
+static UNIFORMBUFFER FrameBuffer; // FRAMEUNIFORMS, binding point 0
+
+// what PrepareTextureMips hands to UploadTextureBMP: the levels, and their blocks when compressed
+typedef struct {
+    MIPCHAIN chain;
+    int      nCompressed;
+    BCIMAGE  blocks[MIP_MAX_LEVELS];
+} TEXTUREMIPS;
 
 static float vertices[] = 
     {
@@ -63,31 +88,6 @@ static float vertices[] =
             -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
     };
 
-const char* vertexShaderSource = 
-	"#version 330 core\n"
-	"layout (location = 0) in vec3 aPos;\n"
-	"layout (location = 1) in vec2 aTexCoord;\n"
-	"out vec2 TexCoord;\n"
-	"uniform mat4 model;\n"
-	"uniform mat4 view;\n"
-	"uniform mat4 projection;\n"
-	"void main()\n"
-	"{\n"
-	"	gl_Position = projection * view * model * vec4(aPos, 1.0f);\n"
-	"	TexCoord = vec2(aTexCoord.x, aTexCoord.y);\n"
-	"}\0";
-
-const char* fragmentShaderSource =
-	"#version 330 core\n"
-	"out vec4 FragColor;\n"
-	"in vec2 TexCoord;\n"
-	"uniform sampler2D texture1;\n"
-	"void main()\n"
-	"{\n"
-	"	FragColor = texture(texture1, TexCoord);\n"
-	"}\0";
-
-
 void getScreenDim_Win32(HWND hWnd, int *width, int* height)
 {
     RECT rect;
@@ -105,111 +105,100 @@ void CheckGLErrors(const char *context)
     }
 }
 
-GLuint LoadTextureFromBMP_Win32(const char* filename)
+// texloader backend: a 1x1 grey texture to draw with until the BMP is decoded
+unsigned int CreatePlaceholderTexture(void* pContext)
 {
-    HBITMAP    hBitmap = NULL;
-    BITMAP     bmp;
-    BYTE       *pixels = NULL;
-    GLuint     texID = 0;
-    HDC        screenDC = NULL;
-    HDC        memDC = NULL;
-
-    // Acquire DCs
-    screenDC = GetDC(NULL);
-    if (!screenDC) {
-        fprintf(stderr, "Error: GetDC failed\n");
-        return 0;
-    }
-    memDC = CreateCompatibleDC(screenDC);
-    if (!memDC) {
-        fprintf(stderr, "Error: CreateCompatibleDC failed\n");
-        ReleaseDC(NULL, screenDC);
-        return 0;
-    }
+    static const unsigned char grey[4] = { 128, 128, 128, 255 };
+    GLuint texID = 0;
 
-    // Load BMP into DIB section (24-bit)
-    hBitmap = (HBITMAP)LoadImageA(
-        NULL, filename, IMAGE_BITMAP,
-        0, 0, LR_LOADFROMFILE | LR_CREATEDIBSECTION
-    );
-    if (!hBitmap) {
-        fprintf(stderr, "Error: could not load BMP \"%s\"\n", filename);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
-    }
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D, texID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    CheckGLErrors("Placeholder texture");
+    return texID;
+}
 
-    // Query bitmap info
-    GetObject(hBitmap, sizeof(bmp), &bmp);
-    if (bmp.bmBitsPixel != 24) {
-        fprintf(stderr, "Error: only 24-bit BMP supported (found %u bpp)\n",
-                bmp.bmBitsPixel);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
+// texloader backend, on the decode worker: every mip level, filtered in linear light,
+// then block compressed (once: the blocks are kept in bccache/, see ../common/bc.c)
+void* PrepareTextureMips(void* pContext, const BMPIMAGE* image)
+{
+    TEXTUREMIPS* mips = (TEXTUREMIPS*)calloc(1, sizeof(TEXTUREMIPS));
+    if (mips && !BuildMipChain(&mips->chain, image->pPixels, image->width, image->height, image->pitch, MIP_KAISER, 1, 1)) {
+        free(mips);
+        return NULL; // UploadTextureBMP falls back to glGenerateMipmap
     }
-
-    // Allocate pixel buffer
-    pixels = (BYTE*)malloc(bmp.bmWidth * bmp.bmHeight * 3);
-    if (!pixels) {
-        fprintf(stderr, "Error: malloc(%u) failed\n",
-                bmp.bmWidth * bmp.bmHeight * 3u);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
+    if (mips && CompressTextures) {
+        int format = image->bHasAlpha ? BC_BC3 : BC_BC1;
+        for (int i = 0; i < mips->chain.nLevels; i++) {
+            const MIPLEVEL* level = &mips->chain.levels[i];
+            if (!EncodeBcImageCached(&mips->blocks[i], "bccache", level->pPixels, level->width, level->height,
+                                     level->pitch, image->format == BMP_BGRA, format, BC_NORMAL, 1)) {
+                break;
+            }
+            mips->nCompressed++;
+        }
     }
+    return mips;
+}
 
-    // Prepare BITMAPINFO for top-down BGR read
-    BITMAPINFO bi;
-    ZeroMemory(&bi, sizeof(bi));
-    bi.bmiHeader.biSize        = sizeof(bi.bmiHeader);
-    bi.bmiHeader.biWidth       = bmp.bmWidth;
-    bi.bmiHeader.biHeight      = -bmp.bmHeight;  // negative for top-down
-    bi.bmiHeader.biPlanes      = 1;
-    bi.bmiHeader.biBitCount    = 24;
-    bi.bmiHeader.biCompression = BI_RGB;
-
-    // Extract bits
-    SelectObject(memDC, hBitmap);
-    if (!GetDIBits(memDC, hBitmap, 0, bmp.bmHeight, pixels, &bi, DIB_RGB_COLORS)) {
-        fprintf(stderr, "Error: GetDIBits failed\n");
-        free(pixels);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
+void FreeTextureMips(void* pContext, void* prepared)
+{
+    TEXTUREMIPS* mips = (TEXTUREMIPS*)prepared;
+    for (int i = 0; i < mips->nCompressed; i++) {
+        FreeBcImage(&mips->blocks[i]);
     }
+    FreeMipChain(&mips->chain);
+    free(mips);
+}
 
-    // Create and upload OpenGL texture
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+// texloader backend: the decoded image into the placeholder, same handle
+int UploadTextureBMP(void* pContext, unsigned int texID, const BMPIMAGE* image, void* prepared)
+{
+    const TEXTUREMIPS* mips = (const TEXTUREMIPS*)prepared;
+    GLenum format = image->format == BMP_BGRA ? GL_BGRA : GL_RGBA;
 
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGB8,
-        bmp.bmWidth,
-        bmp.bmHeight,
-        0,
-        GL_BGR,
-        GL_UNSIGNED_BYTE,
-        pixels
-    );
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // Cleanup GDI & memory
-    free(pixels);
-    DeleteObject(hBitmap);
-    DeleteDC(memDC);
-    ReleaseDC(NULL, screenDC);
+    glBindTexture(GL_TEXTURE_2D, texID);
+    if (mips && mips->nCompressed == mips->chain.nLevels) {
+        // 0.5 (BC1) or 1 (BC3) byte a texel instead of 3 or 4, in memory and over the bus
+        GLenum compressed = mips->blocks[0].format == BC_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        for (int i = 0; i < mips->nCompressed; i++) {
+            const BCIMAGE* level = &mips->blocks[i];
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, compressed, level->width, level->height, 0, (GLsizei)level->cbData, level->pData);
+        }
+    } else if (mips) {
+        // explicit levels: the same on every driver, and gamma correct
+        for (int i = 0; i < mips->chain.nLevels; i++) {
+            const MIPLEVEL* level = &mips->chain.levels[i];
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGB8, level->width, level->height, 0, format, GL_UNSIGNED_BYTE, level->pPixels);
+        }
+    } else {
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            GL_RGB8,
+            image->width,
+            image->height,
+            0,
+            format,
+            GL_UNSIGNED_BYTE,
+            image->pPixels
+        );
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    return glGetError() == GL_NO_ERROR;
+}
 
-    return texID;
+// whole word match in the extension string (one name can be the start of another)
+BOOL HasGLExtension(const char* name)
+{
+    const char* list = (const char*)glGetString(GL_EXTENSIONS);
+    size_t n = strlen(name);
+    for (const char* p = list; p && (p = strstr(p, name)) != NULL; p += n) {
+        if ((p == list || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0')) {
+            return TRUE;
+        }
+    }
+    return FALSE;
 }
 
 void SetupViewport(HWND hWnd)
@@ -220,30 +209,56 @@ void SetupViewport(HWND hWnd)
     CheckGLErrors("Viewport");
 }
 
-void CompileAndLinkShaders()
+// a shader's text from the pack, or the loose file mapped into *file (unmap it after the compile)
+const GLchar* GetShaderSource(const char* name, GLint* length, MAPPEDFILE* file)
 {
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-    CheckGLErrors("Compile vertex shader");
-
-
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    CheckGLErrors("Compile fragment shader");
+    size_t cb = 0;
+    const GLchar* text = (const GLchar*)GetPackBlob(&Pack, name, &cb);
 
+    memset(file, 0, sizeof(*file));
+    if (!text && MapFile(name, file) && file->pData) {
+        text = (const GLchar*)file->pData;
+        cb = file->cbSize;
+    }
+    if (!text) {
+        fprintf(stderr, "Error: no shader \"%s\", not in cube.pak or next to the exe\n", name);
+        text = "";
+    }
+    *length = (GLint)cb;
+    return text;
+}
 
-    shaderProgram = glCreateProgram(); 
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+void CompileAndLinkShaders()
+{
+    MAPPEDFILE vertexFile, fragmentFile;
+    static PROGRAMBUILD build; // the logs, 2K
+    SHADERSOURCE sources[2] = { { GL_VERTEX_SHADER, "cube.vert" }, { GL_FRAGMENT_SHADER, "cube.frag" } };
+    sources[0].pText = GetShaderSource("cube.vert", &sources[0].cbText, &vertexFile);
+    sources[1].pText = GetShaderSource("cube.frag", &sources[1].cbText, &fragmentFile);
+
+    // a binary from glcache/ when the sources and the driver are the ones it was made with, see ../../common/progcache.c
+    shaderProgram = BuildProgramCached("glcache", sources, 2, &build);
+    UnmapFile(&vertexFile);
+    UnmapFile(&fragmentFile);
+    printf("shaders: %s in %.2f ms\n", build.bFromCache ? "glcache" : build.bStale ? "compiled, the cached binary was stale" : "compiled",
+           build.tSeconds * 1000.0);
     CheckGLErrors("shader program link");
+    if (shaderProgram == 0) {
+        fprintf(stderr, "Error: no shader program, the log is above\n");
+        return;
+    }
 
     glUseProgram(shaderProgram);
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);  
+    // every location now, none by name in Display
+    static const char* const frameMembers[3] = { "projection", "view", "model" };
+    static const size_t frameOffsets[3] = { offsetof(FRAMEUNIFORMS, projection), offsetof(FRAMEUNIFORMS, view), offsetof(FRAMEUNIFORMS, model) };
+    ReflectProgram(&ProgramInfo, shaderProgram);
+    BindProgramBlock(&ProgramInfo, "Frame", 0);
+    CheckProgramBlock(&ProgramInfo, "Frame", sizeof(FRAMEUNIFORMS), frameMembers, frameOffsets, 3);
+    glUniform1i(GetProgramUniform(&ProgramInfo, "texture1"), 0);
+    CreateUniformBuffer(&FrameBuffer, 0, sizeof(FRAMEUNIFORMS));
+    CheckGLErrors("Uniform buffer");
 }
 
 void BindVertexArrays()
@@ -267,9 +282,40 @@ void BindVertexArrays()
     CheckGLErrors("Vertex Attribute texture");
 }
 
+// a cooked texture: every level straight from the mapped pack, nothing decoded or filtered. 0 if the
+// pack doesn't have it (or has blocks and the driver can't take them)
+GLuint CreatePackTexture(const char* name)
+{
+    const PACKTEXTURE* cooked = GetPackTexture(&Pack, name);
+    BOOL compressed = cooked && (cooked->format == PACK_BC1 || cooked->format == PACK_BC3);
+    GLuint texID = 0;
+
+    if (!cooked || (compressed && !CompressTextures)) {
+        return 0;
+    }
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D, texID);
+    for (GLint i = 0; i < (GLint)cooked->nLevels; i++) {
+        const PACKLEVEL* level = &cooked->levels[i];
+        if (compressed) {
+            GLenum format = cooked->format == PACK_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, (GLsizei)level->size, PackTextureLevel(cooked, i));
+        } else {
+            GLenum format = cooked->format == PACK_BGRA8 ? GL_BGRA : GL_RGBA;
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGB8, level->width, level->height, 0, format, GL_UNSIGNED_BYTE, PackTextureLevel(cooked, i));
+        }
+    }
+    CheckGLErrors("Pack texture");
+    return texID;
+}
+
 void LoadAndCreateTextures()
 {
-    texture = LoadTextureFromBMP_Win32("dirt.bmp");
+    // cooked: ready now. Loose: returns right away, the placeholder shows until PumpTextureUploads
+    texture = CreatePackTexture("dirt.bmp");
+    if (texture == 0) {
+        texture = LoadTextureAsync(&Loader, "dirt.bmp");
+    }
     if (texture == 0) {
         fprintf(stderr, "Failed to load texture!\n");
         return;
@@ -287,12 +333,6 @@ void LoadAndCreateTextures()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     CheckGLErrors("Texture filtering");
-
-    // load image, create texture and generate mipmaps
-    //GLuint data = LoadTextureFromBMP_Win32("dirt.bmp");
-    //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    //glGenerateMipmap(GL_TEXTURE_2D);
-    //CheckGLErrors("Image load and texture creation");
 }
 
 
@@ -300,8 +340,8 @@ void LoadAndCreateTextures()
 void Display(HDC DeviceContext, HWND hWnd, int width, int height)
 {
     // time setup
-	DWORD currentTime = GetTickCount(); 
-    float deltaTime = (currentTime - lastTime) * 0.001f;
+	double currentTime = PaceNow(); // high resolution, GetTickCount moves in ~16ms steps
+    float deltaTime = (float)(currentTime - lastTime);
     lastTime = currentTime;
 
     SetupViewport(hWnd);
@@ -316,24 +356,22 @@ void Display(HDC DeviceContext, HWND hWnd, int width, int height)
     // activate shader
     glUseProgram(shaderProgram);
 
-    // transformations
-    mat4 model, view, projection;
-    mat4_identity(model);
-    mat4_identity(view);
-    mat4_identity(projection);
-
-    mat4_rotate(model, Angle, 1.0f, 1.0f, 0.0f);
-    mat4_translate(view, 0.0f, 0.0f, -5.0f);
-    mat4_perspective(projection, 3.1415926f/4.0f,(float)width/(float)height, 0.1f, 100.0f);
+    // transformations: the camera never moves, so view is built by the
+    // compiler; the projection only changes with the window shape; only the
+    // model is new every frame. All three go up in one call (was three
+    // glGetUniformLocation and three glUniformMatrix4fv)
+    static FRAMEUNIFORMS frame = { .view = MAT4_TRANSLATE_INIT(0.0f, 0.0f, -5.0f) };
+    static float projectionAspect = 0.0f;
 
-    unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
-    unsigned int viewLoc  = glGetUniformLocation(shaderProgram, "view");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
+    float aspect = (float)width/(float)height;
+    if (aspect != projectionAspect)
+    {
+        mat4_perspective(frame.projection, 3.1415926f/4.0f, aspect, 0.1f, 100.0f);
+        projectionAspect = aspect;
+    }
+    mat4_rotate(frame.model, Angle, 1.0f, 1.0f, 0.0f);
 
-    GLint loc = glGetUniformLocation(shaderProgram, "projection");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, &projection[0][0]);
+    UpdateUniformBuffer(&FrameBuffer, &frame);
 
     // render box
     glBindVertexArray(VAO);
@@ -448,6 +486,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine, int iCmdShow)
 {
 	MSG msg;
+	FRAMEPACER pacer; // replaces Sleep(10): fixed frame rate, see ../common/pacing.c
 	HWND hWnd;
 	WNDCLASSEX wc;
 
@@ -484,6 +523,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	DebugConsole();
 
 	OpenGLRC = InitOpenGL(hWnd);
+	InitBmpDecoder(); // SSSE3 swizzle for the 24bpp textures
+	InitMipKernels(); // mips on the cpu, see ../common/mip.c
+	InitBcEncoder(); // texture blocks on the cpu, see ../common/bc.c
+	CompressTextures = glCompressedTexImage2D && HasGLExtension("GL_EXT_texture_compression_s3tc");
+	printf("assets: %s\n", OpenPack(&Pack, "cube.pak") ? "cube.pak" : "loose files");
+	TEXTURELOADERBACKEND backend = { NULL, CreatePlaceholderTexture, UploadTextureBMP, PrepareTextureMips, FreeTextureMips };
+	CreateTextureLoader(&Loader, &backend, 0, 64);
     CompileAndLinkShaders();
     BindVertexArrays();
     LoadAndCreateTextures();
@@ -492,7 +538,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	if(OpenGLRC)
 	{
 		
-        lastTime = GetTickCount();
+        lastTime = PaceNow();
+
+		InitFramePacer(&pacer, 60.0);
 
 		Running = TRUE;
 		while(Running)
@@ -510,10 +558,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 				DispatchMessage(&msg);
 			}
 
+			PumpTextureUploads(&Loader, 0.002); // decoded textures, 2 ms a frame at most
 			InvalidateRect(hWnd, NULL, FALSE);
-			Sleep(10);
+			WaitNextFrame(&pacer); // 60 fps on an absolute schedule
 		}
 
+		FreeFramePacer(&pacer);
+		DestroyTextureLoader(&Loader);
+		ClosePack(&Pack);
+		DestroyUniformBuffer(&FrameBuffer);
+
 		DestroyOpenGL(OpenGLRC);
 	}
 
@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoord;
+uniform sampler2D texture1;
+void main()
+{
+	FragColor = texture(texture1, TexCoord);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+out vec2 TexCoord;
+// one buffer, written once a frame: FRAMEUNIFORMS in cube.c
+layout (std140) uniform Frame
+{
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+};
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0f);
+	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+}
@@ -35,17 +35,29 @@ static PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus = NULL;
 static PFNGLUNIFORM1IPROC glUniform1i = NULL;
 static PFNGLDRAWBUFFERSPROC glDrawBuffers = NULL;
 static PFNGLUNIFORM4FPROC glUniform4f = NULL;
+static PFNGLDELETEBUFFERSPROC glDeleteBuffers = NULL;
+static PFNGLGETACTIVEUNIFORMPROC glGetActiveUniform = NULL;
+static PFNGLGETACTIVEUNIFORMSIVPROC glGetActiveUniformsiv = NULL;
+static PFNGLGETACTIVEUNIFORMBLOCKIVPROC glGetActiveUniformBlockiv = NULL;
+static PFNGLGETACTIVEUNIFORMBLOCKNAMEPROC glGetActiveUniformBlockName = NULL;
+static PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding = NULL;
+static PFNGLBINDBUFFERBASEPROC glBindBufferBase = NULL;
+static PFNGLDETACHSHADERPROC glDetachShader = NULL;
+static PFNGLPROGRAMPARAMETERIPROC glProgramParameteri = NULL;
+static PFNGLGETPROGRAMBINARYPROC glGetProgramBinary = NULL;
+static PFNGLPROGRAMBINARYPROC glProgramBinary = NULL;
 
 static void (*glDisableVertexAttribArray)(GLuint) = NULL;
 static void (*glBindAttribLocation)(GLuint, GLuint,GLchar*) = NULL;
 static void (*glGenerateMipmap)(GLenum) = NULL;
 // static void (*glUniform4fv)(GLint, GLsizei, GLfloat*) = NULL;
-static void (*glUniformMatrix4fv)(GLint, GLsizei, GLboolean, GLfloat*) = NULL;
+static void (*glUniformMatrix4fv)(GLint, GLsizei, GLboolean, const GLfloat*) = NULL;
 
 // TODO: there is something fishy with Windows gl.h header
 // Let's try to ship our own gl.h just like glext.h
 #ifdef _WIN32
 static PFNGLACTIVETEXTUREPROC glActiveTexture = NULL;
+static PFNGLCOMPRESSEDTEXIMAGE2DPROC glCompressedTexImage2D = NULL;
 #endif // _WIN32
 
 static void load_gl_extensions(void)
@@ -83,15 +95,28 @@ static void load_gl_extensions(void)
     glUniform1i               = (PFNGLUNIFORM1IPROC) wglGetProcAddress("glUniform1i");
     glDrawBuffers             = (PFNGLDRAWBUFFERSPROC) wglGetProcAddress("glDrawBuffers");
     glUniform4f               = (PFNGLUNIFORM4FPROC) wglGetProcAddress("glUniform4f");
+    glDeleteBuffers           = (PFNGLDELETEBUFFERSPROC) wglGetProcAddress("glDeleteBuffers");
+    glGetActiveUniform        = (PFNGLGETACTIVEUNIFORMPROC) wglGetProcAddress("glGetActiveUniform");
+    glGetActiveUniformsiv     = (PFNGLGETACTIVEUNIFORMSIVPROC) wglGetProcAddress("glGetActiveUniformsiv");
+    glGetActiveUniformBlockiv = (PFNGLGETACTIVEUNIFORMBLOCKIVPROC) wglGetProcAddress("glGetActiveUniformBlockiv");
+    glGetActiveUniformBlockName = (PFNGLGETACTIVEUNIFORMBLOCKNAMEPROC) wglGetProcAddress("glGetActiveUniformBlockName");
+    glUniformBlockBinding     = (PFNGLUNIFORMBLOCKBINDINGPROC) wglGetProcAddress("glUniformBlockBinding");
+    glBindBufferBase          = (PFNGLBINDBUFFERBASEPROC) wglGetProcAddress("glBindBufferBase");
+    glDetachShader            = (PFNGLDETACHSHADERPROC) wglGetProcAddress("glDetachShader");
+    // 4.1 / ARB_get_program_binary: NULL before, progcache.c asks GL_NUM_PROGRAM_BINARY_FORMATS first
+    glProgramParameteri       = (PFNGLPROGRAMPARAMETERIPROC) wglGetProcAddress("glProgramParameteri");
+    glGetProgramBinary        = (PFNGLGETPROGRAMBINARYPROC) wglGetProcAddress("glGetProgramBinary");
+    glProgramBinary           = (PFNGLPROGRAMBINARYPROC) wglGetProcAddress("glProgramBinary");
 #ifdef _WIN32
     glActiveTexture           = (PFNGLACTIVETEXTUREPROC) wglGetProcAddress("glActiveTexture");
+    glCompressedTexImage2D    = (PFNGLCOMPRESSEDTEXIMAGE2DPROC) wglGetProcAddress("glCompressedTexImage2D");
 #endif // _WIN32
 
     glDisableVertexAttribArray = (void (*)(GLuint)) wglGetProcAddress("glDisableVertexAttribArray");
     glBindAttribLocation = (void (*)  (GLuint, GLuint,GLchar*)) wglGetProcAddress("glBindAttribLocation");
     glGenerateMipmap = (void (*)(GLenum)) wglGetProcAddress("glGenerateMipmap");
     // glUniform4fv = (void (*)(GLint, GLsizei, GLfloat*)) wglGetProcAddress("glUniform4fv");
-    glUniformMatrix4fv = (void (*)(GLint, GLsizei, GLboolean, GLfloat*)) wglGetProcAddress("glUniformMatrix4fv");
+    glUniformMatrix4fv = (void (*)(GLint, GLsizei, GLboolean, const GLfloat*)) wglGetProcAddress("glUniformMatrix4fv");
 
 #if 0
     if (glfwExtensionSupported("GL_ARB_debug_output")) {
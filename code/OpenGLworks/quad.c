@@ -5,13 +5,14 @@
 #include <GL/glext.h>
 #include <stdio.h>
 #include "glextloader.c"
+#include "../common/pacing.c"
 
 static GLuint cubeVBO;
 static GLuint cubeEBO;
 
 static BOOL Running = FALSE;
 static HGLRC OpenGLRC;
-static DWORD lastTime = 0;
+static double lastTime = 0.0;
 static float  Angle = 0.0f;
 
 static unsigned int shaderProgram;
@@ -286,8 +287,8 @@ void SetPerspective(float fovY, float aspect, float zNear, float zFar)
 
 void Display(HDC DeviceContext, HWND hWnd)
 {
-    DWORD currentTime = GetTickCount(); 
-    float deltaTime = (currentTime - lastTime) * 0.001f;
+    double currentTime = PaceNow(); // high resolution, GetTickCount moves in ~16ms steps
+    float deltaTime = (float)(currentTime - lastTime);
     lastTime = currentTime;
 
     SetupViewport(hWnd);
@@ -363,6 +364,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 {
 	// __debugbreak();
 	MSG msg;
+	FRAMEPACER pacer; // replaces Sleep(10): fixed frame rate, see ../common/pacing.c
 	HWND hWnd;
 	WNDCLASSEX wc;
 
@@ -407,7 +409,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	if(OpenGLRC)
 	{
 		
-        lastTime = GetTickCount();
+        lastTime = PaceNow();
+
+		InitFramePacer(&pacer, 60.0);
 
 		Running = TRUE;
 		while(Running)
@@ -426,9 +430,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 			}
 
 			InvalidateRect(hWnd, NULL, FALSE);
-			Sleep(10);
+			WaitNextFrame(&pacer); // 60 fps on an absolute schedule
 		}
 
+		FreeFramePacer(&pacer);
+
 		DestroyOpenGL(OpenGLRC);
 	}
 
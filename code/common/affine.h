@@ -0,0 +1,277 @@
+/*
+	affine: 3x4 transforms for model/view matrices (header only, needs mat4.h)
+	Notes:
+		- model and view matrices never use the last row of a mat4, it is
+		  always (0, 0, 0, 1); an affine keeps the other 3 rows only:
+				r[i] = (m_i0, m_i1, m_i2, t_i)
+		  3x3 linear part (rotation, scale) + the translation column
+		- rows, not columns: row i of a product is a sum of the rows of the
+		  right hand side, 16 bytes each, one SSE register
+		- affine_mul(A, B, out) multiplies like mat4_mul(A, B, out) does,
+		  so affine_to_mat4 of the result is mat4_mul of the mat4s (B * A in
+		  math notation: A first, then B); it is 3 rows of
+		  3 mul + 3 add on 4 floats (18 vector ops, 72 flops) against 4 rows
+		  of 4 mul + 3 add for mat4_mul (28 ops, 112 flops)
+		- inverses without the general 4x4 cofactors:
+				affine_inverse_rigid  rotation + translation: R^T, -R^T t
+				affine_inverse_trs    rotation * scale (no shear): the rows of
+				                      the inverse are the columns / |column|^2
+				affine_inverse        any invertible 3x3 (3x3 cofactors),
+				                      returns 0 if singular
+		- affine_to_mat4 only when the matrix goes to GL (glUniformMatrix4fv)
+*/
+
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "mat4.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+typedef struct { float r[3][4]; } __attribute__((aligned(16))) affine;
+#else
+typedef struct { float r[3][4]; } affine;
+#endif
+
+#define AFFINE_IDENTITY_INIT \
+    { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } } }
+
+static inline void affine_identity(affine* A)
+{
+    static const affine id = AFFINE_IDENTITY_INIT;
+    *A = id;
+}
+
+/* The upper 3 rows of M (the last row is assumed to be 0, 0, 0, 1) */
+static inline void affine_from_mat4(const mat4 M, affine* A)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            A->r[i][c] = M[c][i];
+        }
+    }
+}
+
+/* Full column-major mat4 for GL, at upload time */
+static inline void affine_to_mat4(const affine* A, mat4 M)
+{
+#if defined(MAT4_SSE)
+    __m128 r0 = _mm_loadu_ps(A->r[0]);
+    __m128 r1 = _mm_loadu_ps(A->r[1]);
+    __m128 r2 = _mm_loadu_ps(A->r[2]);
+    __m128 r3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(M[0], r0);
+    _mm_storeu_ps(M[1], r1);
+    _mm_storeu_ps(M[2], r2);
+    _mm_storeu_ps(M[3], r3);
+#else
+    for (int c = 0; c < 4; ++c)
+    {
+        M[c][0] = A->r[0][c];
+        M[c][1] = A->r[1][c];
+        M[c][2] = A->r[2][c];
+        M[c][3] = c == 3 ? 1.0f : 0.0f;
+    }
+#endif
+}
+
+/* Same as mat4_mul on the mat4s: out = B * A in math notation (can alias) */
+static inline void affine_mul(const affine* A, const affine* B, affine* out)
+{
+#if defined(MAT4_SSE)
+    __m128 a0 = _mm_loadu_ps(A->r[0]);
+    __m128 a1 = _mm_loadu_ps(A->r[1]);
+    __m128 a2 = _mm_loadu_ps(A->r[2]);
+    __m128 r[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        __m128 v = _mm_mul_ps(_mm_set1_ps(B->r[i][0]), a0);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(B->r[i][1]), a1));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(B->r[i][2]), a2));
+        // A's hidden last row (0, 0, 0, 1) times B's translation
+        r[i] = _mm_add_ps(v, _mm_setr_ps(0.0f, 0.0f, 0.0f, B->r[i][3]));
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        _mm_storeu_ps(out->r[i], r[i]);
+    }
+#else
+    affine tmp;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            tmp.r[i][c] = B->r[i][0] * A->r[0][c] + B->r[i][1] * A->r[1][c] + B->r[i][2] * A->r[2][c];
+        }
+        tmp.r[i][3] += B->r[i][3];
+    }
+    *out = tmp;
+#endif
+}
+
+/* p' = A * (p, 1) */
+static inline void affine_transform_point(const affine* A, const float p[3], float out[3])
+{
+    float x = p[0], y = p[1], z = p[2];
+    for (int i = 0; i < 3; ++i)
+    {
+        out[i] = A->r[i][0] * x + A->r[i][1] * y + A->r[i][2] * z + A->r[i][3];
+    }
+}
+
+/* d' = A * (d, 0): directions ignore the translation */
+static inline void affine_transform_dir(const affine* A, const float d[3], float out[3])
+{
+    float x = d[0], y = d[1], z = d[2];
+    for (int i = 0; i < 3; ++i)
+    {
+        out[i] = A->r[i][0] * x + A->r[i][1] * y + A->r[i][2] * z;
+    }
+}
+
+/* inverse translation: t' = -L' t, with L' the inverse linear part already in out */
+static inline void affine_inverse_translation(const affine* A, affine* out)
+{
+    float t0 = A->r[0][3], t1 = A->r[1][3], t2 = A->r[2][3];
+    for (int i = 0; i < 3; ++i)
+    {
+        out->r[i][3] = -(out->r[i][0] * t0 + out->r[i][1] * t1 + out->r[i][2] * t2);
+    }
+}
+
+/* Rotation + translation only: transpose the rotation, -R^T t (can alias) */
+static inline void affine_inverse_rigid(const affine* A, affine* out)
+{
+#if defined(MAT4_SSE)
+    __m128 a0 = _mm_loadu_ps(A->r[0]);
+    __m128 a1 = _mm_loadu_ps(A->r[1]);
+    __m128 a2 = _mm_loadu_ps(A->r[2]);
+    __m128 t0 = _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 t1 = _mm_shuffle_ps(a1, a1, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 t2 = _mm_shuffle_ps(a2, a2, _MM_SHUFFLE(3, 3, 3, 3));
+
+    // lane i: -(R[0][i] t0 + R[1][i] t1 + R[2][i] t2) = (-R^T t)_i
+    __m128 nt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, t0), _mm_mul_ps(a1, t1)), _mm_mul_ps(a2, t2));
+    nt = _mm_xor_ps(nt, _mm_set1_ps(-0.0f));
+
+    // row i of the inverse is column i of (R | t) with -R^T t under it
+    _MM_TRANSPOSE4_PS(a0, a1, a2, nt);
+    _mm_storeu_ps(out->r[0], a0);
+    _mm_storeu_ps(out->r[1], a1);
+    _mm_storeu_ps(out->r[2], a2);
+#else
+    affine tmp;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            tmp.r[i][c] = A->r[c][i];
+        }
+    }
+    affine_inverse_translation(A, &tmp);
+    *out = tmp;
+#endif
+}
+
+/*
+   Rotation * scale, no shear (what mat4_trs / affine_trs build): the
+   columns are orthogonal, so the inverse's rows are the columns divided by
+   their squared length. Returns 0 if a scale is 0 (can alias)
+*/
+static inline int affine_inverse_trs(const affine* A, affine* out)
+{
+    affine tmp;
+    for (int c = 0; c < 3; ++c)
+    {
+        float x = A->r[0][c], y = A->r[1][c], z = A->r[2][c];
+        float len2 = x * x + y * y + z * z;
+        if (!(len2 > 0.0f))
+        {
+            return 0;
+        }
+        float inv = 1.0f / len2;
+        tmp.r[c][0] = x * inv;
+        tmp.r[c][1] = y * inv;
+        tmp.r[c][2] = z * inv;
+    }
+    affine_inverse_translation(A, &tmp);
+    *out = tmp;
+    return 1;
+}
+
+/* Any invertible linear part: 3x3 cofactors, returns 0 if singular (can alias) */
+static inline int affine_inverse(const affine* A, affine* out)
+{
+    const float (*m)[4] = A->r;
+    float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+
+    // same rule as mat4_inverse: singular up to float rounding
+    float big = 0.0f;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            big = fabsf(m[i][c]) > big ? fabsf(m[i][c]) : big;
+        }
+    }
+    if (!(fabsf(det) > 1e-6f * big * big * big))
+    {
+        return 0;
+    }
+    float inv = 1.0f / det;
+
+    affine tmp;
+    tmp.r[0][0] = c00 * inv;
+    tmp.r[1][0] = c01 * inv;
+    tmp.r[2][0] = c02 * inv;
+    tmp.r[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv;
+    tmp.r[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv;
+    tmp.r[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv;
+    tmp.r[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv;
+    tmp.r[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv;
+    tmp.r[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv;
+    affine_inverse_translation(A, &tmp);
+    *out = tmp;
+    return 1;
+}
+
+/* Builders, the same matrices as their mat4_xxx versions */
+static inline void affine_translate(affine* A, float tx, float ty, float tz)
+{
+    affine_identity(A);
+    A->r[0][3] = tx;
+    A->r[1][3] = ty;
+    A->r[2][3] = tz;
+}
+
+static inline void affine_scale(affine* A, float sx, float sy, float sz)
+{
+    affine_identity(A);
+    A->r[0][0] = sx;
+    A->r[1][1] = sy;
+    A->r[2][2] = sz;
+}
+
+static inline void affine_rotate(affine* A, float angle, float x, float y, float z)
+{
+    mat4 M;
+    mat4_rotate(M, angle, x, y, z);
+    affine_from_mat4(M, A);
+}
+
+static inline void affine_trs(affine* A, float tx, float ty, float tz,
+                              float angle, float x, float y, float z,
+                              float sx, float sy, float sz)
+{
+    mat4 M;
+    mat4_trs(M, tx, ty, tz, angle, x, y, z, sx, sy, sz);
+    affine_from_mat4(M, A);
+}
+
+#endif // AFFINE_H
@@ -0,0 +1,207 @@
+/*
+	Headless test/benchmark for affine.h (no window, runs on linux too)
+	Notes:
+		- random TRS transforms (and sheared ones for affine_inverse):
+		  affine_to_mat4(affine_mul) against mat4_mul, the three inverses
+		  against mat4_inverse, A * inverse(A) against the identity, points
+		  and directions against the mat4 path
+		- speed: ns per multiply (affine_mul vs mat4_mul) and per inverse
+		  (rigid, trs, general vs mat4_inverse) on 1024 independent matrices
+		- exits with 1 if an error is over its bound
+
+	build:
+		windows: cl /nologo /O2 affinebench.c
+		linux:   cc -O2 affinebench.c -o affinebench -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "affine.h"
+#include "pacing.c"
+
+#define COUNT  1024
+#define ROUNDS 2000
+
+static volatile float g_fSink;
+
+static unsigned int g_uSeed = 1;
+
+static float RandomFloat(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (float)(g_uSeed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+// relative to the element, absolute under 1 (the translations go up to ~20)
+static double MaxDiff(const mat4 A, const mat4 B)
+{
+	double d = 0.0;
+	for (int i = 0; i < 16; i++) {
+		double b = (double)(&B[0][0])[i];
+		double e = fabs((double)(&A[0][0])[i] - b) / fmax(1.0, fabs(b));
+		if (e > d) {
+			d = e;
+		}
+	}
+	return d;
+}
+
+// scale in [0.5, 2] so the inverses stay well conditioned
+static void RandomTRS(affine* A, int bScale)
+{
+	float s = bScale ? 1.25f + RandomFloat() * 0.75f : 1.0f;
+	float t = bScale ? 1.25f + RandomFloat() * 0.75f : 1.0f;
+	float u = bScale ? 1.25f + RandomFloat() * 0.75f : 1.0f;
+	affine_trs(A, RandomFloat() * 10.0f, RandomFloat() * 10.0f, RandomFloat() * 10.0f,
+			   RandomFloat() * 4.0f, RandomFloat(), RandomFloat(), RandomFloat() + 1.5f, s, t, u);
+}
+
+static int CheckAffine(void)
+{
+	double dMul = 0.0, dRigid = 0.0, dTrs = 0.0, dGeneral = 0.0, dPoint = 0.0;
+	affine A, B, C, I;
+	mat4 MA, MB, MC, R, MI;
+
+	for (int n = 0; n < 10000; n++) {
+		RandomTRS(&A, 1);
+		RandomTRS(&B, 1);
+		affine_to_mat4(&A, MA);
+		affine_to_mat4(&B, MB);
+
+		// multiply, and aliasing
+		affine_mul(&A, &B, &C);
+		affine_to_mat4(&C, MC);
+		mat4_mul(MA, MB, R);
+		dMul = fmax(dMul, MaxDiff(MC, R));
+		I = A;
+		affine_mul(&I, &B, &I);
+		if (memcmp(&I, &C, sizeof(affine)) != 0) {
+			printf("MISMATCH affine_mul with out == A\n");
+			return 1;
+		}
+		I = B;
+		affine_mul(&A, &I, &I);
+		if (memcmp(&I, &C, sizeof(affine)) != 0) {
+			printf("MISMATCH affine_mul with out == B\n");
+			return 1;
+		}
+
+		// points and directions
+		float p[3] = { RandomFloat() * 5.0f, RandomFloat() * 5.0f, RandomFloat() * 5.0f }, q[3], d[3];
+		affine_transform_point(&A, p, q);
+		affine_transform_dir(&A, p, d);
+		for (int i = 0; i < 3; i++) {
+			float mp = MA[0][i] * p[0] + MA[1][i] * p[1] + MA[2][i] * p[2];
+			dPoint = fmax(dPoint, fabs(q[i] - (mp + MA[3][i])) / fmax(1.0, fabs(q[i])));
+			dPoint = fmax(dPoint, fabs(d[i] - mp));
+		}
+
+		// inverses against mat4_inverse
+		mat4_inverse(MA, MI);
+		if (!affine_inverse_trs(&A, &C) || !affine_inverse(&A, &I)) {
+			printf("MISMATCH an affine inverse refused a TRS matrix\n");
+			return 1;
+		}
+		affine_to_mat4(&C, R);
+		dTrs = fmax(dTrs, MaxDiff(R, MI));
+		affine_to_mat4(&I, R);
+		dGeneral = fmax(dGeneral, MaxDiff(R, MI));
+
+		RandomTRS(&B, 0);
+		affine_to_mat4(&B, MB);
+		mat4_inverse(MB, MI);
+		affine_inverse_rigid(&B, &C);
+		affine_to_mat4(&C, R);
+		dRigid = fmax(dRigid, MaxDiff(R, MI));
+		affine_inverse_rigid(&B, &B); // in place
+		if (memcmp(&B, &C, sizeof(affine)) != 0) {
+			printf("MISMATCH affine_inverse_rigid in place\n");
+			return 1;
+		}
+
+		// shear: only the general one can do it (skip badly conditioned ones,
+		// mat4_inverse takes anything that is not singular)
+		A.r[0][1] += 0.7f;
+		affine_to_mat4(&A, MA);
+		double dCond = 0.0;
+		if (mat4_inverse(MA, MI)) {
+			for (int c = 0; c < 3; c++) {
+				dCond += fabs(MI[c][0]) + fabs(MI[c][1]) + fabs(MI[c][2]);
+			}
+		}
+		if (dCond > 0.0 && dCond < 100.0) {
+			if (!affine_inverse(&A, &I)) {
+				printf("MISMATCH affine_inverse refused a sheared matrix\n");
+				return 1;
+			}
+			affine_to_mat4(&I, R);
+			mat4_mul(MA, R, MC);
+			mat4_identity(R);
+			dGeneral = fmax(dGeneral, MaxDiff(MC, R));
+		}
+	}
+
+	// singular: a zero scale
+	affine_scale(&A, 1.0f, 0.0f, 1.0f);
+	if (affine_inverse(&A, &C) || affine_inverse_trs(&A, &C)) {
+		printf("MISMATCH an affine inverse accepted a singular matrix\n");
+		return 1;
+	}
+
+	printf("affine_mul %.3g from mat4_mul, points %.3g\n", dMul, dPoint);
+	printf("inverse from mat4_inverse: rigid %.3g, trs %.3g, general %.3g\n", dRigid, dTrs, dGeneral);
+	if (dMul > 1e-6 || dPoint > 1e-6 || dRigid > 1e-5 || dTrs > 1e-5 || dGeneral > 1e-4) {
+		printf("MISMATCH error over the bound\n");
+		return 1;
+	}
+	return 0;
+}
+
+static affine g_A[COUNT], g_B[COUNT], g_C[COUNT];
+static mat4 g_MA[COUNT], g_MB[COUNT], g_MC[COUNT];
+
+typedef void (*PFNBENCH)(int i);
+
+static void MulAffine(int i)   { affine_mul(&g_A[i], &g_B[i], &g_C[i]); }
+static void MulMat4(int i)     { mat4_mul(g_MA[i], g_MB[i], g_MC[i]); }
+static void InvRigid(int i)    { affine_inverse_rigid(&g_A[i], &g_C[i]); }
+static void InvTrs(int i)      { affine_inverse_trs(&g_A[i], &g_C[i]); }
+static void InvGeneral(int i)  { affine_inverse(&g_A[i], &g_C[i]); }
+static void InvMat4(int i)     { mat4_inverse(g_MA[i], g_MC[i]); }
+static void ToMat4(int i)      { affine_to_mat4(&g_A[i], g_MC[i]); }
+
+static void Bench(const char* szName, PFNBENCH pfn)
+{
+	double t0 = PaceNow();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < COUNT; i++) {
+			pfn(i);
+		}
+	}
+	printf("%-22s %8.2f\n", szName, (PaceNow() - t0) * 1e9 / ((double)ROUNDS * COUNT));
+	g_fSink += g_C[COUNT / 2].r[1][3] + g_MC[COUNT / 2][3][1];
+}
+
+int main(void)
+{
+	if (CheckAffine()) {
+		return 1;
+	}
+
+	for (int i = 0; i < COUNT; i++) {
+		RandomTRS(&g_A[i], 1);
+		RandomTRS(&g_B[i], 1);
+		affine_to_mat4(&g_A[i], g_MA[i]);
+		affine_to_mat4(&g_B[i], g_MB[i]);
+	}
+
+	printf("\n%-22s %8s\n", "ns per op", "");
+	Bench("mat4_mul", MulMat4);
+	Bench("affine_mul", MulAffine);
+	Bench("mat4_inverse", InvMat4);
+	Bench("affine_inverse", InvGeneral);
+	Bench("affine_inverse_trs", InvTrs);
+	Bench("affine_inverse_rigid", InvRigid);
+	Bench("affine_to_mat4", ToMat4);
+	return 0;
+}
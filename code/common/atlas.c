@@ -0,0 +1,283 @@
+/*
+	Texture atlas: many small textures packed into one, UVs remapped
+	Notes:
+		- PackAtlas(sizes, n, gutter, maxSize) places n tiles (skyline
+		  bottom-left: each tile goes where its top ends lowest, ties to the
+		  left) in the smallest power of 2 atlas it finds: the smallest size
+		  with the area first, then twice as wide, twice as high... up to
+		  maxSize a side
+		- tiles go in tallest first, then widest, then input order: same
+		  input, same atlas, on any machine (no float in the packer)
+		- each tile gets gutter pixels on every side; BlitAtlasTile copies
+		  the tile and repeats its edge pixels into the gutter, so bilinear
+		  filtering and mip level k (2^k texels per texel) don't pull in the
+		  neighbour: a gutter of 2^k keeps levels 0..k clean
+		- pTiles[i] is tile i of the input: where it landed and its u0 v0
+		  u1 v1; AtlasTexCoord maps a 0..1 texcoord of the original texture
+		  into the atlas, so a mesh with many textures draws with one
+		  texture bound and one draw call. No GL_REPEAT inside an atlas: a
+		  texcoord outside 0..1 lands in the neighbour
+		- v follows the pixel rows: v = 0 is row 0, the top row in bmp.c's
+		  order, like a texture uploaded from LoadBmp
+		- the skyline is the top edge of everything placed so far, one node
+		  per flat run; a fit is checked against the nodes under the tile,
+		  O(tiles x nodes), thousands of 16x16 tiles take well under a ms
+*/
+
+#ifndef ATLAS_C
+#define ATLAS_C
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef struct {
+	int   x, y;             // top left of the tile, the gutter is around it
+	int   width, height;
+	float u0, v0, u1, v1;   // the tile in atlas texcoords
+} ATLASTILE;
+
+typedef struct {
+	int x, y, width;        // a flat run of the skyline, y = first free row
+} ATLASSKYLINE;
+
+typedef struct {
+	int           width;
+	int           height;
+	int           gutter;
+	int           nTiles;
+	ATLASTILE*    pTiles;   // in input order
+	int           nSkyline;
+	ATLASSKYLINE* pSkyline;
+	int64_t       nTileArea; // tile pixels, without gutters
+} ATLAS;
+
+typedef struct {
+	int width, height, index;
+} ATLASORDER;
+
+static int CompareAtlasOrder(const void* a, const void* b)
+{
+	const ATLASORDER* p = (const ATLASORDER*)a;
+	const ATLASORDER* q = (const ATLASORDER*)b;
+	if (p->height != q->height) {
+		return q->height - p->height;
+	}
+	if (p->width != q->width) {
+		return q->width - p->width;
+	}
+	return p->index - q->index;
+}
+
+// top row a width w tile would sit on at skyline node i, -1 if it doesn't fit
+static int FitAtlasSkyline(const ATLAS* pAtlas, int i, int w, int h)
+{
+	int x = pAtlas->pSkyline[i].x, y = 0;
+	if (x + w > pAtlas->width) {
+		return -1;
+	}
+	for (int left = w; left > 0; i++) {
+		y = pAtlas->pSkyline[i].y > y ? pAtlas->pSkyline[i].y : y;
+		left -= pAtlas->pSkyline[i].width;
+	}
+	return y + h <= pAtlas->height ? y : -1;
+}
+
+static void AddAtlasSkyline(ATLAS* pAtlas, int i, int x, int y, int w)
+{
+	ATLASSKYLINE* s = pAtlas->pSkyline;
+
+	// the new run at i, the ones it covers shrink or go
+	memmove(&s[i + 1], &s[i], (pAtlas->nSkyline - i) * sizeof(ATLASSKYLINE));
+	s[i].x = x;
+	s[i].y = y;
+	s[i].width = w;
+	pAtlas->nSkyline++;
+
+	int j = i + 1;
+	while (j < pAtlas->nSkyline && s[j].x < x + w) {
+		int shrink = x + w - s[j].x;
+		if (shrink < s[j].width) {
+			s[j].x += shrink;
+			s[j].width -= shrink;
+			break;
+		}
+		memmove(&s[j], &s[j + 1], (pAtlas->nSkyline - j - 1) * sizeof(ATLASSKYLINE));
+		pAtlas->nSkyline--;
+	}
+
+	// neighbours at the same height become one run
+	for (j = i > 0 ? i - 1 : 0; j + 1 < pAtlas->nSkyline && j <= i + 1;) {
+		if (s[j].y == s[j + 1].y) {
+			s[j].width += s[j + 1].width;
+			memmove(&s[j + 1], &s[j + 2], (pAtlas->nSkyline - j - 2) * sizeof(ATLASSKYLINE));
+			pAtlas->nSkyline--;
+		} else {
+			j++;
+		}
+	}
+}
+
+// one try at width x height, 1 if every tile fit
+static int PackAtlasInto(ATLAS* pAtlas, const ATLASORDER* pOrder, int width, int height)
+{
+	int pad = 2 * pAtlas->gutter;
+
+	pAtlas->width = width;
+	pAtlas->height = height;
+	pAtlas->nSkyline = 1;
+	pAtlas->pSkyline[0].x = 0;
+	pAtlas->pSkyline[0].y = 0;
+	pAtlas->pSkyline[0].width = width;
+
+	for (int n = 0; n < pAtlas->nTiles; n++) {
+		int w = pOrder[n].width + pad, h = pOrder[n].height + pad;
+		int best = -1, bestX = 0, bestY = 0, bestTop = 0x7FFFFFFF;
+		for (int i = 0; i < pAtlas->nSkyline; i++) {
+			int y = FitAtlasSkyline(pAtlas, i, w, h);
+			if (y >= 0 && y + h < bestTop) {
+				best = i;
+				bestX = pAtlas->pSkyline[i].x;
+				bestY = y;
+				bestTop = y + h;
+			}
+		}
+		if (best < 0) {
+			return 0;
+		}
+		AddAtlasSkyline(pAtlas, best, bestX, bestY + h, w);
+
+		ATLASTILE* t = &pAtlas->pTiles[pOrder[n].index];
+		t->x = bestX + pAtlas->gutter;
+		t->y = bestY + pAtlas->gutter;
+		t->width = pOrder[n].width;
+		t->height = pOrder[n].height;
+	}
+	return 1;
+}
+
+static void FreeAtlas(ATLAS* pAtlas)
+{
+	free(pAtlas->pTiles);
+	free(pAtlas->pSkyline);
+	memset(pAtlas, 0, sizeof(*pAtlas));
+}
+
+/*
+	pSizes: width, height of each tile (2 ints a tile). Returns 0 if they
+	don't fit in maxSize x maxSize, or out of memory
+*/
+static int PackAtlas(ATLAS* pAtlas, const int* pSizes, int nTiles, int gutter, int maxSize)
+{
+	memset(pAtlas, 0, sizeof(*pAtlas));
+	pAtlas->gutter = gutter;
+	pAtlas->nTiles = nTiles;
+	pAtlas->pTiles = (ATLASTILE*)calloc(nTiles > 0 ? nTiles : 1, sizeof(ATLASTILE));
+	// at most one run per column, and one spare for the insert
+	pAtlas->pSkyline = (ATLASSKYLINE*)malloc((maxSize + 2) * sizeof(ATLASSKYLINE));
+	ATLASORDER* pOrder = (ATLASORDER*)malloc((nTiles > 0 ? nTiles : 1) * sizeof(ATLASORDER));
+	if (!pAtlas->pTiles || !pAtlas->pSkyline || !pOrder || nTiles < 0 || maxSize < 1) {
+		free(pOrder);
+		FreeAtlas(pAtlas);
+		return 0;
+	}
+
+	int64_t area = 0;
+	for (int i = 0; i < nTiles; i++) {
+		int w = pSizes[2 * i], h = pSizes[2 * i + 1];
+		if (w < 1 || h < 1 || w + 2 * gutter > maxSize || h + 2 * gutter > maxSize) {
+			free(pOrder);
+			FreeAtlas(pAtlas);
+			return 0;
+		}
+		pOrder[i].width = w;
+		pOrder[i].height = h;
+		pOrder[i].index = i;
+		area += (int64_t)(w + 2 * gutter) * (h + 2 * gutter);
+		pAtlas->nTileArea += (int64_t)w * h;
+	}
+	qsort(pOrder, nTiles, sizeof(ATLASORDER), CompareAtlasOrder);
+
+	// smallest power of 2 size that has the area (wider one first, never
+	// more than 2:1), then one more side doubled per failed try
+	int width = 1, height = 1;
+	while ((int64_t)width * height < area && (width < maxSize || height < maxSize)) {
+		if (width <= height) {
+			width *= 2;
+		} else {
+			height *= 2;
+		}
+	}
+	int bOk = 0;
+	while (width <= maxSize && height <= maxSize) {
+		if (PackAtlasInto(pAtlas, pOrder, width, height)) {
+			bOk = 1;
+			break;
+		}
+		if (width <= height) {
+			width *= 2;
+		} else {
+			height *= 2;
+		}
+	}
+	free(pOrder);
+	if (!bOk) {
+		FreeAtlas(pAtlas);
+		return 0;
+	}
+
+	for (int i = 0; i < nTiles; i++) {
+		ATLASTILE* t = &pAtlas->pTiles[i];
+		t->u0 = (float)t->x / pAtlas->width;
+		t->v0 = (float)t->y / pAtlas->height;
+		t->u1 = (float)(t->x + t->width) / pAtlas->width;
+		t->v1 = (float)(t->y + t->height) / pAtlas->height;
+	}
+	return 1;
+}
+
+// texcoord (u, v) of tile i's own texture -> atlas texcoord
+static void AtlasTexCoord(const ATLAS* pAtlas, int i, float u, float v, float uv[2])
+{
+	const ATLASTILE* t = &pAtlas->pTiles[i];
+	uv[0] = t->u0 + u * (t->u1 - t->u0);
+	uv[1] = t->v0 + v * (t->v1 - t->v0);
+}
+
+/*
+	Tile i's pixels (4 bytes each, top row first) into the atlas pixels,
+	edges repeated into the gutter. bSwapRB swaps bytes 0 and 2 (a BGRA
+	tile into an RGBA atlas)
+*/
+static void BlitAtlasTile(const ATLAS* pAtlas, int i, uint8_t* pAtlasPixels, int atlasPitch,
+						  const uint8_t* pTile, int tilePitch, int bSwapRB)
+{
+	const ATLASTILE* t = &pAtlas->pTiles[i];
+	int g = pAtlas->gutter;
+
+	for (int y = -g; y < t->height + g; y++) {
+		int sy = y < 0 ? 0 : y >= t->height ? t->height - 1 : y;
+		const uint8_t* src = pTile + (size_t)tilePitch * sy;
+		uint8_t* dst = pAtlasPixels + (size_t)atlasPitch * (t->y + y) + 4 * (size_t)(t->x - g);
+
+		if (!bSwapRB) {
+			memcpy(dst + 4 * g, src, (size_t)t->width * 4);
+		} else {
+			for (int x = 0; x < t->width; x++) {
+				uint8_t* d = dst + 4 * (g + x);
+				const uint8_t* s = src + 4 * x;
+				d[0] = s[bSwapRB ? 2 : 0];
+				d[1] = s[1];
+				d[2] = s[bSwapRB ? 0 : 2];
+				d[3] = s[3];
+			}
+		}
+		// the row's edge pixels out into the left and right gutters
+		for (int x = 0; x < g; x++) {
+			memcpy(dst + 4 * x, dst + 4 * g, 4);
+			memcpy(dst + 4 * (g + t->width + x), dst + 4 * (g + t->width - 1), 4);
+		}
+	}
+}
+
+#endif // ATLAS_C
@@ -0,0 +1,206 @@
+/*
+	Headless test/benchmark for atlas.c
+	Notes:
+		- 16x16 block tiles and random sizes 1..80: every tile with its
+		  gutter inside the atlas, no two overlap (a bitmap of the atlas),
+		  the same input packs the same way twice
+		- tiles that can't fit (bigger than maxSize, too many) must fail
+		- BlitAtlasTile: tile pixels where the UVs say, gutters equal to
+		  the nearest edge pixel, the R/B swap
+		- AtlasTexCoord: 0..1 maps onto the tile's pixel edges
+		- time and fill (tile pixels / atlas pixels) for 1K, 4K, 16K
+		  16x16 tiles with a 2 pixel gutter, and 2000 random sizes
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 atlasbench.c
+		linux:   cc -O2 atlasbench.c -o atlasbench -lm
+*/
+
+#include <stdio.h>
+#include "atlas.c"
+#include "pacing.c"
+
+static unsigned int g_uSeed = 1;
+
+static int RandomInt(int lo, int hi)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return lo + (int)((g_uSeed >> 8) % (unsigned int)(hi - lo + 1));
+}
+
+static int* BlockSizes(int n)
+{
+	int* p = (int*)malloc(2 * n * sizeof(int));
+	for (int i = 0; i < 2 * n; i++) {
+		p[i] = 16;
+	}
+	return p;
+}
+
+static int* RandomSizes(int n)
+{
+	int* p = (int*)malloc(2 * n * sizeof(int));
+	g_uSeed = 7;
+	for (int i = 0; i < 2 * n; i++) {
+		p[i] = RandomInt(1, 80);
+	}
+	return p;
+}
+
+static int CheckLayout(const char* szWhat, const int* pSizes, int n, int gutter, int maxSize)
+{
+	ATLAS a, b;
+	if (!PackAtlas(&a, pSizes, n, gutter, maxSize) || !PackAtlas(&b, pSizes, n, gutter, maxSize)) {
+		printf("MISMATCH %s: did not pack\n", szWhat);
+		return 1;
+	}
+	if (a.width != b.width || a.height != b.height || memcmp(a.pTiles, b.pTiles, n * sizeof(ATLASTILE)) != 0) {
+		printf("MISMATCH %s: two packs differ\n", szWhat);
+		return 1;
+	}
+
+	uint8_t* pUsed = (uint8_t*)calloc((size_t)a.width * a.height, 1);
+	for (int i = 0; i < n; i++) {
+		const ATLASTILE* t = &a.pTiles[i];
+		int x0 = t->x - gutter, y0 = t->y - gutter, x1 = t->x + t->width + gutter, y1 = t->y + t->height + gutter;
+		if (t->width != pSizes[2 * i] || t->height != pSizes[2 * i + 1] || x0 < 0 || y0 < 0 || x1 > a.width ||
+			y1 > a.height) {
+			printf("MISMATCH %s: tile %d at %d,%d %dx%d in %dx%d\n", szWhat, i, t->x, t->y, t->width, t->height,
+				   a.width, a.height);
+			return 1;
+		}
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				if (pUsed[(size_t)y * a.width + x]++) {
+					printf("MISMATCH %s: tile %d overlaps at %d,%d\n", szWhat, i, x, y);
+					return 1;
+				}
+			}
+		}
+		float uv[2];
+		AtlasTexCoord(&a, i, 0.0f, 0.0f, uv);
+		int bBad = uv[0] * a.width != t->x || uv[1] * a.height != t->y;
+		AtlasTexCoord(&a, i, 1.0f, 1.0f, uv);
+		bBad |= uv[0] * a.width != t->x + t->width || uv[1] * a.height != t->y + t->height;
+		if (bBad) {
+			printf("MISMATCH %s: tile %d texcoords\n", szWhat, i);
+			return 1;
+		}
+	}
+	printf("%-24s %5d tiles in %4dx%-4d no overlap, same twice: ok\n", szWhat, n, a.width, a.height);
+	free(pUsed);
+	FreeAtlas(&a);
+	FreeAtlas(&b);
+	return 0;
+}
+
+static int CheckFailures(void)
+{
+	ATLAS a;
+	int big[2] = { 60, 10 };
+	int* pMany = BlockSizes(1000);
+	int bFail = PackAtlas(&a, big, 1, 4, 64) || PackAtlas(&a, pMany, 1000, 2, 256);
+	free(pMany);
+	if (bFail) {
+		printf("MISMATCH a tile that can't fit was packed\n");
+		return 1;
+	}
+	// exactly full: 16 tiles of 16x16 (no gutter) in 64x64
+	int* pFull = BlockSizes(16);
+	bFail = !PackAtlas(&a, pFull, 16, 0, 64) || a.width != 64 || a.height != 64;
+	free(pFull);
+	if (bFail) {
+		printf("MISMATCH 16 tiles of 16x16 should fill 64x64\n");
+		return 1;
+	}
+	FreeAtlas(&a);
+	printf("too big / too many refused, exact fit packed: ok\n");
+	return 0;
+}
+
+static int CheckBlit(void)
+{
+	int sizes[] = { 5, 3, 16, 16, 1, 1, 7, 9 };
+	int n = 4, g = 3;
+	ATLAS a;
+	PackAtlas(&a, sizes, n, g, 256);
+	uint8_t* pAtlas = (uint8_t*)calloc((size_t)a.width * a.height, 4);
+
+	for (int bSwap = 0; bSwap < 2; bSwap++) {
+		for (int i = 0; i < n; i++) {
+			const ATLASTILE* t = &a.pTiles[i];
+			uint8_t* pTile = (uint8_t*)malloc((size_t)t->width * t->height * 4);
+			for (int p = 0; p < t->width * t->height * 4; p++) {
+				pTile[p] = (uint8_t)(p * 13 + i * 71);
+			}
+			BlitAtlasTile(&a, i, pAtlas, a.width * 4, pTile, t->width * 4, bSwap);
+
+			for (int y = -g; y < t->height + g; y++) {
+				for (int x = -g; x < t->width + g; x++) {
+					int sx = x < 0 ? 0 : x >= t->width ? t->width - 1 : x;
+					int sy = y < 0 ? 0 : y >= t->height ? t->height - 1 : y;
+					const uint8_t* s = pTile + ((size_t)sy * t->width + sx) * 4;
+					const uint8_t* d = pAtlas + ((size_t)(t->y + y) * a.width + t->x + x) * 4;
+					if (d[0] != s[bSwap ? 2 : 0] || d[1] != s[1] || d[2] != s[bSwap ? 0 : 2] || d[3] != s[3]) {
+						printf("MISMATCH blit tile %d (%d, %d) swap %d\n", i, x, y, bSwap);
+						return 1;
+					}
+				}
+			}
+			free(pTile);
+		}
+	}
+	free(pAtlas);
+	FreeAtlas(&a);
+	printf("blit with gutters, R/B swap: ok\n");
+	return 0;
+}
+
+static void Bench(const char* szWhat, const int* pSizes, int n, int gutter)
+{
+	ATLAS a;
+	double best = 1e9;
+	for (int r = 0; r < 5; r++) {
+		double t0 = PaceNow();
+		int bOk = PackAtlas(&a, pSizes, n, gutter, 16384);
+		double t = PaceNow() - t0;
+		best = t < best ? t : best;
+		if (!bOk) {
+			printf("%-28s did not pack\n", szWhat);
+			return;
+		}
+		if (r < 4) {
+			FreeAtlas(&a);
+		}
+	}
+	double padded = 0.0, area = (double)a.width * a.height;
+	for (int i = 0; i < n; i++) {
+		padded += (double)(pSizes[2 * i] + 2 * gutter) * (pSizes[2 * i + 1] + 2 * gutter);
+	}
+	printf("%-24s %6d tiles %5dx%-5d %8.3f ms  fill %5.1f%% (%5.1f%% with gutters)\n", szWhat, n, a.width,
+		   a.height, best * 1e3, 100.0 * a.nTileArea / area, 100.0 * padded / area);
+	FreeAtlas(&a);
+}
+
+int main(void)
+{
+	int* pBlocks = BlockSizes(16384);
+	int* pRandom = RandomSizes(2000);
+
+	if (CheckLayout("16x16, gutter 2", pBlocks, 4096, 2, 4096) || CheckLayout("16x16, no gutter", pBlocks, 1000, 0, 4096) ||
+		CheckLayout("random 1..80, gutter 1", pRandom, 2000, 1, 8192) ||
+		CheckLayout("random 1..80, gutter 4", pRandom, 500, 4, 8192) || CheckFailures() || CheckBlit()) {
+		return 1;
+	}
+
+	printf("\n");
+	Bench("16x16, gutter 2", pBlocks, 1024, 2);
+	Bench("16x16, gutter 2", pBlocks, 4096, 2);
+	Bench("16x16, gutter 2", pBlocks, 16384, 2);
+	Bench("random 1..80, gutter 2", pRandom, 2000, 2);
+
+	free(pBlocks);
+	free(pRandom);
+	return 0;
+}
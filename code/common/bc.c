@@ -0,0 +1,934 @@
+/*
+	BC1 / BC3 (DXT1 / DXT5) block compression on the cpu, and a decoder
+	Notes:
+		- EncodeBcImage(pixels, w, h, pitch, bBgra, format, preset, nThreads)
+		  takes 4 byte pixels, top row first (LoadBmp, a MIPLEVEL), and makes
+		  one block per 4x4 pixels, block rows top first, so pData goes
+		  straight to glCompressedTexImage2D with
+		  GL_COMPRESSED_RGB_S3TC_DXT1_EXT / GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		- BC_BC1: 8 bytes a block (0.5 byte a pixel against 3 for GL_RGB8),
+		  colour only, always the 4 colour mode (no punch through alpha).
+		  BC_BC3: 16 bytes a block, 8 of alpha (2 endpoints, 3 bit
+		  indices) then a BC1 style colour block
+		- bBgra: the pixels are B, G, R, A (BMP_BGRA), the blocks are
+		  always R, G, B; sizes that aren't a multiple of 4 repeat the
+		  last row / column into the edge blocks
+		- presets:
+		  BC_FAST: bounding box of the block (the diagonal flipped to
+		  follow the colours), inset by 1/16, nearest palette entry
+		  BC_NORMAL: principal axis (power iteration on the covariance),
+		  endpoints at the ends of the projection, one least squares
+		  refit of the endpoints to the indices
+		  BC_HIGH: refits until the error stops going down, then moves
+		  each endpoint channel +-1 (565 steps) while that helps; alpha
+		  also tries the 6 value mode (explicit 0 and 255)
+		  one colour blocks use a table of the best endpoint pair for each
+		  byte (the 1/3 point hits it) in every preset
+		- error is plain squared RGB difference, no perceptual weights,
+		  the same thing PSNR measures
+		- palettes round: (2 * c0 + c1 + 1) / 3 and
+		  ((8 - i) * a0 + (i - 1) * a1 + 3) / 7; DecodeBcImage uses the
+		  same, hardware is within 1 of it
+		- the search for the nearest palette entry (16 pixels x 4 colours,
+		  16 alphas x 8 values) is the inner loop, scalar / SSE2 / AVX2
+		  kernels picked by InitBcEncoder, same blocks from every kernel
+		- images with at least BC_THREAD_BLOCKS blocks are cut into bands
+		  of block rows, one per thread (thread.c); nThreads <= 0 is one
+		  per cpu
+		- EncodeBcImageCached: the same, through a directory of .bc files
+		  named by a hash of the pixels and the parameters; a hit maps the
+		  file (mapfile.c) and encodes nothing. A file that is short or has
+		  the wrong header is a miss and gets written again. Old entries
+		  are never deleted
+		- call InitBcEncoder() once at startup (tables, not thread safe),
+		  then encode on any thread
+*/
+
+#ifndef BC_C
+#define BC_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "cpu.c"
+#include "thread.c"
+#include "mapfile.c"
+#include "hash.c"
+
+#define BC_BC1 0
+#define BC_BC3 1
+
+#define BC_FAST   0
+#define BC_NORMAL 1
+#define BC_HIGH   2
+
+#define BC_THREAD_BLOCKS 4096   // 256 x 256 pixels
+#define MAX_BC_THREADS   16
+#define BC_FILE_MAGIC    0x31434342u // "BCC1"
+#define BC_FILE_VERSION  1
+
+typedef struct {
+	int        format;      // BC_BC1 / BC_BC3
+	int        width;
+	int        height;
+	int        blocksX;
+	int        blocksY;
+	size_t     cbData;
+	const uint8_t* pData;   // blocksY rows of blocksX blocks, 8 or 16 bytes each
+	uint8_t*   pOwned;      // pData when it was encoded here
+	MAPPEDFILE file;        // pData is in here when it came from the cache
+	int        bFromCache;
+} BCIMAGE;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	int32_t  format;
+	int32_t  preset;
+	int32_t  width;
+	int32_t  height;
+	uint64_t cbData;
+} BCFILEHEADER;
+
+static uint8_t g_Bc5To8[32];
+static uint8_t g_Bc6To8[64];
+static uint8_t g_BcMatch5[256][2];   // byte -> 5 bit c0, c1 with (2 * c0 + c1 + 1) / 3 closest
+static uint8_t g_BcMatch6[256][2];
+
+static size_t BcBlockBytes(int format)
+{
+	return format == BC_BC3 ? 16 : 8;
+}
+
+static size_t BcImageBytes(int width, int height, int format)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BcBlockBytes(format);
+}
+
+static void BuildBcMatch(uint8_t (*pMatch)[2], const uint8_t* pExpand, int nValues)
+{
+	for (int v = 0; v < 256; v++) {
+		int best = 0x7FFFFFFF;
+		for (int a = 0; a < nValues; a++) {
+			for (int b = 0; b < nValues; b++) {
+				int e = (2 * pExpand[a] + pExpand[b] + 1) / 3 - v;
+				int spread = pExpand[a] > pExpand[b] ? pExpand[a] - pExpand[b] : pExpand[b] - pExpand[a];
+				// exact first, then endpoints close together (less for the hardware to round)
+				int score = e * e * 1024 + spread;
+				if (score < best) {
+					best = score;
+					pMatch[v][0] = (uint8_t)a;
+					pMatch[v][1] = (uint8_t)b;
+				}
+			}
+		}
+	}
+}
+
+static void InitBcTables(void)
+{
+	for (int i = 0; i < 32; i++) {
+		g_Bc5To8[i] = (uint8_t)((i << 3) | (i >> 2));
+	}
+	for (int i = 0; i < 64; i++) {
+		g_Bc6To8[i] = (uint8_t)((i << 2) | (i >> 4));
+	}
+	BuildBcMatch(g_BcMatch5, g_Bc5To8, 32);
+	BuildBcMatch(g_BcMatch6, g_Bc6To8, 64);
+}
+
+static uint16_t PackBc565(int r5, int g6, int b5)
+{
+	return (uint16_t)((r5 << 11) | (g6 << 5) | b5);
+}
+
+// 4 colour palette of a 565 pair, R G B 0 bytes per entry
+static void BcColorPalette(uint16_t c0, uint16_t c1, uint8_t pPalette[16])
+{
+	int r0 = g_Bc5To8[c0 >> 11], g0 = g_Bc6To8[(c0 >> 5) & 63], b0 = g_Bc5To8[c0 & 31];
+	int r1 = g_Bc5To8[c1 >> 11], g1 = g_Bc6To8[(c1 >> 5) & 63], b1 = g_Bc5To8[c1 & 31];
+	uint8_t p[16] = {
+		(uint8_t)r0, (uint8_t)g0, (uint8_t)b0, 0,
+		(uint8_t)r1, (uint8_t)g1, (uint8_t)b1, 0,
+		(uint8_t)((2 * r0 + r1 + 1) / 3), (uint8_t)((2 * g0 + g1 + 1) / 3), (uint8_t)((2 * b0 + b1 + 1) / 3), 0,
+		(uint8_t)((r0 + 2 * r1 + 1) / 3), (uint8_t)((g0 + 2 * g1 + 1) / 3), (uint8_t)((b0 + 2 * b1 + 1) / 3), 0,
+	};
+	memcpy(pPalette, p, 16);
+}
+
+// a0 > a1: 8 values, else 6 values then 0 and 255
+static void BcAlphaPalette(int a0, int a1, uint8_t pPalette[8])
+{
+	pPalette[0] = (uint8_t)a0;
+	pPalette[1] = (uint8_t)a1;
+	if (a0 > a1) {
+		for (int i = 2; i < 8; i++) {
+			pPalette[i] = (uint8_t)(((8 - i) * a0 + (i - 1) * a1 + 3) / 7);
+		}
+	} else {
+		for (int i = 2; i < 6; i++) {
+			pPalette[i] = (uint8_t)(((6 - i) * a0 + (i - 1) * a1 + 2) / 5);
+		}
+		pPalette[6] = 0;
+		pPalette[7] = 255;
+	}
+}
+
+/*
+	kernels: the nearest palette entry for each of the 16 pixels, ties to
+	the lower index. Colour: pBlock is 16 R G B A pixels (A ignored),
+	returns 2 bit indices, pixel 0 in the low bits. Alpha: 16 bytes,
+	returns 3 bit indices. *pError = sum of squared differences
+*/
+typedef uint32_t (*PFNBCCOLOR)(const uint8_t* pBlock, const uint8_t* pPalette, uint32_t* pError);
+typedef uint64_t (*PFNBCALPHA)(const uint8_t* pAlpha, const uint8_t* pPalette, uint32_t* pError);
+
+static uint32_t BcColorIndicesScalar(const uint8_t* pBlock, const uint8_t* pPalette, uint32_t* pError)
+{
+	uint32_t indices = 0, error = 0;
+	for (int i = 0; i < 16; i++) {
+		const uint8_t* s = pBlock + 4 * i;
+		uint32_t best = 0xFFFFFFFF, index = 0;
+		for (uint32_t k = 0; k < 4; k++) {
+			const uint8_t* p = pPalette + 4 * k;
+			int dr = s[0] - p[0], dg = s[1] - p[1], db = s[2] - p[2];
+			uint32_t d = (uint32_t)(dr * dr + dg * dg + db * db);
+			if (d < best) {
+				best = d;
+				index = k;
+			}
+		}
+		indices |= index << (2 * i);
+		error += best;
+	}
+	*pError = error;
+	return indices;
+}
+
+static uint64_t BcAlphaIndicesScalar(const uint8_t* pAlpha, const uint8_t* pPalette, uint32_t* pError)
+{
+	uint64_t indices = 0;
+	uint32_t error = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 256, index = 0;
+		for (int k = 0; k < 8; k++) {
+			int d = pAlpha[i] > pPalette[k] ? pAlpha[i] - pPalette[k] : pPalette[k] - pAlpha[i];
+			if (d < best) {
+				best = d;
+				index = k;
+			}
+		}
+		indices |= (uint64_t)index << (3 * i);
+		error += (uint32_t)(best * best);
+	}
+	*pError = error;
+	return indices;
+}
+
+static uint32_t PackBcColorIndices(const int32_t* pIndex)
+{
+	uint32_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		indices |= (uint32_t)pIndex[i] << (2 * i);
+	}
+	return indices;
+}
+
+#ifdef CPU_X86
+static uint32_t HorizontalSumSSE2(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+static uint32_t BcColorIndicesSSE2(const uint8_t* pBlock, const uint8_t* pPalette, uint32_t* pError)
+{
+	const __m128i zero = _mm_setzero_si128(), rgb = _mm_set1_epi32(0x00FFFFFF);
+	__m128i px[8], best[4], index[4];
+	int32_t out[16];
+
+	// 2 pixels a register as 16 bit R G B 0
+	for (int i = 0; i < 4; i++) {
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pBlock + 16 * i)), rgb);
+		px[2 * i] = _mm_unpacklo_epi8(v, zero);
+		px[2 * i + 1] = _mm_unpackhi_epi8(v, zero);
+	}
+	for (int k = 0; k < 4; k++) {
+		int32_t c;
+		memcpy(&c, pPalette + 4 * k, 4);
+		__m128i p = _mm_unpacklo_epi8(_mm_set1_epi32(c), zero), n = _mm_set1_epi32(k);
+		for (int j = 0; j < 4; j++) {
+			__m128i d0 = _mm_sub_epi16(px[2 * j], p), d1 = _mm_sub_epi16(px[2 * j + 1], p);
+			// (r^2 + g^2, b^2) per pixel, then the pairs added: 4 distances
+			__m128 s0 = _mm_castsi128_ps(_mm_madd_epi16(d0, d0)), s1 = _mm_castsi128_ps(_mm_madd_epi16(d1, d1));
+			__m128i dist = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0))),
+										 _mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1))));
+			if (k == 0) {
+				best[j] = dist;
+				index[j] = zero;
+			} else {
+				__m128i lt = _mm_cmplt_epi32(dist, best[j]);
+				best[j] = _mm_or_si128(_mm_and_si128(lt, dist), _mm_andnot_si128(lt, best[j]));
+				index[j] = _mm_or_si128(_mm_and_si128(lt, n), _mm_andnot_si128(lt, index[j]));
+			}
+		}
+	}
+	for (int j = 0; j < 4; j++) {
+		_mm_storeu_si128((__m128i*)(out + 4 * j), index[j]);
+	}
+	*pError = HorizontalSumSSE2(_mm_add_epi32(_mm_add_epi32(best[0], best[1]), _mm_add_epi32(best[2], best[3])));
+	return PackBcColorIndices(out);
+}
+
+static uint64_t BcAlphaIndicesSSE2(const uint8_t* pAlpha, const uint8_t* pPalette, uint32_t* pError)
+{
+	const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8(-1);
+	__m128i a = _mm_loadu_si128((const __m128i*)pAlpha), best = zero, index = zero;
+	uint8_t out[16];
+
+	for (int k = 0; k < 8; k++) {
+		__m128i p = _mm_set1_epi8((char)pPalette[k]);
+		__m128i d = _mm_or_si128(_mm_subs_epu8(a, p), _mm_subs_epu8(p, a));
+		if (k == 0) {
+			best = d;
+		} else {
+			__m128i m = _mm_min_epu8(d, best);
+			__m128i lt = _mm_xor_si128(_mm_cmpeq_epi8(m, best), ones);
+			best = m;
+			index = _mm_or_si128(_mm_and_si128(lt, _mm_set1_epi8((char)k)), _mm_andnot_si128(lt, index));
+		}
+	}
+	_mm_storeu_si128((__m128i*)out, index);
+	__m128i lo = _mm_unpacklo_epi8(best, zero), hi = _mm_unpackhi_epi8(best, zero);
+	*pError = HorizontalSumSSE2(_mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		indices |= (uint64_t)out[i] << (3 * i);
+	}
+	return indices;
+}
+
+TARGET_AVX2
+static uint32_t BcColorIndicesAVX2(const uint8_t* pBlock, const uint8_t* pPalette, uint32_t* pError)
+{
+	const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+	__m256i px[4], best[2], index[2];
+	int32_t out[16];
+
+	// 4 pixels a register, 16 bit R G B 0
+	for (int i = 0; i < 4; i++) {
+		px[i] = _mm256_cvtepu8_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i*)(pBlock + 16 * i)), rgb));
+	}
+	for (int k = 0; k < 4; k++) {
+		const uint8_t* c = pPalette + 4 * k;
+		__m256i p = _mm256_set1_epi64x((int64_t)c[0] | (int64_t)c[1] << 16 | (int64_t)c[2] << 32);
+		__m256i n = _mm256_set1_epi32(k);
+		for (int j = 0; j < 2; j++) {
+			__m256i d0 = _mm256_sub_epi16(px[2 * j], p), d1 = _mm256_sub_epi16(px[2 * j + 1], p);
+			// pixels come out 0 1 4 5 2 3 6 7 (hadd works per 128 bit lane), put back at the end
+			__m256i dist = _mm256_hadd_epi32(_mm256_madd_epi16(d0, d0), _mm256_madd_epi16(d1, d1));
+			if (k == 0) {
+				best[j] = dist;
+				index[j] = _mm256_setzero_si256();
+			} else {
+				__m256i lt = _mm256_cmpgt_epi32(best[j], dist);
+				best[j] = _mm256_min_epi32(dist, best[j]);
+				index[j] = _mm256_blendv_epi8(index[j], n, lt);
+			}
+		}
+	}
+	for (int j = 0; j < 2; j++) {
+		_mm256_storeu_si256((__m256i*)(out + 8 * j), _mm256_permute4x64_epi64(index[j], _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	__m256i sum = _mm256_add_epi32(best[0], best[1]);
+	*pError = HorizontalSumSSE2(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+	return PackBcColorIndices(out);
+}
+#endif
+
+typedef struct {
+	const char*  szName;
+	PFNBCCOLOR   pfnColor;
+	PFNBCALPHA   pfnAlpha;
+	unsigned int uRequired; // CPU_xxx bits
+} BCKERNEL;
+
+// narrowest first, InitBcEncoder takes the last one the cpu supports
+static const BCKERNEL g_BcKernels[] = {
+	{ "scalar", BcColorIndicesScalar, BcAlphaIndicesScalar, 0 },
+#ifdef CPU_X86
+	{ "sse2", BcColorIndicesSSE2, BcAlphaIndicesSSE2, CPU_SSE2 },
+	{ "avx2", BcColorIndicesAVX2, BcAlphaIndicesSSE2, CPU_SSE2 | CPU_AVX2 },
+#endif
+};
+#define BC_KERNEL_COUNT ((int)(sizeof(g_BcKernels) / sizeof(g_BcKernels[0])))
+
+static const BCKERNEL* g_pBcKernel = &g_BcKernels[0];
+static unsigned int g_uBcCpu = 0;
+
+static int IsBcKernelSupported(int i)
+{
+	return (g_BcKernels[i].uRequired & g_uBcCpu) == g_BcKernels[i].uRequired;
+}
+
+// picks the kernels and builds the tables, returns the kernel name
+static const char* InitBcEncoder(void)
+{
+	InitBcTables();
+	g_uBcCpu = GetCpuFeatures();
+
+	for (int i = 0; i < BC_KERNEL_COUNT; i++) {
+		if (IsBcKernelSupported(i)) {
+			g_pBcKernel = &g_BcKernels[i];
+		}
+	}
+
+	return g_pBcKernel->szName;
+}
+
+static int ClampBcByte(float v)
+{
+	return v < 0.0f ? 0 : v > 255.0f ? 255 : (int)(v + 0.5f);
+}
+
+static uint16_t QuantizeBc565(const float rgb[3])
+{
+	return PackBc565((ClampBcByte(rgb[0]) * 31 + 127) / 255, (ClampBcByte(rgb[1]) * 63 + 127) / 255,
+					 (ClampBcByte(rgb[2]) * 31 + 127) / 255);
+}
+
+static uint32_t EvaluateBcColor(const uint8_t* pBlock, uint16_t c0, uint16_t c1, uint32_t* pIndices)
+{
+	uint8_t palette[16];
+	uint32_t error;
+	BcColorPalette(c0, c1, palette);
+	*pIndices = g_pBcKernel->pfnColor(pBlock, palette, &error);
+	return error;
+}
+
+// endpoints that fit the colours best for these indices (least squares), 0 if they can't move
+static int RefitBcEndpoints(const uint8_t* pBlock, uint32_t indices, uint16_t* pC0, uint16_t* pC1)
+{
+	static const float w0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0 }, bx[3] = { 0 };
+
+	for (int i = 0; i < 16; i++) {
+		float a = w0[(indices >> (2 * i)) & 3], b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < 3; c++) {
+			ax[c] += a * pBlock[4 * i + c];
+			bx[c] += b * pBlock[4 * i + c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (det < 1e-4f) {
+		return 0;   // every pixel on one index
+	}
+	float e0[3], e1[3];
+	for (int c = 0; c < 3; c++) {
+		e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+		e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+	}
+	*pC0 = QuantizeBc565(e0);
+	*pC1 = QuantizeBc565(e1);
+	return 1;
+}
+
+// one channel of one endpoint +-1 at a time, kept while the error goes down
+static uint32_t SearchBcEndpoints(const uint8_t* pBlock, uint16_t* pC0, uint16_t* pC1, uint32_t* pIndices, uint32_t error)
+{
+	static const int shift[3] = { 11, 5, 0 }, top[3] = { 31, 63, 31 };
+
+	for (int pass = 0; pass < 8 && error > 0; pass++) {
+		int bBetter = 0;
+		for (int e = 0; e < 2; e++) {
+			for (int c = 0; c < 3; c++) {
+				for (int step = -1; step <= 1; step += 2) {
+					uint16_t* pC = e ? pC1 : pC0;
+					int v = ((*pC >> shift[c]) & top[c]) + step;
+					if (v < 0 || v > top[c]) {
+						continue;
+					}
+					uint16_t old = *pC;
+					uint32_t indices;
+					*pC = (uint16_t)((old & ~(top[c] << shift[c])) | (v << shift[c]));
+					uint32_t err = EvaluateBcColor(pBlock, *pC0, *pC1, &indices);
+					if (err < error) {
+						error = err;
+						*pIndices = indices;
+						bBetter = 1;
+					} else {
+						*pC = old;
+					}
+				}
+			}
+		}
+		if (!bBetter) {
+			break;
+		}
+	}
+	return error;
+}
+
+static void WriteBcColorBlock(uint8_t* pOut, uint16_t c0, uint16_t c1, uint32_t indices)
+{
+	// c0 > c1 is the 4 colour mode; swapping the endpoints swaps 0 <-> 1, 2 <-> 3
+	if (c0 < c1) {
+		uint16_t t = c0;
+		c0 = c1;
+		c1 = t;
+		indices ^= 0x55555555u;
+	} else if (c0 == c1) {
+		indices = 0;   // 3 colour mode: index 3 would be black
+	}
+	pOut[0] = (uint8_t)c0;
+	pOut[1] = (uint8_t)(c0 >> 8);
+	pOut[2] = (uint8_t)c1;
+	pOut[3] = (uint8_t)(c1 >> 8);
+	for (int i = 0; i < 4; i++) {
+		pOut[4 + i] = (uint8_t)(indices >> (8 * i));
+	}
+}
+
+static void EncodeBcColorBlock(const uint8_t* pBlock, int preset, uint8_t* pOut)
+{
+	int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			int v = pBlock[4 * i + c];
+			lo[c] = v < lo[c] ? v : lo[c];
+			hi[c] = v > hi[c] ? v : hi[c];
+			mean[c] += (float)v;
+		}
+	}
+	if (lo[0] == hi[0] && lo[1] == hi[1] && lo[2] == hi[2]) {
+		// one colour: the table pair, every pixel on the 1/3 point
+		uint16_t c0 = PackBc565(g_BcMatch5[lo[0]][0], g_BcMatch6[lo[1]][0], g_BcMatch5[lo[2]][0]);
+		uint16_t c1 = PackBc565(g_BcMatch5[lo[0]][1], g_BcMatch6[lo[1]][1], g_BcMatch5[lo[2]][1]);
+		WriteBcColorBlock(pOut, c0, c1, 0xAAAAAAAAu);
+		return;
+	}
+
+	float cov[6] = { 0 };   // rr rg rb gg gb bb
+	for (int c = 0; c < 3; c++) {
+		mean[c] *= 1.0f / 16.0f;
+	}
+	for (int i = 0; i < 16; i++) {
+		float r = pBlock[4 * i] - mean[0], g = pBlock[4 * i + 1] - mean[1], b = pBlock[4 * i + 2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b;
+		cov[3] += g * g;
+		cov[4] += g * b;
+		cov[5] += b * b;
+	}
+
+	float e0[3], e1[3];
+	if (preset == BC_FAST) {
+		// the box's diagonal, flipped on the channels that fall while the widest one rises
+		int w = hi[1] - lo[1] >= hi[0] - lo[0] ? 1 : 0;
+		w = hi[2] - lo[2] > hi[w] - lo[w] ? 2 : w;
+		const float row[3][3] = { { cov[0], cov[1], cov[2] }, { cov[1], cov[3], cov[4] }, { cov[2], cov[4], cov[5] } };
+		for (int c = 0; c < 3; c++) {
+			float inset = (hi[c] - lo[c]) * (1.0f / 16.0f);
+			float a = hi[c] - inset, b = lo[c] + inset;
+			int bFlip = row[w][c] < 0.0f;
+			e0[c] = bFlip ? b : a;
+			e1[c] = bFlip ? a : b;
+		}
+	} else {
+		// power iteration from the row of the widest channel
+		int w = cov[3] >= cov[0] ? 1 : 0;
+		w = cov[5] > (w ? cov[3] : cov[0]) ? 2 : w;
+		const float row[3][3] = { { cov[0], cov[1], cov[2] }, { cov[1], cov[3], cov[4] }, { cov[2], cov[4], cov[5] } };
+		float axis[3] = { row[w][0], row[w][1], row[w][2] };
+		for (int it = 0; it < (preset == BC_HIGH ? 8 : 4); it++) {
+			float x = row[0][0] * axis[0] + row[0][1] * axis[1] + row[0][2] * axis[2];
+			float y = row[1][0] * axis[0] + row[1][1] * axis[1] + row[1][2] * axis[2];
+			float z = row[2][0] * axis[0] + row[2][1] * axis[1] + row[2][2] * axis[2];
+			float m = fabsf(x) > fabsf(y) ? fabsf(x) : fabsf(y);
+			m = fabsf(z) > m ? fabsf(z) : m;
+			if (m < 1e-12f) {
+				break;
+			}
+			axis[0] = x / m;
+			axis[1] = y / m;
+			axis[2] = z / m;
+		}
+		float len = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		if (len < 1e-12f) {
+			axis[0] = axis[1] = axis[2] = 1.0f;
+			len = 3.0f;
+		}
+		float tMin = 1e30f, tMax = -1e30f;
+		for (int i = 0; i < 16; i++) {
+			float t = (pBlock[4 * i] - mean[0]) * axis[0] + (pBlock[4 * i + 1] - mean[1]) * axis[1] +
+					  (pBlock[4 * i + 2] - mean[2]) * axis[2];
+			tMin = t < tMin ? t : tMin;
+			tMax = t > tMax ? t : tMax;
+		}
+		for (int c = 0; c < 3; c++) {
+			e0[c] = mean[c] + tMax * axis[c] / len;
+			e1[c] = mean[c] + tMin * axis[c] / len;
+		}
+	}
+
+	uint16_t c0 = QuantizeBc565(e0), c1 = QuantizeBc565(e1);
+	uint32_t indices, error = EvaluateBcColor(pBlock, c0, c1, &indices);
+
+	if (preset != BC_FAST) {
+		for (int it = 0; it < (preset == BC_HIGH ? 4 : 1) && error > 0; it++) {
+			uint16_t r0, r1;
+			uint32_t refitIndices;
+			if (!RefitBcEndpoints(pBlock, indices, &r0, &r1) || (r0 == c0 && r1 == c1)) {
+				break;
+			}
+			uint32_t refitError = EvaluateBcColor(pBlock, r0, r1, &refitIndices);
+			if (refitError >= error) {
+				break;
+			}
+			c0 = r0;
+			c1 = r1;
+			indices = refitIndices;
+			error = refitError;
+		}
+	}
+	if (preset == BC_HIGH) {
+		SearchBcEndpoints(pBlock, &c0, &c1, &indices, error);
+	}
+	WriteBcColorBlock(pOut, c0, c1, indices);
+}
+
+static void EncodeBcAlphaBlock(const uint8_t* pBlock, int preset, uint8_t* pOut)
+{
+	uint8_t alpha[16], palette[8];
+	int lo = 255, hi = 0, lo6 = 255, hi6 = 0;
+
+	for (int i = 0; i < 16; i++) {
+		int a = pBlock[4 * i + 3];
+		alpha[i] = (uint8_t)a;
+		lo = a < lo ? a : lo;
+		hi = a > hi ? a : hi;
+		if (a != 0 && a != 255) {
+			lo6 = a < lo6 ? a : lo6;
+			hi6 = a > hi6 ? a : hi6;
+		}
+	}
+
+	int a0 = hi, a1 = lo;
+	uint64_t indices = 0;
+	uint32_t error = 0;
+	if (hi > lo) {
+		BcAlphaPalette(a0, a1, palette);
+		indices = g_pBcKernel->pfnAlpha(alpha, palette, &error);
+		// the 6 value mode has 0 and 255 for free: better when the rest sit close together
+		if (preset == BC_HIGH && error > 0 && lo6 <= hi6 && (lo == 0 || hi == 255)) {
+			uint32_t error6;
+			BcAlphaPalette(lo6, hi6, palette);
+			uint64_t indices6 = g_pBcKernel->pfnAlpha(alpha, palette, &error6);
+			if (error6 < error) {
+				a0 = lo6;
+				a1 = hi6;
+				indices = indices6;
+			}
+		}
+	}
+	pOut[0] = (uint8_t)a0;
+	pOut[1] = (uint8_t)a1;
+	for (int i = 0; i < 6; i++) {
+		pOut[2 + i] = (uint8_t)(indices >> (8 * i));
+	}
+}
+
+// the 4x4 pixels at block (bx, by) as R G B A, edges repeated
+static void GatherBcBlock(const uint8_t* pPixels, int width, int height, int pitch, int bBgra, int bx, int by,
+						  uint8_t pBlock[64])
+{
+	for (int y = 0; y < 4; y++) {
+		int sy = 4 * by + y < height ? 4 * by + y : height - 1;
+		const uint8_t* pRow = pPixels + (size_t)pitch * sy;
+		if (4 * bx + 4 <= width) {
+			memcpy(pBlock + 16 * y, pRow + 16 * (size_t)bx, 16);
+		} else {
+			for (int x = 0; x < 4; x++) {
+				int sx = 4 * bx + x < width ? 4 * bx + x : width - 1;
+				memcpy(pBlock + 16 * y + 4 * x, pRow + 4 * (size_t)sx, 4);
+			}
+		}
+	}
+	if (bBgra) {
+		for (int i = 0; i < 16; i++) {
+			uint8_t t = pBlock[4 * i];
+			pBlock[4 * i] = pBlock[4 * i + 2];
+			pBlock[4 * i + 2] = t;
+		}
+	}
+}
+
+typedef struct {
+	const uint8_t* pPixels;
+	int            width;
+	int            height;
+	int            pitch;
+	int            bBgra;
+	int            format;
+	int            preset;
+	uint8_t*       pOut;
+	int            by0, by1;   // block rows [by0, by1)
+} BCBAND;
+
+static void EncodeBcBand(const BCBAND* pBand)
+{
+	int blocksX = (pBand->width + 3) / 4;
+	size_t cbBlock = BcBlockBytes(pBand->format);
+	uint8_t block[64];
+
+	for (int by = pBand->by0; by < pBand->by1; by++) {
+		uint8_t* pOut = pBand->pOut + cbBlock * blocksX * by;
+		for (int bx = 0; bx < blocksX; bx++, pOut += cbBlock) {
+			GatherBcBlock(pBand->pPixels, pBand->width, pBand->height, pBand->pitch, pBand->bBgra, bx, by, block);
+			if (pBand->format == BC_BC3) {
+				EncodeBcAlphaBlock(block, pBand->preset, pOut);
+				EncodeBcColorBlock(block, pBand->preset, pOut + 8);
+			} else {
+				EncodeBcColorBlock(block, pBand->preset, pOut);
+			}
+		}
+	}
+}
+
+static THREADPROC(BcBandProc)
+{
+	EncodeBcBand((const BCBAND*)pContext);
+	return 0;
+}
+
+static void FreeBcImage(BCIMAGE* pImage)
+{
+	free(pImage->pOwned);
+	if (pImage->bFromCache) {
+		UnmapFile(&pImage->file);
+	}
+	memset(pImage, 0, sizeof(*pImage));
+}
+
+static void InitBcImage(BCIMAGE* pImage, int width, int height, int format)
+{
+	memset(pImage, 0, sizeof(*pImage));
+	pImage->format = format;
+	pImage->width = width;
+	pImage->height = height;
+	pImage->blocksX = (width + 3) / 4;
+	pImage->blocksY = (height + 3) / 4;
+	pImage->cbData = BcImageBytes(width, height, format);
+}
+
+/*
+	pPixels: width x height, 4 bytes a pixel, pitch bytes a row. Returns 0
+	on bad arguments or out of memory
+*/
+static int EncodeBcImage(BCIMAGE* pImage, const uint8_t* pPixels, int width, int height, int pitch, int bBgra,
+						 int format, int preset, int nThreads)
+{
+	BCBAND bands[MAX_BC_THREADS];
+	THREAD threads[MAX_BC_THREADS];
+
+	memset(pImage, 0, sizeof(*pImage));
+	if (width < 1 || height < 1 || (format != BC_BC1 && format != BC_BC3)) {
+		return 0;
+	}
+	InitBcImage(pImage, width, height, format);
+	pImage->pOwned = (uint8_t*)malloc(pImage->cbData);
+	if (!pImage->pOwned) {
+		return 0;
+	}
+	pImage->pData = pImage->pOwned;
+
+	if (nThreads <= 0) {
+		nThreads = GetCpuCount();
+	}
+	nThreads = nThreads > MAX_BC_THREADS ? MAX_BC_THREADS : nThreads;
+	if ((size_t)pImage->blocksX * pImage->blocksY < BC_THREAD_BLOCKS) {
+		nThreads = 1;
+	}
+	nThreads = nThreads > pImage->blocksY ? pImage->blocksY : nThreads;
+
+	for (int i = 0; i < nThreads; i++) {
+		BCBAND band = { pPixels, width, height, pitch, bBgra, format, preset, pImage->pOwned,
+						(int)((int64_t)pImage->blocksY * i / nThreads), (int)((int64_t)pImage->blocksY * (i + 1) / nThreads) };
+		bands[i] = band;
+	}
+	// bands 1.. on threads, band 0 here; a band that can't get a thread runs here too
+	int nStarted = 0;
+	for (int i = 1; i < nThreads; i++) {
+		if (StartThread(&threads[nStarted], BcBandProc, &bands[i])) {
+			nStarted++;
+		} else {
+			EncodeBcBand(&bands[i]);
+		}
+	}
+	EncodeBcBand(&bands[0]);
+	for (int i = 0; i < nStarted; i++) {
+		JoinThread(threads[i]);
+	}
+	return 1;
+}
+
+// one block to 16 R G B A pixels; BC1 with c0 <= c1 is the 3 colour mode, index 3 transparent black
+static void DecodeBcBlock(const uint8_t* pBlock, int format, uint8_t pRgba[64])
+{
+	const uint8_t* pColor = format == BC_BC3 ? pBlock + 8 : pBlock;
+	uint16_t c0 = (uint16_t)(pColor[0] | pColor[1] << 8), c1 = (uint16_t)(pColor[2] | pColor[3] << 8);
+	uint32_t indices = (uint32_t)pColor[4] | (uint32_t)pColor[5] << 8 | (uint32_t)pColor[6] << 16 | (uint32_t)pColor[7] << 24;
+	uint8_t palette[16];
+
+	BcColorPalette(c0, c1, palette);
+	for (int k = 0; k < 4; k++) {
+		palette[4 * k + 3] = 255;
+	}
+	if (format == BC_BC1 && c0 <= c1) {
+		for (int c = 0; c < 3; c++) {
+			palette[8 + c] = (uint8_t)((palette[c] + palette[4 + c] + 1) / 2);
+			palette[12 + c] = 0;
+		}
+		palette[15] = 0;
+	}
+	for (int i = 0; i < 16; i++) {
+		memcpy(pRgba + 4 * i, palette + 4 * ((indices >> (2 * i)) & 3), 4);
+	}
+
+	if (format == BC_BC3) {
+		uint8_t alpha[8];
+		uint64_t bits = 0;
+		BcAlphaPalette(pBlock[0], pBlock[1], alpha);
+		for (int i = 0; i < 6; i++) {
+			bits |= (uint64_t)pBlock[2 + i] << (8 * i);
+		}
+		for (int i = 0; i < 16; i++) {
+			pRgba[4 * i + 3] = alpha[(bits >> (3 * i)) & 7];
+		}
+	}
+}
+
+// the whole image back to R G B A pixels (width x height, pitch bytes a row)
+static void DecodeBcImage(const BCIMAGE* pImage, uint8_t* pPixels, int pitch)
+{
+	size_t cbBlock = BcBlockBytes(pImage->format);
+	uint8_t rgba[64];
+
+	for (int by = 0; by < pImage->blocksY; by++) {
+		for (int bx = 0; bx < pImage->blocksX; bx++) {
+			DecodeBcBlock(pImage->pData + cbBlock * ((size_t)by * pImage->blocksX + bx), pImage->format, rgba);
+			for (int y = 0; y < 4 && 4 * by + y < pImage->height; y++) {
+				int n = pImage->width - 4 * bx < 4 ? pImage->width - 4 * bx : 4;
+				memcpy(pPixels + (size_t)pitch * (4 * by + y) + 16 * (size_t)bx, rgba + 16 * y, 4 * (size_t)n);
+			}
+		}
+	}
+}
+
+/*
+	disk cache
+*/
+static uint64_t BcCacheKey(const uint8_t* pPixels, int width, int height, int pitch, int bBgra, int format, int preset)
+{
+	int32_t params[6] = { width, height, bBgra, format, preset, BC_FILE_VERSION };
+	uint64_t h = HashBytes(params, sizeof(params), 0);
+	for (int y = 0; y < height; y++) {
+		h = HashBytes(pPixels + (size_t)pitch * y, (size_t)width * 4, h);
+	}
+	return h;
+}
+
+// 0 if the file isn't there or isn't this image
+static int LoadBcCacheFile(BCIMAGE* pImage, const char* szPath, uint64_t key, int width, int height, int format, int preset)
+{
+	BCFILEHEADER header;
+
+	InitBcImage(pImage, width, height, format);
+	if (!MapFile(szPath, &pImage->file)) {
+		return 0;
+	}
+	if (pImage->file.cbSize != sizeof(header) + pImage->cbData) {
+		UnmapFile(&pImage->file);
+		return 0;
+	}
+	memcpy(&header, pImage->file.pData, sizeof(header));
+	if (header.magic != BC_FILE_MAGIC || header.version != BC_FILE_VERSION || header.key != key ||
+		header.format != format || header.preset != preset || header.width != width || header.height != height ||
+		header.cbData != pImage->cbData) {
+		UnmapFile(&pImage->file);
+		return 0;
+	}
+	pImage->pData = pImage->file.pData + sizeof(header);
+	pImage->bFromCache = 1;
+	return 1;
+}
+
+// the header goes in last: a file cut short by a crash never matches
+static int SaveBcCacheFile(const BCIMAGE* pImage, const char* szPath, uint64_t key, int preset)
+{
+	BCFILEHEADER header = { 0, BC_FILE_VERSION, key, pImage->format, preset, pImage->width, pImage->height, pImage->cbData };
+	FILE* f = fopen(szPath, "wb");
+	if (!f) {
+		return 0;
+	}
+	int bOk = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(pImage->pData, 1, pImage->cbData, f) == pImage->cbData &&
+			  fflush(f) == 0;
+	header.magic = BC_FILE_MAGIC;
+	bOk = bOk && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+	bOk = fclose(f) == 0 && bOk;
+	if (!bOk) {
+		remove(szPath);
+	}
+	return bOk;
+}
+
+/*
+	EncodeBcImage through szCacheDir (made if it isn't there). A cache that
+	can't be read or written only costs the encode
+*/
+static int EncodeBcImageCached(BCIMAGE* pImage, const char* szCacheDir, const uint8_t* pPixels, int width, int height,
+							   int pitch, int bBgra, int format, int preset, int nThreads)
+{
+	char szPath[1024];
+
+	if (width < 1 || height < 1 || (format != BC_BC1 && format != BC_BC3)) {
+		memset(pImage, 0, sizeof(*pImage));
+		return 0;
+	}
+	uint64_t key = BcCacheKey(pPixels, width, height, pitch, bBgra, format, preset);
+	snprintf(szPath, sizeof(szPath), "%s/%016llx.bc", szCacheDir, (unsigned long long)key);
+	if (LoadBcCacheFile(pImage, szPath, key, width, height, format, preset)) {
+		return 1;
+	}
+
+	if (!EncodeBcImage(pImage, pPixels, width, height, pitch, bBgra, format, preset, nThreads)) {
+		return 0;
+	}
+#ifdef _WIN32
+	_mkdir(szCacheDir);
+#else
+	mkdir(szCacheDir, 0755);
+#endif
+	SaveBcCacheFile(pImage, szPath, key, preset);
+	return 1;
+}
+
+#endif // BC_C
@@ -0,0 +1,447 @@
+/*
+	Headless test/benchmark for bc.c
+	Notes:
+		- hand made blocks decode to the colours the format says (4 colour,
+		  3 colour + black, 8 and 6 value alpha)
+		- every byte as a one colour block comes back within 1 (the 565
+		  endpoint tables), odd sizes give the blocks of the
+		  image padded with its edge pixels
+		- every kernel against the scalar one, to the bit; threads against
+		  one thread, to the bit; BGRA input gives the same blocks as RGBA
+		- PSNR must not go down from fast to normal to high
+		- the disk cache: miss then hit, the same blocks, a cut short or
+		  scribbled file is a miss
+		- then MP/s (1 thread and one per cpu) and PSNR for each preset,
+		  BC1 and BC3, on a 2K image; MP/s of every kernel
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 bcbench.c
+		linux:   cc -O2 -pthread bcbench.c -o bcbench -lm
+*/
+
+#include <stdio.h>
+#include "bc.c"
+#include "pacing.c"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define BC_BENCH_CACHE "bcbench_cache"
+
+static unsigned int g_uSeed = 1;
+
+static uint8_t RandomByte(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (uint8_t)(g_uSeed >> 24);
+}
+
+static const char* g_szFormats[2] = { "BC1", "BC3" };
+static const char* g_szPresets[3] = { "fast", "normal", "high" };
+
+// smooth colour waves, hard edged stripes, a little noise, alpha a soft circle: texture-ish
+static uint8_t* MakeImage(int width, int height)
+{
+	uint8_t* p = (uint8_t*)malloc((size_t)width * height * 4);
+	if (!p) {
+		return NULL;
+	}
+	g_uSeed = 1;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			uint8_t* q = p + ((size_t)y * width + x) * 4;
+			double u = (double)x / width, v = (double)y / height;
+			int noise = (RandomByte() & 15) - 8;
+			int r = (int)(128 + 100 * sin(6.0 * u + 2.0 * v)) + noise;
+			int g = (int)(128 + 90 * sin(5.0 * v - 3.0 * u)) + noise;
+			int b = ((x / 24 + y / 40) & 1) ? 200 + noise : 40 + noise;
+			double d = sqrt((u - 0.5) * (u - 0.5) + (v - 0.5) * (v - 0.5));
+			q[0] = (uint8_t)(r < 0 ? 0 : r > 255 ? 255 : r);
+			q[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+			q[2] = (uint8_t)(b < 0 ? 0 : b > 255 ? 255 : b);
+			int a = d > 0.45 ? 0 : d < 0.25 ? 255 : 255 - (int)((d - 0.25) * 1275.0) + noise;
+			q[3] = (uint8_t)(a < 0 ? 0 : a > 255 ? 255 : a);
+		}
+	}
+	return p;
+}
+
+// over the R G B (nChannels 3) or all four bytes; 99 for no error
+static double Psnr(const uint8_t* a, const uint8_t* b, size_t nPixels, int c0, int nChannels)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < nPixels; i++) {
+		for (int c = c0; c < c0 + nChannels; c++) {
+			double d = (double)a[4 * i + c] - b[4 * i + c];
+			sum += d * d;
+		}
+	}
+	double mse = sum / ((double)nPixels * nChannels);
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+static uint8_t* RoundTrip(const BCIMAGE* pImage)
+{
+	uint8_t* p = (uint8_t*)malloc((size_t)pImage->width * pImage->height * 4);
+	if (p) {
+		DecodeBcImage(pImage, p, pImage->width * 4);
+	}
+	return p;
+}
+
+static int CheckDecoder(void)
+{
+	// c0 = red, c1 = blue (c0 > c1), indices 0 1 2 3 repeated
+	static const uint8_t bc1[8] = { 0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4 };
+	// same colours swapped (c0 < c1): 3 colour mode, index 3 transparent black
+	static const uint8_t bc1b[8] = { 0x1F, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4 };
+	static const uint8_t want[4][4] = { { 255, 0, 0, 255 }, { 0, 0, 255, 255 }, { 170, 0, 85, 255 }, { 85, 0, 170, 255 } };
+	static const uint8_t wantb[4][4] = { { 0, 0, 255, 255 }, { 255, 0, 0, 255 }, { 128, 0, 128, 255 }, { 0, 0, 0, 0 } };
+	// alpha 200 / 60 (8 values) and 60 / 200 (6 values + 0, 255), index i at pixel i, 8..15 index 7
+	uint8_t bc3[16] = { 200, 60 }, bc3b[16] = { 60, 200 };
+	static const uint8_t wantA[8] = { 200, 60, 180, 160, 140, 120, 100, 80 };
+	static const uint8_t wantAb[8] = { 60, 200, 88, 116, 144, 172, 0, 255 };
+	uint64_t bits = 0;
+	uint8_t rgba[64], rgbab[64];
+
+	for (int i = 0; i < 16; i++) {
+		bits |= (uint64_t)(i < 8 ? i : 7) << (3 * i);
+	}
+	for (int i = 0; i < 6; i++) {
+		bc3[2 + i] = bc3b[2 + i] = (uint8_t)(bits >> (8 * i));
+	}
+	memcpy(bc3 + 8, bc1, 8);
+	memcpy(bc3b + 8, bc1, 8);
+
+	DecodeBcBlock(bc1, BC_BC1, rgba);
+	DecodeBcBlock(bc1b, BC_BC1, rgbab);
+	for (int i = 0; i < 16; i++) {
+		if (memcmp(rgba + 4 * i, want[i & 3], 4) != 0 || memcmp(rgbab + 4 * i, wantb[i & 3], 4) != 0) {
+			printf("MISMATCH BC1 decode pixel %d: %d %d %d %d\n", i, rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2],
+				   rgba[4 * i + 3]);
+			return 1;
+		}
+	}
+	DecodeBcBlock(bc3, BC_BC3, rgba);
+	DecodeBcBlock(bc3b, BC_BC3, rgbab);
+	for (int i = 0; i < 16; i++) {
+		int k = i < 8 ? i : 7;
+		if (rgba[4 * i + 3] != wantA[k] || rgbab[4 * i + 3] != wantAb[k] || memcmp(rgba + 4 * i, want[i & 3], 3) != 0) {
+			printf("MISMATCH BC3 decode pixel %d: alpha %d %d\n", i, rgba[4 * i + 3], rgbab[4 * i + 3]);
+			return 1;
+		}
+	}
+	printf("decode BC1 4 / 3 colour, BC3 8 / 6 value alpha: ok\n");
+	return 0;
+}
+
+static int SameImages(const BCIMAGE* a, const BCIMAGE* b)
+{
+	return a->cbData == b->cbData && memcmp(a->pData, b->pData, a->cbData) == 0;
+}
+
+static int CheckSolidAndOdd(void)
+{
+	// 256 x 4 pixels, 4 equal columns a block; 4 shifts give every byte a block
+	for (int shift = 0; shift < 4; shift++) {
+		uint8_t* q = (uint8_t*)malloc(256 * 4 * 4);
+		for (int i = 0; i < 256 * 4; i++) {
+			int v = ((i & 255) & ~3) + shift;
+			q[4 * i] = (uint8_t)v;
+			q[4 * i + 1] = (uint8_t)(255 - v);
+			q[4 * i + 2] = (uint8_t)(v * 7);
+			q[4 * i + 3] = (uint8_t)v;
+		}
+		for (int preset = BC_FAST; preset <= BC_HIGH; preset++) {
+			BCIMAGE image;
+			EncodeBcImage(&image, q, 256, 4, 256 * 4, 0, BC_BC3, preset, 1);
+			uint8_t* r = RoundTrip(&image);
+			for (int i = 0; i < 256 * 4; i++) {
+				for (int c = 0; c < 4; c++) {
+					if (abs(r[4 * i + c] - q[4 * i + c]) > 1) {
+						printf("MISMATCH one colour block %s: %d became %d (channel %d)\n", g_szPresets[preset],
+							   q[4 * i + c], r[4 * i + c], c);
+						return 1;
+					}
+				}
+			}
+			free(r);
+			FreeBcImage(&image);
+		}
+		free(q);
+	}
+
+	// sizes that aren't a multiple of 4: the same blocks as the image padded with its last row / column
+	static const int sizes[][2] = { { 1, 1 }, { 3, 5 }, { 37, 23 }, { 64, 1 }, { 2, 70 } };
+	for (int i = 0; i < 5; i++) {
+		int w = sizes[i][0], h = sizes[i][1], pw = (w + 3) & ~3, ph = (h + 3) & ~3;
+		uint8_t* src = MakeImage(w, h);
+		uint8_t* pad = (uint8_t*)malloc((size_t)pw * ph * 4);
+		for (int y = 0; y < ph; y++) {
+			for (int x = 0; x < pw; x++) {
+				memcpy(pad + ((size_t)y * pw + x) * 4, src + ((size_t)(y < h ? y : h - 1) * w + (x < w ? x : w - 1)) * 4, 4);
+			}
+		}
+		for (int format = BC_BC1; format <= BC_BC3; format++) {
+			BCIMAGE image, padded;
+			if (!EncodeBcImage(&image, src, w, h, w * 4, 0, format, BC_NORMAL, 1) || image.blocksX != pw / 4 ||
+				image.blocksY != ph / 4 || image.cbData != BcImageBytes(w, h, format)) {
+				printf("MISMATCH %dx%d %s: size\n", w, h, g_szFormats[format]);
+				return 1;
+			}
+			EncodeBcImage(&padded, pad, pw, ph, pw * 4, 0, format, BC_NORMAL, 1);
+			uint8_t* r = RoundTrip(&image);
+			uint8_t* rp = RoundTrip(&padded);
+			int bSame = SameImages(&image, &padded);
+			for (int y = 0; y < h; y++) {
+				bSame &= memcmp(r + (size_t)y * w * 4, rp + (size_t)y * pw * 4, (size_t)w * 4) == 0;
+			}
+			if (!bSame) {
+				printf("MISMATCH %dx%d %s: edge blocks differ from the padded image\n", w, h, g_szFormats[format]);
+				return 1;
+			}
+			free(r);
+			free(rp);
+			FreeBcImage(&image);
+			FreeBcImage(&padded);
+		}
+		free(src);
+		free(pad);
+	}
+	printf("one colour blocks within 1, odd sizes: ok\n");
+	return 0;
+}
+
+static int CheckKernelsAndThreads(void)
+{
+	int w = 301, h = 277;
+	uint8_t* src = MakeImage(w, h);
+	uint8_t* bgra = (uint8_t*)malloc((size_t)w * h * 4);
+	const BCKERNEL* pBest = g_pBcKernel;
+
+	for (int i = 0; i < w * h; i++) {
+		bgra[4 * i] = src[4 * i + 2];
+		bgra[4 * i + 1] = src[4 * i + 1];
+		bgra[4 * i + 2] = src[4 * i];
+		bgra[4 * i + 3] = src[4 * i + 3];
+	}
+	for (int format = BC_BC1; format <= BC_BC3; format++) {
+		for (int preset = BC_FAST; preset <= BC_HIGH; preset++) {
+			BCIMAGE ref, image;
+			g_pBcKernel = &g_BcKernels[0];
+			EncodeBcImage(&ref, src, w, h, w * 4, 0, format, preset, 1);
+			for (int k = 1; k < BC_KERNEL_COUNT; k++) {
+				if (!IsBcKernelSupported(k)) {
+					continue;
+				}
+				g_pBcKernel = &g_BcKernels[k];
+				EncodeBcImage(&image, src, w, h, w * 4, 0, format, preset, 1);
+				if (!SameImages(&ref, &image)) {
+					printf("MISMATCH %s %s: kernel %s differs from scalar\n", g_szFormats[format], g_szPresets[preset],
+						   g_pBcKernel->szName);
+					return 1;
+				}
+				FreeBcImage(&image);
+			}
+			g_pBcKernel = pBest;
+			// small enough for one thread by default: force the bands through a bigger count
+			EncodeBcImage(&image, bgra, w, h, w * 4, 1, format, preset, 1);
+			int bSame = SameImages(&ref, &image);
+			FreeBcImage(&image);
+			BCBAND band = { src, w, h, w * 4, 0, format, preset, NULL, 0, 0 };
+			uint8_t* pOut = (uint8_t*)malloc(ref.cbData);
+			for (int n = 1; n <= 7; n += 3) {
+				// band by band, the way the threads cut it
+				band.pOut = pOut;
+				for (int i = 0; i < n; i++) {
+					band.by0 = ref.blocksY * i / n;
+					band.by1 = ref.blocksY * (i + 1) / n;
+					EncodeBcBand(&band);
+				}
+				bSame &= memcmp(pOut, ref.pData, ref.cbData) == 0;
+			}
+			free(pOut);
+			if (!bSame) {
+				printf("MISMATCH %s %s: BGRA or bands differ\n", g_szFormats[format], g_szPresets[preset]);
+				return 1;
+			}
+			FreeBcImage(&ref);
+		}
+	}
+
+	// a real threaded encode, big enough to be cut
+	uint8_t* big = MakeImage(512, 512);
+	BCIMAGE one, many;
+	EncodeBcImage(&one, big, 512, 512, 512 * 4, 0, BC_BC3, BC_NORMAL, 1);
+	EncodeBcImage(&many, big, 512, 512, 512 * 4, 0, BC_BC3, BC_NORMAL, 5);
+	int bSame = SameImages(&one, &many);
+	FreeBcImage(&one);
+	FreeBcImage(&many);
+	free(big);
+	free(src);
+	free(bgra);
+	if (!bSame) {
+		printf("MISMATCH 5 threads differ from 1\n");
+		return 1;
+	}
+	printf("kernels against scalar, BGRA, bands, threads: ok\n");
+	return 0;
+}
+
+static int CheckPresets(void)
+{
+	int w = 256, h = 256;
+	uint8_t* src = MakeImage(w, h);
+	for (int format = BC_BC1; format <= BC_BC3; format++) {
+		double last = 0.0, lastA = 0.0;
+		for (int preset = BC_FAST; preset <= BC_HIGH; preset++) {
+			BCIMAGE image;
+			EncodeBcImage(&image, src, w, h, w * 4, 0, format, preset, 1);
+			uint8_t* r = RoundTrip(&image);
+			double psnr = Psnr(src, r, (size_t)w * h, 0, 3), psnrA = Psnr(src, r, (size_t)w * h, 3, 1);
+			if (psnr < last || (format == BC_BC3 && psnrA < lastA) || psnr < 30.0) {
+				printf("MISMATCH %s %s: PSNR %.2f after %.2f\n", g_szFormats[format], g_szPresets[preset], psnr, last);
+				return 1;
+			}
+			last = psnr;
+			lastA = psnrA;
+			free(r);
+			FreeBcImage(&image);
+		}
+	}
+	free(src);
+	printf("PSNR fast <= normal <= high: ok\n");
+	return 0;
+}
+
+static void RemoveCacheFile(const BCIMAGE* pImage, const uint8_t* src, int w, int h, int preset, char* szPath, size_t cb)
+{
+	uint64_t key = BcCacheKey(src, w, h, w * 4, 0, pImage->format, preset);
+	snprintf(szPath, cb, "%s/%016llx.bc", BC_BENCH_CACHE, (unsigned long long)key);
+}
+
+static int CheckCache(void)
+{
+	int w = 123, h = 77;
+	uint8_t* src = MakeImage(w, h);
+	BCIMAGE ref, a, b;
+	char szPath[1024];
+
+	EncodeBcImage(&ref, src, w, h, w * 4, 0, BC_BC3, BC_NORMAL, 1);
+	RemoveCacheFile(&ref, src, w, h, BC_NORMAL, szPath, sizeof(szPath));
+	remove(szPath);
+
+	int bOk = EncodeBcImageCached(&a, BC_BENCH_CACHE, src, w, h, w * 4, 0, BC_BC3, BC_NORMAL, 1) && !a.bFromCache &&
+			  SameImages(&ref, &a);
+	bOk = bOk && EncodeBcImageCached(&b, BC_BENCH_CACHE, src, w, h, w * 4, 0, BC_BC3, BC_NORMAL, 1) && b.bFromCache &&
+		  SameImages(&ref, &b);
+	FreeBcImage(&b);
+	if (!bOk) {
+		printf("MISMATCH cache: miss then hit\n");
+		return 1;
+	}
+
+	// cut short, then a bad magic: both a miss, and written again
+	FILE* f = fopen(szPath, "wb");
+	fwrite("BCC1", 1, 4, f);
+	fclose(f);
+	bOk = EncodeBcImageCached(&b, BC_BENCH_CACHE, src, w, h, w * 4, 0, BC_BC3, BC_NORMAL, 1) && !b.bFromCache;
+	FreeBcImage(&b);
+	f = fopen(szPath, "r+b");
+	fwrite("XXXX", 1, 4, f);
+	fclose(f);
+	bOk = bOk && EncodeBcImageCached(&b, BC_BENCH_CACHE, src, w, h, w * 4, 0, BC_BC3, BC_NORMAL, 1) && !b.bFromCache &&
+		  SameImages(&ref, &b);
+	FreeBcImage(&b);
+	bOk = bOk && EncodeBcImageCached(&b, BC_BENCH_CACHE, src, w, h, w * 4, 0, BC_BC3, BC_NORMAL, 1) && b.bFromCache;
+	FreeBcImage(&b);
+	// another preset is another file
+	bOk = bOk && EncodeBcImageCached(&b, BC_BENCH_CACHE, src, w, h, w * 4, 0, BC_BC3, BC_FAST, 1) && !b.bFromCache;
+	FreeBcImage(&b);
+	if (!bOk) {
+		printf("MISMATCH cache: bad file taken as a hit\n");
+		return 1;
+	}
+
+	remove(szPath);
+	RemoveCacheFile(&ref, src, w, h, BC_FAST, szPath, sizeof(szPath));
+	remove(szPath);
+#ifdef _WIN32
+	RemoveDirectoryA(BC_BENCH_CACHE);
+#else
+	rmdir(BC_BENCH_CACHE);
+#endif
+	FreeBcImage(&a);
+	FreeBcImage(&ref);
+	free(src);
+	printf("disk cache miss, hit, bad files: ok\n");
+	return 0;
+}
+
+static void Bench(const uint8_t* src, int side, int format, int preset, int nThreads, int bPsnr)
+{
+	BCIMAGE image;
+	double best = 1e9;
+	int nRuns = preset == BC_HIGH ? 1 : 3;
+	for (int r = 0; r < nRuns; r++) {
+		double t0 = PaceNow();
+		EncodeBcImage(&image, src, side, side, side * 4, 0, format, preset, nThreads);
+		double t = PaceNow() - t0;
+		best = t < best ? t : best;
+		if (r + 1 < nRuns) {
+			FreeBcImage(&image);
+		}
+	}
+	printf("%s %-7s %-7s %2d %9.1f ms %8.2f MP/s", g_szFormats[format], g_szPresets[preset], g_pBcKernel->szName,
+		   nThreads, best * 1e3, (double)side * side / best * 1e-6);
+	if (bPsnr) {
+		uint8_t* r = RoundTrip(&image);
+		printf("  PSNR %5.2f dB", Psnr(src, r, (size_t)side * side, 0, 3));
+		if (format == BC_BC3) {
+			printf(", alpha %5.2f dB", Psnr(src, r, (size_t)side * side, 3, 1));
+		}
+		free(r);
+	}
+	printf("\n");
+	FreeBcImage(&image);
+}
+
+int main(void)
+{
+	const char* szKernel = InitBcEncoder();
+	int nCpus = GetCpuCount();
+
+	if (CheckDecoder() || CheckSolidAndOdd() || CheckKernelsAndThreads() || CheckPresets() || CheckCache()) {
+		return 1;
+	}
+
+	int side = 2048;
+	uint8_t* src = MakeImage(side, side);
+	printf("\nkernel %s, %d cpus, %dx%d (GL_RGB8 %d KB, BC1 %d KB, BC3 %d KB)\n", szKernel, nCpus, side, side,
+		   side * side * 3 / 1024, (int)(BcImageBytes(side, side, BC_BC1) / 1024), (int)(BcImageBytes(side, side, BC_BC3) / 1024));
+	for (int format = BC_BC1; format <= BC_BC3; format++) {
+		for (int preset = BC_FAST; preset <= BC_HIGH; preset++) {
+			Bench(src, side, format, preset, 1, 1);
+			if (nCpus > 1) {
+				Bench(src, side, format, preset, nCpus, 0);
+			}
+		}
+	}
+
+	printf("\n");
+	const BCKERNEL* pBest = g_pBcKernel;
+	for (int k = 0; k < BC_KERNEL_COUNT; k++) {
+		if (IsBcKernelSupported(k)) {
+			g_pBcKernel = &g_BcKernels[k];
+			Bench(src, 1024, BC_BC1, BC_NORMAL, 1, 0);
+			Bench(src, 1024, BC_BC1, BC_HIGH, 1, 0);
+		}
+	}
+	g_pBcKernel = pBest;
+	free(src);
+	return 0;
+}
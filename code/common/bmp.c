@@ -0,0 +1,291 @@
+/*
+	BMP decoder on a mapped file, no GDI (runs on linux too)
+	Notes:
+		- LoadBmp maps the file (mapfile.c) and checks the headers, then:
+				32bpp top-down    pPixels points into the mapping, no copy
+				                  at all, BGRA (GL_BGRA / GL_BGRA_EXT)
+				32bpp bottom-up   rows copied in reverse order, BGRA
+				24bpp             BGR -> RGBA swizzle (SSSE3: 16 pixels per
+				                  3 loads / 4 stores) into one buffer, rows
+				                  reversed in the same pass if bottom-up
+		  so the texture upload is 1 copy at most, against GDI's LoadImage
+		  + GetDIBits + malloc (2 copies and a DC round trip)
+		- pPixels is always top row first, 4 bytes per pixel, pitch bytes
+		  per row (= width * 4), the same rows GetDIBits gave back with a
+		  negative biHeight
+		- only uncompressed 24/32 bpp (BI_RGB, and BI_BITFIELDS with the
+		  plain BGRA masks); palettes, RLE, 16bpp, OS/2 headers are refused
+		  with a message in szError
+		- every offset and size comes from the file: checked against the
+		  file size before any pixel is read, sizes capped so nothing
+		  overflows
+		- the 4th byte of a 32bpp BI_RGB file is unused, bHasAlpha is set
+		  only when a V3+ header gives an alpha mask
+		- InitBmpDecoder() picks the swizzle kernel (scalar until called)
+		- LoadBmpFromMemory does the same on bytes you already have (the
+		  zero copy pointer is then into those bytes)
+
+	usage:
+		BMPIMAGE img;
+		if (LoadBmp("dirt.bmp", &img)) {
+			glTexImage2D(..., img.width, img.height, 0,
+						 img.format == BMP_BGRA ? GL_BGRA_EXT : GL_RGBA, GL_UNSIGNED_BYTE, img.pPixels);
+			FreeBmp(&img);
+		}
+*/
+
+#ifndef BMP_C
+#define BMP_C
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cpu.c"
+#include "mapfile.c"
+
+#define BMP_RGBA  0
+#define BMP_BGRA  1
+
+#define BMP_MAX_SIDE    32768
+#define BMP_MAX_PIXELS  (1 << 28) // 1 GB as RGBA
+
+typedef struct {
+	int            width;
+	int            height;
+	int            pitch;      // bytes from one row to the next
+	int            format;     // BMP_RGBA or BMP_BGRA
+	int            bHasAlpha;  // else the 4th byte is undefined, treat as opaque
+	int            bZeroCopy;  // pPixels points into the file
+	const uint8_t* pPixels;    // top row first
+	uint8_t*       pOwned;     // decoded pixels when not zero copy
+	MAPPEDFILE     file;
+	const char*    szError;    // why LoadBmp failed
+} BMPIMAGE;
+
+typedef void (*PFNBGRTORGBA)(const uint8_t* pSrc, uint8_t* pDst, int n);
+
+static void BgrToRgbaScalar(const uint8_t* pSrc, uint8_t* pDst, int n)
+{
+	for (int i = 0; i < n; i++) {
+		pDst[0] = pSrc[2];
+		pDst[1] = pSrc[1];
+		pDst[2] = pSrc[0];
+		pDst[3] = 255;
+		pSrc += 3;
+		pDst += 4;
+	}
+}
+
+#ifdef CPU_X86
+TARGET_SSSE3 static void BgrToRgbaSSSE3(const uint8_t* pSrc, uint8_t* pDst, int n)
+{
+	// 4 pixels of 3 bytes -> 4 of 4: reverse each BGR, 0 in the 4th byte then or 255
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	int i = 0;
+
+	// 16 pixels = 48 bytes in, 64 out; reads exactly the 48 bytes
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(pSrc + 0));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(pSrc + 32));
+		__m128i p0 = a;                          // bytes 0..11
+		__m128i p1 = _mm_alignr_epi8(b, a, 12);  // bytes 12..23
+		__m128i p2 = _mm_alignr_epi8(c, b, 8);   // bytes 24..35
+		__m128i p3 = _mm_srli_si128(c, 4);       // bytes 36..47
+		_mm_storeu_si128((__m128i*)(pDst + 0), _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha));
+		_mm_storeu_si128((__m128i*)(pDst + 16), _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha));
+		_mm_storeu_si128((__m128i*)(pDst + 32), _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), alpha));
+		_mm_storeu_si128((__m128i*)(pDst + 48), _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), alpha));
+		pSrc += 48;
+		pDst += 64;
+	}
+
+	BgrToRgbaScalar(pSrc, pDst, n - i);
+}
+#endif
+
+typedef struct {
+	const char*  szName;
+	PFNBGRTORGBA pfn;
+	unsigned int uRequired; // CPU_xxx bits
+} BMPKERNEL;
+
+// narrowest first, InitBmpDecoder takes the last one the cpu supports
+static const BMPKERNEL g_BmpKernels[] = {
+	{ "scalar", BgrToRgbaScalar, 0 },
+#ifdef CPU_X86
+	{ "ssse3",  BgrToRgbaSSSE3,  CPU_SSSE3 },
+#endif
+};
+
+#define BMP_KERNEL_COUNT ((int)(sizeof(g_BmpKernels) / sizeof(g_BmpKernels[0])))
+
+static unsigned int g_uBmpCpu = 0;
+static PFNBGRTORGBA g_pfnBgrToRgba = BgrToRgbaScalar;
+static const char* g_szBmpKernel = "scalar";
+
+static int IsBmpKernelSupported(int i)
+{
+	return (g_BmpKernels[i].uRequired & g_uBmpCpu) == g_BmpKernels[i].uRequired;
+}
+
+// pick the widest swizzle the cpu supports, returns its name
+static const char* InitBmpDecoder(void)
+{
+	g_uBmpCpu = GetCpuFeatures();
+
+	for (int i = 0; i < BMP_KERNEL_COUNT; i++) {
+		if (IsBmpKernelSupported(i)) {
+			g_pfnBgrToRgba = g_BmpKernels[i].pfn;
+			g_szBmpKernel = g_BmpKernels[i].szName;
+		}
+	}
+
+	return g_szBmpKernel;
+}
+
+// little endian reads, the headers are not aligned
+static uint32_t BmpU32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t BmpU16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int BmpFail(BMPIMAGE* pImage, const char* szError)
+{
+	pImage->szError = szError;
+	return 0;
+}
+
+/*
+	Decodes cbData bytes of a .bmp file. On success pPixels is either into
+	pData (bZeroCopy, keep pData alive) or pOwned. Returns 0 and sets
+	szError on a bad or unsupported file
+*/
+static int LoadBmpFromMemory(const uint8_t* pData, size_t cbData, BMPIMAGE* pImage)
+{
+	memset(pImage, 0, sizeof(*pImage));
+
+	// BITMAPFILEHEADER (14) + at least a BITMAPINFOHEADER (40)
+	if (cbData < 14 + 40 || pData[0] != 'B' || pData[1] != 'M') {
+		return BmpFail(pImage, "not a BMP file");
+	}
+	uint32_t offBits = BmpU32(pData + 10);
+	uint32_t cbHeader = BmpU32(pData + 14);
+	if (cbHeader != 40 && cbHeader != 52 && cbHeader != 56 && cbHeader != 108 && cbHeader != 124) {
+		return BmpFail(pImage, "unsupported BMP header (OS/2 or unknown)");
+	}
+	if (14 + (size_t)cbHeader > cbData) {
+		return BmpFail(pImage, "truncated BMP header");
+	}
+
+	int32_t width = (int32_t)BmpU32(pData + 18);
+	int32_t height = (int32_t)BmpU32(pData + 22);
+	uint16_t planes = BmpU16(pData + 26);
+	uint16_t bpp = BmpU16(pData + 28);
+	uint32_t compression = BmpU32(pData + 30);
+	int bTopDown = height < 0;
+	uint32_t rows = bTopDown ? 0u - (uint32_t)height : (uint32_t)height;
+
+	if (width <= 0 || rows == 0 || width > BMP_MAX_SIDE || rows > BMP_MAX_SIDE ||
+		(uint64_t)width * rows > BMP_MAX_PIXELS) {
+		return BmpFail(pImage, "bad BMP size");
+	}
+	if (planes != 1) {
+		return BmpFail(pImage, "bad BMP planes");
+	}
+	if (bpp != 24 && bpp != 32) {
+		return BmpFail(pImage, "only 24 and 32 bpp BMPs are supported");
+	}
+
+	// BI_BITFIELDS masks follow a 40 byte header or are inside a bigger one:
+	// at 54 either way, the alpha mask at 66 from V3 headers on
+	if (compression == 3 && bpp == 32) {
+		if ((size_t)offBits < 14 + 40 + 12 || cbData < 14 + 40 + 12) {
+			return BmpFail(pImage, "truncated BMP bit masks");
+		}
+		if (BmpU32(pData + 54) != 0x00FF0000 || BmpU32(pData + 58) != 0x0000FF00 ||
+			BmpU32(pData + 62) != 0x000000FF) {
+			return BmpFail(pImage, "only BGRA bit masks are supported");
+		}
+		pImage->bHasAlpha = cbHeader >= 56 && BmpU32(pData + 66) == 0xFF000000;
+	} else if (compression != 0) {
+		return BmpFail(pImage, "compressed BMPs are not supported");
+	}
+
+	// rows are padded to 4 bytes; the last one may miss its padding
+	size_t cbRow = ((size_t)width * bpp / 8 + 3) & ~(size_t)3;
+	if (offBits < 14 + cbHeader || offBits > cbData ||
+		cbData - offBits < cbRow * (rows - 1) + (size_t)width * bpp / 8) {
+		return BmpFail(pImage, "truncated BMP pixels");
+	}
+
+	const uint8_t* pBits = pData + offBits;
+	pImage->width = width;
+	pImage->height = (int)rows;
+	pImage->pitch = width * 4;
+	pImage->format = bpp == 32 ? BMP_BGRA : BMP_RGBA;
+
+	if (bpp == 32 && bTopDown) {
+		pImage->pPixels = pBits;
+		pImage->bZeroCopy = 1;
+		return 1;
+	}
+
+	pImage->pOwned = (uint8_t*)malloc((size_t)pImage->pitch * rows);
+	if (!pImage->pOwned) {
+		return BmpFail(pImage, "out of memory");
+	}
+
+	for (uint32_t y = 0; y < rows; y++) {
+		const uint8_t* pSrc = pBits + cbRow * (bTopDown ? y : rows - 1 - y);
+		uint8_t* pDst = pImage->pOwned + (size_t)pImage->pitch * y;
+		if (bpp == 32) {
+			memcpy(pDst, pSrc, pImage->pitch);
+		} else {
+			g_pfnBgrToRgba(pSrc, pDst, width);
+		}
+	}
+	pImage->pPixels = pImage->pOwned;
+	return 1;
+}
+
+// maps the file; it stays mapped only while pPixels points into it
+static int LoadBmp(const char* szPath, BMPIMAGE* pImage)
+{
+	MAPPEDFILE file;
+	if (!MapFile(szPath, &file)) {
+		memset(pImage, 0, sizeof(*pImage));
+		return BmpFail(pImage, "can't open the BMP file");
+	}
+
+	if (!LoadBmpFromMemory(file.pData, file.cbSize, pImage)) {
+		UnmapFile(&file);
+		return 0;
+	}
+
+	if (pImage->bZeroCopy) {
+		pImage->file = file;
+	} else {
+		UnmapFile(&file);
+	}
+	return 1;
+}
+
+static void FreeBmp(BMPIMAGE* pImage)
+{
+	free(pImage->pOwned);
+	if (pImage->file.pData) {
+		UnmapFile(&pImage->file);
+	}
+	pImage->pOwned = NULL;
+	pImage->pPixels = NULL;
+}
+
+#endif // BMP_C
@@ -0,0 +1,375 @@
+/*
+	Headless test/benchmark for bmp.c (no window, runs on linux too)
+	Notes:
+		- the shipped textures (rotatingCube/dirt.bmp, grass.bmp,
+		  dirtgrass.bmp, or the paths on the command line) against a plain
+		  fread decoder written separately from bmp.c
+		- generated files: 24/32 bpp, top-down/bottom-up, widths 1..67 (row
+		  padding, SIMD tails), 32bpp top-down must be zero copy, also once
+		  through a real file (LoadBmp maps it)
+		- broken files: every truncation of a valid file, bad magic, sizes,
+		  planes, bpp, compression, offsets; must fail with a message, never
+		  read out of bounds
+		- swizzle kernels against the scalar one, then MP/s decoding a 4096^2
+		  image with each kernel
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 bmpbench.c
+		linux:   cc -O2 bmpbench.c -o bmpbench -lm
+*/
+
+#include <stdio.h>
+#include "bmp.c"
+#include "pacing.c"
+
+static unsigned int g_uSeed = 1;
+
+static uint8_t RandomByte(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (uint8_t)(g_uSeed >> 24);
+}
+
+static void Put32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+// pixel (x, y) of the generated images, y = 0 at the top
+static void TestPixel(int x, int y, uint8_t bgra[4])
+{
+	bgra[0] = (uint8_t)(x * 7 + y);
+	bgra[1] = (uint8_t)(x + y * 13);
+	bgra[2] = (uint8_t)(x * y + 5);
+	bgra[3] = (uint8_t)(x ^ y);
+}
+
+// a BITMAPINFOHEADER file, malloc'd, size in *pcb
+static uint8_t* MakeBmp(int width, int height, int bpp, int bTopDown, size_t* pcb)
+{
+	size_t cbRow = ((size_t)width * bpp / 8 + 3) & ~(size_t)3;
+	size_t cb = 54 + cbRow * height;
+	uint8_t* p = (uint8_t*)calloc(cb, 1);
+	if (!p) {
+		return NULL;
+	}
+	p[0] = 'B'; p[1] = 'M';
+	Put32(p + 2, (uint32_t)cb);
+	Put32(p + 10, 54);
+	Put32(p + 14, 40);
+	Put32(p + 18, (uint32_t)width);
+	Put32(p + 22, (uint32_t)(bTopDown ? -height : height));
+	p[26] = 1;
+	p[28] = (uint8_t)bpp;
+	for (int y = 0; y < height; y++) {
+		uint8_t* row = p + 54 + cbRow * (bTopDown ? y : height - 1 - y);
+		for (int x = 0; x < width; x++) {
+			uint8_t bgra[4];
+			TestPixel(x, y, bgra);
+			memcpy(row + x * bpp / 8, bgra, bpp / 8);
+		}
+	}
+	*pcb = cb;
+	return p;
+}
+
+static int CheckDecoded(const BMPIMAGE* pImage, int width, int height, int bpp, const char* szWhat)
+{
+	if (pImage->width != width || pImage->height != height || pImage->pitch != width * 4 ||
+		pImage->format != (bpp == 32 ? BMP_BGRA : BMP_RGBA)) {
+		printf("MISMATCH %s %dx%d %dbpp: size or format\n", szWhat, width, height, bpp);
+		return 1;
+	}
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const uint8_t* q = pImage->pPixels + (size_t)pImage->pitch * y + x * 4;
+			uint8_t bgra[4], want[4];
+			TestPixel(x, y, bgra);
+			if (bpp == 32) {
+				memcpy(want, bgra, 4);
+			} else {
+				want[0] = bgra[2]; want[1] = bgra[1]; want[2] = bgra[0]; want[3] = 255;
+			}
+			if (memcmp(q, want, 4) != 0) {
+				printf("MISMATCH %s %dx%d %dbpp: pixel %d,%d\n", szWhat, width, height, bpp, x, y);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int CheckGenerated(void)
+{
+	for (int bpp = 24; bpp <= 32; bpp += 8) {
+		for (int bTopDown = 0; bTopDown < 2; bTopDown++) {
+			for (int width = 1; width <= 67; width++) {
+				int height = 1 + width % 5;
+				size_t cb;
+				uint8_t* p = MakeBmp(width, height, bpp, bTopDown, &cb);
+				BMPIMAGE img;
+				if (!p || !LoadBmpFromMemory(p, cb, &img)) {
+					printf("MISMATCH valid %dx%d %dbpp refused: %s\n", width, height, bpp, p ? img.szError : "");
+					return 1;
+				}
+				int bZero = bpp == 32 && bTopDown;
+				if (img.bZeroCopy != bZero || (bZero && img.pPixels != p + 54)) {
+					printf("MISMATCH %dx%d %dbpp: zero copy %d\n", width, height, bpp, img.bZeroCopy);
+					return 1;
+				}
+				if (CheckDecoded(&img, width, height, bpp, bTopDown ? "top-down" : "bottom-up")) {
+					return 1;
+				}
+				FreeBmp(&img);
+				free(p);
+			}
+		}
+	}
+
+	// through a real file: LoadBmp keeps the mapping for the zero copy one
+	const char* szPath = "bmpbench.tmp";
+	for (int bpp = 24; bpp <= 32; bpp += 8) {
+		size_t cb;
+		uint8_t* p = MakeBmp(37, 11, bpp, 1, &cb);
+		FILE* f = fopen(szPath, "wb");
+		if (!p || !f || fwrite(p, 1, cb, f) != cb) {
+			printf("can't write %s\n", szPath);
+			return 1;
+		}
+		fclose(f);
+		free(p);
+
+		BMPIMAGE img;
+		if (!LoadBmp(szPath, &img)) {
+			printf("MISMATCH LoadBmp: %s\n", img.szError);
+			return 1;
+		}
+		if (img.bZeroCopy != (bpp == 32) || (img.file.pData != NULL) != (bpp == 32) ||
+			CheckDecoded(&img, 37, 11, bpp, "file")) {
+			printf("MISMATCH LoadBmp %dbpp: zero copy or mapping\n", bpp);
+			return 1;
+		}
+		FreeBmp(&img);
+	}
+	remove(szPath);
+
+	BMPIMAGE img;
+	if (LoadBmp("no such file.bmp", &img) || !img.szError) {
+		printf("MISMATCH LoadBmp accepted a missing file\n");
+		return 1;
+	}
+
+	printf("generated 24/32 bpp, both row orders, widths 1..67: ok\n");
+	return 0;
+}
+
+static int ExpectRefused(const uint8_t* p, size_t cb, const char* szWhat)
+{
+	BMPIMAGE img;
+	if (LoadBmpFromMemory(p, cb, &img)) {
+		printf("MISMATCH accepted: %s\n", szWhat);
+		FreeBmp(&img);
+		return 1;
+	}
+	return !img.szError;
+}
+
+static int CheckBroken(void)
+{
+	size_t cb;
+	uint8_t* p = MakeBmp(5, 3, 24, 0, &cb);
+	uint8_t* q = (uint8_t*)malloc(cb);
+	if (!p || !q) {
+		return 1;
+	}
+
+	// every truncation; a copy of exactly that size so a read past it is
+	// a read past the allocation (asan / valgrind catch it)
+	for (size_t n = 0; n < cb - 1; n++) {
+		uint8_t* t = (uint8_t*)malloc(n ? n : 1);
+		memcpy(t, p, n);
+		if (ExpectRefused(t, n, "truncated")) {
+			printf("  at %d of %d bytes\n", (int)n, (int)cb);
+			return 1;
+		}
+		free(t);
+	}
+
+	struct { int off, size; uint32_t value; const char* szWhat; } broken[] = {
+		{ 0,  1, 'X',         "bad magic" },
+		{ 10, 4, 1 << 20,     "pixels past the end" },
+		{ 10, 4, 20,          "pixels inside the header" },
+		{ 14, 4, 12,          "OS/2 header" },
+		{ 18, 4, 0,           "zero width" },
+		{ 18, 4, (uint32_t)-5, "negative width" },
+		{ 18, 4, 100000,      "huge width" },
+		{ 22, 4, 0,           "zero height" },
+		{ 22, 4, 0x80000000u, "INT_MIN height" },
+		{ 26, 2, 2,           "2 planes" },
+		{ 28, 2, 8,           "8 bpp" },
+		{ 28, 2, 16,          "16 bpp" },
+		{ 30, 4, 1,           "RLE8" },
+		{ 30, 4, 3,           "bit fields on 24 bpp" },
+		{ 28, 2, 32,          "32 bpp with too few pixels" },
+	};
+	for (int i = 0; i < (int)(sizeof(broken) / sizeof(broken[0])); i++) {
+		memcpy(q, p, cb);
+		if (broken[i].size == 1) {
+			q[broken[i].off] = (uint8_t)broken[i].value;
+		} else if (broken[i].size == 2) {
+			q[broken[i].off] = (uint8_t)broken[i].value;
+			q[broken[i].off + 1] = (uint8_t)(broken[i].value >> 8);
+		} else {
+			Put32(q + broken[i].off, broken[i].value);
+		}
+		if (ExpectRefused(q, cb, broken[i].szWhat)) {
+			return 1;
+		}
+	}
+	free(p);
+	free(q);
+
+	// a taller image than the pixels in the file
+	p = MakeBmp(8, 8, 32, 0, &cb);
+	Put32(p + 22, 9);
+	if (ExpectRefused(p, cb, "height over the pixel data")) {
+		return 1;
+	}
+	free(p);
+
+	printf("broken files refused: ok\n");
+	return 0;
+}
+
+// plain fread decoder for the 24bpp bottom-up files we ship, nothing shared with bmp.c
+static int CheckShipped(const char* szPath)
+{
+	FILE* f = fopen(szPath, "rb");
+	uint8_t header[54];
+	if (!f || fread(header, 1, 54, f) != 54) {
+		printf("can't read %s\n", szPath);
+		return 1;
+	}
+	int offBits = header[10] | header[11] << 8;
+	int width = header[18] | header[19] << 8;
+	int height = header[22] | header[23] << 8;
+	int cbRow = (width * 3 + 3) & ~3;
+	uint8_t* file = (uint8_t*)malloc((size_t)cbRow * height);
+	fseek(f, offBits, SEEK_SET);
+	if (header[28] != 24 || !file || fread(file, 1, (size_t)cbRow * height, f) != (size_t)cbRow * height) {
+		printf("can't read %s (24bpp bottom-up expected)\n", szPath);
+		return 1;
+	}
+	fclose(f);
+
+	BMPIMAGE img;
+	if (!LoadBmp(szPath, &img)) {
+		printf("MISMATCH %s: %s\n", szPath, img.szError);
+		return 1;
+	}
+	if (img.width != width || img.height != height || img.format != BMP_RGBA || img.bZeroCopy) {
+		printf("MISMATCH %s: size or format\n", szPath);
+		return 1;
+	}
+	for (int y = 0; y < height; y++) {
+		const uint8_t* bgr = file + cbRow * (height - 1 - y);
+		for (int x = 0; x < width; x++) {
+			const uint8_t* rgba = img.pPixels + img.pitch * y + x * 4;
+			if (rgba[0] != bgr[x * 3 + 2] || rgba[1] != bgr[x * 3 + 1] || rgba[2] != bgr[x * 3] || rgba[3] != 255) {
+				printf("MISMATCH %s: pixel %d,%d\n", szPath, x, y);
+				return 1;
+			}
+		}
+	}
+	printf("%-32s %dx%d ok, top left %02x%02x%02x\n", szPath, width, height,
+		   img.pPixels[0], img.pPixels[1], img.pPixels[2]);
+	FreeBmp(&img);
+	free(file);
+	return 0;
+}
+
+static int CheckKernels(void)
+{
+	uint8_t src[300], want[400], got[400];
+	for (int i = 0; i < 300; i++) {
+		src[i] = RandomByte();
+	}
+	for (int k = 1; k < BMP_KERNEL_COUNT; k++) {
+		if (!IsBmpKernelSupported(k)) {
+			continue;
+		}
+		for (int n = 0; n <= 100; n++) {
+			memset(want, 0xCD, sizeof(want));
+			memset(got, 0xCD, sizeof(got));
+			BgrToRgbaScalar(src, want, n);
+			g_BmpKernels[k].pfn(src, got, n);
+			if (memcmp(want, got, sizeof(got)) != 0) {
+				printf("MISMATCH %s swizzle, %d pixels\n", g_BmpKernels[k].szName, n);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void BenchDecode(const uint8_t* p, size_t cb, const char* szWhat, int nPixels)
+{
+	double best = 1e9;
+	for (int run = 0; run < 7; run++) {
+		BMPIMAGE img;
+		double t0 = PaceNow();
+		LoadBmpFromMemory(p, cb, &img);
+		double t = PaceNow() - t0;
+		FreeBmp(&img);
+		best = t < best ? t : best;
+	}
+	if (best * 1e3 < 0.01) {
+		printf("%-28s %10s      %8.4f ms\n", szWhat, "-", best * 1e3); // headers only
+	} else {
+		printf("%-28s %10.1f MP/s %8.2f ms\n", szWhat, nPixels / best * 1e-6, best * 1e3);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	static const char* szShipped[] = {
+		"../rotatingCube/dirt.bmp", "../rotatingCube/grass.bmp", "../rotatingCube/dirtgrass.bmp"
+	};
+
+	printf("swizzle: %s\n", InitBmpDecoder());
+	if (CheckKernels() || CheckGenerated() || CheckBroken()) {
+		return 1;
+	}
+	for (int i = 0; i < (argc > 1 ? argc - 1 : 3); i++) {
+		if (CheckShipped(argc > 1 ? argv[i + 1] : szShipped[i])) {
+			return 1;
+		}
+	}
+
+	int side = 4096;
+	size_t cb24, cb32, cb32up;
+	uint8_t* p24 = MakeBmp(side, side, 24, 0, &cb24);
+	uint8_t* p32 = MakeBmp(side, side, 32, 1, &cb32);
+	uint8_t* p32up = MakeBmp(side, side, 32, 0, &cb32up);
+	if (!p24 || !p32 || !p32up) {
+		return 1;
+	}
+
+	printf("\n%dx%d decode\n", side, side);
+	for (int k = 0; k < BMP_KERNEL_COUNT; k++) {
+		if (IsBmpKernelSupported(k)) {
+			char szWhat[64];
+			snprintf(szWhat, sizeof(szWhat), "24bpp bottom-up, %s", g_BmpKernels[k].szName);
+			g_pfnBgrToRgba = g_BmpKernels[k].pfn;
+			BenchDecode(p24, cb24, szWhat, side * side);
+		}
+	}
+	BenchDecode(p32up, cb32up, "32bpp bottom-up (row flip)", side * side);
+	BenchDecode(p32, cb32, "32bpp top-down (zero copy)", side * side);
+
+	free(p24);
+	free(p32);
+	free(p32up);
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+	cook: loose files -> one asset pack (packcook.c, read with pack.c)
+	Notes:
+		- cook [-bc] out.pak [name=]file ...
+		  the name is what the game looks up, the file's path by default
+		  with \ as / and no leading ./ (".\\dirt.bmp" is "dirt.bmp")
+		- -bc: textures as BC1 / BC3 blocks instead of 4 byte pixels
+		- prints every entry and the pack size; exits with 1 on an error,
+		  no pack is left behind
+
+	build:
+		windows: cl /nologo /O2 cook.c
+		linux:   cc -O2 -pthread cook.c -o cook -lm
+*/
+
+#include <stdio.h>
+#include "packcook.c"
+#include "pacing.c"
+
+static const char* g_szTypes[3] = { "blob", "texture", "mesh" };
+
+int main(int argc, char** argv)
+{
+	int flags = 0, first = 1;
+	if (argc > 1 && strcmp(argv[1], "-bc") == 0) {
+		flags |= COOK_BC;
+		first++;
+	}
+	if (argc - first < 1) {
+		fprintf(stderr, "usage: cook [-bc] out.pak [name=]file ...\n");
+		return 1;
+	}
+
+	const char* szOut = argv[first];
+	int n = argc - first - 1;
+	COOKINPUT* pInputs = (COOKINPUT*)calloc(n > 0 ? n : 1, sizeof(COOKINPUT));
+	char** ppNames = (char**)calloc(n > 0 ? n : 1, sizeof(char*));
+	for (int i = 0; i < n; i++) {
+		const char* szArg = argv[first + 1 + i];
+		const char* szEquals = strchr(szArg, '=');
+		size_t cbName = szEquals ? (size_t)(szEquals - szArg) : strlen(szArg);
+		char* szName = (char*)malloc(cbName + 1);
+		memcpy(szName, szArg, cbName);
+		szName[cbName] = 0;
+		for (char* s = szName; *s; s++) {
+			*s = *s == '\\' ? '/' : *s;
+		}
+		while (szName[0] == '.' && szName[1] == '/') {
+			memmove(szName, szName + 2, strlen(szName + 2) + 1);
+		}
+		ppNames[i] = szName;
+		pInputs[i].szName = szName;
+		pInputs[i].szPath = szEquals ? szEquals + 1 : szArg;
+	}
+
+	InitBmpDecoder();
+	InitMipKernels();
+	InitBcEncoder();
+
+	char szError[512];
+	double t0 = PaceNow();
+	int bOk = CookPack(szOut, pInputs, n, flags, szError, sizeof(szError));
+	double t = PaceNow() - t0;
+	if (!bOk) {
+		fprintf(stderr, "cook: %s\n", szError);
+	} else {
+		PACK pack;
+		if (OpenPack(&pack, szOut)) {
+			for (int i = 0; i < n; i++) {
+				const PACKENTRY* e = FindPack(&pack, pInputs[i].szName);
+				printf("%-32s %-8s %10llu bytes at %llu\n", pInputs[i].szName, g_szTypes[e->type < 3 ? e->type : 0],
+					   (unsigned long long)e->size, (unsigned long long)e->offset);
+			}
+			printf("%s: %d entries, %llu bytes, %.1f ms\n", szOut, n, (unsigned long long)pack.pHeader->cbFile, t * 1e3);
+			ClosePack(&pack);
+		} else {
+			fprintf(stderr, "cook: %s doesn't open\n", szOut);
+			bOk = 0;
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		free(ppNames[i]);
+	}
+	free(ppNames);
+	free(pInputs);
+	return bOk ? 0 : 1;
+}
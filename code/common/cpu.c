@@ -0,0 +1,99 @@
+/*
+	CPU features for picking SIMD kernels at runtime (no windows.h needed)
+	Notes:
+		- CPU_X86 is defined when x86 intrinsics are available, TARGET_xxx go
+		  in front of a function that uses a wider instruction set than the
+		  build (gcc/clang need them, msvc compiles any intrinsic anyway)
+		- GetCpuFeatures() asks cpuid, and xgetbv for AVX: the cpu having it is
+		  not enough, the OS must also save the ymm/zmm registers
+		- call it once at startup and keep the bits, it is not free
+*/
+
+#ifndef CPU_C
+#define CPU_C
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#include <cpuid.h>
+#define TARGET_SSSE3  __attribute__((target("ssse3")))
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+/*
+	cpu feature bits we care about
+*/
+#define CPU_SSE2    0x1
+#define CPU_AVX2    0x2
+#define CPU_AVX512  0x4
+#define CPU_SSSE3   0x8
+
+static void CpuId(int leaf, int sub, unsigned int regs[4])
+{
+#if defined(CPU_X86) && defined(_MSC_VER)
+	__cpuidex((int*)regs, leaf, sub);
+#elif defined(CPU_X86)
+	__cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#else
+	regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+static unsigned long long XGetBv(void)
+{
+#if defined(CPU_X86) && defined(_MSC_VER)
+	return _xgetbv(0);
+#elif defined(CPU_X86)
+	unsigned int lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#else
+	return 0;
+#endif
+}
+
+static unsigned int GetCpuFeatures(void)
+{
+	unsigned int regs[4];
+	unsigned int features = 0;
+
+	CpuId(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+	if (maxLeaf < 1) {
+		return 0;
+	}
+
+	CpuId(1, 0, regs);
+	if (regs[3] & (1u << 26)) {
+		features |= CPU_SSE2;
+	}
+	if (regs[2] & (1u << 9)) {
+		features |= CPU_SSSE3;
+	}
+
+	// AVX needs the OS to save the ymm/zmm registers too (OSXSAVE + XCR0)
+	if (!(regs[2] & (1u << 27)) || maxLeaf < 7) {
+		return features;
+	}
+	unsigned long long xcr0 = XGetBv();
+
+	CpuId(7, 0, regs);
+	if ((regs[1] & (1u << 5)) && (xcr0 & 0x6) == 0x6) {
+		features |= CPU_AVX2;
+	}
+	if ((regs[1] & (1u << 16)) && (xcr0 & 0xE6) == 0xE6) {
+		features |= CPU_AVX512;
+	}
+
+	return features;
+}
+
+#endif // CPU_C
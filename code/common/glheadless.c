@@ -0,0 +1,125 @@
+/*
+	A GL context with no window on screen, for the GL benches
+	Notes:
+		- linux: EGL with Mesa's surfaceless platform, a 3.3 core context
+		  and no surface at all; with LIBGL_ALWAYS_SOFTWARE=1 (or no gpu)
+		  that is llvmpipe, so it runs on a build box
+		- windows: a hidden window and a plain wglCreateContext (what cube
+		  does), the entry points from ../OpenGLworks/cube/glextloader.c;
+		  build with /I..\OpenGLworks\include for GL/glext.h
+		- nothing is drawn to a default framebuffer: render into an FBO,
+		  read it back with glReadPixels
+		- after this include every GL entry point up to 4.x is there by its
+		  gl* name (linux: GL_GLEXT_PROTOTYPES, link with -lEGL -lOpenGL)
+*/
+
+#ifndef GLHEADLESS_C
+#define GLHEADLESS_C
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "../OpenGLworks/cube/glextloader.c"
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+typedef struct {
+#ifdef _WIN32
+	HWND  hWnd;
+	HDC   hDC;
+	HGLRC hRC;
+#else
+	EGLDisplay display;
+	EGLContext context;
+#endif
+} HEADLESSGL;
+
+static void DestroyHeadlessGL(HEADLESSGL* pGL)
+{
+#ifdef _WIN32
+	if (pGL->hRC) {
+		wglMakeCurrent(NULL, NULL);
+		wglDeleteContext(pGL->hRC);
+	}
+	if (pGL->hWnd) {
+		ReleaseDC(pGL->hWnd, pGL->hDC);
+		DestroyWindow(pGL->hWnd);
+	}
+#else
+	if (pGL->display != EGL_NO_DISPLAY) {
+		eglMakeCurrent(pGL->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (pGL->context != EGL_NO_CONTEXT) {
+			eglDestroyContext(pGL->display, pGL->context);
+		}
+		eglTerminate(pGL->display);
+	}
+#endif
+	memset(pGL, 0, sizeof(*pGL));
+}
+
+// 0 (and a message on stderr) if there is no GL here; the context is current on return
+static int CreateHeadlessGL(HEADLESSGL* pGL)
+{
+	memset(pGL, 0, sizeof(*pGL));
+#ifdef _WIN32
+	WNDCLASSA wc = { 0 };
+	wc.lpfnWndProc = DefWindowProcA;
+	wc.hInstance = GetModuleHandleA(NULL);
+	wc.lpszClassName = "HeadlessGL";
+	RegisterClassA(&wc);
+	pGL->hWnd = CreateWindowA("HeadlessGL", "", WS_OVERLAPPEDWINDOW, 0, 0, 64, 64, NULL, NULL, wc.hInstance, NULL);
+	pGL->hDC = pGL->hWnd ? GetDC(pGL->hWnd) : NULL;
+
+	PIXELFORMATDESCRIPTOR pfd = { 0 };
+	pfd.nSize = sizeof(pfd);
+	pfd.nVersion = 1;
+	pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+	pfd.iPixelType = PFD_TYPE_RGBA;
+	pfd.cColorBits = 32;
+	int format = pGL->hDC ? ChoosePixelFormat(pGL->hDC, &pfd) : 0;
+	if (format && SetPixelFormat(pGL->hDC, format, &pfd)) {
+		pGL->hRC = wglCreateContext(pGL->hDC);
+	}
+	if (!pGL->hRC || !wglMakeCurrent(pGL->hDC, pGL->hRC)) {
+		fprintf(stderr, "no GL context\n");
+		DestroyHeadlessGL(pGL);
+		return 0;
+	}
+	load_gl_extensions();
+	return 1;
+#else
+	static const EGLint attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	pGL->display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	pGL->context = EGL_NO_CONTEXT;
+	if (pGL->display == EGL_NO_DISPLAY || !eglInitialize(pGL->display, NULL, NULL)) {
+		fprintf(stderr, "no EGL display (0x%x)\n", eglGetError());
+		pGL->display = EGL_NO_DISPLAY;
+		return 0;
+	}
+	if (eglBindAPI(EGL_OPENGL_API)) {
+		pGL->context = eglCreateContext(pGL->display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+	}
+	if (pGL->context == EGL_NO_CONTEXT || !eglMakeCurrent(pGL->display, EGL_NO_SURFACE, EGL_NO_SURFACE, pGL->context)) {
+		fprintf(stderr, "no GL 3.3 core context (0x%x)\n", eglGetError());
+		DestroyHeadlessGL(pGL);
+		return 0;
+	}
+	return 1;
+#endif
+}
+
+#endif // GLHEADLESS_C
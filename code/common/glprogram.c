@@ -0,0 +1,308 @@
+/*
+	Shader programs from source, reflection and uniform buffers
+	Notes:
+		- BuildProgram compiles each SHADERSOURCE and links them, reading
+		  every compile and link log: a log that says anything (errors,
+		  or warnings on a success) goes to stderr under the shader's
+		  name, and into the caller's buffer. 0 when a stage or the link
+		  fails
+		- ReflectProgram, once after the link: every active uniform (name,
+		  type, location, and block / offset for the ones in a block) and
+		  every uniform block (name, size) into a PROGRAMINFO. Nothing asks
+		  GL by name after that: GetProgramUniform is a scan of the copy,
+		  done at init, the location goes in a static
+		- block members have no location (-1), they live in a buffer: a
+		  std140 block has the same layout on every driver, so a C struct
+		  can mirror it (mat4 and vec4 as they are, a vec3 padded to 16)
+		  and CheckProgramBlock compares the struct's offsetof / sizeof
+		  with what the driver says, once
+		- BindProgramBlock points a block at a binding point, CreateUniform
+		  Buffer puts a buffer on one; UpdateUniformBuffer is a bind and
+		  one glBufferSubData of the whole struct, whatever changed
+		- a uniform array is reflected as its first element, "lights[0]"
+		  is found as "lights"
+		- include after GL/gl.h, GL/glext.h and the function loader (the
+		  app's glextloader.c, or glheadless.c)
+*/
+
+#ifndef GLPROGRAM_C
+#define GLPROGRAM_C
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGRAM_MAX_UNIFORMS 32
+#define PROGRAM_MAX_BLOCKS   8
+#define PROGRAM_MAX_NAME     64
+#define PROGRAM_MAX_SOURCES  4
+
+// BuildProgram flags
+#define PROGRAM_RETRIEVABLE  1 // glGetProgramBinary will be asked for it (progcache.c)
+
+typedef struct {
+	GLenum        type;    // GL_VERTEX_SHADER, ...
+	const char*   szName;  // for the log, "cube.vert"
+	const GLchar* pText;
+	GLint         cbText;  // no nul needed
+} SHADERSOURCE;
+
+typedef struct {
+	char   szName[PROGRAM_MAX_NAME];
+	GLint  location;  // -1 in a block
+	GLenum type;      // GL_FLOAT_MAT4, GL_SAMPLER_2D, ...
+	GLint  size;      // array length, 1 for a plain one
+	GLint  block;     // index in PROGRAMINFO blocks, -1 outside one
+	GLint  offset;    // bytes into the block, -1 outside one
+} PROGRAMUNIFORM;
+
+typedef struct {
+	char   szName[PROGRAM_MAX_NAME];
+	GLuint index;     // the program's block index
+	GLint  cbSize;    // GL_UNIFORM_BLOCK_DATA_SIZE
+} PROGRAMBLOCK;
+
+typedef struct {
+	GLuint         program;
+	int            nUniforms;
+	int            nBlocks;
+	PROGRAMUNIFORM uniforms[PROGRAM_MAX_UNIFORMS];
+	PROGRAMBLOCK   blocks[PROGRAM_MAX_BLOCKS];
+} PROGRAMINFO;
+
+typedef struct {
+	GLuint     buffer;
+	GLuint     binding;
+	GLsizeiptr cbSize;
+} UNIFORMBUFFER;
+
+// the info log of a shader (bProgram 0) or a program, if it says something: to stderr and, when
+// szLog isn't NULL, appended to it
+static void ReportGLLog(GLuint object, int bProgram, const char* szWhat, char* szLog, size_t cbLog)
+{
+	char szText[2048];
+	GLint cb = 0;
+
+	szText[0] = 0;
+	if (bProgram) {
+		glGetProgramInfoLog(object, sizeof(szText), &cb, szText);
+	} else {
+		glGetShaderInfoLog(object, sizeof(szText), &cb, szText);
+	}
+	while (cb > 0 && (szText[cb - 1] == '\n' || szText[cb - 1] == ' ')) {
+		szText[--cb] = 0;
+	}
+	if (cb <= 0) {
+		return;
+	}
+	fprintf(stderr, "%s:\n%s\n", szWhat, szText);
+	if (szLog) {
+		size_t n = strlen(szLog);
+		snprintf(szLog + n, cbLog - n, "%s:\n%s\n", szWhat, szText);
+	}
+}
+
+// a linked program, 0 (and the logs) if a stage doesn't compile or the link fails. szLog can be NULL
+static GLuint BuildProgram(const SHADERSOURCE* pSources, int nSources, int flags, char* szLog, size_t cbLog)
+{
+	GLuint shaders[PROGRAM_MAX_SOURCES];
+	GLint bOk = 1;
+	char szWhat[PROGRAM_MAX_SOURCES * (PROGRAM_MAX_NAME + 3) + 32];
+
+	if (szLog && cbLog) {
+		szLog[0] = 0;
+	}
+	if (nSources < 1 || nSources > PROGRAM_MAX_SOURCES) {
+		return 0;
+	}
+	for (int i = 0; i < nSources; i++) {
+		GLint bCompiled = 0;
+		shaders[i] = glCreateShader(pSources[i].type);
+		glShaderSource(shaders[i], 1, &pSources[i].pText, &pSources[i].cbText);
+		glCompileShader(shaders[i]);
+		glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &bCompiled);
+		snprintf(szWhat, sizeof(szWhat), "%.*s %s", PROGRAM_MAX_NAME, pSources[i].szName, bCompiled ? "compiled, with warnings" : "doesn't compile");
+		ReportGLLog(shaders[i], 0, szWhat, szLog, cbLog);
+		bOk = bOk && bCompiled;
+	}
+
+	GLuint program = 0;
+	if (bOk) {
+		program = glCreateProgram();
+		if (flags & PROGRAM_RETRIEVABLE) {
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		for (int i = 0; i < nSources; i++) {
+			glAttachShader(program, shaders[i]);
+		}
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &bOk);
+		char szNames[PROGRAM_MAX_SOURCES * (PROGRAM_MAX_NAME + 3)] = "";
+		for (int i = 0; i < nSources; i++) {
+			size_t n = strlen(szNames);
+			snprintf(szNames + n, sizeof(szNames) - n, "%s%.*s", i ? " + " : "", PROGRAM_MAX_NAME, pSources[i].szName);
+		}
+		snprintf(szWhat, sizeof(szWhat), "%s %s", szNames, bOk ? "linked, with warnings" : "don't link");
+		ReportGLLog(program, 1, szWhat, szLog, cbLog);
+		for (int i = 0; i < nSources; i++) {
+			glDetachShader(program, shaders[i]);
+		}
+		if (!bOk) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	for (int i = 0; i < nSources; i++) {
+		glDeleteShader(shaders[i]);
+	}
+	return program;
+}
+
+// "name[0]" -> "name"
+static void TrimArrayName(char* szName)
+{
+	size_t n = strlen(szName);
+	if (n > 3 && strcmp(szName + n - 3, "[0]") == 0) {
+		szName[n - 3] = 0;
+	}
+}
+
+// the program must be linked; returns the number of uniforms (past PROGRAM_MAX_UNIFORMS are dropped, with a message)
+static int ReflectProgram(PROGRAMINFO* pInfo, GLuint program)
+{
+	GLint nUniforms = 0, nBlocks = 0;
+
+	memset(pInfo, 0, sizeof(*pInfo));
+	pInfo->program = program;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &nUniforms);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &nBlocks);
+	if (nUniforms > PROGRAM_MAX_UNIFORMS || nBlocks > PROGRAM_MAX_BLOCKS) {
+		fprintf(stderr, "ReflectProgram: %d uniforms, %d blocks, only %d and %d kept\n", nUniforms, nBlocks,
+				PROGRAM_MAX_UNIFORMS, PROGRAM_MAX_BLOCKS);
+		nUniforms = nUniforms < PROGRAM_MAX_UNIFORMS ? nUniforms : PROGRAM_MAX_UNIFORMS;
+		nBlocks = nBlocks < PROGRAM_MAX_BLOCKS ? nBlocks : PROGRAM_MAX_BLOCKS;
+	}
+
+	for (GLint i = 0; i < nBlocks; i++) {
+		PROGRAMBLOCK* b = &pInfo->blocks[i];
+		b->index = (GLuint)i;
+		glGetActiveUniformBlockName(program, (GLuint)i, PROGRAM_MAX_NAME, NULL, b->szName);
+		glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &b->cbSize);
+	}
+	pInfo->nBlocks = nBlocks;
+
+	for (GLint i = 0; i < nUniforms; i++) {
+		PROGRAMUNIFORM* u = &pInfo->uniforms[i];
+		GLuint index = (GLuint)i;
+		glGetActiveUniform(program, index, PROGRAM_MAX_NAME, NULL, &u->size, &u->type, u->szName);
+		glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &u->block);
+		glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &u->offset);
+		u->location = u->block < 0 ? glGetUniformLocation(program, u->szName) : -1;
+		if (u->block >= nBlocks) {
+			u->block = -1; // one of the dropped blocks
+		}
+		TrimArrayName(u->szName);
+	}
+	pInfo->nUniforms = nUniforms;
+	return nUniforms;
+}
+
+static const PROGRAMUNIFORM* FindProgramUniform(const PROGRAMINFO* pInfo, const char* szName)
+{
+	for (int i = 0; i < pInfo->nUniforms; i++) {
+		if (strcmp(pInfo->uniforms[i].szName, szName) == 0) {
+			return &pInfo->uniforms[i];
+		}
+	}
+	return NULL;
+}
+
+// the location, -1 if it isn't active (or is in a block); glUniform* ignores -1
+static GLint GetProgramUniform(const PROGRAMINFO* pInfo, const char* szName)
+{
+	const PROGRAMUNIFORM* u = FindProgramUniform(pInfo, szName);
+	return u ? u->location : -1;
+}
+
+static const PROGRAMBLOCK* FindProgramBlock(const PROGRAMINFO* pInfo, const char* szName)
+{
+	for (int i = 0; i < pInfo->nBlocks; i++) {
+		if (strcmp(pInfo->blocks[i].szName, szName) == 0) {
+			return &pInfo->blocks[i];
+		}
+	}
+	return NULL;
+}
+
+// the block reads the buffer at binding; returns its size, 0 if the program has no such block
+static GLint BindProgramBlock(const PROGRAMINFO* pInfo, const char* szName, GLuint binding)
+{
+	const PROGRAMBLOCK* b = FindProgramBlock(pInfo, szName);
+	if (!b) {
+		return 0;
+	}
+	glUniformBlockBinding(pInfo->program, b->index, binding);
+	return b->cbSize;
+}
+
+// the C struct mirroring a block: 1 if its size and every member's offset match (pszMembers and
+// pOffsets: nMembers of them, offsetof in the struct); a message for each that doesn't
+static int CheckProgramBlock(const PROGRAMINFO* pInfo, const char* szBlock, size_t cbStruct,
+							 const char* const* pszMembers, const size_t* pOffsets, int nMembers)
+{
+	const PROGRAMBLOCK* b = FindProgramBlock(pInfo, szBlock);
+	int bOk = 1;
+
+	if (!b) {
+		fprintf(stderr, "no uniform block %s\n", szBlock);
+		return 0;
+	}
+	if ((size_t)b->cbSize != cbStruct) {
+		fprintf(stderr, "uniform block %s: %d bytes, the struct has %d\n", szBlock, b->cbSize, (int)cbStruct);
+		bOk = 0;
+	}
+	for (int i = 0; i < nMembers; i++) {
+		const PROGRAMUNIFORM* u = FindProgramUniform(pInfo, pszMembers[i]);
+		// an unused member can be optimized out, nothing to check then
+		if (u && (u->block != (GLint)(b - pInfo->blocks) || (size_t)u->offset != pOffsets[i])) {
+			fprintf(stderr, "uniform block %s: %s at %d, the struct has it at %d\n", szBlock, pszMembers[i], u->offset,
+					(int)pOffsets[i]);
+			bOk = 0;
+		}
+	}
+	return bOk;
+}
+
+// leaves the buffer bound to GL_UNIFORM_BUFFER
+static int CreateUniformBuffer(UNIFORMBUFFER* pBuffer, GLuint binding, GLsizeiptr cbSize)
+{
+	memset(pBuffer, 0, sizeof(*pBuffer));
+	glGenBuffers(1, &pBuffer->buffer);
+	if (!pBuffer->buffer) {
+		return 0;
+	}
+	pBuffer->binding = binding;
+	pBuffer->cbSize = cbSize;
+	glBindBuffer(GL_UNIFORM_BUFFER, pBuffer->buffer);
+	glBufferData(GL_UNIFORM_BUFFER, cbSize, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, pBuffer->buffer);
+	return 1;
+}
+
+// the whole struct in one call: a few hundred bytes, the driver copies them into its command
+// stream, the draw that used the old contents isn't waited for
+static void UpdateUniformBuffer(const UNIFORMBUFFER* pBuffer, const void* pData)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, pBuffer->buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, pBuffer->cbSize, pData);
+}
+
+static void DestroyUniformBuffer(UNIFORMBUFFER* pBuffer)
+{
+	if (pBuffer->buffer) {
+		glDeleteBuffers(1, &pBuffer->buffer);
+	}
+	memset(pBuffer, 0, sizeof(*pBuffer));
+}
+
+#endif // GLPROGRAM_C
@@ -0,0 +1,340 @@
+/*
+	Test/benchmark for glprogram.c on a headless context (glheadless.c)
+	Notes:
+		- the program is cube's own: ../OpenGLworks/cube/cube.vert and
+		  cube.frag, run from this directory. The old cube.vert (three
+		  loose mat4 uniforms) is kept here to compare against
+		- reflection: the Frame block is 192 bytes with projection, view,
+		  model at 0, 64, 128 (FRAMEUNIFORMS, as in cube.c), texture1 is a
+		  sampler with a location; a struct that doesn't match is caught;
+		  the old program's three locations are glGetUniformLocation's; an
+		  array is found by its bare name
+		- the frame as Display did it (3 glGetUniformLocation + 3
+		  glUniformMatrix4fv) and with the uniform buffer, drawn into a
+		  64x64 FBO at a few angles: every pixel must match
+		- GL calls a frame, counted, and the time of the uniform part alone
+		  (a driver's cost, llvmpipe's here, nothing of the draw)
+		- exits with 1 on a mismatch, 2 if there is no GL context
+		- linux: Mesa (LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe on a box with a gpu)
+
+	build:
+		windows: cl /nologo /O2 /I..\OpenGLworks\include glprogrambench.c opengl32.lib user32.lib gdi32.lib
+		linux:   cc -O2 glprogrambench.c -o glprogrambench -lEGL -lOpenGL -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "glheadless.c"
+#include "glprogram.c"
+#include "mapfile.c"
+#include "pacing.c"
+#include "mat4.h"
+
+#define SIDE       64
+#define ITERATIONS 200000
+
+// as in cube.c
+typedef struct {
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+} FRAMEUNIFORMS;
+
+static const char* g_szOldVertex =
+	"#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec2 aTexCoord;\n"
+	"out vec2 TexCoord;\n"
+	"uniform mat4 model;\n"
+	"uniform mat4 view;\n"
+	"uniform mat4 projection;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_Position = projection * view * model * vec4(aPos, 1.0f);\n"
+	"	TexCoord = vec2(aTexCoord.x, aTexCoord.y);\n"
+	"}\n";
+
+static const char* g_szArrayFragment =
+	"#version 330 core\n"
+	"out vec4 FragColor;\n"
+	"uniform vec4 colors[3];\n"
+	"void main()\n"
+	"{\n"
+	"	FragColor = colors[0] + colors[2];\n"
+	"}\n";
+
+// a quad, z = 0, as cube's vertices: position then uv
+static const float g_Quad[6 * 5] = {
+	-1.0f, -1.0f, 0.0f,  0.0f, 0.0f,
+	 1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
+	 1.0f,  1.0f, 0.0f,  1.0f, 1.0f,
+	 1.0f,  1.0f, 0.0f,  1.0f, 1.0f,
+	-1.0f,  1.0f, 0.0f,  0.0f, 1.0f,
+	-1.0f, -1.0f, 0.0f,  0.0f, 0.0f,
+};
+
+static int g_nErrors;
+static int g_nCalls;
+static GLuint g_Vao, g_Texture;
+
+// one GL call of a frame
+#define COUNTED(call) (g_nCalls++, call)
+
+static void Check(int bOk, const char* szWhat)
+{
+	if (!bOk) {
+		printf("FAILED: %s\n", szWhat);
+		g_nErrors++;
+	}
+}
+
+static GLuint CompileShader(GLenum type, const char* szSource, GLint length)
+{
+	GLuint shader = glCreateShader(type);
+	GLint bOk = 0;
+	glShaderSource(shader, 1, &szSource, length ? &length : NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &bOk);
+	if (!bOk) {
+		char szLog[1024];
+		glGetShaderInfoLog(shader, sizeof(szLog), NULL, szLog);
+		printf("compile: %s\n", szLog);
+	}
+	return shader;
+}
+
+static GLuint LinkProgram(const char* szVertex, GLint cbVertex, const char* szFragment, GLint cbFragment)
+{
+	GLuint vertex = CompileShader(GL_VERTEX_SHADER, szVertex, cbVertex);
+	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, szFragment, cbFragment);
+	GLuint program = glCreateProgram();
+	GLint bOk = 0;
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &bOk);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	if (!bOk) {
+		char szLog[1024];
+		glGetProgramInfoLog(program, sizeof(szLog), NULL, szLog);
+		printf("link: %s\n", szLog);
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+static void SetFrame(FRAMEUNIFORMS* pFrame, float angle)
+{
+	static const mat4 view = MAT4_TRANSLATE_INIT(0.0f, 0.0f, -3.0f);
+	mat4_perspective(pFrame->projection, 3.1415926f / 4.0f, 1.0f, 0.1f, 100.0f);
+	memcpy(pFrame->view, view, sizeof(mat4));
+	mat4_rotate(pFrame->model, angle, 1.0f, 1.0f, 0.0f);
+}
+
+// Display before: the locations asked by name, a call a matrix
+static void OldUniforms(GLuint program, const FRAMEUNIFORMS* pFrame)
+{
+	GLint modelLoc = COUNTED(glGetUniformLocation(program, "model"));
+	GLint viewLoc = COUNTED(glGetUniformLocation(program, "view"));
+	COUNTED(glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &pFrame->model[0][0]));
+	COUNTED(glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &pFrame->view[0][0]));
+	GLint loc = COUNTED(glGetUniformLocation(program, "projection"));
+	COUNTED(glUniformMatrix4fv(loc, 1, GL_FALSE, &pFrame->projection[0][0]));
+}
+
+static void NewUniforms(const UNIFORMBUFFER* pBuffer, const FRAMEUNIFORMS* pFrame)
+{
+	g_nCalls += 2; // bind, sub-data
+	UpdateUniformBuffer(pBuffer, pFrame);
+}
+
+// Display's GL calls, with one of the two uniform paths
+static void DrawFrame(GLuint program, const UNIFORMBUFFER* pBuffer, const FRAMEUNIFORMS* pFrame)
+{
+	COUNTED(glViewport(0, 0, SIDE, SIDE));
+	COUNTED(glClearColor(0.2f, 0.3f, 0.3f, 1.0f));
+	COUNTED(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+	COUNTED(glBindTexture(GL_TEXTURE_2D, g_Texture));
+	COUNTED(glUseProgram(program));
+	if (pBuffer) {
+		NewUniforms(pBuffer, pFrame);
+	} else {
+		OldUniforms(program, pFrame);
+	}
+	COUNTED(glBindVertexArray(g_Vao));
+	COUNTED(glDrawArrays(GL_TRIANGLES, 0, 6));
+}
+
+static void CreateScene(void)
+{
+	GLuint vbo;
+	glGenVertexArrays(1, &g_Vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(g_Vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(g_Quad), g_Quad, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	unsigned char checker[8 * 8 * 4];
+	for (int i = 0; i < 8 * 8; i++) {
+		unsigned char c = ((i ^ (i >> 3)) & 1) ? 230 : 40;
+		checker[i * 4 + 0] = c;
+		checker[i * 4 + 1] = (unsigned char)(c / 2 + i);
+		checker[i * 4 + 2] = (unsigned char)(255 - c);
+		checker[i * 4 + 3] = 255;
+	}
+	glGenTextures(1, &g_Texture);
+	glBindTexture(GL_TEXTURE_2D, g_Texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 8, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	GLuint fbo, color;
+	glGenTextures(1, &color);
+	glBindTexture(GL_TEXTURE_2D, color);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SIDE, SIDE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+	Check(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "framebuffer");
+}
+
+int main(void)
+{
+	HEADLESSGL gl;
+	if (!CreateHeadlessGL(&gl)) {
+		return 2;
+	}
+	printf("%s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+	MAPPEDFILE vertexFile, fragmentFile;
+	if (!MapFile("../OpenGLworks/cube/cube.vert", &vertexFile) || !MapFile("../OpenGLworks/cube/cube.frag", &fragmentFile)) {
+		printf("run from code/common: no ../OpenGLworks/cube/cube.vert, cube.frag\n");
+		return 1;
+	}
+	GLuint program = LinkProgram((const char*)vertexFile.pData, (GLint)vertexFile.cbSize, (const char*)fragmentFile.pData,
+								 (GLint)fragmentFile.cbSize);
+	GLuint oldProgram = LinkProgram(g_szOldVertex, 0, (const char*)fragmentFile.pData, (GLint)fragmentFile.cbSize);
+	GLuint arrayProgram = LinkProgram(g_szOldVertex, 0, g_szArrayFragment, 0);
+	UnmapFile(&vertexFile);
+	UnmapFile(&fragmentFile);
+	if (!program || !oldProgram || !arrayProgram) {
+		printf("FAILED: the programs don't link\n");
+		return 1;
+	}
+
+	/*
+		reflection
+	*/
+	PROGRAMINFO info, oldInfo, arrayInfo;
+	static const char* const members[3] = { "projection", "view", "model" };
+	static const size_t offsets[3] = { offsetof(FRAMEUNIFORMS, projection), offsetof(FRAMEUNIFORMS, view),
+									   offsetof(FRAMEUNIFORMS, model) };
+	static const size_t badOffsets[3] = { 0, 64, 144 };
+
+	ReflectProgram(&info, program);
+	const PROGRAMBLOCK* frameBlock = FindProgramBlock(&info, "Frame");
+	const PROGRAMUNIFORM* sampler = FindProgramUniform(&info, "texture1");
+	Check(info.nBlocks == 1 && frameBlock && frameBlock->cbSize == 192, "the Frame block, 192 bytes");
+	Check(info.nUniforms == 4, "4 uniforms");
+	Check(CheckProgramBlock(&info, "Frame", sizeof(FRAMEUNIFORMS), members, offsets, 3), "FRAMEUNIFORMS matches Frame");
+	printf("(two mismatches expected:)\n");
+	fflush(stdout);
+	Check(!CheckProgramBlock(&info, "Frame", 208, members, badOffsets, 3), "a wrong struct is caught");
+	Check(sampler && sampler->type == GL_SAMPLER_2D && sampler->location >= 0 && sampler->block == -1, "texture1");
+	Check(GetProgramUniform(&info, "model") == -1, "a block member has no location");
+	Check(GetProgramUniform(&info, "nothing") == -1 && !FindProgramBlock(&info, "nothing"), "not there");
+
+	ReflectProgram(&oldInfo, oldProgram);
+	Check(oldInfo.nBlocks == 0 && oldInfo.nUniforms == 4, "old program: 4 uniforms, no block");
+	for (int i = 0; i < 3; i++) {
+		const PROGRAMUNIFORM* u = FindProgramUniform(&oldInfo, members[i]);
+		Check(u && u->type == GL_FLOAT_MAT4 && u->block == -1 && u->offset == -1 &&
+			  u->location == glGetUniformLocation(oldProgram, members[i]), "old program locations");
+	}
+
+	ReflectProgram(&arrayInfo, arrayProgram);
+	const PROGRAMUNIFORM* colors = FindProgramUniform(&arrayInfo, "colors");
+	Check(colors && colors->size == 3 && colors->type == GL_FLOAT_VEC4 && colors->location >= 0, "an array by its name");
+
+	/*
+		the same pixels both ways
+	*/
+	UNIFORMBUFFER buffer;
+	CreateScene();
+	Check(BindProgramBlock(&info, "Frame", 0) == 192, "BindProgramBlock");
+	Check(CreateUniformBuffer(&buffer, 0, sizeof(FRAMEUNIFORMS)), "CreateUniformBuffer");
+	glUseProgram(program);
+	glUniform1i(GetProgramUniform(&info, "texture1"), 0);
+
+	static unsigned char oldPixels[SIDE * SIDE * 4], newPixels[SIDE * SIDE * 4];
+	int nOldCalls = 0, nNewCalls = 0, nDrawn = 0, nDiffer = 0;
+	for (int a = 0; a < 8; a++) {
+		FRAMEUNIFORMS frame;
+		SetFrame(&frame, 0.1f + a * 0.7f);
+
+		g_nCalls = 0;
+		DrawFrame(oldProgram, NULL, &frame);
+		nOldCalls = g_nCalls;
+		glReadPixels(0, 0, SIDE, SIDE, GL_RGBA, GL_UNSIGNED_BYTE, oldPixels);
+
+		g_nCalls = 0;
+		DrawFrame(program, &buffer, &frame);
+		nNewCalls = g_nCalls;
+		glReadPixels(0, 0, SIDE, SIDE, GL_RGBA, GL_UNSIGNED_BYTE, newPixels);
+
+		for (int i = 0; i < SIDE * SIDE; i++) {
+			nDrawn += oldPixels[i * 4] != 51; // not the clear colour
+		}
+		nDiffer += memcmp(oldPixels, newPixels, sizeof(oldPixels)) != 0;
+	}
+	Check(nDrawn > 8 * SIDE * SIDE / 8, "the quad covers the frame");
+	Check(nDiffer == 0, "the same pixels with the uniform buffer");
+	Check(glGetError() == GL_NO_ERROR, "no GL errors");
+	printf("%d of 8 angles the same, %d pixels drawn\n", 8 - nDiffer, nDrawn);
+	printf("GL calls a frame: glGetUniformLocation + glUniformMatrix4fv %d (6 of them uniforms), uniform buffer %d (2)\n",
+		   nOldCalls, nNewCalls);
+
+	/*
+		the uniform part alone
+	*/
+	FRAMEUNIFORMS frame;
+	SetFrame(&frame, 0.5f);
+	glUseProgram(oldProgram);
+	glFinish();
+	double t0 = PaceNow();
+	for (int i = 0; i < ITERATIONS; i++) {
+		frame.model[3][0] = (float)(i & 1) * 1e-6f;
+		OldUniforms(oldProgram, &frame);
+	}
+	glFinish();
+	double tOld = PaceNow() - t0;
+
+	glUseProgram(program);
+	t0 = PaceNow();
+	for (int i = 0; i < ITERATIONS; i++) {
+		frame.model[3][0] = (float)(i & 1) * 1e-6f;
+		NewUniforms(&buffer, &frame);
+	}
+	glFinish();
+	double tNew = PaceNow() - t0;
+	printf("uniforms a frame: by name %7.1f ns, uniform buffer %7.1f ns\n", tOld * 1e9 / ITERATIONS, tNew * 1e9 / ITERATIONS);
+
+	DestroyUniformBuffer(&buffer);
+	glDeleteProgram(program);
+	glDeleteProgram(oldProgram);
+	glDeleteProgram(arrayProgram);
+	DestroyHeadlessGL(&gl);
+
+	if (g_nErrors) {
+		printf("%d FAILED\n", g_nErrors);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
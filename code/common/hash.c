@@ -0,0 +1,64 @@
+/*
+	64 bit hashes for cache keys (not cryptographic)
+	Notes:
+		- HashBytes: 8 bytes per step, multiply + rotate, murmur3's fmix64
+		  at the end so every input bit reaches every output bit; several
+		  GB/s, a texture file costs far less than decoding it
+		- the seed lets the same bytes give unrelated keys in different
+		  tables (or chain: HashBytes(b, n, HashBytes(a, m, 0)))
+		- HashString for nul terminated keys (paths)
+		- unaligned input is fine (memcpy loads), same result on any
+		  little endian machine, so a hash can be stored on disk
+*/
+
+#ifndef HASH_C
+#define HASH_C
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_PRIME1 0x9E3779B185EBCA87ull
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4Full
+
+static uint64_t HashMix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t HashBytes(const void* pData, size_t cb, uint64_t seed)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	uint64_t h = seed ^ (cb * HASH_PRIME1);
+	size_t i = 0;
+
+	for (; i + 8 <= cb; i += 8) {
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		w *= HASH_PRIME2;
+		w = (w << 31) | (w >> 33);
+		h ^= w * HASH_PRIME1;
+		h = ((h << 27) | (h >> 37)) * HASH_PRIME1 + 0x52DCE729;
+	}
+
+	// last 1..7 bytes
+	uint64_t tail = 0;
+	for (size_t k = 0; i + k < cb; k++) {
+		tail |= (uint64_t)p[i + k] << (8 * k);
+	}
+	h ^= tail * HASH_PRIME2;
+
+	return HashMix64(h);
+}
+
+static uint64_t HashString(const char* sz, uint64_t seed)
+{
+	return HashBytes(sz, strlen(sz), seed);
+}
+
+#endif // HASH_C
@@ -0,0 +1,119 @@
+/*
+	Read-only file mapping, windows and posix
+	Notes:
+		- the file's bytes show up at pData without a read into a buffer:
+		  pages come in from the page cache on first touch, nothing is
+		  copied for data that is used where it lies
+		- read only and private, the file can't change under the mapping on
+		  windows (the handle keeps it open), on posix don't truncate a file
+		  that is mapped (SIGBUS)
+		- an empty file maps to pData = NULL, cbSize = 0 and still succeeds
+*/
+
+#ifndef MAPFILE_C
+#define MAPFILE_C
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+	const uint8_t* pData;
+	size_t         cbSize;
+#ifdef _WIN32
+	HANDLE         hFile;
+	HANDLE         hMapping;
+#endif
+} MAPPEDFILE;
+
+static void UnmapFile(MAPPEDFILE* pFile);
+
+// returns 0 if the file can't be opened or mapped
+static int MapFile(const char* szPath, MAPPEDFILE* pFile)
+{
+	pFile->pData = NULL;
+	pFile->cbSize = 0;
+
+#ifdef _WIN32
+	pFile->hMapping = NULL;
+	pFile->hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+							   FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pFile->hFile == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(pFile->hFile, &size) || (unsigned long long)size.QuadPart > (size_t)-1) {
+		UnmapFile(pFile);
+		return 0;
+	}
+	pFile->cbSize = (size_t)size.QuadPart;
+	if (pFile->cbSize == 0) {
+		return 1; // CreateFileMapping refuses empty files
+	}
+
+	pFile->hMapping = CreateFileMappingA(pFile->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (pFile->hMapping) {
+		pFile->pData = (const uint8_t*)MapViewOfFile(pFile->hMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	int fd = open(szPath, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (unsigned long long)st.st_size > (size_t)-1) {
+		close(fd);
+		return 0;
+	}
+	pFile->cbSize = (size_t)st.st_size;
+	if (pFile->cbSize == 0) {
+		close(fd);
+		return 1;
+	}
+
+	void* p = mmap(NULL, pFile->cbSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps its own reference
+	pFile->pData = p == MAP_FAILED ? NULL : (const uint8_t*)p;
+#endif
+
+	if (!pFile->pData) {
+		UnmapFile(pFile);
+		return 0;
+	}
+	return 1;
+}
+
+static void UnmapFile(MAPPEDFILE* pFile)
+{
+#ifdef _WIN32
+	if (pFile->pData) {
+		UnmapViewOfFile(pFile->pData);
+	}
+	if (pFile->hMapping) {
+		CloseHandle(pFile->hMapping);
+	}
+	if (pFile->hFile != INVALID_HANDLE_VALUE && pFile->hFile) {
+		CloseHandle(pFile->hFile);
+	}
+	pFile->hFile = INVALID_HANDLE_VALUE;
+	pFile->hMapping = NULL;
+#else
+	if (pFile->pData) {
+		munmap((void*)pFile->pData, pFile->cbSize);
+	}
+#endif
+	pFile->pData = NULL;
+	pFile->cbSize = 0;
+}
+
+#endif // MAPFILE_C
@@ -0,0 +1,325 @@
+/*
+	mat4: 4x4 float matrices for the GL demos (header only)
+	Notes:
+		- one copy for everybody, it replaces OpenGLworks/cube/matrix.c and
+		  shadersCube/cube/matrix.c; the old functions keep their signatures
+		  and results:
+				mat4_identity, mat4_mul, mat4_translate, mat4_rotate, mat4_perspective
+		- column-major like GL wants it: M[c] is column c, M[3][0..2] is the
+		  translation, so a mat4 goes to glUniformMatrix4fv(.., GL_FALSE, &M[0][0])
+		- mat4_mul(A, B, out) is out[i] = sum_k A[i][k] * B[k] (same as the old
+		  triple loop, which is B*A in math notation), with SSE/NEON it is 4
+		  broadcasts + 4 mul + 3 add per column, the sums in the same order as
+		  the scalar loop (mat4_mul_ref) so the results only differ if the
+		  compiler fuses multiply-adds in one of them
+		- out can alias A or B, the columns of B are loaded before any store
+		- storage is 16 byte aligned where a typedef can say so (gcc/clang),
+		  the SIMD code uses unaligned loads so a mat4 in a struct, on the heap
+		  or with msvc works too (an aligned unaligned-load costs nothing today)
+		- mat4_inverse is the general one (cofactors from 12 2x2
+		  determinants), returns 0 and leaves out alone for a singular matrix
+		  (determinant under 1e-6 * the lengths of the first three columns
+		  and of the bottom row, NaN included: translations and scales don't
+		  count, only the shape)
+		- constant matrices: MAT4_xxx_INIT are initializers, so
+				static const mat4 view = MAT4_TRANSLATE_INIT(0.0f, 0.0f, -5.0f);
+		  is built by the compiler and lives in .rodata, nothing runs for it
+		  (perspective takes f = 1 / tan(fovY / 2) since tanf is not a
+		  constant expression in C)
+		- mat4_trs builds translate * rotate * scale straight into one matrix
+		  (no multiplies); it is inline, so with constant arguments gcc/clang
+		  fold the whole thing, cosf/sinf included, to 16 stores
+*/
+
+#ifndef MAT4_H
+#define MAT4_H
+
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__SSE__)
+#define MAT4_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MAT4_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* 4×4 matrix in column-major order */
+#if defined(__GNUC__) || defined(__clang__)
+typedef float mat4[4][4] __attribute__((aligned(16)));
+#else
+typedef float mat4[4][4];
+#endif
+
+/* Set M to the identity matrix */
+static inline void mat4_identity(mat4 M)
+{
+    memset(M, 0, sizeof(mat4));
+    M[0][0] = M[1][1] = M[2][2] = M[3][3] = 1.0f;
+}
+
+/* Multiply A * B → out, the original triple loop (reference for the tests) */
+static inline void mat4_mul_ref(const mat4 A, const mat4 B, mat4 out)
+{
+    mat4 tmp;
+
+    for (int r = 0; r < 4; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            tmp[r][c] = 0.0f;
+            for (int k = 0; k < 4; ++k)
+            {
+                tmp[r][c] += A[r][k] * B[k][c];
+            }
+        }
+    }
+    memcpy(out, tmp, sizeof(tmp));
+}
+
+/* Multiply A * B → out (can alias) */
+static inline void mat4_mul(const mat4 A, const mat4 B, mat4 out)
+{
+#if defined(MAT4_SSE)
+    __m128 b0 = _mm_loadu_ps(B[0]);
+    __m128 b1 = _mm_loadu_ps(B[1]);
+    __m128 b2 = _mm_loadu_ps(B[2]);
+    __m128 b3 = _mm_loadu_ps(B[3]);
+    __m128 r[4];
+
+    for (int i = 0; i < 4; ++i)
+    {
+        __m128 v = _mm_mul_ps(_mm_set1_ps(A[i][0]), b0);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(A[i][1]), b1));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(A[i][2]), b2));
+        r[i] = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(A[i][3]), b3));
+    }
+    // A's rows were read as scalars above, now it is safe to overwrite
+    for (int i = 0; i < 4; ++i)
+    {
+        _mm_storeu_ps(out[i], r[i]);
+    }
+#elif defined(MAT4_NEON)
+    float32x4_t b0 = vld1q_f32(B[0]);
+    float32x4_t b1 = vld1q_f32(B[1]);
+    float32x4_t b2 = vld1q_f32(B[2]);
+    float32x4_t b3 = vld1q_f32(B[3]);
+    float32x4_t r[4];
+
+    for (int i = 0; i < 4; ++i)
+    {
+        float32x4_t v = vmulq_n_f32(b0, A[i][0]);
+        v = vaddq_f32(v, vmulq_n_f32(b1, A[i][1]));
+        v = vaddq_f32(v, vmulq_n_f32(b2, A[i][2]));
+        r[i] = vaddq_f32(v, vmulq_n_f32(b3, A[i][3]));
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        vst1q_f32(out[i], r[i]);
+    }
+#else
+    mat4_mul_ref(A, B, out);
+#endif
+}
+
+/* Transpose A → out (can alias) */
+static inline void mat4_transpose(const mat4 A, mat4 out)
+{
+#if defined(MAT4_SSE)
+    __m128 c0 = _mm_loadu_ps(A[0]);
+    __m128 c1 = _mm_loadu_ps(A[1]);
+    __m128 c2 = _mm_loadu_ps(A[2]);
+    __m128 c3 = _mm_loadu_ps(A[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(out[0], c0);
+    _mm_storeu_ps(out[1], c1);
+    _mm_storeu_ps(out[2], c2);
+    _mm_storeu_ps(out[3], c3);
+#elif defined(MAT4_NEON)
+    float32x4x4_t m = vld4q_f32(&A[0][0]); // de-interleaves: m.val[i] = row i
+    vst1q_f32(out[0], m.val[0]);
+    vst1q_f32(out[1], m.val[1]);
+    vst1q_f32(out[2], m.val[2]);
+    vst1q_f32(out[3], m.val[3]);
+#else
+    mat4 tmp;
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int r = 0; r < 4; ++r)
+        {
+            tmp[r][c] = A[c][r];
+        }
+    }
+    memcpy(out, tmp, sizeof(tmp));
+#endif
+}
+
+/*
+   Inverse of A → out (can alias), returns 0 if A is singular.
+   The transpose of the inverse is the inverse of the transpose, so this
+   does not care about rows or columns
+*/
+static inline int mat4_inverse(const mat4 A, mat4 out)
+{
+    const float* m = &A[0][0];
+
+    // 2x2 determinants of the first two and of the last two columns
+    float s0 = m[0] * m[5] - m[4] * m[1];
+    float s1 = m[0] * m[6] - m[4] * m[2];
+    float s2 = m[0] * m[7] - m[4] * m[3];
+    float s3 = m[1] * m[6] - m[5] * m[2];
+    float s4 = m[1] * m[7] - m[5] * m[3];
+    float s5 = m[2] * m[7] - m[6] * m[3];
+
+    float c5 = m[10] * m[15] - m[14] * m[11];
+    float c4 = m[9] * m[15] - m[13] * m[11];
+    float c3 = m[9] * m[14] - m[13] * m[10];
+    float c2 = m[8] * m[15] - m[12] * m[11];
+    float c1 = m[8] * m[14] - m[12] * m[10];
+    float c0 = m[8] * m[13] - m[12] * m[9];
+
+    float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+
+    // singular, up to float rounding: det against the lengths of the first
+    // three columns and of the bottom row, so neither a translation (however
+    // far) nor a scale (however small) has a say, only the shape does
+    float n0 = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2] + m[3] * m[3]);
+    float n1 = sqrtf(m[4] * m[4] + m[5] * m[5] + m[6] * m[6] + m[7] * m[7]);
+    float n2 = sqrtf(m[8] * m[8] + m[9] * m[9] + m[10] * m[10] + m[11] * m[11]);
+    float n3 = sqrtf(m[3] * m[3] + m[7] * m[7] + m[11] * m[11] + m[15] * m[15]);
+    if (!(fabsf(det) > 1e-6f * n0 * n1 * n2 * n3))
+    {
+        return 0;
+    }
+    float inv = 1.0f / det;
+
+    float r[16];
+    r[0]  = ( m[5] * c5 - m[6] * c4 + m[7] * c3) * inv;
+    r[1]  = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * inv;
+    r[2]  = ( m[13] * s5 - m[14] * s4 + m[15] * s3) * inv;
+    r[3]  = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * inv;
+
+    r[4]  = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * inv;
+    r[5]  = ( m[0] * c5 - m[2] * c2 + m[3] * c1) * inv;
+    r[6]  = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * inv;
+    r[7]  = ( m[8] * s5 - m[10] * s2 + m[11] * s1) * inv;
+
+    r[8]  = ( m[4] * c4 - m[5] * c2 + m[7] * c0) * inv;
+    r[9]  = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * inv;
+    r[10] = ( m[12] * s4 - m[13] * s2 + m[15] * s0) * inv;
+    r[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * inv;
+
+    r[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * inv;
+    r[13] = ( m[0] * c3 - m[1] * c1 + m[2] * c0) * inv;
+    r[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * inv;
+    r[15] = ( m[8] * s3 - m[9] * s1 + m[10] * s0) * inv;
+
+    memcpy(out, r, sizeof(r));
+    return 1;
+}
+
+/* Constant initializers, column by column */
+#define MAT4_IDENTITY_INIT \
+    { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, \
+      { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } }
+
+#define MAT4_TRANSLATE_INIT(tx, ty, tz) \
+    { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, \
+      { 0.0f, 0.0f, 1.0f, 0.0f }, { (tx), (ty), (tz), 1.0f } }
+
+#define MAT4_SCALE_INIT(sx, sy, sz) \
+    { { (sx), 0.0f, 0.0f, 0.0f }, { 0.0f, (sy), 0.0f, 0.0f }, \
+      { 0.0f, 0.0f, (sz), 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } }
+
+/* f = 1 / tan(fovY / 2), e.g. 2.4142136f for 45 degrees */
+#define MAT4_PERSPECTIVE_INIT(f, aspect, near_, far_) \
+    { { (f) / (aspect), 0.0f, 0.0f, 0.0f }, { 0.0f, (f), 0.0f, 0.0f }, \
+      { 0.0f, 0.0f, ((far_) + (near_)) / ((near_) - (far_)), -1.0f }, \
+      { 0.0f, 0.0f, (2.0f * (far_) * (near_)) / ((near_) - (far_)), 0.0f } }
+
+/* Build a translation matrix T(tx,ty,tz) */
+static inline void mat4_translate(mat4 M, float tx, float ty, float tz)
+{
+    mat4_identity(M);
+
+    M[3][0] = tx;
+    M[3][1] = ty;
+    M[3][2] = tz;
+}
+
+/* Build a rotation matrix around axis (x,y,z) by angle radians */
+static inline void mat4_rotate(mat4 M, float angle, float x, float y, float z)
+{
+    float c = cosf(angle), s = sinf(angle);
+    float len = sqrtf(x*x + y*y + z*z);
+    if (len == 0.0f) { mat4_identity(M); return; }
+    x/=len; y/=len; z/=len;
+    float nc = 1.0f - c;
+
+    M[0][0] = x*x*nc + c;
+    M[0][1] = y*x*nc + z*s;
+    M[0][2] = x*z*nc - y*s;
+    M[0][3] = 0.0f;
+
+    M[1][0] = x*y*nc - z*s;
+    M[1][1] = y*y*nc + c;
+    M[1][2] = y*z*nc + x*s;
+    M[1][3] = 0.0f;
+
+    M[2][0] = x*z*nc + y*s;
+    M[2][1] = y*z*nc - x*s;
+    M[2][2] = z*z*nc + c;
+    M[2][3] = 0.0f;
+
+    M[3][0] = M[3][1] = M[3][2] = 0.0f;
+    M[3][3] = 1.0f;
+}
+
+/* Build a scale matrix S(sx,sy,sz) */
+static inline void mat4_scale(mat4 M, float sx, float sy, float sz)
+{
+    mat4_identity(M);
+
+    M[0][0] = sx;
+    M[1][1] = sy;
+    M[2][2] = sz;
+}
+
+/*
+   Build T(tx,ty,tz) * R(angle, axis) * S(sx,sy,sz) in one go: the rotation
+   columns times the scale, then the translation column
+*/
+static inline void mat4_trs(mat4 M, float tx, float ty, float tz,
+                            float angle, float x, float y, float z,
+                            float sx, float sy, float sz)
+{
+    mat4_rotate(M, angle, x, y, z);
+
+    for (int r = 0; r < 3; ++r)
+    {
+        M[0][r] *= sx;
+        M[1][r] *= sy;
+        M[2][r] *= sz;
+    }
+    M[3][0] = tx;
+    M[3][1] = ty;
+    M[3][2] = tz;
+}
+
+/* Build a perspective projection matrix:
+   fovY in radians, aspect = width/height, near>0, far>near */
+static inline void mat4_perspective(mat4 M, float fovY, float aspect, float near_, float far_)
+{
+    float f = 1.0f / tanf(fovY * 0.5f);
+    mat4_identity(M);
+
+    M[0][0] = f / aspect;
+    M[1][1] = f;
+    M[2][2] = (far_ + near_) / (near_ - far_);
+    M[2][3] = -1.0f;
+    M[3][2] = (2.0f * far_ * near_) / (near_ - far_);
+    M[3][3] = 0.0f;
+}
+
+#endif // MAT4_H
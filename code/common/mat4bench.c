@@ -0,0 +1,297 @@
+/*
+	Headless test/benchmark for mat4.h (no window, runs on linux too)
+	Notes:
+		- precision: random matrices, SIMD mat4_mul against mat4_mul_ref (max
+		  absolute error), aliasing (out == A, out == B),
+		  transpose twice == identity, A * inverse(A) against the identity,
+		  translations (up to 1e6) and small or large scales must invert, and
+		  singular matrices (also scaled down) must be refused
+		- folding: the MAT4_xxx_INIT constants and mat4_trs against the same
+		  matrices built at runtime (mat4_translate/rotate/scale + mat4_mul)
+		- speed: ns per multiply for the reference and the SIMD version, on a
+		  chain (every multiply waits for the last one: latency) and on 1024
+		  independent pairs (throughput)
+		- exits with 1 if an error is over its bound
+
+	build:
+		windows: cl /nologo /O2 mat4bench.c
+		linux:   cc -O2 mat4bench.c -o mat4bench -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mat4.h"
+#include "pacing.c"
+
+#define PAIRS 1024
+#define ROUNDS 2000
+
+static volatile float g_fSink;
+
+static unsigned int g_uSeed = 1;
+
+static float RandomFloat(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (float)(g_uSeed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static void RandomMat4(mat4 M)
+{
+	for (int i = 0; i < 16; i++) {
+		(&M[0][0])[i] = RandomFloat();
+	}
+}
+
+static double MaxDiff(const mat4 A, const mat4 B)
+{
+	double d = 0.0;
+	for (int i = 0; i < 16; i++) {
+		double e = fabs((double)(&A[0][0])[i] - (double)(&B[0][0])[i]);
+		if (e > d) {
+			d = e;
+		}
+	}
+	return d;
+}
+
+static int CheckMat4(void)
+{
+	mat4 A, B, R, S, T, I;
+	double dMaxMul = 0.0, dMaxInv = 0.0;
+	int nInverted = 0;
+
+	mat4_identity(I);
+	for (int n = 0; n < 10000; n++) {
+		RandomMat4(A);
+		RandomMat4(B);
+
+		mat4_mul_ref(A, B, R);
+		mat4_mul(A, B, S);
+		double d = MaxDiff(R, S);
+		if (d > dMaxMul) {
+			dMaxMul = d;
+		}
+
+		// aliasing
+		memcpy(T, A, sizeof(mat4));
+		mat4_mul(T, B, T);
+		if (MaxDiff(T, S) != 0.0) {
+			printf("MISMATCH mat4_mul with out == A\n");
+			return 1;
+		}
+		memcpy(T, B, sizeof(mat4));
+		mat4_mul(A, T, T);
+		if (MaxDiff(T, S) != 0.0) {
+			printf("MISMATCH mat4_mul with out == B\n");
+			return 1;
+		}
+
+		mat4_transpose(A, T);
+		if (T[1][2] != A[2][1] || T[3][0] != A[0][3]) {
+			printf("MISMATCH mat4_transpose\n");
+			return 1;
+		}
+		mat4_transpose(T, T);
+		if (MaxDiff(T, A) != 0.0) {
+			printf("MISMATCH mat4_transpose twice\n");
+			return 1;
+		}
+
+		// A * inverse(A) = I, skip badly conditioned random matrices
+		if (mat4_inverse(A, T)) {
+			mat4_mul(A, T, S);
+			double dCond = 0.0;
+			for (int i = 0; i < 16; i++) {
+				dCond += fabs((&T[0][0])[i]);
+			}
+			if (dCond < 100.0) {
+				d = MaxDiff(S, I);
+				if (d > dMaxInv) {
+					dMaxInv = d;
+				}
+				nInverted++;
+			}
+		}
+	}
+
+	// the demos' matrices: inverse of a translation is the opposite translation,
+	// however far it goes
+	static const float translations[] = { 1.0f, 32.0f, 50.0f, 100.0f, 1000.0f, 1e6f };
+	for (int i = 0; i < 6; i++) {
+		float t = translations[i];
+		mat4_translate(A, t, -2.0f * t, 3.0f * t);
+		mat4_translate(B, -t, 2.0f * t, -3.0f * t);
+		if (!mat4_inverse(A, T) || MaxDiff(T, B) > 1e-6 * t) {
+			printf("MISMATCH mat4_inverse of a translation by %g\n", t);
+			return 1;
+		}
+	}
+
+	// small and large uniform scales, alone and with a far translation
+	static const float scales[] = { 0.01f, 0.001f, 1000.0f };
+	for (int i = 0; i < 3; i++) {
+		float k = scales[i];
+		mat4_scale(A, k, k, k);
+		mat4_scale(B, 1.0f / k, 1.0f / k, 1.0f / k);
+		if (!mat4_inverse(A, T) || MaxDiff(T, B) > 1e-6 / k) {
+			printf("MISMATCH mat4_inverse of a scale by %g\n", k);
+			return 1;
+		}
+		mat4_translate(B, 1000.0f, 50.0f, -32.0f);
+		mat4_mul(B, A, A);
+		if (!mat4_inverse(A, T)) {
+			printf("MISMATCH mat4_inverse refused a scale by %g and a translation\n", k);
+			return 1;
+		}
+		mat4_mul(A, T, S);
+		if (MaxDiff(S, I) > 1e-4) {
+			printf("MISMATCH mat4_inverse of a scale by %g and a translation\n", k);
+			return 1;
+		}
+	}
+
+	// a point on the near plane goes to z = -1, on the far plane to z = +1
+	mat4_perspective(A, 3.1415926f / 4.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+	for (int i = 0; i < 2; i++) {
+		float z = i == 0 ? -0.1f : -100.0f;
+		float zc = A[2][2] * z + A[3][2], wc = A[2][3] * z;
+		if (fabsf(zc / wc - (i == 0 ? -1.0f : 1.0f)) > 1e-4f) {
+			printf("MISMATCH mat4_perspective depth range\n");
+			return 1;
+		}
+	}
+
+	// singular: two equal columns
+	RandomMat4(A);
+	memcpy(A[2], A[1], sizeof(A[1]));
+	if (mat4_inverse(A, T)) {
+		printf("MISMATCH mat4_inverse accepted a singular matrix\n");
+		return 1;
+	}
+	for (int i = 0; i < 16; i++) {
+		(&A[0][0])[i] *= 0.001f; // scaled down it is still singular
+	}
+	if (mat4_inverse(A, T)) {
+		printf("MISMATCH mat4_inverse accepted a small singular matrix\n");
+		return 1;
+	}
+	mat4_scale(A, 1.0f, 1.0f, 0.0f); // flattened, with a translation
+	A[3][0] = 1000.0f;
+	if (mat4_inverse(A, T)) {
+		printf("MISMATCH mat4_inverse accepted a flat matrix\n");
+		return 1;
+	}
+
+	printf("mat4_mul: max error %.3g against the scalar loop\n", dMaxMul);
+	printf("mat4_inverse: max |A * inverse(A) - I| %.3g (%d matrices)\n", dMaxInv, nInverted);
+	if (dMaxMul > 1e-6 || dMaxInv > 1e-4) {
+		printf("MISMATCH error over the bound\n");
+		return 1;
+	}
+	return 0;
+}
+
+// built by the compiler
+static const mat4 g_View = MAT4_TRANSLATE_INIT(0.0f, 0.0f, -5.0f);
+static const mat4 g_Scale = MAT4_SCALE_INIT(2.0f, 0.5f, 3.0f);
+static const mat4 g_Projection = MAT4_PERSPECTIVE_INIT(2.4142136f, 4.0f / 3.0f, 0.1f, 100.0f);
+
+static int CheckFolding(void)
+{
+	static const mat4 I = MAT4_IDENTITY_INIT;
+	mat4 A, B, T, R, S;
+
+	mat4_identity(B);
+	mat4_translate(T, 0.0f, 0.0f, -5.0f);
+	mat4_scale(S, 2.0f, 0.5f, 3.0f);
+	mat4_perspective(R, 3.1415926f / 4.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+	if (MaxDiff(I, B) != 0.0 || MaxDiff(g_View, T) != 0.0 || MaxDiff(g_Scale, S) != 0.0) {
+		printf("MISMATCH MAT4_xxx_INIT against the runtime matrices\n");
+		return 1;
+	}
+	// f written out by hand, the rest is the same arithmetic
+	if (MaxDiff(g_Projection, R) > 1e-6) {
+		printf("MISMATCH MAT4_PERSPECTIVE_INIT against mat4_perspective\n");
+		return 1;
+	}
+
+	// T * R * S: constant arguments (folded) and the multiply chain
+	mat4_trs(A, 1.0f, -2.0f, 3.0f, 0.7f, 1.0f, 1.0f, 0.0f, 2.0f, 0.5f, 3.0f);
+	mat4_translate(T, 1.0f, -2.0f, 3.0f);
+	mat4_rotate(R, 0.7f, 1.0f, 1.0f, 0.0f);
+	mat4_scale(S, 2.0f, 0.5f, 3.0f);
+	mat4_mul(S, R, B);	// mat4_mul(A, B) is B * A in math notation
+	mat4_mul(B, T, B);
+	if (MaxDiff(A, B) > 1e-6) {
+		printf("MISMATCH mat4_trs against translate * rotate * scale (%.3g)\n", MaxDiff(A, B));
+		return 1;
+	}
+
+	printf("folding: constant initializers and mat4_trs match the runtime path\n");
+	return 0;
+}
+
+typedef void (*PFNMAT4MUL)(const mat4 A, const mat4 B, mat4 out);
+
+static void BenchMul(const char* szName, PFNMAT4MUL pfnMul)
+{
+	static mat4 A[PAIRS], B[PAIRS], R[PAIRS];
+	mat4 chain;
+
+	for (int i = 0; i < PAIRS; i++) {
+		RandomMat4(A[i]);
+		RandomMat4(B[i]);
+	}
+
+	double t0 = PaceNow();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < PAIRS; i++) {
+			pfnMul(A[i], B[i], R[i]);
+		}
+	}
+	double dThroughput = (PaceNow() - t0) * 1e9 / ((double)ROUNDS * PAIRS);
+	g_fSink += R[PAIRS / 2][1][1];
+
+	// rotations keep the chain from blowing up
+	mat4_rotate(A[0], 0.01f, 1.0f, 2.0f, 3.0f);
+	mat4_identity(chain);
+	t0 = PaceNow();
+	for (int r = 0; r < ROUNDS * PAIRS; r++) {
+		pfnMul(chain, A[0], chain);
+	}
+	double dLatency = (PaceNow() - t0) * 1e9 / ((double)ROUNDS * PAIRS);
+	g_fSink += chain[2][2];
+
+	printf("%-14s %14.2f %14.2f\n", szName, dThroughput, dLatency);
+}
+
+static void BenchInverse(void)
+{
+	static mat4 A[PAIRS], R[PAIRS];
+
+	for (int i = 0; i < PAIRS; i++) {
+		RandomMat4(A[i]);
+	}
+	double t0 = PaceNow();
+	for (int r = 0; r < ROUNDS / 4; r++) {
+		for (int i = 0; i < PAIRS; i++) {
+			mat4_inverse(A[i], R[i]);
+		}
+	}
+	printf("%-14s %14.2f\n", "mat4_inverse", (PaceNow() - t0) * 1e9 / ((double)ROUNDS / 4 * PAIRS));
+	g_fSink += R[7][1][2];
+}
+
+int main(void)
+{
+	if (CheckMat4() || CheckFolding()) {
+		return 1;
+	}
+
+	printf("\n%-14s %14s %14s\n", "ns per op", "independent", "chained");
+	BenchMul("mat4_mul_ref", mat4_mul_ref);
+	BenchMul("mat4_mul", mat4_mul);
+	BenchInverse();
+	return 0;
+}
@@ -0,0 +1,741 @@
+/*
+	Mip chains on the cpu: box or Kaiser filter, sRGB correct, any size
+	Notes:
+		- BuildMipChain(pixels, w, h, pitch, filter, bSrgb, nThreads) makes
+		  every level down to 1x1; level 0 is the source itself (not copied,
+		  keep it alive), the others are in one block, 4 bytes per pixel,
+		  top row first, so each level goes straight to
+		  glTexImage2D(GL_TEXTURE_2D, i, ...) or to SampleMipChain
+		- sizes follow GL: next = max(1, size / 2), a 333 wide level gives
+		  166, the filter covers the 3 source pixels that fall in each
+		  destination pixel (weights by area), nothing is lost or shifted
+		- MIP_BOX: area average, the plain 2x2 mean on even sizes.
+		  MIP_KAISER: Kaiser windowed sinc, 3 lobes (13 source taps at
+		  2:1), sharper, keeps detail the box blurs away; it can
+		  overshoot, results are clamped
+		- bSrgb: the 3 colour bytes are sRGB, filter in linear light
+		  (table in, 16K entry table out), averaging sRGB bytes makes
+		  a black/white checker 128 instead of 188 and darkens every
+		  high contrast texture in the distance. The 4th byte (alpha) is
+		  always linear. Channel order doesn't matter, RGBA or BGRA
+		- edges clamp (a tiling texture wants wrap: not done, the error is
+		  a few pixels at the border of each level)
+		- separable: each source row is filtered across into floats once
+		  (ring of as many rows as the vertical filter has taps), then each
+		  destination row is a weighted sum of those rows; kernels for the
+		  two sums are scalar / SSE2 / AVX2, picked by InitMipKernels
+		- linear box on even sizes skips the floats: 2x2 mean of bytes,
+		  (a + b + c + d + 2) >> 2, SSE2 does 4 output pixels per step
+		- levels with at least MIP_THREAD_PIXELS output pixels are cut
+		  into bands of rows, one per thread (thread.c); nThreads <= 0 is
+		  one per cpu
+		- call InitMipKernels() once at startup: it builds the sRGB tables
+		  too (not thread safe), BuildMipChain itself can run on any
+		  thread
+		- alpha is not premultiplied: colour under alpha 0 bleeds in
+*/
+
+#ifndef MIP_C
+#define MIP_C
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "cpu.c"
+#include "thread.c"
+
+#define MIP_BOX    0
+#define MIP_KAISER 1
+
+#define MIP_MAX_LEVELS    16   // 32768 x 32768
+#define MIP_MAX_SIZE      32768
+#define MIP_THREAD_PIXELS (256 * 1024)
+#define MAX_MIP_THREADS   16
+#define MIP_KAISER_LOBES  3
+#define MIP_KAISER_ALPHA  4.0
+#define MIP_SRGB_STEPS    16384 // linear -> sRGB table entries
+
+typedef struct {
+	int            width;
+	int            height;
+	int            pitch;   // bytes from one row to the next
+	const uint8_t* pPixels; // top row first, 4 bytes per pixel
+} MIPLEVEL;
+
+typedef struct {
+	int      nLevels;
+	int      filter;
+	int      bSrgb;
+	MIPLEVEL levels[MIP_MAX_LEVELS];
+	uint8_t* pOwned;   // levels 1..n-1
+} MIPCHAIN;
+
+// where each destination pixel reads: nTaps source pixels from pFirst[x]
+typedef struct {
+	int    nTaps;
+	int*   pFirst;
+	float* pWeights;   // nTaps per destination pixel
+} MIPTAPS;
+
+/*
+	tables
+*/
+static float   g_MipToLinear[256];                 // sRGB byte -> linear
+static float   g_MipUnorm[256];                    // byte * (1 / 255)
+static uint8_t g_MipToSrgb[MIP_SRGB_STEPS + 1];    // linear -> sRGB byte
+
+static double SrgbToLinear(double s)
+{
+	return s <= 0.04045 ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4);
+}
+
+static double LinearToSrgb(double l)
+{
+	return l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+}
+
+static void InitMipTables(void)
+{
+	for (int i = 0; i < 256; i++) {
+		g_MipToLinear[i] = (float)SrgbToLinear(i / 255.0);
+		g_MipUnorm[i] = (float)i * (1.0f / 255.0f); // what MipDecodeSSE2 computes
+	}
+	for (int i = 0; i <= MIP_SRGB_STEPS; i++) {
+		g_MipToSrgb[i] = (uint8_t)(LinearToSrgb((double)i / MIP_SRGB_STEPS) * 255.0 + 0.5);
+	}
+}
+
+/*
+	filter weights
+*/
+static double BesselI0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static double KaiserSinc(double t)
+{
+	// t in destination pixels; window reaches 0 at MIP_KAISER_LOBES
+	double r = t / MIP_KAISER_LOBES;
+	if (r <= -1.0 || r >= 1.0) {
+		return 0.0;
+	}
+	double sinc = t == 0.0 ? 1.0 : sin(3.14159265358979323846 * t) / (3.14159265358979323846 * t);
+	double beta = 3.14159265358979323846 * MIP_KAISER_ALPHA;
+	return sinc * BesselI0(beta * sqrt(1.0 - r * r)) / BesselI0(beta);
+}
+
+static void FreeMipTaps(MIPTAPS* pTaps)
+{
+	free(pTaps->pFirst);
+	free(pTaps->pWeights);
+	memset(pTaps, 0, sizeof(*pTaps));
+}
+
+// weights for src -> dst along one axis; 0 if out of memory
+static int BuildMipTaps(MIPTAPS* pTaps, int src, int dst, int filter)
+{
+	double scale = (double)src / dst;
+	int    nRaw;
+
+	memset(pTaps, 0, sizeof(*pTaps));
+	if (src == dst) {
+		nRaw = 1;
+	} else if (filter == MIP_KAISER) {
+		nRaw = (int)ceil(2.0 * MIP_KAISER_LOBES * scale) + 1;
+	} else {
+		// a window of scale pixels touches one more unless it starts on a pixel edge
+		nRaw = (int)ceil(scale) + (scale != floor(scale));
+	}
+	pTaps->nTaps = nRaw < src ? nRaw : src;
+
+	double* pRaw = (double*)malloc(nRaw * sizeof(double));
+	pTaps->pFirst = (int*)malloc(dst * sizeof(int));
+	pTaps->pWeights = (float*)calloc((size_t)dst * pTaps->nTaps, sizeof(float));
+	if (!pRaw || !pTaps->pFirst || !pTaps->pWeights) {
+		free(pRaw);
+		FreeMipTaps(pTaps);
+		return 0;
+	}
+
+	for (int x = 0; x < dst; x++) {
+		// destination pixel x covers [x, x + 1) * scale in the source
+		double lo = x * scale, hi = (x + 1) * scale, center = (x + 0.5) * scale;
+		int    start;
+		if (src == dst) {
+			start = x;
+			pRaw[0] = 1.0;
+		} else if (filter == MIP_KAISER) {
+			start = (int)floor(center - MIP_KAISER_LOBES * scale);
+			for (int k = 0; k < nRaw; k++) {
+				pRaw[k] = KaiserSinc((start + k + 0.5 - center) / scale);
+			}
+		} else {
+			start = (int)floor(lo);
+			for (int k = 0; k < nRaw; k++) {
+				double a = start + k > lo ? start + k : lo;
+				double b = start + k + 1 < hi ? start + k + 1 : hi;
+				pRaw[k] = b > a ? b - a : 0.0;
+			}
+		}
+
+		// clamp to the edge: out of range taps add to the edge pixel, the
+		// window [first, first + nTaps) holds every clamped index
+		int first = start < 0 ? 0 : start > src - pTaps->nTaps ? src - pTaps->nTaps : start;
+		double sum = 0.0;
+		for (int k = 0; k < nRaw; k++) {
+			sum += pRaw[k];
+		}
+		float* pW = pTaps->pWeights + (size_t)x * pTaps->nTaps;
+		for (int k = 0; k < nRaw; k++) {
+			int i = start + k < 0 ? 0 : start + k >= src ? src - 1 : start + k;
+			pW[i - first] += (float)(pRaw[k] / sum);
+		}
+		pTaps->pFirst[x] = first;
+	}
+
+	free(pRaw);
+	return 1;
+}
+
+/*
+	kernels
+	MipRow:    one row across, 4 floats a pixel: dst[x] = sum w[k] * src[first[x] + k]
+	MipColumn: n floats down: dst[j] = sum w[k] * rows[k][j]
+	MipHalve:  2x2 byte mean of two source rows into one row, dst pixels wide
+	MipDecode: bytes -> floats (sRGB or /255, alpha always /255)
+	MipEncode: floats -> bytes, clamped, rounded (sRGB through the table)
+	the float sums run in the same order in every kernel, the results are
+	the same to the bit
+*/
+typedef void (*PFNMIPROW)(const float* pSrc, float* pDst, int width, const MIPTAPS* pTaps);
+typedef void (*PFNMIPCOLUMN)(const float* const* ppRows, const float* pWeights, int nTaps, float* pDst, int n);
+typedef void (*PFNMIPHALVE)(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, int width);
+typedef void (*PFNMIPDECODE)(const uint8_t* pSrc, float* pDst, int width, int bSrgb);
+typedef void (*PFNMIPENCODE)(const float* pSrc, uint8_t* pDst, int width, int bSrgb);
+
+static void MipRowScalar(const float* pSrc, float* pDst, int width, const MIPTAPS* pTaps)
+{
+	for (int x = 0; x < width; x++) {
+		const float* s = pSrc + (size_t)pTaps->pFirst[x] * 4;
+		const float* w = pTaps->pWeights + (size_t)x * pTaps->nTaps;
+		float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+		for (int k = 0; k < pTaps->nTaps; k++) {
+			r += w[k] * s[4 * k + 0];
+			g += w[k] * s[4 * k + 1];
+			b += w[k] * s[4 * k + 2];
+			a += w[k] * s[4 * k + 3];
+		}
+		pDst[4 * x + 0] = r;
+		pDst[4 * x + 1] = g;
+		pDst[4 * x + 2] = b;
+		pDst[4 * x + 3] = a;
+	}
+}
+
+static void MipColumnScalar(const float* const* ppRows, const float* pWeights, int nTaps, float* pDst, int n)
+{
+	for (int j = 0; j < n; j++) {
+		float sum = 0.0f;
+		for (int k = 0; k < nTaps; k++) {
+			sum += pWeights[k] * ppRows[k][j];
+		}
+		pDst[j] = sum;
+	}
+}
+
+static void MipHalveScalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, int width)
+{
+	for (int i = 0; i < width * 4; i++) {
+		int c = i & 3, x = i >> 2;
+		pDst[i] = (uint8_t)((pRow0[8 * x + c] + pRow0[8 * x + 4 + c] + pRow1[8 * x + c] + pRow1[8 * x + 4 + c] + 2) >> 2);
+	}
+}
+
+static void MipDecodeScalar(const uint8_t* pSrc, float* pDst, int width, int bSrgb)
+{
+	const float* pColour = bSrgb ? g_MipToLinear : g_MipUnorm;
+	for (int x = 0; x < width; x++) {
+		pDst[4 * x + 0] = pColour[pSrc[4 * x + 0]];
+		pDst[4 * x + 1] = pColour[pSrc[4 * x + 1]];
+		pDst[4 * x + 2] = pColour[pSrc[4 * x + 2]];
+		pDst[4 * x + 3] = g_MipUnorm[pSrc[4 * x + 3]];
+	}
+}
+
+static uint8_t EncodeMipUnorm(float v)
+{
+	return v <= 0.0f ? 0 : v >= 1.0f ? 255 : (uint8_t)(v * 255.0f + 0.5f);
+}
+
+static void MipEncodeScalar(const float* pSrc, uint8_t* pDst, int width, int bSrgb)
+{
+	if (!bSrgb) {
+		for (int i = 0; i < width * 4; i++) {
+			pDst[i] = EncodeMipUnorm(pSrc[i]);
+		}
+		return;
+	}
+	for (int x = 0; x < width; x++) {
+		for (int c = 0; c < 3; c++) {
+			float v = pSrc[4 * x + c];
+			pDst[4 * x + c] = g_MipToSrgb[v <= 0.0f ? 0 : v >= 1.0f ? MIP_SRGB_STEPS : (int)(v * MIP_SRGB_STEPS + 0.5f)];
+		}
+		pDst[4 * x + 3] = EncodeMipUnorm(pSrc[4 * x + 3]);
+	}
+}
+
+#ifdef CPU_X86
+static void MipRowSSE2(const float* pSrc, float* pDst, int width, const MIPTAPS* pTaps)
+{
+	// a pixel is one register, the taps broadcast
+	for (int x = 0; x < width; x++) {
+		const float* s = pSrc + (size_t)pTaps->pFirst[x] * 4;
+		const float* w = pTaps->pWeights + (size_t)x * pTaps->nTaps;
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < pTaps->nTaps; k++) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(s + 4 * k)));
+		}
+		_mm_storeu_ps(pDst + 4 * x, sum);
+	}
+}
+
+static void MipColumnSSE2(const float* const* ppRows, const float* pWeights, int nTaps, float* pDst, int n)
+{
+	int j = 0;
+	for (; j + 8 <= n; j += 8) {
+		__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+		for (int k = 0; k < nTaps; k++) {
+			__m128 w = _mm_set1_ps(pWeights[k]);
+			s0 = _mm_add_ps(s0, _mm_mul_ps(w, _mm_loadu_ps(ppRows[k] + j)));
+			s1 = _mm_add_ps(s1, _mm_mul_ps(w, _mm_loadu_ps(ppRows[k] + j + 4)));
+		}
+		_mm_storeu_ps(pDst + j, s0);
+		_mm_storeu_ps(pDst + j + 4, s1);
+	}
+	for (; j < n; j += 4) {
+		__m128 s0 = _mm_setzero_ps();
+		for (int k = 0; k < nTaps; k++) {
+			s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_set1_ps(pWeights[k]), _mm_loadu_ps(ppRows[k] + j)));
+		}
+		_mm_storeu_ps(pDst + j, s0);
+	}
+}
+
+static void MipHalveSSE2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, int width)
+{
+	const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+	int x = 0;
+
+	// 8 source pixels of each row -> 4 out: rows added as 16 bit, then
+	// neighbours (the two 64 bit halves of each register)
+	for (; x + 4 <= width; x += 4) {
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(pRow0 + 8 * x));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(pRow0 + 8 * x + 16));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(pRow1 + 8 * x));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(pRow1 + 8 * x + 16));
+		__m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero));
+		__m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero));
+		__m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(b0, zero), _mm_unpacklo_epi8(b1, zero));
+		__m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero));
+		__m128i q01 = _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23));
+		__m128i q23 = _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67));
+		q01 = _mm_srli_epi16(_mm_add_epi16(q01, two), 2);
+		q23 = _mm_srli_epi16(_mm_add_epi16(q23, two), 2);
+		_mm_storeu_si128((__m128i*)(pDst + 4 * x), _mm_packus_epi16(q01, q23));
+	}
+
+	MipHalveScalar(pRow0 + 8 * x, pRow1 + 8 * x, pDst + 4 * x, width - x);
+}
+
+static void MipDecodeSSE2(const uint8_t* pSrc, float* pDst, int width, int bSrgb)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 unorm = _mm_set1_ps(1.0f / 255.0f);
+	int x = 0;
+
+	if (!bSrgb) {
+		// 4 pixels: bytes -> 32 bit -> float * (1 / 255), the same
+		// products g_MipUnorm holds
+		for (; x + 4 <= width; x += 4) {
+			__m128i p = _mm_loadu_si128((const __m128i*)(pSrc + 4 * x));
+			__m128i lo = _mm_unpacklo_epi8(p, zero), hi = _mm_unpackhi_epi8(p, zero);
+			_mm_storeu_ps(pDst + 4 * x + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), unorm));
+			_mm_storeu_ps(pDst + 4 * x + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), unorm));
+			_mm_storeu_ps(pDst + 4 * x + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), unorm));
+			_mm_storeu_ps(pDst + 4 * x + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), unorm));
+		}
+	} else {
+		// table lookups, one store a pixel instead of four
+		for (; x < width; x++) {
+			const uint8_t* s = pSrc + 4 * x;
+			_mm_storeu_ps(pDst + 4 * x, _mm_setr_ps(g_MipToLinear[s[0]], g_MipToLinear[s[1]], g_MipToLinear[s[2]],
+													g_MipUnorm[s[3]]));
+		}
+	}
+
+	MipDecodeScalar(pSrc + 4 * x, pDst + 4 * x, width - x, bSrgb);
+}
+
+static void MipEncodeSSE2(const float* pSrc, uint8_t* pDst, int width, int bSrgb)
+{
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+	int x = 0;
+
+	if (!bSrgb) {
+		// clamp, * 255 + 0.5, truncate: the scalar rounding exactly; 4 pixels a step
+		const __m128 scale = _mm_set1_ps(255.0f);
+		for (; x + 4 <= width; x += 4) {
+			__m128i q[4];
+			for (int i = 0; i < 4; i++) {
+				__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pSrc + 4 * x + 4 * i), zero), one);
+				q[i] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+			}
+			__m128i w = _mm_packs_epi32(q[0], q[1]), z = _mm_packs_epi32(q[2], q[3]);
+			_mm_storeu_si128((__m128i*)(pDst + 4 * x), _mm_packus_epi16(w, z));
+		}
+	} else {
+		// table index for the colours, the alpha itself in the 4th lane
+		const __m128 scale = _mm_setr_ps(MIP_SRGB_STEPS, MIP_SRGB_STEPS, MIP_SRGB_STEPS, 255.0f);
+		for (; x < width; x++) {
+			__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pSrc + 4 * x), zero), one);
+			int index[4];
+			_mm_storeu_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half)));
+			pDst[4 * x + 0] = g_MipToSrgb[index[0]];
+			pDst[4 * x + 1] = g_MipToSrgb[index[1]];
+			pDst[4 * x + 2] = g_MipToSrgb[index[2]];
+			pDst[4 * x + 3] = (uint8_t)index[3];
+		}
+	}
+
+	MipEncodeScalar(pSrc + 4 * x, pDst + 4 * x, width - x, bSrgb);
+}
+
+TARGET_AVX2 static void MipColumnAVX2(const float* const* ppRows, const float* pWeights, int nTaps, float* pDst, int n)
+{
+	int j = 0;
+	for (; j + 16 <= n; j += 16) {
+		__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+		for (int k = 0; k < nTaps; k++) {
+			__m256 w = _mm256_set1_ps(pWeights[k]);
+			s0 = _mm256_add_ps(s0, _mm256_mul_ps(w, _mm256_loadu_ps(ppRows[k] + j)));
+			s1 = _mm256_add_ps(s1, _mm256_mul_ps(w, _mm256_loadu_ps(ppRows[k] + j + 8)));
+		}
+		_mm256_storeu_ps(pDst + j, s0);
+		_mm256_storeu_ps(pDst + j + 8, s1);
+	}
+	for (; j < n; j += 4) {
+		__m128 s0 = _mm_setzero_ps();
+		for (int k = 0; k < nTaps; k++) {
+			s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_set1_ps(pWeights[k]), _mm_loadu_ps(ppRows[k] + j)));
+		}
+		_mm_storeu_ps(pDst + j, s0);
+	}
+}
+
+TARGET_AVX2 static void MipRowAVX2(const float* pSrc, float* pDst, int width, const MIPTAPS* pTaps)
+{
+	// two pixels a register: x and x + 1 side by side, each with its own taps
+	int x = 0;
+	for (; x + 2 <= width; x += 2) {
+		const float* s0 = pSrc + (size_t)pTaps->pFirst[x] * 4;
+		const float* s1 = pSrc + (size_t)pTaps->pFirst[x + 1] * 4;
+		const float* w0 = pTaps->pWeights + (size_t)x * pTaps->nTaps;
+		const float* w1 = w0 + pTaps->nTaps;
+		__m256 sum = _mm256_setzero_ps();
+		for (int k = 0; k < pTaps->nTaps; k++) {
+			__m256 w = _mm256_setr_m128(_mm_set1_ps(w0[k]), _mm_set1_ps(w1[k]));
+			__m256 s = _mm256_setr_m128(_mm_loadu_ps(s0 + 4 * k), _mm_loadu_ps(s1 + 4 * k));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(w, s));
+		}
+		_mm256_storeu_ps(pDst + 4 * x, sum);
+	}
+	if (x < width) {
+		MIPTAPS last = { pTaps->nTaps, pTaps->pFirst + x, pTaps->pWeights + (size_t)x * pTaps->nTaps };
+		MipRowSSE2(pSrc, pDst + 4 * x, 1, &last);
+	}
+}
+#endif
+
+typedef struct {
+	const char*  szName;
+	PFNMIPROW    pfnRow;
+	PFNMIPCOLUMN pfnColumn;
+	PFNMIPHALVE  pfnHalve;
+	PFNMIPDECODE pfnDecode;
+	PFNMIPENCODE pfnEncode;
+	unsigned int uRequired; // CPU_xxx bits
+} MIPKERNEL;
+
+// narrowest first, InitMipKernels takes the last one the cpu supports
+static const MIPKERNEL g_MipKernels[] = {
+	{ "scalar", MipRowScalar, MipColumnScalar, MipHalveScalar, MipDecodeScalar, MipEncodeScalar, 0 },
+#ifdef CPU_X86
+	{ "sse2", MipRowSSE2, MipColumnSSE2, MipHalveSSE2, MipDecodeSSE2, MipEncodeSSE2, CPU_SSE2 },
+	{ "avx2", MipRowAVX2, MipColumnAVX2, MipHalveSSE2, MipDecodeSSE2, MipEncodeSSE2, CPU_SSE2 | CPU_AVX2 },
+#endif
+};
+#define MIP_KERNEL_COUNT ((int)(sizeof(g_MipKernels) / sizeof(g_MipKernels[0])))
+
+static const MIPKERNEL* g_pMipKernel = &g_MipKernels[0];
+static unsigned int g_uMipCpu = 0;
+
+static int IsMipKernelSupported(int i)
+{
+	return (g_MipKernels[i].uRequired & g_uMipCpu) == g_MipKernels[i].uRequired;
+}
+
+// picks the kernels and builds the sRGB tables, returns the kernel name
+static const char* InitMipKernels(void)
+{
+	InitMipTables();
+	g_uMipCpu = GetCpuFeatures();
+
+	for (int i = 0; i < MIP_KERNEL_COUNT; i++) {
+		if (IsMipKernelSupported(i)) {
+			g_pMipKernel = &g_MipKernels[i];
+		}
+	}
+
+	return g_pMipKernel->szName;
+}
+
+/*
+	one level from the one above, a band of destination rows at a time
+*/
+typedef struct {
+	const MIPLEVEL* pSrc;
+	const MIPLEVEL* pDst;
+	const MIPTAPS*  pTapsX;
+	const MIPTAPS*  pTapsY;
+	int             bSrgb;
+	int             bHalve;   // linear box on even sizes
+	int             y0, y1;   // destination rows [y0, y1)
+	int             bOk;
+} MIPBAND;
+
+static void BuildMipBand(MIPBAND* pBand)
+{
+	const MIPLEVEL* pSrc = pBand->pSrc;
+	const MIPLEVEL* pDst = pBand->pDst;
+	const MIPKERNEL* pKernel = g_pMipKernel;
+
+	if (pBand->bHalve) {
+		for (int y = pBand->y0; y < pBand->y1; y++) {
+			const uint8_t* pRow0 = pSrc->pPixels + (size_t)pSrc->pitch * (2 * y);
+			pKernel->pfnHalve(pRow0, pRow0 + pSrc->pitch, (uint8_t*)pDst->pPixels + (size_t)pDst->pitch * y, pDst->width);
+		}
+		pBand->bOk = 1;
+		return;
+	}
+
+	// ring of filtered rows: source row j lives in slot j % nTaps
+	int nTaps = pBand->pTapsY->nTaps;
+	size_t nRow = (size_t)pDst->width * 4;
+	float* pMemory = (float*)malloc(((size_t)pSrc->width * 4 + nRow * (nTaps + 1)) * sizeof(float) +
+									nTaps * (sizeof(int) + sizeof(float*)));
+	if (!pMemory) {
+		pBand->bOk = 0;
+		return;
+	}
+	float*  pDecoded = pMemory;
+	float*  pRing = pDecoded + (size_t)pSrc->width * 4;
+	float*  pOut = pRing + nRow * nTaps;
+	const float** ppRows = (const float**)(pOut + nRow);
+	int*    pTags = (int*)(ppRows + nTaps);
+	for (int k = 0; k < nTaps; k++) {
+		pTags[k] = -1;
+	}
+
+	for (int y = pBand->y0; y < pBand->y1; y++) {
+		int first = pBand->pTapsY->pFirst[y];
+		for (int k = 0; k < nTaps; k++) {
+			int j = first + k, slot = j % nTaps;
+			float* pRow = pRing + nRow * slot;
+			if (pTags[slot] != j) {
+				pKernel->pfnDecode(pSrc->pPixels + (size_t)pSrc->pitch * j, pDecoded, pSrc->width, pBand->bSrgb);
+				pKernel->pfnRow(pDecoded, pRow, pDst->width, pBand->pTapsX);
+				pTags[slot] = j;
+			}
+			ppRows[k] = pRow;
+		}
+		pKernel->pfnColumn(ppRows, pBand->pTapsY->pWeights + (size_t)y * nTaps, nTaps, pOut, (int)nRow);
+		pKernel->pfnEncode(pOut, (uint8_t*)pDst->pPixels + (size_t)pDst->pitch * y, pDst->width, pBand->bSrgb);
+	}
+
+	free(pMemory);
+	pBand->bOk = 1;
+}
+
+static THREADPROC(MipBandProc)
+{
+	BuildMipBand((MIPBAND*)pContext);
+	return 0;
+}
+
+static int BuildMipLevel(const MIPLEVEL* pSrc, const MIPLEVEL* pDst, int filter, int bSrgb, int nThreads)
+{
+	MIPTAPS tapsX, tapsY;
+	MIPBAND bands[MAX_MIP_THREADS];
+	THREAD  threads[MAX_MIP_THREADS];
+	int     bHalve = filter == MIP_BOX && !bSrgb && pSrc->width == 2 * pDst->width && pSrc->height == 2 * pDst->height;
+
+	memset(&tapsX, 0, sizeof(tapsX));
+	memset(&tapsY, 0, sizeof(tapsY));
+	if (!bHalve && (!BuildMipTaps(&tapsX, pSrc->width, pDst->width, filter) ||
+					!BuildMipTaps(&tapsY, pSrc->height, pDst->height, filter))) {
+		FreeMipTaps(&tapsX);
+		return 0;
+	}
+
+	if ((size_t)pDst->width * pDst->height < MIP_THREAD_PIXELS) {
+		nThreads = 1;
+	}
+	nThreads = nThreads > pDst->height ? pDst->height : nThreads;
+
+	int nStarted = 0, bOk = 1;
+	for (int i = 0; i < nThreads; i++) {
+		MIPBAND band = { pSrc, pDst, &tapsX, &tapsY, bSrgb, bHalve,
+						 (int)((int64_t)pDst->height * i / nThreads), (int)((int64_t)pDst->height * (i + 1) / nThreads), 0 };
+		bands[i] = band;
+	}
+	// bands 1.. on threads, band 0 here; a band that can't get a thread runs here too
+	for (int i = 1; i < nThreads; i++) {
+		if (StartThread(&threads[nStarted], MipBandProc, &bands[i])) {
+			nStarted++;
+		} else {
+			BuildMipBand(&bands[i]);
+		}
+	}
+	BuildMipBand(&bands[0]);
+	for (int i = 0; i < nStarted; i++) {
+		JoinThread(threads[i]);
+	}
+	for (int i = 0; i < nThreads; i++) {
+		bOk &= bands[i].bOk;
+	}
+
+	FreeMipTaps(&tapsX);
+	FreeMipTaps(&tapsY);
+	return bOk;
+}
+
+static void FreeMipChain(MIPCHAIN* pChain)
+{
+	free(pChain->pOwned);
+	memset(pChain, 0, sizeof(*pChain));
+}
+
+/*
+	Every level of a 4 byte per pixel image down to 1x1. filter MIP_BOX or
+	MIP_KAISER, bSrgb: the colour bytes are sRGB. Returns 0 on failure
+	(bad size, out of memory)
+*/
+static int BuildMipChain(MIPCHAIN* pChain, const uint8_t* pPixels, int width, int height, int pitch,
+						 int filter, int bSrgb, int nThreads)
+{
+	memset(pChain, 0, sizeof(*pChain));
+	if (!pPixels || width < 1 || height < 1 || width > MIP_MAX_SIZE || height > MIP_MAX_SIZE || pitch < width * 4) {
+		return 0;
+	}
+	if (nThreads <= 0) {
+		nThreads = GetCpuCount();
+	}
+	nThreads = nThreads > MAX_MIP_THREADS ? MAX_MIP_THREADS : nThreads;
+
+	// sizes first, then one block for levels 1..
+	size_t cbTotal = 0;
+	int w = width, h = height;
+	pChain->levels[0].width = width;
+	pChain->levels[0].height = height;
+	pChain->levels[0].pitch = pitch;
+	pChain->levels[0].pPixels = pPixels;
+	pChain->nLevels = 1;
+	while (w > 1 || h > 1) {
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+		MIPLEVEL* pLevel = &pChain->levels[pChain->nLevels++];
+		pLevel->width = w;
+		pLevel->height = h;
+		pLevel->pitch = w * 4;
+		cbTotal += (size_t)w * h * 4;
+	}
+	pChain->filter = filter;
+	pChain->bSrgb = bSrgb;
+	if (pChain->nLevels == 1) {
+		return 1;
+	}
+
+	pChain->pOwned = (uint8_t*)malloc(cbTotal);
+	if (!pChain->pOwned) {
+		FreeMipChain(pChain);
+		return 0;
+	}
+	uint8_t* p = pChain->pOwned;
+	for (int i = 1; i < pChain->nLevels; i++) {
+		pChain->levels[i].pPixels = p;
+		p += (size_t)pChain->levels[i].pitch * pChain->levels[i].height;
+	}
+
+	for (int i = 1; i < pChain->nLevels; i++) {
+		if (!BuildMipLevel(&pChain->levels[i - 1], &pChain->levels[i], filter, bSrgb, nThreads)) {
+			FreeMipChain(pChain);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+	cpu sampling: bilinear in a level, trilinear between two, u and v wrap
+	(GL_REPEAT), lod 0 = level 0. Returns linear values (sRGB decoded when
+	the chain is sRGB), 0..1
+*/
+static void SampleMipLevel(const MIPLEVEL* pLevel, float u, float v, int bSrgb, float rgba[4])
+{
+	const float* pColour = bSrgb ? g_MipToLinear : g_MipUnorm;
+	float x = u * pLevel->width - 0.5f, y = v * pLevel->height - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	float ax = x - fx, ay = y - fy;
+	int x0 = (int)fx % pLevel->width, y0 = (int)fy % pLevel->height;
+	x0 += x0 < 0 ? pLevel->width : 0;
+	y0 += y0 < 0 ? pLevel->height : 0;
+	int x1 = x0 + 1 == pLevel->width ? 0 : x0 + 1, y1 = y0 + 1 == pLevel->height ? 0 : y0 + 1;
+
+	const uint8_t* p00 = pLevel->pPixels + (size_t)pLevel->pitch * y0 + 4 * x0;
+	const uint8_t* p01 = pLevel->pPixels + (size_t)pLevel->pitch * y0 + 4 * x1;
+	const uint8_t* p10 = pLevel->pPixels + (size_t)pLevel->pitch * y1 + 4 * x0;
+	const uint8_t* p11 = pLevel->pPixels + (size_t)pLevel->pitch * y1 + 4 * x1;
+	for (int c = 0; c < 4; c++) {
+		const float* t = c < 3 ? pColour : g_MipUnorm;
+		float top = t[p00[c]] + (t[p01[c]] - t[p00[c]]) * ax;
+		float bottom = t[p10[c]] + (t[p11[c]] - t[p10[c]]) * ax;
+		rgba[c] = top + (bottom - top) * ay;
+	}
+}
+
+static void SampleMipChain(const MIPCHAIN* pChain, float u, float v, float lod, float rgba[4])
+{
+	float maxLod = (float)(pChain->nLevels - 1);
+	lod = lod < 0.0f ? 0.0f : lod > maxLod ? maxLod : lod;
+	int i = (int)lod;
+	float t = lod - i;
+
+	SampleMipLevel(&pChain->levels[i], u, v, pChain->bSrgb, rgba);
+	if (t > 0.0f) {
+		float next[4];
+		SampleMipLevel(&pChain->levels[i + 1], u, v, pChain->bSrgb, next);
+		for (int c = 0; c < 4; c++) {
+			rgba[c] += (next[c] - rgba[c]) * t;
+		}
+	}
+}
+
+#endif // MIP_C
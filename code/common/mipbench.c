@@ -0,0 +1,335 @@
+/*
+	Headless test/benchmark for mip.c
+	Notes:
+		- level sizes for square, NPOT, 1 wide, 1 high sources
+		- every level against a double precision reference built from the
+		  level above (box by area, Kaiser, linear and sRGB), within 1
+		- every kernel against the scalar one, to the bit; threads against
+		  one thread, to the bit
+		- a black/white checker must give 188 (sRGB) and 128 (linear)
+		- SampleMipChain at texel centres gives the texels back
+		- then ms and source MP/s for 1K, 4K, 8K sources: box linear (the
+		  byte path), box sRGB, Kaiser sRGB; every kernel at 4K
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 mipbench.c
+		linux:   cc -O2 -pthread mipbench.c -o mipbench -lm
+*/
+
+#include <stdio.h>
+#include "mip.c"
+#include "pacing.c"
+
+static unsigned int g_uSeed = 1;
+
+static uint8_t RandomByte(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (uint8_t)(g_uSeed >> 24);
+}
+
+// smooth gradients, stripes and noise: something for the filters to chew on
+static uint8_t* MakeImage(int width, int height)
+{
+	uint8_t* p = (uint8_t*)malloc((size_t)width * height * 4);
+	if (!p) {
+		return NULL;
+	}
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			uint8_t* q = p + ((size_t)y * width + x) * 4;
+			q[0] = (uint8_t)(x * 255 / width);
+			q[1] = (uint8_t)((x / 3 + y / 5) & 1 ? 230 : 20);
+			q[2] = RandomByte();
+			q[3] = (uint8_t)(255 - y * 255 / height);
+		}
+	}
+	return p;
+}
+
+static const char* g_szModes[4] = { "box linear", "box sRGB", "kaiser linear", "kaiser sRGB" };
+#define MODE_FILTER(m) ((m) >> 1)
+#define MODE_SRGB(m)   ((m) & 1)
+
+/*
+	reference: one level from the one above in doubles, weights worked out
+	per pixel with no tables
+*/
+static double RefWeight(int filter, int i, int x, double scale, int src, int dst)
+{
+	if (src == dst) {
+		return i == x ? 1.0 : 0.0;
+	}
+	if (filter == MIP_KAISER) {
+		return KaiserSinc((i + 0.5 - (x + 0.5) * scale) / scale);
+	}
+	double lo = x * scale > i ? x * scale : i;
+	double hi = (x + 1) * scale < i + 1 ? (x + 1) * scale : i + 1;
+	return hi > lo ? hi - lo : 0.0;
+}
+
+static int CheckAgainstReference(const MIPLEVEL* pSrc, const MIPLEVEL* pDst, int filter, int bSrgb)
+{
+	double sx = (double)pSrc->width / pDst->width, sy = (double)pSrc->height / pDst->height;
+	int rx = filter == MIP_KAISER ? (int)(MIP_KAISER_LOBES * sx) + 2 : 2;
+	int ry = filter == MIP_KAISER ? (int)(MIP_KAISER_LOBES * sy) + 2 : 2;
+	int worst = 0;
+
+	for (int y = 0; y < pDst->height; y++) {
+		for (int x = 0; x < pDst->width; x++) {
+			double sum[4] = { 0, 0, 0, 0 }, wsum = 0.0;
+			int cx = (int)((x + 0.5) * sx), cy = (int)((y + 0.5) * sy);
+			for (int j = cy - ry; j <= cy + ry; j++) {
+				double wy = RefWeight(filter, j, y, sy, pSrc->height, pDst->height);
+				for (int i = cx - rx; i <= cx + rx && wy != 0.0; i++) {
+					double w = wy * RefWeight(filter, i, x, sx, pSrc->width, pDst->width);
+					int ii = i < 0 ? 0 : i >= pSrc->width ? pSrc->width - 1 : i;
+					int jj = j < 0 ? 0 : j >= pSrc->height ? pSrc->height - 1 : j;
+					const uint8_t* s = pSrc->pPixels + (size_t)pSrc->pitch * jj + 4 * ii;
+					for (int c = 0; c < 4; c++) {
+						sum[c] += w * (bSrgb && c < 3 ? SrgbToLinear(s[c] / 255.0) : s[c] / 255.0);
+					}
+					wsum += w;
+				}
+			}
+			const uint8_t* d = pDst->pPixels + (size_t)pDst->pitch * y + 4 * x;
+			for (int c = 0; c < 4; c++) {
+				double v = sum[c] / wsum;
+				v = v < 0.0 ? 0.0 : v > 1.0 ? 1.0 : v;
+				int want = (int)((bSrgb && c < 3 ? LinearToSrgb(v) : v) * 255.0 + 0.5);
+				int diff = abs(want - d[c]);
+				worst = diff > worst ? diff : worst;
+			}
+		}
+	}
+	return worst;
+}
+
+static int CheckSizes(void)
+{
+	static const int sizes[][2] = { { 1, 1 }, { 256, 256 }, { 333, 171 }, { 1, 7 }, { 4096, 1 }, { 3, 1000 } };
+	for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		int w = sizes[i][0], h = sizes[i][1], nLevels = 1;
+		uint8_t* p = MakeImage(w, h);
+		MIPCHAIN chain;
+		if (!BuildMipChain(&chain, p, w, h, w * 4, MIP_KAISER, 1, 1)) {
+			printf("MISMATCH %dx%d: BuildMipChain failed\n", w, h);
+			return 1;
+		}
+		for (int l = 1; w > 1 || h > 1; l++, nLevels++) {
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+			if (l >= chain.nLevels || chain.levels[l].width != w || chain.levels[l].height != h) {
+				printf("MISMATCH %dx%d: level %d\n", sizes[i][0], sizes[i][1], l);
+				return 1;
+			}
+		}
+		if (chain.nLevels != nLevels) {
+			printf("MISMATCH %dx%d: %d levels, want %d\n", sizes[i][0], sizes[i][1], chain.nLevels, nLevels);
+			return 1;
+		}
+		FreeMipChain(&chain);
+		free(p);
+	}
+	MIPCHAIN chain;
+	uint8_t pixel[4] = { 0 };
+	if (BuildMipChain(&chain, pixel, 0, 1, 4, MIP_BOX, 0, 1) || BuildMipChain(&chain, pixel, 1, 1, 3, MIP_BOX, 0, 1)) {
+		printf("MISMATCH bad sizes accepted\n");
+		return 1;
+	}
+	printf("level sizes: ok\n");
+	return 0;
+}
+
+static int CheckReference(void)
+{
+	static const int sizes[][2] = { { 64, 64 }, { 333, 171 }, { 1, 37 }, { 45, 2 } };
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+		int w = sizes[s][0], h = sizes[s][1];
+		uint8_t* p = MakeImage(w, h);
+		for (int m = 0; m < 4; m++) {
+			MIPCHAIN chain;
+			int worst = 0;
+			BuildMipChain(&chain, p, w, h, w * 4, MODE_FILTER(m), MODE_SRGB(m), 1);
+			for (int l = 1; l < chain.nLevels; l++) {
+				int d = CheckAgainstReference(&chain.levels[l - 1], &chain.levels[l], MODE_FILTER(m), MODE_SRGB(m));
+				worst = d > worst ? d : worst;
+			}
+			FreeMipChain(&chain);
+			if (worst > 1) {
+				printf("MISMATCH %s %dx%d: off by %d from the reference\n", g_szModes[m], w, h, worst);
+				return 1;
+			}
+		}
+		free(p);
+	}
+	printf("against the reference, all levels, 4 modes: within 1\n");
+	return 0;
+}
+
+static int SameChains(const MIPCHAIN* a, const MIPCHAIN* b)
+{
+	if (a->nLevels != b->nLevels) {
+		return 0;
+	}
+	for (int l = 1; l < a->nLevels; l++) {
+		if (memcmp(a->levels[l].pPixels, b->levels[l].pPixels,
+				   (size_t)a->levels[l].pitch * a->levels[l].height) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int CheckKernelsAndThreads(void)
+{
+	static const int sizes[][2] = { { 1024, 1024 }, { 333, 171 }, { 1000, 3 } };
+	const MIPKERNEL* pBest = g_pMipKernel;
+
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+		int w = sizes[s][0], h = sizes[s][1];
+		uint8_t* p = MakeImage(w, h);
+		for (int m = 0; m < 4; m++) {
+			MIPCHAIN want, got;
+			g_pMipKernel = &g_MipKernels[0];
+			BuildMipChain(&want, p, w, h, w * 4, MODE_FILTER(m), MODE_SRGB(m), 1);
+			for (int k = 1; k < MIP_KERNEL_COUNT; k++) {
+				if (!IsMipKernelSupported(k)) {
+					continue;
+				}
+				g_pMipKernel = &g_MipKernels[k];
+				BuildMipChain(&got, p, w, h, w * 4, MODE_FILTER(m), MODE_SRGB(m), 1);
+				if (!SameChains(&want, &got)) {
+					printf("MISMATCH %s %s %dx%d\n", g_MipKernels[k].szName, g_szModes[m], w, h);
+					return 1;
+				}
+				FreeMipChain(&got);
+			}
+			g_pMipKernel = pBest;
+			BuildMipChain(&got, p, w, h, w * 4, MODE_FILTER(m), MODE_SRGB(m), 4);
+			if (!SameChains(&want, &got)) {
+				printf("MISMATCH 4 threads %s %dx%d\n", g_szModes[m], w, h);
+				return 1;
+			}
+			FreeMipChain(&got);
+			FreeMipChain(&want);
+		}
+		free(p);
+	}
+	printf("kernels against scalar, 4 threads against 1: same bits\n");
+	return 0;
+}
+
+static int CheckChecker(void)
+{
+	uint8_t p[8 * 8 * 4];
+	for (int i = 0; i < 64; i++) {
+		uint8_t v = ((i & 7) + (i >> 3)) & 1 ? 255 : 0;
+		p[4 * i + 0] = p[4 * i + 1] = p[4 * i + 2] = v;
+		p[4 * i + 3] = 255;
+	}
+	for (int bSrgb = 0; bSrgb < 2; bSrgb++) {
+		MIPCHAIN chain;
+		BuildMipChain(&chain, p, 8, 8, 32, MIP_BOX, bSrgb, 1);
+		int want = bSrgb ? 188 : 128;
+		for (int l = 1; l < chain.nLevels; l++) {
+			const uint8_t* q = chain.levels[l].pPixels;
+			if (q[0] != want || q[2] != want || q[3] != 255) {
+				printf("MISMATCH checker %s level %d: %d, want %d\n", bSrgb ? "sRGB" : "linear", l, q[0], want);
+				return 1;
+			}
+		}
+		FreeMipChain(&chain);
+	}
+	printf("black/white checker: 188 sRGB, 128 linear: ok\n");
+	return 0;
+}
+
+static int CheckSampling(void)
+{
+	int w = 37, h = 20;
+	uint8_t* p = MakeImage(w, h);
+	MIPCHAIN chain;
+	BuildMipChain(&chain, p, w, h, w * 4, MIP_BOX, 0, 1);
+
+	for (int l = 0; l < chain.nLevels; l++) {
+		const MIPLEVEL* pLevel = &chain.levels[l];
+		for (int y = 0; y < pLevel->height; y++) {
+			for (int x = 0; x < pLevel->width; x++) {
+				float rgba[4];
+				const uint8_t* q = pLevel->pPixels + (size_t)pLevel->pitch * y + 4 * x;
+				// + 1.0: wraps back onto the same texel
+				SampleMipChain(&chain, (x + 0.5f) / pLevel->width + 1.0f, (y + 0.5f) / pLevel->height, (float)l, rgba);
+				for (int c = 0; c < 4; c++) {
+					if (fabsf(rgba[c] * 255.0f - q[c]) > 0.01f) {
+						printf("MISMATCH sample level %d (%d, %d): %f want %d\n", l, x, y, rgba[c] * 255.0f, q[c]);
+						return 1;
+					}
+				}
+			}
+		}
+	}
+	FreeMipChain(&chain);
+	free(p);
+	printf("sampling at texel centres: ok\n");
+	return 0;
+}
+
+static void Bench(int side, int mode, int nThreads)
+{
+	uint8_t* p = MakeImage(side, side);
+	if (!p) {
+		printf("%-6d out of memory\n", side);
+		return;
+	}
+	MIPCHAIN chain;
+	double best = 1e9;
+	int nRuns = side <= 1024 ? 10 : side <= 4096 ? 3 : 1;
+	for (int r = 0; r < nRuns; r++) {
+		double t0 = PaceNow();
+		int bOk = BuildMipChain(&chain, p, side, side, side * 4, MODE_FILTER(mode), MODE_SRGB(mode), nThreads);
+		double t = PaceNow() - t0;
+		best = t < best ? t : best;
+		if (bOk) {
+			FreeMipChain(&chain);
+		}
+	}
+	printf("%5dK %-14s %-7s %2d  %9.2f ms %8.1f MP/s\n", side / 1024, g_szModes[mode], g_pMipKernel->szName,
+		   nThreads, best * 1e3, (double)side * side / best * 1e-6);
+	free(p);
+}
+
+int main(void)
+{
+	const char* szKernel = InitMipKernels();
+	int nCpus = GetCpuCount();
+
+	if (CheckSizes() || CheckReference() || CheckKernelsAndThreads() || CheckChecker() || CheckSampling()) {
+		return 1;
+	}
+
+	printf("\nkernel %s, %d cpus; source MP/s, all levels\n", szKernel, nCpus);
+	printf("%6s %-14s %-7s %2s  %12s %13s\n", "size", "mode", "kernel", "th", "time", "speed");
+	static const int sides[] = { 1024, 4096, 8192 };
+	for (int i = 0; i < 3; i++) {
+		Bench(sides[i], 0, nCpus);
+		Bench(sides[i], 1, nCpus);
+		Bench(sides[i], 3, nCpus);
+	}
+	if (nCpus > 1) {
+		Bench(8192, 3, 1);
+	}
+
+	printf("\n");
+	const MIPKERNEL* pBest = g_pMipKernel;
+	for (int k = 0; k < MIP_KERNEL_COUNT; k++) {
+		if (IsMipKernelSupported(k)) {
+			g_pMipKernel = &g_MipKernels[k];
+			Bench(4096, 0, 1);
+			Bench(4096, 3, 1);
+		}
+	}
+	g_pMipKernel = pBest;
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+	Headless test/benchmark for the frame pacer (no window, runs on linux too)
+	Notes:
+		- a fake frame does some busy work (0.2..4ms, a few frames 1.5 periods
+		  long to force missed deadlines), then waits for the next frame
+		- the old loop (work + Sleep(1) / Sleep(10)) against WaitNextFrame at
+		  60, 120 and 240 Hz: frame interval percentiles, missed deadlines, how
+		  much of the wait was spinning, and the drift of the mean interval
+		- exits with 1 if the paced mean interval is more than 2% off the target
+
+	build:
+		windows: cl /nologo /O2 pacebench.c
+		linux:   cc -O2 pacebench.c -o pacebench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pacing.c"
+
+#define SECONDS 2.0
+
+static volatile unsigned int g_uSink;
+
+static void BusyWork(double dSeconds)
+{
+	double dEnd = PaceNow() + dSeconds;
+	while (PaceNow() < dEnd) {
+		g_uSink++;
+	}
+}
+
+// work of frame i: mostly short, every 97th frame longer than a period
+static double FrameWork(int i, double dPeriod)
+{
+	if (i % 97 == 96) {
+		return dPeriod * 1.5;
+	}
+	return 0.0002 + (double)((i * 7919) % 100) / 100.0 * (dPeriod * 0.25 < 0.004 ? dPeriod * 0.25 : 0.004);
+}
+
+static void PrintStats(const char* szName, double dHz, const PACESTATS* pStats)
+{
+	printf("%-14s %6.0f %8.3f %8.3f %8.3f %8.3f %8.3f %8lld %7.1f%%\n", szName, dHz,
+		   pStats->mean, pStats->p50, pStats->p95, pStats->p99, pStats->max,
+		   pStats->llMissed, pStats->dSpinShare * 100.0);
+}
+
+// the loops we had: work, then sleep a fixed time (no target at all)
+static void RunOldLoop(const char* szName, double dSleep)
+{
+	FRAMEPACER pacer; // only for the clock and the stats
+	PACESTATS stats;
+	double dEnd;
+	int i = 0;
+
+	InitFramePacer(&pacer, 1000.0);
+	dEnd = PaceNow() + SECONDS;
+	while (PaceNow() < dEnd) {
+		BusyWork(FrameWork(i++, 1.0 / 60.0));
+		PaceSleep(&pacer, dSleep);
+
+		double dNow = PaceNow();
+		pacer.history[pacer.iHistory] = (float)((dNow - pacer.dLastStart) * 1000.0);
+		pacer.iHistory = (pacer.iHistory + 1) % PACE_HISTORY;
+		if (pacer.nHistory < PACE_HISTORY) {
+			pacer.nHistory++;
+		}
+		pacer.dLastStart = dNow;
+		pacer.llFrames++;
+	}
+	GetFramePacerStats(&pacer, &stats);
+	PrintStats(szName, stats.mean > 0.0 ? 1000.0 / stats.mean : 0.0, &stats);
+	FreeFramePacer(&pacer);
+}
+
+static int RunPaced(double dHz)
+{
+	FRAMEPACER pacer;
+	PACESTATS stats;
+	int nFrames = (int)(SECONDS * dHz);
+
+	InitFramePacer(&pacer, dHz);
+	WaitNextFrame(&pacer);
+	ResetFramePacerStats(&pacer);
+
+	double t0 = pacer.dLastStart;
+	for (int i = 0; i < nFrames; i++) {
+		BusyWork(FrameWork(i, pacer.dPeriod));
+		WaitNextFrame(&pacer);
+	}
+	double dMean = (pacer.dLastStart - t0) / nFrames;
+
+	GetFramePacerStats(&pacer, &stats);
+	PrintStats("WaitNextFrame", dHz, &stats);
+	FreeFramePacer(&pacer);
+
+	// late frames restart the schedule, so the mean can only be longer:
+	// allow for them, nothing else
+	double dAllowed = pacer.dPeriod * (1.0 + 0.02) + (double)stats.llMissed * pacer.dPeriod / nFrames;
+	if (dMean > dAllowed || dMean < pacer.dPeriod * 0.98) {
+		printf("DRIFT at %.0f Hz: mean interval %.4f ms, target %.4f ms\n", dHz, dMean * 1000.0, pacer.dPeriod * 1000.0);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	printf("%-14s %6s %8s %8s %8s %8s %8s %8s %8s\n",
+		   "loop", "Hz", "mean ms", "p50", "p95", "p99", "max", "missed", "spin");
+
+	RunOldLoop("Sleep(1)", 0.001);
+	RunOldLoop("Sleep(10)", 0.010);
+	failed |= RunPaced(60.0);
+	failed |= RunPaced(120.0);
+	failed |= RunPaced(240.0);
+
+	return failed;
+}
@@ -0,0 +1,271 @@
+/*
+	Frame pacing: one frame every 1/rate seconds instead of Sleep(1)/Sleep(10)
+	Notes:
+		- PaceNow() is a monotonic clock in seconds (QueryPerformanceCounter on
+		  windows, clock_gettime(CLOCK_MONOTONIC) on linux)
+		- frames have absolute deadlines: deadline += period, never now + period,
+		  so the error of one wait is not added to the next (no drift)
+		- waiting is hybrid: sleep until dSlack before the deadline, then spin on
+		  the clock for the rest
+		- dSlack is measured: after every sleep we look at how late it woke up
+		  (oversleep) and move the slack towards it, fast up and slow down, so
+		  it follows the worst wake-ups the OS gives us without spinning forever
+		- on windows the sleep is a high resolution waitable timer (windows 10
+		  1803+), or a normal one with timeBeginPeriod(1) on older systems
+		- a frame that starts after its deadline is a missed deadline; if we are
+		  a whole period late the schedule restarts from now instead of
+		  rendering a burst of frames to catch up
+		- the last PACE_HISTORY frame intervals are kept for p50/p95/p99
+
+	usage:
+		FRAMEPACER pacer;
+		InitFramePacer(&pacer, 60.0);
+		while (running) {
+			... messages, update, render ...
+			WaitNextFrame(&pacer);
+		}
+		FreeFramePacer(&pacer);
+*/
+
+#ifndef PACING_C
+#define PACING_C
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+#define PACE_HISTORY    1024
+#define PACE_MIN_SLACK  0.0002  // never spin less than this
+#define PACE_MAX_SLACK  0.004   // nor more than this (a bad wake-up should not cost a core)
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+typedef struct {
+	double   dPeriod;        // seconds per frame
+	double   dDeadline;      // when the next frame should start
+	double   dLastStart;     // when the last frame started
+	double   dFrameDelta;    // seconds between the last two frame starts (for animation)
+	double   dSlack;         // wake up this much before the deadline, then spin
+
+	// stats
+	long long llFrames;
+	long long llMissed;      // frames that started after their deadline
+	double   dSlept;         // seconds spent sleeping
+	double   dSpun;          // seconds spent spinning
+	float    history[PACE_HISTORY]; // frame intervals, ms
+	int      iHistory;
+	int      nHistory;
+
+#ifdef _WIN32
+	HANDLE   hTimer;
+	BOOL     bPeriod;        // timeBeginPeriod(1) to undo
+#endif
+} FRAMEPACER;
+
+typedef struct {
+	double    p50, p95, p99, max;  // frame interval, ms
+	double    mean;
+	long long llFrames, llMissed;
+	double    dSpinShare;          // spun / (slept + spun)
+} PACESTATS;
+
+static double PaceNow(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// tells the cpu we are spinning (hyperthread sibling, power)
+static void PaceSpinPause(void)
+{
+#if defined(_M_X64) || defined(_M_IX86)
+	YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+	__asm__ volatile("pause");
+#endif
+}
+
+static void PaceSleep(FRAMEPACER* pPacer, double dSeconds)
+{
+#ifdef _WIN32
+	if (pPacer->hTimer) {
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)(dSeconds * 1e7); // relative, 100ns units
+		if (SetWaitableTimer(pPacer->hTimer, &due, 0, NULL, NULL, FALSE)) {
+			WaitForSingleObject(pPacer->hTimer, INFINITE);
+			return;
+		}
+	}
+	Sleep((DWORD)(dSeconds * 1000.0));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)dSeconds;
+	ts.tv_nsec = (long)((dSeconds - (double)ts.tv_sec) * 1e9);
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+	}
+#endif
+}
+
+static void SetFramePacerRate(FRAMEPACER* pPacer, double dHz)
+{
+	pPacer->dPeriod = 1.0 / dHz;
+	pPacer->dDeadline = PaceNow() + pPacer->dPeriod;
+}
+
+static void ResetFramePacerStats(FRAMEPACER* pPacer)
+{
+	pPacer->llFrames = 0;
+	pPacer->llMissed = 0;
+	pPacer->dSlept = 0.0;
+	pPacer->dSpun = 0.0;
+	pPacer->iHistory = 0;
+	pPacer->nHistory = 0;
+}
+
+static void InitFramePacer(FRAMEPACER* pPacer, double dHz)
+{
+	memset(pPacer, 0, sizeof(*pPacer));
+	pPacer->dSlack = 0.001;
+
+#ifdef _WIN32
+	pPacer->hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (pPacer->hTimer == NULL) {
+		// older windows: normal timer, with the 1ms scheduler tick
+		pPacer->hTimer = CreateWaitableTimer(NULL, TRUE, NULL);
+		pPacer->bPeriod = timeBeginPeriod(1) == TIMERR_NOERROR;
+	}
+#endif
+
+	SetFramePacerRate(pPacer, dHz);
+	pPacer->dLastStart = PaceNow();
+}
+
+static void FreeFramePacer(FRAMEPACER* pPacer)
+{
+#ifdef _WIN32
+	if (pPacer->hTimer) {
+		CloseHandle(pPacer->hTimer);
+		pPacer->hTimer = NULL;
+	}
+	if (pPacer->bPeriod) {
+		timeEndPeriod(1);
+		pPacer->bPeriod = FALSE;
+	}
+#endif
+}
+
+/*
+	Waits for the deadline of the next frame and starts it. Returns the
+	seconds since the previous frame started (also in dFrameDelta)
+*/
+static double WaitNextFrame(FRAMEPACER* pPacer)
+{
+	double dNow = PaceNow();
+	double dRemaining = pPacer->dDeadline - dNow;
+
+	if (dRemaining < 0.0) {
+		pPacer->llMissed++;
+	}
+
+	// sleep most of it, then see how late the OS woke us up
+	if (dRemaining > pPacer->dSlack) {
+		double dAsked = dRemaining - pPacer->dSlack;
+		double t0 = dNow;
+		PaceSleep(pPacer, dAsked);
+		dNow = PaceNow();
+
+		double dOver = (dNow - t0) - dAsked;
+		if (dOver > pPacer->dSlack) {
+			pPacer->dSlack += (dOver - pPacer->dSlack) * 0.5;
+		} else {
+			pPacer->dSlack += (dOver - pPacer->dSlack) * 0.02;
+		}
+		if (pPacer->dSlack < PACE_MIN_SLACK) pPacer->dSlack = PACE_MIN_SLACK;
+		if (pPacer->dSlack > PACE_MAX_SLACK) pPacer->dSlack = PACE_MAX_SLACK;
+		pPacer->dSlept += dNow - t0;
+	}
+
+	// spin the rest
+	double dSpinStart = dNow;
+	while (dNow < pPacer->dDeadline) {
+		PaceSpinPause();
+		dNow = PaceNow();
+	}
+	pPacer->dSpun += dNow - dSpinStart;
+
+	// next deadline on the absolute schedule, or from now if we fell a period behind
+	pPacer->dDeadline += pPacer->dPeriod;
+	if (pPacer->dDeadline < dNow) {
+		pPacer->dDeadline = dNow + pPacer->dPeriod;
+	}
+
+	pPacer->dFrameDelta = dNow - pPacer->dLastStart;
+	pPacer->dLastStart = dNow;
+
+	pPacer->history[pPacer->iHistory] = (float)(pPacer->dFrameDelta * 1000.0);
+	pPacer->iHistory = (pPacer->iHistory + 1) % PACE_HISTORY;
+	if (pPacer->nHistory < PACE_HISTORY) {
+		pPacer->nHistory++;
+	}
+	pPacer->llFrames++;
+
+	return pPacer->dFrameDelta;
+}
+
+static int CompareFloat(const void* a, const void* b)
+{
+	float fa = *(const float*)a, fb = *(const float*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+// percentiles over the last PACE_HISTORY frames
+static void GetFramePacerStats(const FRAMEPACER* pPacer, PACESTATS* pStats)
+{
+	float sorted[PACE_HISTORY];
+	int n = pPacer->nHistory;
+	double dSum = 0.0;
+
+	memset(pStats, 0, sizeof(*pStats));
+	pStats->llFrames = pPacer->llFrames;
+	pStats->llMissed = pPacer->llMissed;
+	if (pPacer->dSlept + pPacer->dSpun > 0.0) {
+		pStats->dSpinShare = pPacer->dSpun / (pPacer->dSlept + pPacer->dSpun);
+	}
+	if (n == 0) {
+		return;
+	}
+
+	memcpy(sorted, pPacer->history, n * sizeof(float));
+	qsort(sorted, n, sizeof(float), CompareFloat);
+	for (int i = 0; i < n; i++) {
+		dSum += sorted[i];
+	}
+
+	pStats->p50 = sorted[(n - 1) * 50 / 100];
+	pStats->p95 = sorted[(n - 1) * 95 / 100];
+	pStats->p99 = sorted[(n - 1) * 99 / 100];
+	pStats->max = sorted[n - 1];
+	pStats->mean = dSum / n;
+}
+
+#endif // PACING_C
@@ -0,0 +1,249 @@
+/*
+	Asset pack: one file, mapped once, assets found by name
+	Notes:
+		- layout: PACKHEADER, the entries sorted by name hash, the bucket
+		  table, the names, then the blobs, each at a multiple of
+		  PACK_ALIGN (64) from the start of the file. The mapping is page
+		  aligned, so every blob (and every texture level in one) is
+		  cache line aligned in memory too
+		- FindPack: hash the name (HashString), the top nBucketBits bits
+		  pick a bucket, the bucket table gives the first entry of it and
+		  of the next one: a few hash compares, then one strcmp to be
+		  sure. Entries are sorted by hash so a bucket is a run of them;
+		  there are at least as many buckets as entries, about one
+		  entry a bucket, O(1)
+		- OpenPack maps the file and checks the header and the tables
+		  fit, nothing else is read or copied; a lookup checks its entry
+		  fits in the file, a texture or mesh checks its own levels (in
+		  the blob, halving from level 0, as big as the format needs).
+		  What the pointers give is the cooked data as it will be used:
+		  texture levels go straight to glTexImage2D /
+		  glCompressedTexImage2D, meshes to glBufferData, shader text to
+		  glShaderSource (with its length, no nul)
+		- PACK_BLOB: the loose file's bytes. PACK_TEXTURE: a PACKTEXTURE
+		  then the levels (largest first, 4 byte pixels top row first or
+		  BC blocks, see bc.c). PACK_MESH: a PACKMESH then the floats
+		- little endian on disk, like the hashes (hash.c)
+		- packcook.c writes packs, cook.c is the command line tool
+*/
+
+#ifndef PACK_C
+#define PACK_C
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mapfile.c"
+#include "hash.c"
+
+#define PACK_MAGIC      0x314B4150u // "PAK1"
+#define PACK_VERSION    1
+#define PACK_ALIGN      64
+#define PACK_HASH_SEED  0x5041434Bu
+#define PACK_MAX_LEVELS 16
+
+#define PACK_BLOB    0
+#define PACK_TEXTURE 1
+#define PACK_MESH    2
+
+// PACKTEXTURE format
+#define PACK_RGBA8 0
+#define PACK_BGRA8 1
+#define PACK_BC1   2
+#define PACK_BC3   3
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t cbFile;
+	uint32_t nEntries;
+	uint32_t nBucketBits;
+	uint64_t entriesOffset;   // PACKENTRY[nEntries], sorted by hash
+	uint64_t bucketsOffset;   // uint32_t[(1 << nBucketBits) + 1]: first entry of each bucket, then nEntries
+	uint64_t namesOffset;     // nul terminated names
+	uint64_t cbNames;
+} PACKHEADER;
+
+typedef struct {
+	uint64_t hash;
+	uint64_t offset;          // from the start of the file
+	uint64_t size;
+	uint32_t nameOffset;      // from namesOffset
+	uint32_t type;            // PACK_BLOB, ...
+} PACKENTRY;
+
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;          // from the start of the blob
+	uint64_t size;
+} PACKLEVEL;
+
+typedef struct {
+	uint32_t  format;         // PACK_RGBA8, ...
+	uint32_t  width;
+	uint32_t  height;
+	uint32_t  nLevels;
+	PACKLEVEL levels[PACK_MAX_LEVELS];
+} PACKTEXTURE;
+
+typedef struct {
+	uint32_t nVertices;
+	uint32_t nFloats;         // per vertex
+	uint64_t offset;          // from the start of the blob
+} PACKMESH;
+
+typedef struct {
+	MAPPEDFILE        file;
+	const PACKHEADER* pHeader;
+	const PACKENTRY*  pEntries;
+	const uint32_t*   pBuckets;
+	const char*       pNames;
+} PACK;
+
+static uint64_t HashPackName(const char* szName)
+{
+	return HashString(szName, PACK_HASH_SEED);
+}
+
+static uint32_t PackBucket(uint64_t hash, uint32_t nBits)
+{
+	return nBits ? (uint32_t)(hash >> (64 - nBits)) : 0;
+}
+
+static void ClosePack(PACK* pPack)
+{
+	UnmapFile(&pPack->file);
+	memset(pPack, 0, sizeof(*pPack));
+}
+
+// 0 if the file isn't there or isn't a pack this code reads
+static int OpenPack(PACK* pPack, const char* szPath)
+{
+	memset(pPack, 0, sizeof(*pPack));
+	if (!MapFile(szPath, &pPack->file)) {
+		return 0;
+	}
+
+	const uint8_t* p = pPack->file.pData;
+	uint64_t cb = pPack->file.cbSize;
+	const PACKHEADER* h = (const PACKHEADER*)p;
+	if (cb < sizeof(PACKHEADER) || h->magic != PACK_MAGIC || h->version != PACK_VERSION || h->cbFile != cb ||
+		h->nBucketBits > 30 || h->entriesOffset % 8 || h->bucketsOffset % 4 ||
+		h->entriesOffset > cb || (uint64_t)h->nEntries * sizeof(PACKENTRY) > cb - h->entriesOffset ||
+		h->bucketsOffset > cb || (((uint64_t)1 << h->nBucketBits) + 1) * 4 > cb - h->bucketsOffset ||
+		h->namesOffset > cb || h->cbNames > cb - h->namesOffset || (h->cbNames && p[h->namesOffset + h->cbNames - 1])) {
+		ClosePack(pPack);
+		return 0;
+	}
+	pPack->pHeader = h;
+	pPack->pEntries = (const PACKENTRY*)(p + h->entriesOffset);
+	pPack->pBuckets = (const uint32_t*)(p + h->bucketsOffset);
+	pPack->pNames = (const char*)(p + h->namesOffset);
+	return 1;
+}
+
+// NULL if there is no such name (or its entry doesn't fit the file)
+static const PACKENTRY* FindPack(const PACK* pPack, const char* szName)
+{
+	if (!pPack->pHeader) {
+		return NULL;
+	}
+	uint64_t hash = HashPackName(szName);
+	uint32_t bucket = PackBucket(hash, pPack->pHeader->nBucketBits);
+	uint32_t first = pPack->pBuckets[bucket], last = pPack->pBuckets[bucket + 1];
+	last = last < pPack->pHeader->nEntries ? last : pPack->pHeader->nEntries;
+
+	for (uint32_t i = first; i < last; i++) {
+		const PACKENTRY* e = &pPack->pEntries[i];
+		if (e->hash == hash && e->nameOffset < pPack->pHeader->cbNames && strcmp(pPack->pNames + e->nameOffset, szName) == 0) {
+			uint64_t cb = pPack->pHeader->cbFile;
+			return e->offset <= cb && e->size <= cb - e->offset ? e : NULL;
+		}
+	}
+	return NULL;
+}
+
+static const uint8_t* PackData(const PACK* pPack, const PACKENTRY* pEntry)
+{
+	return pPack->file.pData + pEntry->offset;
+}
+
+// any entry's bytes (a shader's text), NULL if it isn't there
+static const uint8_t* GetPackBlob(const PACK* pPack, const char* szName, size_t* pcb)
+{
+	const PACKENTRY* e = FindPack(pPack, szName);
+	if (!e) {
+		return NULL;
+	}
+	*pcb = (size_t)e->size;
+	return PackData(pPack, e);
+}
+
+// bytes a level of that size needs (BcImageBytes for the BC formats), 0 for an unknown format
+static uint64_t PackLevelBytes(uint32_t format, uint32_t width, uint32_t height)
+{
+	switch (format) {
+	case PACK_RGBA8:
+	case PACK_BGRA8:
+		return (uint64_t)width * height * 4;
+	case PACK_BC1:
+	case PACK_BC3:
+		return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * (format == PACK_BC3 ? 16 : 8);
+	default:
+		return 0;
+	}
+}
+
+/*
+	NULL if it isn't there, isn't a texture, or a level is outside the blob,
+	smaller than its size and format need, or not max(1, size >> i) of level 0
+	(what goes to glTexImage2D must be what the level says it is)
+*/
+static const PACKTEXTURE* GetPackTexture(const PACK* pPack, const char* szName)
+{
+	const PACKENTRY* e = FindPack(pPack, szName);
+	if (!e || e->type != PACK_TEXTURE || e->size < sizeof(PACKTEXTURE)) {
+		return NULL;
+	}
+	const PACKTEXTURE* t = (const PACKTEXTURE*)PackData(pPack, e);
+	if (t->nLevels < 1 || t->nLevels > PACK_MAX_LEVELS || t->width == 0 || t->height == 0) {
+		return NULL;
+	}
+	for (uint32_t i = 0; i < t->nLevels; i++) {
+		const PACKLEVEL* l = &t->levels[i];
+		uint32_t width = t->width >> i ? t->width >> i : 1;
+		uint32_t height = t->height >> i ? t->height >> i : 1;
+		uint64_t cbNeeded = PackLevelBytes(t->format, width, height);
+		if (l->width != width || l->height != height || cbNeeded == 0 || l->size < cbNeeded ||
+			l->offset > e->size || l->size > e->size - l->offset) {
+			return NULL;
+		}
+	}
+	return t;
+}
+
+static const uint8_t* PackTextureLevel(const PACKTEXTURE* pTexture, int i)
+{
+	return (const uint8_t*)pTexture + pTexture->levels[i].offset;
+}
+
+// NULL if it isn't there, isn't a mesh or the floats don't fit
+static const PACKMESH* GetPackMesh(const PACK* pPack, const char* szName)
+{
+	const PACKENTRY* e = FindPack(pPack, szName);
+	if (!e || e->type != PACK_MESH || e->size < sizeof(PACKMESH)) {
+		return NULL;
+	}
+	const PACKMESH* m = (const PACKMESH*)PackData(pPack, e);
+	uint64_t cbFloats = (uint64_t)m->nVertices * m->nFloats * sizeof(float);
+	return m->offset <= e->size && cbFloats <= e->size - m->offset ? m : NULL;
+}
+
+static const float* PackMeshVertices(const PACKMESH* pMesh)
+{
+	return (const float*)((const uint8_t*)pMesh + pMesh->offset);
+}
+
+#endif // PACK_C
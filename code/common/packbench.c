@@ -0,0 +1,419 @@
+/*
+	Headless test/benchmark for pack.c / packcook.c
+	Notes:
+		- cooks the repo's block BMPs, a 1024x1024 BMP, a shader, a mesh
+		  and 4096 small blobs, then: every name resolves, every blob and
+		  texture level is 64 byte aligned in memory, blobs are the files'
+		  bytes, texture levels are LoadBmp + BuildMipChain's pixels (or
+		  EncodeBcImage's blocks with COOK_BC), the mesh is its floats
+		- names that aren't there (or differ in case) give NULL; a
+		  duplicate name fails the cook; a cut short file, a zero magic, a
+		  wrong size don't open
+		- then ns per FindPack against a strcmp scan of the names, and
+		  startup for the 1K texture: loose (LoadBmp + mips, + BC encode)
+		  against the pack (OpenPack + lookup + touching every byte)
+		- writes packbench* files in the current directory, removes them
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 packbench.c
+		linux:   cc -O2 -pthread packbench.c -o packbench -lm
+*/
+
+#include <stdio.h>
+#include "packcook.c"
+#include "pacing.c"
+
+#define NBLOBS     4096
+#define NBLOBFILES 64
+
+static unsigned int g_uSeed = 1;
+
+static uint8_t RandomByte(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (uint8_t)(g_uSeed >> 24);
+}
+
+static const char* g_szBlocks[3] = { "../rotatingCube/dirt.bmp", "../rotatingCube/grass.bmp", "../rotatingCube/dirtgrass.bmp" };
+static const char  g_szShader[] = "#version 330 core\nvoid main()\n{\n}\n";
+static const char  g_szMesh[] = "# x y z u v\n5\n-0.5f, -0.5f, -0.5f,  0.0f, 0.0f, // first\n 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,\n";
+static const float g_Mesh[10] = { -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f, -0.5f, -0.5f, 1.0f, 0.0f };
+
+static char g_szNames[NBLOBS][32];
+static char g_szPaths[NBLOBFILES][32];
+
+static int WriteBenchFile(const char* szPath, const void* p, size_t cb)
+{
+	FILE* f = fopen(szPath, "wb");
+	int bOk = f && fwrite(p, 1, cb, f) == cb;
+	if (f) {
+		fclose(f);
+	}
+	return bOk;
+}
+
+static void Put32(uint8_t* p, uint32_t v)
+{
+	memcpy(p, &v, 4);
+}
+
+// 24 bpp, bottom up, smooth colours and some noise
+static int WriteBmp24(const char* szPath, int width, int height)
+{
+	size_t pitch = ((size_t)width * 3 + 3) & ~(size_t)3, cb = 54 + pitch * height;
+	uint8_t* p = (uint8_t*)calloc(cb, 1);
+	p[0] = 'B';
+	p[1] = 'M';
+	Put32(p + 2, (uint32_t)cb);
+	Put32(p + 10, 54);
+	Put32(p + 14, 40);
+	Put32(p + 18, (uint32_t)width);
+	Put32(p + 22, (uint32_t)height);
+	p[26] = 1;
+	p[28] = 24;
+	for (int y = 0; y < height; y++) {
+		uint8_t* q = p + 54 + pitch * y;
+		for (int x = 0; x < width; x++) {
+			q[3 * x] = (uint8_t)(x * 255 / width);
+			q[3 * x + 1] = (uint8_t)(y * 255 / height);
+			q[3 * x + 2] = (uint8_t)(128 + (RandomByte() & 31));
+		}
+	}
+	int bOk = WriteBenchFile(szPath, p, cb);
+	free(p);
+	return bOk;
+}
+
+static int IsAligned(const void* p)
+{
+	return ((uintptr_t)p & (PACK_ALIGN - 1)) == 0;
+}
+
+// the texture's levels against a fresh decode + mips (+ blocks)
+static int CheckTexture(const PACK* pPack, const char* szName, const char* szPath, int flags)
+{
+	const PACKTEXTURE* t = GetPackTexture(pPack, szName);
+	BMPIMAGE image;
+	MIPCHAIN chain;
+	if (!t || !LoadBmp(szPath, &image)) {
+		printf("MISMATCH %s: no texture\n", szName);
+		return 1;
+	}
+	BuildMipChain(&chain, image.pPixels, image.width, image.height, image.pitch, MIP_KAISER, 1, 0);
+	int bc = image.bHasAlpha ? BC_BC3 : BC_BC1;
+	int bOk = t->width == (uint32_t)image.width && t->height == (uint32_t)image.height && t->nLevels == (uint32_t)chain.nLevels &&
+			  t->format == ((flags & COOK_BC) ? (uint32_t)(bc == BC_BC3 ? PACK_BC3 : PACK_BC1) :
+												image.format == BMP_BGRA ? PACK_BGRA8 : PACK_RGBA8);
+	for (int i = 0; bOk && i < chain.nLevels; i++) {
+		const MIPLEVEL* level = &chain.levels[i];
+		const uint8_t* p = PackTextureLevel(t, i);
+		bOk = IsAligned(p) && t->levels[i].width == (uint32_t)level->width && t->levels[i].height == (uint32_t)level->height;
+		if (bOk && (flags & COOK_BC)) {
+			BCIMAGE blocks;
+			EncodeBcImage(&blocks, level->pPixels, level->width, level->height, level->pitch, image.format == BMP_BGRA, bc,
+						  BC_HIGH, 1);
+			bOk = t->levels[i].size == blocks.cbData && memcmp(p, blocks.pData, blocks.cbData) == 0;
+			FreeBcImage(&blocks);
+		} else {
+			for (int y = 0; bOk && y < level->height; y++) {
+				bOk = memcmp(p + (size_t)level->width * 4 * y, level->pPixels + (size_t)level->pitch * y, (size_t)level->width * 4) == 0;
+			}
+		}
+	}
+	FreeMipChain(&chain);
+	FreeBmp(&image);
+	if (!bOk) {
+		printf("MISMATCH %s: texture levels\n", szName);
+		return 1;
+	}
+	return 0;
+}
+
+static int CookAll(const char* szOut, int flags)
+{
+	COOKINPUT inputs[NBLOBS + 8];
+	int n = 0;
+	char szError[512];
+
+	for (int i = 0; i < 3; i++) {
+		inputs[n].szName = g_szBlocks[i] + 16;   // "dirt.bmp" ...
+		inputs[n++].szPath = g_szBlocks[i];
+	}
+	inputs[n].szName = "big.bmp";
+	inputs[n++].szPath = "packbench_big.bmp";
+	inputs[n].szName = "cube.vert";
+	inputs[n++].szPath = "packbench.vert";
+	inputs[n].szName = "cube.mesh";
+	inputs[n++].szPath = "packbench.mesh";
+	for (int i = 0; i < NBLOBS; i++) {
+		inputs[n].szName = g_szNames[i];
+		inputs[n++].szPath = g_szPaths[i % NBLOBFILES];
+	}
+	if (!CookPack(szOut, inputs, n, flags, szError, sizeof(szError))) {
+		printf("MISMATCH cook: %s\n", szError);
+		return 1;
+	}
+	return 0;
+}
+
+static int CheckPack(const char* szPack, int flags)
+{
+	PACK pack;
+	if (!OpenPack(&pack, szPack)) {
+		printf("MISMATCH %s doesn't open\n", szPack);
+		return 1;
+	}
+	for (int i = 0; i < 3; i++) {
+		if (CheckTexture(&pack, g_szBlocks[i] + 16, g_szBlocks[i], flags)) {
+			return 1;
+		}
+	}
+	if (CheckTexture(&pack, "big.bmp", "packbench_big.bmp", flags)) {
+		return 1;
+	}
+
+	size_t cb;
+	const uint8_t* p = GetPackBlob(&pack, "cube.vert", &cb);
+	const PACKMESH* pMesh = GetPackMesh(&pack, "cube.mesh");
+	if (!p || cb != strlen(g_szShader) || memcmp(p, g_szShader, cb) != 0 || !IsAligned(p) || !pMesh || pMesh->nFloats != 5 ||
+		pMesh->nVertices != 2 || memcmp(PackMeshVertices(pMesh), g_Mesh, sizeof(g_Mesh)) != 0 || !IsAligned(PackMeshVertices(pMesh))) {
+		printf("MISMATCH %s: shader or mesh\n", szPack);
+		return 1;
+	}
+	for (int i = 0; i < NBLOBS; i++) {
+		char szWant[64];
+		snprintf(szWant, sizeof(szWant), "blob %d of %d", i % NBLOBFILES, NBLOBFILES);
+		p = GetPackBlob(&pack, g_szNames[i], &cb);
+		if (!p || cb != strlen(szWant) || memcmp(p, szWant, cb) != 0 || !IsAligned(p)) {
+			printf("MISMATCH %s: %s\n", szPack, g_szNames[i]);
+			return 1;
+		}
+	}
+	if (FindPack(&pack, "missing") || FindPack(&pack, "DIRT.BMP") || FindPack(&pack, "") || GetPackTexture(&pack, "cube.vert") ||
+		GetPackMesh(&pack, "dirt.bmp")) {
+		printf("MISMATCH %s: found what isn't there\n", szPack);
+		return 1;
+	}
+
+	int nMax = 0, nEmpty = 0;
+	uint32_t nBuckets = 1u << pack.pHeader->nBucketBits;
+	for (uint32_t b = 0; b < nBuckets; b++) {
+		int k = (int)(pack.pBuckets[b + 1] - pack.pBuckets[b]);
+		nMax = k > nMax ? k : nMax;
+		nEmpty += k == 0;
+	}
+	printf("%-20s %5u entries %5u buckets (%d empty, at most %d a bucket), %8llu bytes: ok\n", szPack,
+		   pack.pHeader->nEntries, nBuckets, nEmpty, nMax, (unsigned long long)pack.pHeader->cbFile);
+	ClosePack(&pack);
+	return 0;
+}
+
+static int CheckBadPacks(void)
+{
+	char szError[512];
+	PACK pack;
+	COOKINPUT twice[2] = { { "a", "packbench.vert" }, { "a", "packbench.mesh" } };
+	remove("packbench_bad.pak");
+	if (CookPack("packbench_bad.pak", twice, 2, 0, szError, sizeof(szError)) || OpenPack(&pack, "packbench_bad.pak")) {
+		printf("MISMATCH a name twice was cooked\n");
+		return 1;
+	}
+	COOKINPUT missing[1] = { { "a", "packbench_missing.bmp" } };
+	if (CookPack("packbench_bad.pak", missing, 1, 0, szError, sizeof(szError))) {
+		printf("MISMATCH a missing file was cooked\n");
+		return 1;
+	}
+
+	MAPPEDFILE file;
+	MapFile("packbench.pak", &file);
+	uint8_t* p = (uint8_t*)malloc(file.cbSize + 64);
+	size_t cb = file.cbSize;
+	memcpy(p, file.pData, cb);
+	UnmapFile(&file);
+
+	// a texture level that says less than it is, or a size that doesn't halve
+	int bTexture = 0;
+	PACK good;
+	OpenPack(&good, "packbench.pak");
+	PACKTEXTURE* pTexture = (PACKTEXTURE*)(p + FindPack(&good, "dirt.bmp")->offset);
+	ClosePack(&good);
+	for (int i = 0; i < 3; i++) {
+		PACKTEXTURE saved = *pTexture;
+		if (i == 0) {
+			pTexture->levels[0].size -= 4;
+		} else if (i == 1) {
+			pTexture->levels[1].width++;
+		} else {
+			pTexture->levels[pTexture->nLevels - 1].height = 2;
+		}
+		WriteBenchFile("packbench_bad.pak", p, cb);
+		*pTexture = saved;
+
+		// the pack itself is fine, only the texture is refused
+		if (!OpenPack(&pack, "packbench_bad.pak")) {
+			bTexture = 1;
+			continue;
+		}
+		bTexture |= GetPackTexture(&pack, "dirt.bmp") != NULL;
+		ClosePack(&pack);
+	}
+	if (bTexture) {
+		printf("MISMATCH a texture with a bad level was found\n");
+		remove("packbench_bad.pak");
+		free(p);
+		return 1;
+	}
+
+	int bOpened = 0;
+	WriteBenchFile("packbench_bad.pak", p, cb / 2);
+	bOpened |= OpenPack(&pack, "packbench_bad.pak");
+	WriteBenchFile("packbench_bad.pak", p, cb + 64);
+	bOpened |= OpenPack(&pack, "packbench_bad.pak");
+	WriteBenchFile("packbench_bad.pak", p, 20);
+	bOpened |= OpenPack(&pack, "packbench_bad.pak");
+	memset(p, 0, 4);
+	WriteBenchFile("packbench_bad.pak", p, cb);
+	bOpened |= OpenPack(&pack, "packbench_bad.pak");
+	bOpened |= OpenPack(&pack, "packbench_missing.pak");
+	free(p);
+	remove("packbench_bad.pak");
+	if (bOpened) {
+		printf("MISMATCH a bad pack opened\n");
+		return 1;
+	}
+	printf("name twice, missing file, short texture level, level not halving, cut short, too long, zero magic: refused\n");
+	return 0;
+}
+
+static void BenchLookup(void)
+{
+	PACK pack;
+	OpenPack(&pack, "packbench.pak");
+	int nRuns = 20;
+	uint64_t sum = 0;
+
+	double t0 = PaceNow();
+	for (int r = 0; r < nRuns; r++) {
+		for (int i = 0; i < NBLOBS; i++) {
+			sum += FindPack(&pack, g_szNames[(i * 7919) % NBLOBS])->offset;
+		}
+	}
+	double tHash = (PaceNow() - t0) / ((double)nRuns * NBLOBS);
+
+	// the same names with a scan: what a loose list of files costs
+	t0 = PaceNow();
+	for (int i = 0; i < NBLOBS; i += 8) {
+		const char* szName = g_szNames[(i * 7919) % NBLOBS];
+		for (uint32_t e = 0; e < pack.pHeader->nEntries; e++) {
+			if (strcmp(pack.pNames + pack.pEntries[e].nameOffset, szName) == 0) {
+				sum += pack.pEntries[e].offset;
+				break;
+			}
+		}
+	}
+	double tScan = (PaceNow() - t0) / (NBLOBS / 8);
+	printf("FindPack %d names: %7.1f ns a lookup, strcmp scan %9.1f ns (%llu)\n", NBLOBS + 6, tHash * 1e9, tScan * 1e9,
+		   (unsigned long long)(sum & 1));
+	ClosePack(&pack);
+}
+
+static void BenchStartup(const char* szPack, int flags)
+{
+	double tLoose = 1e9, tPack = 1e9;
+	uint64_t sum = 0;
+
+	for (int r = 0; r < 5; r++) {
+		double t0 = PaceNow();
+		BMPIMAGE image;
+		MIPCHAIN chain;
+		LoadBmp("packbench_big.bmp", &image);
+		BuildMipChain(&chain, image.pPixels, image.width, image.height, image.pitch, MIP_KAISER, 1, 0);
+		if (flags & COOK_BC) {
+			for (int i = 0; i < chain.nLevels; i++) {
+				BCIMAGE blocks;
+				const MIPLEVEL* level = &chain.levels[i];
+				EncodeBcImage(&blocks, level->pPixels, level->width, level->height, level->pitch, 1, BC_BC1, BC_NORMAL, 0);
+				sum += blocks.pData[0];
+				FreeBcImage(&blocks);
+			}
+		}
+		sum += chain.levels[chain.nLevels - 1].pPixels[0];
+		FreeMipChain(&chain);
+		FreeBmp(&image);
+		double t = PaceNow() - t0;
+		tLoose = t < tLoose ? t : tLoose;
+
+		t0 = PaceNow();
+		PACK pack;
+		OpenPack(&pack, szPack);
+		const PACKTEXTURE* pTexture = GetPackTexture(&pack, "big.bmp");
+		// what an upload would read
+		for (uint32_t i = 0; i < pTexture->nLevels; i++) {
+			const uint8_t* p = PackTextureLevel(pTexture, i);
+			for (uint64_t k = 0; k < pTexture->levels[i].size; k += 64) {
+				sum += p[k];
+			}
+		}
+		ClosePack(&pack);
+		t = PaceNow() - t0;
+		tPack = t < tPack ? t : tPack;
+	}
+	printf("1024x1024 to upload ready, %-4s loose %8.2f ms, pack %6.2f ms (%llu)\n", (flags & COOK_BC) ? "BC1" : "RGBA",
+		   tLoose * 1e3, tPack * 1e3, (unsigned long long)(sum & 1));
+}
+
+static void RemoveFiles(void)
+{
+	remove("packbench.pak");
+	remove("packbench_bc.pak");
+	remove("packbench_big.bmp");
+	remove("packbench.vert");
+	remove("packbench.mesh");
+	for (int i = 0; i < NBLOBFILES; i++) {
+		remove(g_szPaths[i]);
+	}
+}
+
+int main(void)
+{
+	InitBmpDecoder();
+	InitMipKernels();
+	InitBcEncoder();
+
+	for (int i = 0; i < NBLOBS; i++) {
+		snprintf(g_szNames[i], sizeof(g_szNames[i]), "blobs/%d.txt", i);
+	}
+	int bOk = WriteBmp24("packbench_big.bmp", 1024, 1024) && WriteBenchFile("packbench.vert", g_szShader, strlen(g_szShader)) &&
+			  WriteBenchFile("packbench.mesh", g_szMesh, strlen(g_szMesh));
+	for (int i = 0; i < NBLOBFILES; i++) {
+		char szText[64];
+		snprintf(g_szPaths[i], sizeof(g_szPaths[i]), "packbench_%d.txt", i);
+		snprintf(szText, sizeof(szText), "blob %d of %d", i, NBLOBFILES);
+		bOk = bOk && WriteBenchFile(g_szPaths[i], szText, strlen(szText));
+	}
+	if (!bOk) {
+		printf("can't write the packbench files here\n");
+		RemoveFiles();
+		return 1;
+	}
+
+	double t0 = PaceNow();
+	int bFail = CookAll("packbench.pak", 0);
+	double tCook = PaceNow() - t0;
+	t0 = PaceNow();
+	bFail = bFail || CookAll("packbench_bc.pak", COOK_BC);
+	double tCookBc = PaceNow() - t0;
+	bFail = bFail || CheckPack("packbench.pak", 0) || CheckPack("packbench_bc.pak", COOK_BC) || CheckBadPacks();
+	if (bFail) {
+		RemoveFiles();
+		return 1;
+	}
+
+	printf("\ncook %.1f ms, with -bc %.1f ms\n", tCook * 1e3, tCookBc * 1e3);
+	BenchLookup();
+	BenchStartup("packbench.pak", 0);
+	BenchStartup("packbench_bc.pak", COOK_BC);
+	RemoveFiles();
+	return 0;
+}
@@ -0,0 +1,355 @@
+/*
+	Writes asset packs (pack.c) from loose files, offline
+	Notes:
+		- CookPack(out, inputs, n, flags): each input is a name (what
+		  FindPack looks up) and a loose file, cooked by its extension:
+		  .bmp: LoadBmp, every mip level (mip.c: Kaiser, sRGB), 4 byte
+		  pixels as decoded (PACK_RGBA8 / PACK_BGRA8); with COOK_BC the
+		  levels as BC1 (no alpha) or BC3 blocks, BC_HIGH (bc.c)
+		  .mesh: text, the first number is the floats per vertex, then
+		  the floats. Anything that isn't part of a number separates, so
+		  the body of a C float array pastes in ("0.5f," reads as 0.5);
+		  # and // comment to the end of the line
+		  anything else: the bytes as they are (shaders)
+		- all the decoding, filtering and encoding happens here, the game
+		  only maps the pack and points into it
+		- names must be unique; two names with the same hash are fine,
+		  FindPack compares the names
+		- the header goes in last (the file starts with a zero magic): a
+		  cook that dies half way leaves a file OpenPack refuses
+*/
+
+#ifndef PACKCOOK_C
+#define PACKCOOK_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pack.c"
+#include "bmp.c"
+#include "mip.c"
+#include "bc.c"
+
+#define COOK_BC 1   // textures as BC1 / BC3 blocks
+
+typedef struct {
+	const char* szName;
+	const char* szPath;
+} COOKINPUT;
+
+typedef struct {
+	const char* szName;
+	uint64_t    hash;
+	uint32_t    type;
+	uint8_t*    pData;
+	size_t      cbData;
+	uint64_t    offset;       // in the pack
+	uint32_t    nameOffset;
+} COOKITEM;
+
+static size_t AlignPack(size_t n)
+{
+	return (n + PACK_ALIGN - 1) & ~(size_t)(PACK_ALIGN - 1);
+}
+
+static int HasCookExtension(const char* szPath, const char* szExt)
+{
+	size_t n = strlen(szPath), m = strlen(szExt);
+	if (n < m) {
+		return 0;
+	}
+	for (size_t i = 0; i < m; i++) {
+		char c = szPath[n - m + i];
+		if ((c >= 'A' && c <= 'Z' ? c + 32 : c) != szExt[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// the file's bytes, plus a nul after them (not counted)
+static uint8_t* ReadCookFile(const char* szPath, size_t* pcb)
+{
+	MAPPEDFILE file;
+	if (!MapFile(szPath, &file)) {
+		return NULL;
+	}
+	uint8_t* p = (uint8_t*)malloc(file.cbSize + 1);
+	if (p) {
+		if (file.cbSize) {
+			memcpy(p, file.pData, file.cbSize);
+		}
+		p[file.cbSize] = 0;
+		*pcb = file.cbSize;
+	}
+	UnmapFile(&file);
+	return p;
+}
+
+static int CookTexture(COOKITEM* pItem, const char* szPath, int flags, char* szError, size_t cbError)
+{
+	BMPIMAGE image;
+	MIPCHAIN chain;
+
+	if (!LoadBmp(szPath, &image)) {
+		snprintf(szError, cbError, "%s: %s", szPath, image.szError);
+		return 0;
+	}
+	if (!BuildMipChain(&chain, image.pPixels, image.width, image.height, image.pitch, MIP_KAISER, 1, 0)) {
+		snprintf(szError, cbError, "%s: out of memory for the mips", szPath);
+		FreeBmp(&image);
+		return 0;
+	}
+
+	PACKTEXTURE header;
+	int bc = image.bHasAlpha ? BC_BC3 : BC_BC1;
+	memset(&header, 0, sizeof(header));
+	header.format = (flags & COOK_BC) ? (bc == BC_BC3 ? PACK_BC3 : PACK_BC1) : image.format == BMP_BGRA ? PACK_BGRA8 : PACK_RGBA8;
+	header.width = (uint32_t)image.width;
+	header.height = (uint32_t)image.height;
+	header.nLevels = (uint32_t)chain.nLevels;
+	size_t cb = AlignPack(sizeof(PACKTEXTURE));
+	for (int i = 0; i < chain.nLevels; i++) {
+		const MIPLEVEL* level = &chain.levels[i];
+		header.levels[i].width = (uint32_t)level->width;
+		header.levels[i].height = (uint32_t)level->height;
+		header.levels[i].offset = cb;
+		header.levels[i].size = (flags & COOK_BC) ? BcImageBytes(level->width, level->height, bc) : (size_t)level->width * level->height * 4;
+		cb = AlignPack(cb + (size_t)header.levels[i].size);
+	}
+
+	uint8_t* p = (uint8_t*)calloc(cb, 1);
+	int bOk = p != NULL;
+	for (int i = 0; bOk && i < chain.nLevels; i++) {
+		const MIPLEVEL* level = &chain.levels[i];
+		uint8_t* pLevel = p + header.levels[i].offset;
+		if (flags & COOK_BC) {
+			BCIMAGE blocks;
+			bOk = EncodeBcImage(&blocks, level->pPixels, level->width, level->height, level->pitch, image.format == BMP_BGRA,
+								bc, BC_HIGH, 0);
+			if (bOk) {
+				memcpy(pLevel, blocks.pData, blocks.cbData);
+				FreeBcImage(&blocks);
+			}
+		} else {
+			for (int y = 0; y < level->height; y++) {
+				memcpy(pLevel + (size_t)level->width * 4 * y, level->pPixels + (size_t)level->pitch * y, (size_t)level->width * 4);
+			}
+		}
+	}
+	FreeMipChain(&chain);
+	FreeBmp(&image);
+	if (!bOk) {
+		snprintf(szError, cbError, "%s: out of memory", szPath);
+		free(p);
+		return 0;
+	}
+	memcpy(p, &header, sizeof(header));
+	pItem->type = PACK_TEXTURE;
+	pItem->pData = p;
+	pItem->cbData = cb;
+	return 1;
+}
+
+static int CookMesh(COOKITEM* pItem, const char* szPath, char* szError, size_t cbError)
+{
+	size_t cbText;
+	char* szText = (char*)ReadCookFile(szPath, &cbText);
+	if (!szText) {
+		snprintf(szError, cbError, "%s: can't read it", szPath);
+		return 0;
+	}
+
+	// numbers only; the first one is the floats per vertex
+	size_t nFloats = 0, nMax = cbText / 2 + 1;
+	float* pFloats = (float*)malloc(nMax * sizeof(float));
+	for (char* s = szText; pFloats && *s;) {
+		if (*s == '#' || (s[0] == '/' && s[1] == '/')) {
+			while (*s && *s != '\n') {
+				s++;
+			}
+			continue;
+		}
+		char* pEnd = s;
+		float v = (*s == '-' || *s == '+' || *s == '.' || (*s >= '0' && *s <= '9')) ? strtof(s, &pEnd) : 0.0f;
+		if (pEnd == s) {
+			s++;
+			continue;
+		}
+		pFloats[nFloats++] = v;
+		s = pEnd;
+	}
+	free(szText);
+
+	int stride = nFloats ? (int)pFloats[0] : 0;
+	if (!pFloats || stride < 1 || (float)stride != pFloats[0] || (nFloats - 1) % stride != 0) {
+		snprintf(szError, cbError, "%s: want the floats per vertex, then whole vertices", szPath);
+		free(pFloats);
+		return 0;
+	}
+
+	PACKMESH header;
+	header.nVertices = (uint32_t)((nFloats - 1) / stride);
+	header.nFloats = (uint32_t)stride;
+	header.offset = AlignPack(sizeof(PACKMESH));
+	size_t cbFloats = (nFloats - 1) * sizeof(float);
+	uint8_t* p = (uint8_t*)calloc((size_t)header.offset + cbFloats + 1, 1);
+	if (!p) {
+		snprintf(szError, cbError, "%s: out of memory", szPath);
+		free(pFloats);
+		return 0;
+	}
+	memcpy(p, &header, sizeof(header));
+	memcpy(p + header.offset, pFloats + 1, cbFloats);
+	free(pFloats);
+	pItem->type = PACK_MESH;
+	pItem->pData = p;
+	pItem->cbData = (size_t)header.offset + cbFloats;
+	return 1;
+}
+
+static int CompareCookItems(const void* a, const void* b)
+{
+	const COOKITEM* p = (const COOKITEM*)a;
+	const COOKITEM* q = (const COOKITEM*)b;
+	if (p->hash != q->hash) {
+		return p->hash < q->hash ? -1 : 1;
+	}
+	return strcmp(p->szName, q->szName);
+}
+
+static void FreeCookItems(COOKITEM* pItems, int n)
+{
+	for (int i = 0; i < n; i++) {
+		free(pItems[i].pData);
+	}
+	free(pItems);
+}
+
+static int WriteCookPadding(FILE* f, size_t n)
+{
+	static const uint8_t zeros[PACK_ALIGN] = { 0 };
+	return n == 0 || fwrite(zeros, 1, n, f) == n;
+}
+
+/*
+	Cooks the n inputs into szOut. Returns 0 and a message in szError if
+	a file can't be read or cooked, a name is there twice or the pack
+	can't be written
+*/
+static int CookPack(const char* szOut, const COOKINPUT* pInputs, int n, int flags, char* szError, size_t cbError)
+{
+	COOKITEM* pItems = (COOKITEM*)calloc(n > 0 ? n : 1, sizeof(COOKITEM));
+	if (!pItems) {
+		snprintf(szError, cbError, "out of memory");
+		return 0;
+	}
+
+	size_t cbNames = 0;
+	for (int i = 0; i < n; i++) {
+		COOKITEM* item = &pItems[i];
+		const char* szPath = pInputs[i].szPath;
+		item->szName = pInputs[i].szName;
+		item->hash = HashPackName(item->szName);
+		item->nameOffset = (uint32_t)cbNames;
+		cbNames += strlen(item->szName) + 1;
+
+		int bOk;
+		if (HasCookExtension(szPath, ".bmp")) {
+			bOk = CookTexture(item, szPath, flags, szError, cbError);
+		} else if (HasCookExtension(szPath, ".mesh")) {
+			bOk = CookMesh(item, szPath, szError, cbError);
+		} else {
+			item->type = PACK_BLOB;
+			item->pData = ReadCookFile(szPath, &item->cbData);
+			bOk = item->pData != NULL;
+			if (!bOk) {
+				snprintf(szError, cbError, "%s: can't read it", szPath);
+			}
+		}
+		if (!bOk) {
+			FreeCookItems(pItems, n);
+			return 0;
+		}
+	}
+
+	qsort(pItems, n, sizeof(COOKITEM), CompareCookItems);
+	for (int i = 1; i < n; i++) {
+		if (strcmp(pItems[i].szName, pItems[i - 1].szName) == 0) {
+			snprintf(szError, cbError, "%s: the name is there twice", pItems[i].szName);
+			FreeCookItems(pItems, n);
+			return 0;
+		}
+	}
+
+	// at least as many buckets as entries
+	PACKHEADER header;
+	memset(&header, 0, sizeof(header));
+	while ((1u << header.nBucketBits) < (uint32_t)n) {
+		header.nBucketBits++;
+	}
+	uint32_t nBuckets = 1u << header.nBucketBits;
+	header.version = PACK_VERSION;
+	header.nEntries = (uint32_t)n;
+	header.entriesOffset = sizeof(PACKHEADER);
+	header.bucketsOffset = header.entriesOffset + (uint64_t)n * sizeof(PACKENTRY);
+	header.namesOffset = header.bucketsOffset + ((uint64_t)nBuckets + 1) * sizeof(uint32_t);
+	header.cbNames = cbNames;
+	uint64_t offset = AlignPack((size_t)(header.namesOffset + cbNames));
+	for (int i = 0; i < n; i++) {
+		pItems[i].offset = offset;
+		offset = AlignPack((size_t)(offset + pItems[i].cbData));
+	}
+	header.cbFile = offset;
+
+	PACKENTRY* pEntries = (PACKENTRY*)calloc(n > 0 ? n : 1, sizeof(PACKENTRY));
+	uint32_t* pBuckets = (uint32_t*)malloc(((size_t)nBuckets + 1) * sizeof(uint32_t));
+	char* pNames = (char*)malloc(cbNames > 0 ? cbNames : 1);
+	FILE* f = pEntries && pBuckets && pNames ? fopen(szOut, "wb") : NULL;
+	int bOk = f != NULL;
+	if (bOk) {
+		uint32_t e = 0;
+		for (uint32_t b = 0; b <= nBuckets; b++) {
+			while (e < (uint32_t)n && PackBucket(pItems[e].hash, header.nBucketBits) < b) {
+				e++;
+			}
+			pBuckets[b] = b == nBuckets ? (uint32_t)n : e;
+		}
+		for (int i = 0; i < n; i++) {
+			pEntries[i].hash = pItems[i].hash;
+			pEntries[i].offset = pItems[i].offset;
+			pEntries[i].size = pItems[i].cbData;
+			pEntries[i].nameOffset = pItems[i].nameOffset;
+			pEntries[i].type = pItems[i].type;
+			memcpy(pNames + pItems[i].nameOffset, pItems[i].szName, strlen(pItems[i].szName) + 1);
+		}
+
+		bOk = fwrite(&header, sizeof(header), 1, f) == 1 && (n == 0 || fwrite(pEntries, sizeof(PACKENTRY), n, f) == (size_t)n) &&
+			  fwrite(pBuckets, sizeof(uint32_t), nBuckets + 1, f) == nBuckets + 1 &&
+			  (cbNames == 0 || fwrite(pNames, 1, cbNames, f) == cbNames);
+		uint64_t at = header.namesOffset + cbNames;
+		for (int i = 0; bOk && i < n; i++) {
+			bOk = WriteCookPadding(f, (size_t)(pItems[i].offset - at)) && fwrite(pItems[i].pData, 1, pItems[i].cbData, f) == pItems[i].cbData;
+			at = pItems[i].offset + pItems[i].cbData;
+		}
+		bOk = bOk && WriteCookPadding(f, (size_t)(header.cbFile - at)) && fflush(f) == 0;
+		header.magic = PACK_MAGIC;
+		bOk = bOk && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+		bOk = fclose(f) == 0 && bOk;
+		if (!bOk) {
+			remove(szOut);
+		}
+	}
+	if (!bOk) {
+		snprintf(szError, cbError, "%s: can't write it", szOut);
+	}
+	free(pEntries);
+	free(pBuckets);
+	free(pNames);
+	FreeCookItems(pItems, n);
+	return bOk;
+}
+
+#endif // PACKCOOK_C
@@ -0,0 +1,205 @@
+/*
+	Shader program binaries cached on disk
+	Notes:
+		- BuildProgramCached: BuildProgram (glprogram.c) through a directory
+		  of .glb files. The key hashes every stage's type and text and the
+		  driver's GL_VENDOR, GL_RENDERER, GL_VERSION and GL_SHADING_LANGUAGE
+		  _VERSION strings: other shaders or another driver is another file
+		- a hit maps the file (mapfile.c) and hands it to glProgramBinary,
+		  nothing is compiled. A driver can still turn a binary down (its
+		  strings say the same, its compiler moved on): LINK_STATUS says
+		  so, the sources are compiled and the file written again (bStale)
+		- a miss compiles with GL_PROGRAM_BINARY_RETRIEVABLE_HINT and writes
+		  glGetProgramBinary's bytes; header last, as bc.c does, a file
+		  cut short never loads
+		- no binary formats (GL_NUM_PROGRAM_BINARY_FORMATS 0, or a driver
+		  older than 4.1 / ARB_get_program_binary): compiled every time.
+		  Nor does a cache that can't be written cost anything but the
+		  compile. Old files are never deleted
+		- tSeconds: sources or file to a linked program; a driver can
+		  still finish the work at the first draw, the numbers are what
+		  startup waits for
+		- the program's uniform block bindings and sampler units come back
+		  with a binary as they were at the link, set them again anyway
+		  (cube does, after ReflectProgram)
+*/
+
+#ifndef PROGCACHE_C
+#define PROGCACHE_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "glprogram.c"
+#include "mapfile.c"
+#include "hash.c"
+#include "pacing.c"
+
+#define PROGRAM_CACHE_MAGIC   0x31424C47u // "GLB1"
+#define PROGRAM_CACHE_VERSION 1
+#define PROGRAM_MAX_LOG       2048
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t cbBinary;
+} PROGRAMCACHEHEADER;
+
+typedef struct {
+	int      bFromCache; // the driver took the file, nothing compiled
+	int      bStale;     // there was a file, the driver turned it down: compiled, written again
+	int      bSaved;     // a new file was written
+	uint64_t key;
+	double   tSeconds;   // to a linked program
+	char     szLog[PROGRAM_MAX_LOG]; // the compile / link logs that said something
+} PROGRAMBUILD;
+
+static void ClearGLErrors(void)
+{
+	for (int i = 0; i < 16 && glGetError() != GL_NO_ERROR; i++) {
+	}
+}
+
+static uint64_t ProgramCacheKey(const SHADERSOURCE* pSources, int nSources)
+{
+	static const GLenum strings[4] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	uint32_t version = PROGRAM_CACHE_VERSION;
+	uint64_t h = HashBytes(&version, sizeof(version), 0);
+
+	for (int i = 0; i < 4; i++) {
+		const char* sz = (const char*)glGetString(strings[i]);
+		h = HashString(sz ? sz : "", h);
+	}
+	for (int i = 0; i < nSources; i++) {
+		uint32_t type = pSources[i].type;
+		h = HashBytes(&type, sizeof(type), h);
+		h = HashBytes(pSources[i].pText, (size_t)pSources[i].cbText, h);
+	}
+	return h;
+}
+
+// the program from the file, 0 if the file isn't there, isn't this key, or the driver turns it down
+static GLuint LoadProgramCacheFile(const char* szPath, uint64_t key, int* pbStale)
+{
+	MAPPEDFILE file;
+	PROGRAMCACHEHEADER header;
+	GLuint program = 0;
+
+	if (!MapFile(szPath, &file)) {
+		return 0;
+	}
+	if (file.cbSize >= sizeof(header)) {
+		memcpy(&header, file.pData, sizeof(header));
+	}
+	if (file.cbSize < sizeof(header) || header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION ||
+		header.key != key || header.cbBinary != file.cbSize - sizeof(header)) {
+		UnmapFile(&file);
+		return 0;
+	}
+
+	GLint bOk = 0;
+	program = glCreateProgram();
+	glProgramBinary(program, header.binaryFormat, file.pData + sizeof(header), (GLsizei)header.cbBinary);
+	glGetProgramiv(program, GL_LINK_STATUS, &bOk);
+	UnmapFile(&file);
+	if (!bOk) {
+		ClearGLErrors(); // GL_INVALID_ENUM for a format the driver doesn't have
+		glDeleteProgram(program);
+		*pbStale = 1;
+		return 0;
+	}
+	return program;
+}
+
+// the header goes in last: a file cut short by a crash never matches
+static int SaveProgramCacheFile(const char* szPath, uint64_t key, GLuint program)
+{
+	GLint cbBinary = 0;
+	GLsizei cbGot = 0;
+	GLenum binaryFormat = 0;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &cbBinary);
+	if (cbBinary <= 0) {
+		return 0;
+	}
+	void* pBinary = malloc((size_t)cbBinary);
+	if (!pBinary) {
+		return 0;
+	}
+	glGetProgramBinary(program, cbBinary, &cbGot, &binaryFormat, pBinary);
+	if (cbGot <= 0) {
+		free(pBinary);
+		return 0;
+	}
+
+	PROGRAMCACHEHEADER header = { 0, PROGRAM_CACHE_VERSION, key, binaryFormat, (uint32_t)cbGot };
+	FILE* f = fopen(szPath, "wb");
+	if (!f) {
+		free(pBinary);
+		return 0;
+	}
+	int bOk = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(pBinary, 1, (size_t)cbGot, f) == (size_t)cbGot &&
+			  fflush(f) == 0;
+	header.magic = PROGRAM_CACHE_MAGIC;
+	bOk = bOk && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+	bOk = fclose(f) == 0 && bOk;
+	if (!bOk) {
+		remove(szPath);
+	}
+	free(pBinary);
+	return bOk;
+}
+
+/*
+	BuildProgram through szCacheDir (made if it isn't there). 0 if the
+	sources don't build, the logs are in pBuild->szLog and on stderr
+*/
+static GLuint BuildProgramCached(const char* szCacheDir, const SHADERSOURCE* pSources, int nSources, PROGRAMBUILD* pBuild)
+{
+	char szPath[1024];
+	GLint nFormats = 0;
+	double t0 = PaceNow();
+
+	memset(pBuild, 0, sizeof(*pBuild));
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+	ClearGLErrors(); // GL_INVALID_ENUM before 4.1: no binaries
+	if (nFormats <= 0) {
+		GLuint program = BuildProgram(pSources, nSources, 0, pBuild->szLog, sizeof(pBuild->szLog));
+		pBuild->tSeconds = PaceNow() - t0;
+		return program;
+	}
+
+	pBuild->key = ProgramCacheKey(pSources, nSources);
+	snprintf(szPath, sizeof(szPath), "%s/%016llx.glb", szCacheDir, (unsigned long long)pBuild->key);
+	GLuint program = LoadProgramCacheFile(szPath, pBuild->key, &pBuild->bStale);
+	if (program) {
+		pBuild->bFromCache = 1;
+		pBuild->tSeconds = PaceNow() - t0;
+		return program;
+	}
+
+	program = BuildProgram(pSources, nSources, PROGRAM_RETRIEVABLE, pBuild->szLog, sizeof(pBuild->szLog));
+	pBuild->tSeconds = PaceNow() - t0;
+	if (!program) {
+		return 0;
+	}
+#ifdef _WIN32
+	_mkdir(szCacheDir);
+#else
+	mkdir(szCacheDir, 0755);
+#endif
+	pBuild->bSaved = SaveProgramCacheFile(szPath, pBuild->key, program);
+	return program;
+}
+
+#endif // PROGCACHE_C
@@ -0,0 +1,345 @@
+/*
+	Test/benchmark for progcache.c on a headless context (glheadless.c)
+	Notes:
+		- cube's program, ../OpenGLworks/cube/cube.vert and cube.frag, run
+		  from this directory; the cache goes in progcachebench.tmp/ and is
+		  removed at the end
+		- cold: no file, compile + link + glGetProgramBinary + write; warm:
+		  glProgramBinary from the mapped file. Best of a few of each, every
+		  cold run with a comment no run had before: Mesa keeps a shader
+		  cache of its own (and has no program binaries without it), a
+		  source it has seen would compile warm
+		- the cached program must be the one compiled: same reflection,
+		  same pixels in a 64x64 FBO
+		- a binary the driver turns down (bytes flipped, a format it
+		  doesn't have) compiles and is written again, then loads; a file
+		  cut short is a miss; a changed source is another file; a shader
+		  that doesn't compile gives 0 and its log (with the file name),
+		  and writes nothing
+		- linux: LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe on a box with a gpu
+		- exits with 1 on a mismatch, 2 if there is no GL context
+
+	build:
+		windows: cl /nologo /O2 /I..\OpenGLworks\include progcachebench.c opengl32.lib user32.lib gdi32.lib
+		linux:   cc -O2 progcachebench.c -o progcachebench -lEGL -lOpenGL -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "glheadless.c"
+#include "progcache.c"
+
+#define CACHE_DIR "progcachebench.tmp"
+#define SIDE      64
+#define RUNS      5
+
+static int g_nErrors;
+
+static void Check(int bOk, const char* szWhat)
+{
+	if (!bOk) {
+		printf("FAILED: %s\n", szWhat);
+		g_nErrors++;
+	}
+}
+
+static void CachePath(char* szPath, size_t cb, uint64_t key)
+{
+	snprintf(szPath, cb, "%s/%016llx.glb", CACHE_DIR, (unsigned long long)key);
+}
+
+// count bytes of the file at offset xored with 0x5A
+static void DamageFile(const char* szPath, long offset, int count)
+{
+	FILE* f = fopen(szPath, "r+b");
+	unsigned char b[64];
+	if (!f) {
+		return;
+	}
+	fseek(f, offset, SEEK_SET);
+	count = (int)fread(b, 1, count < 64 ? count : 64, f);
+	for (int i = 0; i < count; i++) {
+		b[i] ^= 0x5A;
+	}
+	fseek(f, offset, SEEK_SET);
+	fwrite(b, 1, count, f);
+	fclose(f);
+}
+
+static void TruncateFile(const char* szPath, long cb)
+{
+	MAPPEDFILE file;
+	if (MapFile(szPath, &file)) {
+		void* p = malloc(cb);
+		memcpy(p, file.pData, cb);
+		UnmapFile(&file);
+		FILE* f = fopen(szPath, "wb");
+		fwrite(p, 1, cb, f);
+		fclose(f);
+		free(p);
+	}
+}
+
+/*
+	a 64x64 frame with a program: a quad through the Frame block, a
+	checker texture
+*/
+static GLuint g_Vao, g_Texture, g_Fbo, g_FrameBuffer;
+
+static void CreateScene(void)
+{
+	static const float quad[6 * 5] = {
+		-1.0f, -1.0f, 0.0f,  0.0f, 0.0f,   1.0f, -1.0f, 0.0f,  1.0f, 0.0f,   1.0f, 1.0f, 0.0f,  1.0f, 1.0f,
+		 1.0f,  1.0f, 0.0f,  1.0f, 1.0f,  -1.0f,  1.0f, 0.0f,  0.0f, 1.0f,  -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+	};
+	// projection, view, model: the quad at z = -2.5, tilted
+	float frame[48] = {
+		2.414f, 0, 0, 0,  0, 2.414f, 0, 0,  0, 0, -1.002f, -1,  0, 0, -0.2002f, 0,
+		1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, -2.5f, 1,
+		0.8f, 0.3f, 0, 0,  -0.3f, 0.8f, 0.5f, 0,  0, -0.5f, 0.8f, 0,  0, 0, 0, 1,
+	};
+	GLuint vbo, color;
+	unsigned char checker[8 * 8 * 4];
+
+	glGenVertexArrays(1, &g_Vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(g_Vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	for (int i = 0; i < 8 * 8; i++) {
+		unsigned char c = ((i ^ (i >> 3)) & 1) ? 230 : 40;
+		checker[i * 4 + 0] = c;
+		checker[i * 4 + 1] = (unsigned char)(c / 2 + i);
+		checker[i * 4 + 2] = (unsigned char)(255 - c);
+		checker[i * 4 + 3] = 255;
+	}
+	glGenTextures(1, &g_Texture);
+	glBindTexture(GL_TEXTURE_2D, g_Texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 8, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &color);
+	glBindTexture(GL_TEXTURE_2D, color);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SIDE, SIDE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glGenFramebuffers(1, &g_Fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, g_Fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+	Check(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "framebuffer");
+
+	glGenBuffers(1, &g_FrameBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, g_FrameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame), frame, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, g_FrameBuffer);
+}
+
+static void DrawScene(GLuint program, unsigned char* pPixels)
+{
+	PROGRAMINFO info;
+	ReflectProgram(&info, program);
+	BindProgramBlock(&info, "Frame", 0);
+	glUseProgram(program);
+	glUniform1i(GetProgramUniform(&info, "texture1"), 0);
+	glViewport(0, 0, SIDE, SIDE);
+	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBindTexture(GL_TEXTURE_2D, g_Texture);
+	glBindVertexArray(g_Vao);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glReadPixels(0, 0, SIDE, SIDE, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+}
+
+static int SameReflection(const PROGRAMINFO* a, const PROGRAMINFO* b)
+{
+	if (a->nUniforms != b->nUniforms || a->nBlocks != b->nBlocks) {
+		return 0;
+	}
+	for (int i = 0; i < a->nUniforms; i++) {
+		const PROGRAMUNIFORM* u = FindProgramUniform(b, a->uniforms[i].szName);
+		if (!u || u->type != a->uniforms[i].type || u->offset != a->uniforms[i].offset || u->size != a->uniforms[i].size) {
+			return 0;
+		}
+	}
+	for (int i = 0; i < a->nBlocks; i++) {
+		const PROGRAMBLOCK* block = FindProgramBlock(b, a->blocks[i].szName);
+		if (!block || block->cbSize != a->blocks[i].cbSize) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+int main(void)
+{
+	HEADLESSGL gl;
+	if (!CreateHeadlessGL(&gl)) {
+		return 2;
+	}
+	GLint nFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+	printf("%s, %s, %d binary formats\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION),
+		   nFormats);
+	if (nFormats <= 0) {
+		printf("no program binaries here: only the compile path is tested\n");
+	}
+
+	MAPPEDFILE vertexFile, fragmentFile;
+	if (!MapFile("../OpenGLworks/cube/cube.vert", &vertexFile) || !MapFile("../OpenGLworks/cube/cube.frag", &fragmentFile)) {
+		printf("run from code/common: no ../OpenGLworks/cube/cube.vert, cube.frag\n");
+		return 1;
+	}
+	SHADERSOURCE sources[2] = {
+		{ GL_VERTEX_SHADER, "cube.vert", (const GLchar*)vertexFile.pData, (GLint)vertexFile.cbSize },
+		{ GL_FRAGMENT_SHADER, "cube.frag", (const GLchar*)fragmentFile.pData, (GLint)fragmentFile.cbSize },
+	};
+	static PROGRAMBUILD build;
+	char szPath[1024];
+	uint64_t key = ProgramCacheKey(sources, 2);
+	CachePath(szPath, sizeof(szPath), key);
+	remove(szPath);
+
+	/*
+		cold and warm
+	*/
+	double tCold[RUNS], tWarm[RUNS];
+	int bColdOk = 1, bWarmOk = 1;
+	for (int run = 0; run < RUNS; run++) {
+		char szNew[4096], szNewPath[1024];
+		int cbNew = snprintf(szNew, sizeof(szNew), "%.*s// cold run %d at %.0f\n", (int)fragmentFile.cbSize,
+							 (const char*)fragmentFile.pData, run, PaceNow() * 1e6);
+		SHADERSOURCE cold[2] = { sources[0], { GL_FRAGMENT_SHADER, "cube.frag", szNew, cbNew } };
+		uint64_t coldKey = ProgramCacheKey(cold, 2);
+		CachePath(szNewPath, sizeof(szNewPath), coldKey);
+
+		GLuint program = BuildProgramCached(CACHE_DIR, cold, 2, &build);
+		bColdOk = bColdOk && program && !build.bFromCache && !build.bStale && build.bSaved == (nFormats > 0);
+		tCold[run] = build.tSeconds;
+		glDeleteProgram(program);
+
+		program = BuildProgramCached(CACHE_DIR, cold, 2, &build);
+		bWarmOk = bWarmOk && program && build.bFromCache == (nFormats > 0) && !build.bStale;
+		tWarm[run] = build.tSeconds;
+		glDeleteProgram(program);
+		remove(szNewPath);
+	}
+	Check(bColdOk, "cold: compiled and written");
+	Check(bWarmOk, "warm: from the file");
+	qsort(tCold, RUNS, sizeof(double), CompareDoubles);
+	qsort(tWarm, RUNS, sizeof(double), CompareDoubles);
+	printf("cold (compile + link + write) %7.2f ms, warm (glProgramBinary) %7.2f ms, best of %d (median %.2f / %.2f)\n",
+		   tCold[0] * 1e3, tWarm[0] * 1e3, RUNS, tCold[RUNS / 2] * 1e3, tWarm[RUNS / 2] * 1e3);
+
+	/*
+		the cached program is the compiled one
+	*/
+	static unsigned char compiledPixels[SIDE * SIDE * 4], cachedPixels[SIDE * SIDE * 4];
+	PROGRAMINFO compiledInfo, cachedInfo;
+	GLuint compiled = BuildProgram(sources, 2, 0, NULL, 0);
+	GLuint cached = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+	Check(compiled && cached && !build.bFromCache && (nFormats <= 0 || build.key == key), "both programs");
+	glDeleteProgram(cached);
+	cached = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+	Check(cached && build.bFromCache == (nFormats > 0), "the cached one from the file");
+	ReflectProgram(&compiledInfo, compiled);
+	ReflectProgram(&cachedInfo, cached);
+	Check(SameReflection(&compiledInfo, &cachedInfo), "same uniforms and blocks");
+	CreateScene();
+	DrawScene(compiled, compiledPixels);
+	DrawScene(cached, cachedPixels);
+	int nDrawn = 0;
+	for (int i = 0; i < SIDE * SIDE; i++) {
+		nDrawn += compiledPixels[i * 4] != 51; // not the clear colour
+	}
+	Check(nDrawn > SIDE * SIDE / 8, "the quad is drawn");
+	Check(memcmp(compiledPixels, cachedPixels, sizeof(cachedPixels)) == 0, "same pixels from the cached program");
+	glDeleteProgram(compiled);
+	glDeleteProgram(cached);
+
+	if (nFormats > 0) {
+		/*
+			stale: the driver turns the binary down
+		*/
+		GLuint program;
+		DamageFile(szPath, (long)sizeof(PROGRAMCACHEHEADER) + 16, 64);
+		program = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+		Check(program && !build.bFromCache && build.bStale && build.bSaved, "flipped bytes: compiled again");
+		glDeleteProgram(program);
+		program = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+		Check(program && build.bFromCache, "then from the file");
+		glDeleteProgram(program);
+
+		DamageFile(szPath, (long)offsetof(PROGRAMCACHEHEADER, binaryFormat), 4);
+		program = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+		Check(program && !build.bFromCache && build.bStale && build.bSaved, "a format the driver doesn't have");
+		Check(glGetError() == GL_NO_ERROR, "the driver's complaint is cleared");
+		glDeleteProgram(program);
+
+		TruncateFile(szPath, (long)sizeof(PROGRAMCACHEHEADER) + 10);
+		program = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+		Check(program && !build.bFromCache && !build.bStale && build.bSaved, "cut short: a miss");
+		glDeleteProgram(program);
+		program = BuildProgramCached(CACHE_DIR, sources, 2, &build);
+		Check(program && build.bFromCache, "then from the file");
+		glDeleteProgram(program);
+	}
+
+	/*
+		another source, a broken one
+	*/
+	char szChanged[4096];
+	int cbChanged = snprintf(szChanged, sizeof(szChanged), "%.*s// changed\n", (int)fragmentFile.cbSize,
+							 (const char*)fragmentFile.pData);
+	SHADERSOURCE changed[2] = { sources[0], { GL_FRAGMENT_SHADER, "changed.frag", szChanged, cbChanged } };
+	uint64_t changedKey = ProgramCacheKey(changed, 2);
+	char szChangedPath[1024];
+	CachePath(szChangedPath, sizeof(szChangedPath), changedKey);
+	GLuint program = BuildProgramCached(CACHE_DIR, changed, 2, &build);
+	Check(program && changedKey != key && !build.bFromCache, "a changed source is another file");
+	glDeleteProgram(program);
+
+	static const char szBroken[] = "#version 330 core\nout vec4 FragColor;\nvoid main()\n{\n\tFragColor = nothing;\n}\n";
+	SHADERSOURCE broken[2] = { sources[0], { GL_FRAGMENT_SHADER, "broken.frag", szBroken, (GLint)sizeof(szBroken) - 1 } };
+	char szBrokenPath[1024];
+	CachePath(szBrokenPath, sizeof(szBrokenPath), ProgramCacheKey(broken, 2));
+	printf("(a compile error expected:)\n");
+	fflush(stdout);
+	program = BuildProgramCached(CACHE_DIR, broken, 2, &build);
+	MAPPEDFILE brokenFile;
+	int bWritten = MapFile(szBrokenPath, &brokenFile);
+	UnmapFile(&brokenFile);
+	Check(!program && !build.bSaved && !bWritten, "a broken shader: 0, nothing written");
+	Check(strstr(build.szLog, "broken.frag doesn't compile") != NULL && strlen(build.szLog) > 40, "its log");
+	Check(glGetError() == GL_NO_ERROR, "no GL errors");
+
+	remove(szPath);
+	remove(szChangedPath);
+#ifdef _WIN32
+	RemoveDirectoryA(CACHE_DIR);
+#else
+	rmdir(CACHE_DIR);
+#endif
+	UnmapFile(&vertexFile);
+	UnmapFile(&fragmentFile);
+	DestroyHeadlessGL(&gl);
+
+	if (g_nErrors) {
+		printf("%d FAILED\n", g_nErrors);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
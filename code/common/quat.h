@@ -0,0 +1,373 @@
+/*
+	quat: rotation quaternions for the GL demos (header only, needs mat4.h)
+	Notes:
+		- quat is {x, y, z, w} = {axis * sin(angle/2), cos(angle/2)}, a unit
+		  quaternion is a rotation; quat_to_mat4 gives the same matrix as
+		  mat4_rotate for the same axis and angle
+		- quat_mul(a, b) is a * b: rotate by b, then by a (like matrices)
+		- spinning objects: keep an orientation, multiply by a small step
+		  every frame and normalize once in a while:
+				q = quat_normalize(quat_mul(step, q));
+		  no trig at all per frame, step is built once from the spin speed
+		- quat_nlerp is lerp + normalize (cheap, speed not constant), quat_slerp
+		  is constant speed; both take the short way round (flip b when
+		  dot < 0)
+		- sincos_approx: range reduction to [-pi/4, pi/4] with pi/2 in three
+		  parts (Cody-Waite) and two small polynomials (the cephes sinf/cosf
+		  ones); max absolute error 1.2e-7 for |x| <= 8192 (measured by
+		  quatbench against double sin/cos), past that the reduction loses bits
+		- sincos_batch does 4 at a time with SSE2 (bit-identical to
+		  sincos_approx), quat_from_axis_angle_batch uses it for thousands of
+		  objects at once
+		- quat_to_mat4_batch and quat_spin_batch (multiply by the step,
+		  normalize, to mat4) do 4 objects per register, quaternions are
+		  transposed in and matrix columns out with _MM_TRANSPOSE4_PS
+*/
+
+#ifndef QUAT_H
+#define QUAT_H
+
+#include <stdint.h>
+#include "mat4.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define QUAT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+typedef struct
+{
+    float x, y, z, w;
+} quat;
+
+#define QUAT_IDENTITY_INIT { 0.0f, 0.0f, 0.0f, 1.0f }
+
+/* Cody-Waite pi/2 = DP1 + DP2 + DP3, the reduction constants of cephes sinf */
+#define SINCOS_2_PI 0.63661977236758134f
+#define SINCOS_DP1  1.5703125f
+#define SINCOS_DP2  4.837512969970703125e-4f
+#define SINCOS_DP3  7.54978995489188216e-8f
+
+/* sin and cos of x, max error 1.2e-7 for |x| <= 8192 */
+static inline void sincos_approx(float x, float* s, float* c)
+{
+    // nearest multiple of pi/2 and what is left of x, in [-pi/4, pi/4]
+    float j = (float)(int)(x * SINCOS_2_PI + copysignf(0.5f, x));
+    int q = (int)j;
+    float r = ((x - j * SINCOS_DP1) - j * SINCOS_DP2) - j * SINCOS_DP3;
+    float r2 = r * r;
+
+    float ps = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    float pc = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+    // quadrant: 0 (s, c), 1 (c, -s), 2 (-s, -c), 3 (-c, s); on the bits
+    // like the SSE version, branches on random angles mispredict half the time
+    uint32_t us, uc;
+    memcpy(&us, &ps, 4);
+    memcpy(&uc, &pc, 4);
+    uint32_t swap = 0u - (uint32_t)(q & 1);
+    uint32_t bs = ((uc & swap) | (us & ~swap)) ^ ((uint32_t)(q & 2) << 30);
+    uint32_t bc = ((us & swap) | (uc & ~swap)) ^ ((uint32_t)((q + 1) & 2) << 30);
+    memcpy(s, &bs, 4);
+    memcpy(c, &bc, 4);
+}
+
+/* s[i], c[i] = sin(x[i]), cos(x[i]) for n values, s/c can not alias x */
+static inline void sincos_batch(const float* x, float* s, float* c, int n)
+{
+    int i = 0;
+#if defined(QUAT_SSE2)
+    const __m128 vTwoPi = _mm_set1_ps(SINCOS_2_PI);
+    const __m128 vHalf = _mm_set1_ps(0.5f);
+    const __m128 vSign = _mm_set1_ps(-0.0f);
+    const __m128i vOne = _mm_set1_epi32(1);
+    const __m128i vTwo = _mm_set1_epi32(2);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i);
+        // round half away from zero, like the scalar version
+        __m128 t = _mm_mul_ps(vx, vTwoPi);
+        t = _mm_add_ps(t, _mm_or_ps(vHalf, _mm_and_ps(vx, vSign)));
+        __m128i q = _mm_cvttps_epi32(t);
+        __m128 j = _mm_cvtepi32_ps(q);
+
+        __m128 r = _mm_sub_ps(vx, _mm_mul_ps(j, _mm_set1_ps(SINCOS_DP1)));
+        r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(SINCOS_DP2)));
+        r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(SINCOS_DP3)));
+        __m128 r2 = _mm_mul_ps(r, r);
+
+        __m128 ps = _mm_add_ps(_mm_set1_ps(8.3321608736e-3f), _mm_mul_ps(r2, _mm_set1_ps(-1.9515295891e-4f)));
+        ps = _mm_add_ps(_mm_set1_ps(-1.6666654611e-1f), _mm_mul_ps(r2, ps));
+        ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+
+        __m128 pc = _mm_add_ps(_mm_set1_ps(-1.388731625493765e-3f), _mm_mul_ps(r2, _mm_set1_ps(2.443315711809948e-5f)));
+        pc = _mm_add_ps(_mm_set1_ps(4.166664568298827e-2f), _mm_mul_ps(r2, pc));
+        pc = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(vHalf, r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), pc));
+
+        // odd quadrants swap sin and cos, then the signs
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, vOne), vOne));
+        __m128 fs = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+        __m128 fc = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+        __m128 negS = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, vTwo), 30));
+        __m128 negC = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, vOne), vTwo), 30));
+        _mm_storeu_ps(s + i, _mm_xor_ps(fs, negS));
+        _mm_storeu_ps(c + i, _mm_xor_ps(fc, negC));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        sincos_approx(x[i], s + i, c + i);
+    }
+}
+
+/* Rotation by angle radians around axis (x,y,z), the axis does not need to be unit */
+static inline quat quat_from_axis_angle(float x, float y, float z, float angle)
+{
+    quat q = QUAT_IDENTITY_INIT;
+    float len = sqrtf(x*x + y*y + z*z);
+    if (len == 0.0f) { return q; }
+
+    float s, c;
+    sincos_approx(angle * 0.5f, &s, &c);
+    s /= len;
+    q.x = x * s;
+    q.y = y * s;
+    q.z = z * s;
+    q.w = c;
+    return q;
+}
+
+/*
+   out[i] = rotation by angle[i] around the unit axis (ax[i], ay[i], az[i]),
+   for many objects at once: the trig goes through sincos_batch
+*/
+static inline void quat_from_axis_angle_batch(const float* ax, const float* ay, const float* az,
+                                              const float* angle, quat* out, int n)
+{
+    float half[256], s[256], c[256];
+
+    for (int i0 = 0; i0 < n; i0 += 256)
+    {
+        int m = n - i0 < 256 ? n - i0 : 256;
+        for (int i = 0; i < m; ++i)
+        {
+            half[i] = angle[i0 + i] * 0.5f;
+        }
+        sincos_batch(half, s, c, m);
+        for (int i = 0; i < m; ++i)
+        {
+            out[i0 + i].x = ax[i0 + i] * s[i];
+            out[i0 + i].y = ay[i0 + i] * s[i];
+            out[i0 + i].z = az[i0 + i] * s[i];
+            out[i0 + i].w = c[i];
+        }
+    }
+}
+
+/* a * b: rotate by b, then by a */
+static inline quat quat_mul(quat a, quat b)
+{
+    quat q;
+    q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+    q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+    q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+    q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+    return q;
+}
+
+static inline float quat_dot(quat a, quat b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+/* Back to length 1 (rounding drifts after many multiplies), 0 stays identity */
+static inline quat quat_normalize(quat q)
+{
+    float len2 = quat_dot(q, q);
+    if (len2 == 0.0f)
+    {
+        quat id = QUAT_IDENTITY_INIT;
+        return id;
+    }
+    float inv = 1.0f / sqrtf(len2);
+    q.x *= inv; q.y *= inv; q.z *= inv; q.w *= inv;
+    return q;
+}
+
+/* Lerp + normalize, t in [0,1] */
+static inline quat quat_nlerp(quat a, quat b, float t)
+{
+    float tb = quat_dot(a, b) < 0.0f ? -t : t; // short way round
+    quat q;
+    q.x = a.x * (1.0f - t) + b.x * tb;
+    q.y = a.y * (1.0f - t) + b.y * tb;
+    q.z = a.z * (1.0f - t) + b.z * tb;
+    q.w = a.w * (1.0f - t) + b.w * tb;
+    return quat_normalize(q);
+}
+
+/* Constant speed interpolation, t in [0,1]; nlerp when a and b are almost the same */
+static inline quat quat_slerp(quat a, quat b, float t)
+{
+    float d = quat_dot(a, b);
+    if (d < 0.0f)
+    {
+        b.x = -b.x; b.y = -b.y; b.z = -b.z; b.w = -b.w;
+        d = -d;
+    }
+    if (d > 0.9995f)
+    {
+        return quat_nlerp(a, b, t);
+    }
+
+    float theta = acosf(d);
+    float s0, c0, s1, c1, st, ct;
+    sincos_approx(theta, &st, &ct);
+    sincos_approx((1.0f - t) * theta, &s0, &c0);
+    sincos_approx(t * theta, &s1, &c1);
+    float w0 = s0 / st, w1 = s1 / st;
+
+    quat q;
+    q.x = a.x * w0 + b.x * w1;
+    q.y = a.y * w0 + b.y * w1;
+    q.z = a.z * w0 + b.z * w1;
+    q.w = a.w * w0 + b.w * w1;
+    return q;
+}
+
+/* Rotation matrix of a unit quaternion (same layout as mat4_rotate) */
+static inline void quat_to_mat4(quat q, mat4 M)
+{
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    M[0][0] = 1.0f - 2.0f * (yy + zz);
+    M[0][1] = 2.0f * (xy + wz);
+    M[0][2] = 2.0f * (xz - wy);
+    M[0][3] = 0.0f;
+
+    M[1][0] = 2.0f * (xy - wz);
+    M[1][1] = 1.0f - 2.0f * (xx + zz);
+    M[1][2] = 2.0f * (yz + wx);
+    M[1][3] = 0.0f;
+
+    M[2][0] = 2.0f * (xz + wy);
+    M[2][1] = 2.0f * (yz - wx);
+    M[2][2] = 1.0f - 2.0f * (xx + yy);
+    M[2][3] = 0.0f;
+
+    M[3][0] = M[3][1] = M[3][2] = 0.0f;
+    M[3][3] = 1.0f;
+}
+
+#if defined(QUAT_SSE2)
+/* 4 quaternions in, their x, y, z, w in 4 registers (one object per lane) */
+#define QUAT_LOAD4(q, vx, vy, vz, vw) \
+    do { \
+        vx = _mm_loadu_ps(&(q)[0].x); vy = _mm_loadu_ps(&(q)[1].x); \
+        vz = _mm_loadu_ps(&(q)[2].x); vw = _mm_loadu_ps(&(q)[3].x); \
+        _MM_TRANSPOSE4_PS(vx, vy, vz, vw); \
+    } while (0)
+
+/* quat_to_mat4 on 4 objects: the 9 elements as vectors, transposed back per column */
+static inline void quat_to_mat4_x4(__m128 x, __m128 y, __m128 z, __m128 w, mat4* M)
+{
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+    __m128 col[3][4];
+
+    col[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+    col[0][1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+    col[0][2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+    col[1][0] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+    col[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+    col[1][2] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+    col[2][0] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+    col[2][1] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+    col[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+    for (int c = 0; c < 3; ++c)
+    {
+        col[c][3] = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(col[c][0], col[c][1], col[c][2], col[c][3]);
+        for (int k = 0; k < 4; ++k)
+        {
+            _mm_storeu_ps(M[k][c], col[c][k]);
+        }
+    }
+    for (int k = 0; k < 4; ++k)
+    {
+        _mm_storeu_ps(M[k][3], _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+}
+#endif
+
+/* M[i] = quat_to_mat4(q[i]) for n objects, 4 at a time with SSE2 */
+static inline void quat_to_mat4_batch(const quat* q, mat4* M, int n)
+{
+    int i = 0;
+#if defined(QUAT_SSE2)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x, y, z, w;
+        QUAT_LOAD4(q + i, x, y, z, w);
+        quat_to_mat4_x4(x, y, z, w, M + i);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        quat_to_mat4(q[i], M[i]);
+    }
+}
+
+/*
+   One frame of spinning objects: q[i] = quat_normalize(step[i] * q[i]),
+   then M[i] = quat_to_mat4(q[i]); the same arithmetic as the scalar
+   functions, 4 objects at a time
+*/
+static inline void quat_spin_batch(quat* q, const quat* step, mat4* M, int n)
+{
+    int i = 0;
+#if defined(QUAT_SSE2)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 ax, ay, az, aw, bx, by, bz, bw;
+        QUAT_LOAD4(step + i, ax, ay, az, aw);
+        QUAT_LOAD4(q + i, bx, by, bz, bw);
+
+        // quat_mul(a, b)
+        __m128 x = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bx), _mm_mul_ps(ax, bw)), _mm_mul_ps(ay, bz)), _mm_mul_ps(az, by));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(aw, by), _mm_mul_ps(ax, bz)), _mm_mul_ps(ay, bw)), _mm_mul_ps(az, bx));
+        __m128 z = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(aw, bz), _mm_mul_ps(ax, by)), _mm_mul_ps(ay, bx)), _mm_mul_ps(az, bw));
+        __m128 w = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(aw, bw), _mm_mul_ps(ax, bx)), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+
+        // quat_normalize (a zero quaternion can not come out of two unit ones)
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)), _mm_mul_ps(w, w));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+        x = _mm_mul_ps(x, inv);
+        y = _mm_mul_ps(y, inv);
+        z = _mm_mul_ps(z, inv);
+        w = _mm_mul_ps(w, inv);
+
+        __m128 tx = x, ty = y, tz = z, tw = w;
+        _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+        _mm_storeu_ps(&q[i + 0].x, tx);
+        _mm_storeu_ps(&q[i + 1].x, ty);
+        _mm_storeu_ps(&q[i + 2].x, tz);
+        _mm_storeu_ps(&q[i + 3].x, tw);
+
+        quat_to_mat4_x4(x, y, z, w, M + i);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        q[i] = quat_normalize(quat_mul(step[i], q[i]));
+        quat_to_mat4(q[i], M[i]);
+    }
+}
+
+#endif // QUAT_H
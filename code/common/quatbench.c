@@ -0,0 +1,338 @@
+/*
+	Headless test/benchmark for quat.h (no window, runs on linux too)
+	Notes:
+		- sincos_approx against double sin/cos on [-8192, 8192] (max absolute
+		  error), sincos_batch must give the same bits as sincos_approx
+		- quat_to_mat4(quat_from_axis_angle) against mat4_rotate, quat_mul
+		  against mat4_mul, slerp/nlerp end points and half way
+		- speed: 100k spinning objects, one frame = a new rotation matrix
+		  for each of them:
+				mat4_rotate            cosf/sinf/sqrtf per object (what we had)
+				quat axis-angle        sincos_approx + quat_to_mat4
+				quat batch             quat_from_axis_angle_batch +
+				                       quat_to_mat4_batch
+				quat integrate         q = normalize(step * q) + quat_to_mat4,
+				                       no trig at all
+				quat spin batch        the same with quat_spin_batch
+		  best of a few runs, the machine is not quiet
+		- exits with 1 if an error is over its bound
+
+	build:
+		windows: cl /nologo /O2 quatbench.c
+		linux:   cc -O2 quatbench.c -o quatbench -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "quat.h"
+#include "pacing.c"
+
+#define OBJECTS 100000
+#define FRAMES  20
+#define SINCOS_MAX_ERROR 1.2e-7
+
+static volatile float g_fSink;
+
+static unsigned int g_uSeed = 1;
+
+static float RandomFloat(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (float)(g_uSeed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static double MaxDiff(const mat4 A, const mat4 B)
+{
+	double d = 0.0;
+	for (int i = 0; i < 16; i++) {
+		double e = fabs((double)(&A[0][0])[i] - (double)(&B[0][0])[i]);
+		if (e > d) {
+			d = e;
+		}
+	}
+	return d;
+}
+
+static double QuatDiff(quat a, quat b)
+{
+	// q and -q are the same rotation
+	if (quat_dot(a, b) < 0.0f) {
+		b.x = -b.x; b.y = -b.y; b.z = -b.z; b.w = -b.w;
+	}
+	return fmax(fmax(fabs(a.x - b.x), fabs(a.y - b.y)), fmax(fabs(a.z - b.z), fabs(a.w - b.w)));
+}
+
+static int CheckSinCos(void)
+{
+	enum { N = 1 << 16 };
+	static float x[N], s[N], c[N];
+	double dMax = 0.0, dMaxSmall = 0.0;
+
+	// a sweep of [-8192, 8192] plus the values around multiples of pi/4
+	for (int pass = 0; pass < 64; pass++) {
+		for (int i = 0; i < N; i++) {
+			if (pass == 0) {
+				x[i] = (float)((i - N / 2) * (3.14159265358979 / 4.0) / 64.0) + RandomFloat() * 1e-3f;
+			} else {
+				x[i] = RandomFloat() * (pass < 32 ? 8.0f : 8192.0f);
+			}
+		}
+		sincos_batch(x, s, c, N);
+		for (int i = 0; i < N; i++) {
+			float ss, cc;
+			sincos_approx(x[i], &ss, &cc);
+			if (ss != s[i] || cc != c[i]) {
+				printf("MISMATCH sincos_batch(%.9g) = %.9g %.9g, sincos_approx %.9g %.9g\n", x[i], s[i], c[i], ss, cc);
+				return 1;
+			}
+			double e = fmax(fabs(ss - sin((double)x[i])), fabs(cc - cos((double)x[i])));
+			dMax = fmax(dMax, e);
+			if (fabsf(x[i]) <= 8.0f) {
+				dMaxSmall = fmax(dMaxSmall, e);
+			}
+		}
+	}
+	printf("sincos_approx: max error %.3g for |x| <= 8, %.3g for |x| <= 8192\n", dMaxSmall, dMax);
+	if (dMax > SINCOS_MAX_ERROR) {
+		printf("MISMATCH sincos_approx error over %.3g\n", SINCOS_MAX_ERROR);
+		return 1;
+	}
+	return 0;
+}
+
+static int CheckQuat(void)
+{
+	double dMaxMat = 0.0, dMaxMul = 0.0;
+	mat4 A, B, R, S;
+
+	for (int n = 0; n < 10000; n++) {
+		float x = RandomFloat(), y = RandomFloat(), z = RandomFloat();
+		float a = RandomFloat() * 10.0f, b = RandomFloat() * 10.0f;
+		quat p = quat_from_axis_angle(x, y, z, a);
+		quat q = quat_from_axis_angle(z, x, y, b);
+
+		mat4_rotate(A, a, x, y, z);
+		quat_to_mat4(p, R);
+		dMaxMat = fmax(dMaxMat, MaxDiff(A, R));
+
+		// p * q is "q, then p": mat4_mul(Mq, Mp) in this library
+		mat4_rotate(B, b, z, x, y);
+		mat4_mul(B, A, S);
+		quat_to_mat4(quat_mul(p, q), R);
+		dMaxMul = fmax(dMaxMul, MaxDiff(S, R));
+	}
+	printf("quat_to_mat4: max error %.3g against mat4_rotate, quat_mul %.3g against mat4_mul\n", dMaxMat, dMaxMul);
+	if (dMaxMat > 1e-6 || dMaxMul > 2e-6) {
+		printf("MISMATCH quat against the matrices\n");
+		return 1;
+	}
+
+	// same axis: half way between 0.2 and 1.4 is 0.8, both for slerp and nlerp
+	// (nlerp is only exact at 0, 1/2 and 1)
+	quat a = quat_from_axis_angle(1.0f, 1.0f, 0.0f, 0.2f);
+	quat b = quat_from_axis_angle(1.0f, 1.0f, 0.0f, 1.4f);
+	quat h = quat_from_axis_angle(1.0f, 1.0f, 0.0f, 0.8f);
+	quat q = quat_from_axis_angle(1.0f, 1.0f, 0.0f, 0.2f + 1.2f * 0.3f);
+	if (QuatDiff(quat_slerp(a, b, 0.0f), a) > 1e-6 || QuatDiff(quat_slerp(a, b, 1.0f), b) > 1e-6 ||
+		QuatDiff(quat_slerp(a, b, 0.5f), h) > 1e-6 || QuatDiff(quat_slerp(a, b, 0.3f), q) > 1e-6) {
+		printf("MISMATCH quat_slerp\n");
+		return 1;
+	}
+	if (QuatDiff(quat_nlerp(a, b, 0.5f), h) > 1e-6 || fabsf(quat_dot(quat_nlerp(a, b, 0.3f), quat_nlerp(a, b, 0.3f)) - 1.0f) > 1e-6f) {
+		printf("MISMATCH quat_nlerp\n");
+		return 1;
+	}
+	// short way round: -b is the same rotation as b
+	quat nb = { -b.x, -b.y, -b.z, -b.w };
+	if (QuatDiff(quat_slerp(a, nb, 0.5f), h) > 1e-6) {
+		printf("MISMATCH quat_slerp took the long way\n");
+		return 1;
+	}
+	return 0;
+}
+
+typedef struct {
+	float ax[OBJECTS], ay[OBJECTS], az[OBJECTS]; // unit spin axis
+	float speed[OBJECTS];                         // radians per second
+	float angle[OBJECTS];
+	quat  q[OBJECTS];                             // orientation (integrate)
+	quat  step[OBJECTS];                          // one frame of spin
+	quat  tmp[OBJECTS];
+	mat4  M[OBJECTS];
+} SCENE;
+
+static const char* g_szRotations[] = {
+	"mat4_rotate", "quat axis-angle", "quat batch", "quat integrate", "quat spin batch"
+};
+
+// one frame of the scene with method iMethod
+static void RotateScene(SCENE* s, int iMethod, float dt)
+{
+	switch (iMethod) {
+	case 0: // what the demos do: angle += speed * dt, then mat4_rotate
+		for (int i = 0; i < OBJECTS; i++) {
+			s->angle[i] += s->speed[i] * dt;
+			mat4_rotate(s->M[i], s->angle[i], s->ax[i], s->ay[i], s->az[i]);
+		}
+		break;
+	case 1:
+		for (int i = 0; i < OBJECTS; i++) {
+			s->angle[i] += s->speed[i] * dt;
+			quat_to_mat4(quat_from_axis_angle(s->ax[i], s->ay[i], s->az[i], s->angle[i]), s->M[i]);
+		}
+		break;
+	case 2:
+		for (int i = 0; i < OBJECTS; i++) {
+			s->angle[i] += s->speed[i] * dt;
+		}
+		quat_from_axis_angle_batch(s->ax, s->ay, s->az, s->angle, s->tmp, OBJECTS);
+		quat_to_mat4_batch(s->tmp, s->M, OBJECTS);
+		break;
+	case 3:
+		for (int i = 0; i < OBJECTS; i++) {
+			s->q[i] = quat_normalize(quat_mul(s->step[i], s->q[i]));
+			quat_to_mat4(s->q[i], s->M[i]);
+		}
+		break;
+	case 4:
+		quat_spin_batch(s->q, s->step, s->M, OBJECTS);
+		break;
+	}
+}
+
+static void BenchRotations(SCENE* s)
+{
+	const float dt = 1.0f / 60.0f;
+
+	printf("\n%d rotations per frame   ms/frame   ns/rotation\n", OBJECTS);
+	for (int iMethod = 0; iMethod < 5; iMethod++) {
+		double dBest = 1e9;
+		for (int r = 0; r < 5; r++) {
+			double t0 = PaceNow();
+			for (int f = 0; f < FRAMES; f++) {
+				RotateScene(s, iMethod, dt);
+			}
+			double dFrame = (PaceNow() - t0) / FRAMES;
+			dBest = dFrame < dBest ? dFrame : dBest;
+		}
+		g_fSink += s->M[OBJECTS / 3][1][2];
+		printf("%-22s %10.3f %12.2f\n", g_szRotations[iMethod], dBest * 1e3, dBest * 1e9 / OBJECTS);
+	}
+}
+
+static void InitScene(SCENE* s)
+{
+	const float dt = 1.0f / 60.0f;
+
+	for (int i = 0; i < OBJECTS; i++) {
+		float x = RandomFloat(), y = RandomFloat(), z = RandomFloat() + 2.0f;
+		float len = sqrtf(x * x + y * y + z * z);
+		s->ax[i] = x / len;
+		s->ay[i] = y / len;
+		s->az[i] = z / len;
+		s->speed[i] = RandomFloat() * 6.0f;
+		s->angle[i] = 0.0f;
+		s->q[i] = quat_from_axis_angle(x, y, z, 0.0f);
+		s->step[i] = quat_from_axis_angle(x, y, z, s->speed[i] * dt);
+	}
+}
+
+// the SIMD batches against the scalar functions, and integration against axis-angle
+static int CheckBatches(SCENE* s)
+{
+	static quat q[OBJECTS];
+	double dDrift = 0.0;
+	mat4 R;
+
+	// 60 frames of spinning both ways: the same bits, and the same place as
+	// axis-angle at speed * 1s (up to the rounding of 60 multiplies)
+	memcpy(q, s->q, sizeof(q));
+	for (int f = 0; f < 60; f++) {
+		RotateScene(s, 4, 1.0f / 60.0f);
+		for (int i = 0; i < OBJECTS; i++) {
+			q[i] = quat_normalize(quat_mul(s->step[i], q[i]));
+		}
+	}
+	for (int i = 0; i < OBJECTS; i++) {
+		quat_to_mat4(q[i], R);
+		if (memcmp(&q[i], &s->q[i], sizeof(quat)) != 0 || memcmp(R, s->M[i], sizeof(mat4)) != 0) {
+			printf("MISMATCH quat_spin_batch against quat_mul + quat_normalize + quat_to_mat4 (object %d)\n", i);
+			return 1;
+		}
+		mat4_rotate(R, s->speed[i], s->ax[i], s->ay[i], s->az[i]);
+		dDrift = fmax(dDrift, MaxDiff(R, s->M[i]));
+	}
+	printf("quat_spin_batch: 60 steps %.3g away from one axis-angle rotation\n", dDrift);
+	if (dDrift > 1e-5) {
+		printf("MISMATCH quat_spin_batch drifted\n");
+		return 1;
+	}
+
+	quat_to_mat4_batch(s->q, s->M, OBJECTS - 3);
+	for (int i = 0; i < OBJECTS - 3; i++) {
+		quat_to_mat4(s->q[i], R);
+		if (memcmp(R, s->M[i], sizeof(mat4)) != 0) {
+			printf("MISMATCH quat_to_mat4_batch (object %d)\n", i);
+			return 1;
+		}
+	}
+	InitScene(s);
+	return 0;
+}
+
+static void BenchSinCos(void)
+{
+	enum { N = 4096, ROUNDS = 500 };
+	static float x[N], s[N], c[N];
+	double t0, dLib, dApprox, dBatch;
+
+	for (int i = 0; i < N; i++) {
+		x[i] = RandomFloat() * 100.0f;
+	}
+
+	t0 = PaceNow();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < N; i++) {
+			s[i] = sinf(x[i]);
+			c[i] = cosf(x[i]);
+		}
+		g_fSink += s[r] + c[r];
+	}
+	dLib = (PaceNow() - t0) * 1e9 / ((double)ROUNDS * N);
+
+	t0 = PaceNow();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < N; i++) {
+			sincos_approx(x[i], s + i, c + i);
+		}
+		g_fSink += s[r] + c[r];
+	}
+	dApprox = (PaceNow() - t0) * 1e9 / ((double)ROUNDS * N);
+
+	t0 = PaceNow();
+	for (int r = 0; r < ROUNDS; r++) {
+		sincos_batch(x, s, c, N);
+		g_fSink += s[r] + c[r];
+	}
+	dBatch = (PaceNow() - t0) * 1e9 / ((double)ROUNDS * N);
+
+	printf("\nns per sin+cos: sinf/cosf %.2f, sincos_approx %.2f, sincos_batch %.2f\n", dLib, dApprox, dBatch);
+}
+
+int main(void)
+{
+	SCENE* s = (SCENE*)malloc(sizeof(SCENE));
+	if (!s) {
+		printf("out of memory\n");
+		return 1;
+	}
+	InitScene(s);
+
+	if (CheckSinCos() || CheckQuat() || CheckBatches(s)) {
+		return 1;
+	}
+	BenchSinCos();
+	BenchRotations(s);
+	free(s);
+	return 0;
+}
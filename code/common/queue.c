@@ -0,0 +1,109 @@
+/*
+	Bounded lock-free queue of pointers, any number of producers and consumers
+	Notes:
+		- D. Vyukov's bounded MPMC queue: a ring of cells, each with a
+		  sequence number that says whose turn the cell is; a push or pop is
+		  one CAS on the shared position plus a release store on the cell,
+		  no lock, a thread that loses the CAS just retries
+		- capacity is a power of 2, fixed at InitQueue; PushQueue returns 0
+		  when full, PopQueue returns NULL when empty (never blocks, pair it
+		  with a semaphore to sleep)
+		- positions are longs that wrap (unsigned math), only differences
+		  are compared
+		- the cells are padded to a cache line so neighbours don't bounce
+		  the same line between producer and consumer
+*/
+
+#ifndef QUEUE_C
+#define QUEUE_C
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.c"
+
+#define QUEUE_ADD(pos, n) ((long)((unsigned long)(pos) + (unsigned long)(n)))
+#define QUEUE_DIFF(a, b)  ((long)((unsigned long)(a) - (unsigned long)(b)))
+
+typedef struct {
+	volatile long seq;
+	void*         pData;
+	char          pad[64 - sizeof(long) - sizeof(void*)];
+} QUEUECELL;
+
+typedef struct {
+	QUEUECELL*    pCells;
+	long          mask;
+	char          pad0[64];
+	volatile long pushPos;
+	char          pad1[64];
+	volatile long popPos;
+	char          pad2[64];
+} QUEUE;
+
+// nCapacity is rounded up to a power of 2, returns 0 if out of memory
+static int InitQueue(QUEUE* pQueue, int nCapacity)
+{
+	long n = 2;
+	while (n < nCapacity) {
+		n *= 2;
+	}
+	memset(pQueue, 0, sizeof(*pQueue));
+	pQueue->pCells = (QUEUECELL*)calloc(n, sizeof(QUEUECELL));
+	if (!pQueue->pCells) {
+		return 0;
+	}
+	for (long i = 0; i < n; i++) {
+		pQueue->pCells[i].seq = i;
+	}
+	pQueue->mask = n - 1;
+	return 1;
+}
+
+static void FreeQueue(QUEUE* pQueue)
+{
+	free(pQueue->pCells);
+	pQueue->pCells = NULL;
+}
+
+static int PushQueue(QUEUE* pQueue, void* pData)
+{
+	long pos = ATOMIC_LOAD(&pQueue->pushPos);
+	for (;;) {
+		QUEUECELL* pCell = &pQueue->pCells[pos & pQueue->mask];
+		long diff = QUEUE_DIFF(ATOMIC_LOAD(&pCell->seq), pos);
+		if (diff == 0) {
+			// the cell is free for pos: claim it, then publish the data
+			if (ATOMIC_CAS(&pQueue->pushPos, pos, QUEUE_ADD(pos, 1))) {
+				pCell->pData = pData;
+				ATOMIC_STORE(&pCell->seq, QUEUE_ADD(pos, 1));
+				return 1;
+			}
+		} else if (diff < 0) {
+			return 0; // full: the cell still holds an item from a lap ago
+		}
+		pos = ATOMIC_LOAD(&pQueue->pushPos);
+	}
+}
+
+static void* PopQueue(QUEUE* pQueue)
+{
+	long pos = ATOMIC_LOAD(&pQueue->popPos);
+	for (;;) {
+		QUEUECELL* pCell = &pQueue->pCells[pos & pQueue->mask];
+		long diff = QUEUE_DIFF(ATOMIC_LOAD(&pCell->seq), QUEUE_ADD(pos, 1));
+		if (diff == 0) {
+			if (ATOMIC_CAS(&pQueue->popPos, pos, QUEUE_ADD(pos, 1))) {
+				void* pData = pCell->pData;
+				// free again for the push one lap later
+				ATOMIC_STORE(&pCell->seq, QUEUE_ADD(pos, pQueue->mask + 1));
+				return pData;
+			}
+		} else if (diff < 0) {
+			return NULL; // empty
+		}
+		pos = ATOMIC_LOAD(&pQueue->popPos);
+	}
+}
+
+#endif // QUEUE_C
@@ -0,0 +1,353 @@
+/*
+	Texture cache: one upload per distinct image, refcounted, LRU under a budget
+	Notes:
+		- AcquireTexture(path) gives the backend handle (a GL texture name),
+		  ReleaseTexture(path) when the caller is done with it (end of the
+		  frame is fine); a hit is a hash of the path and a table lookup, no
+		  file access
+		- keyed by path and by content: on a path miss the file is mapped
+		  and hashed (hash.c), a texture with the same bytes under another
+		  path is shared (nContentHits) instead of decoded and uploaded again
+		- the files are not watched: a path hit never rereads the file
+		- entries with nRefs == 0 sit on an LRU list (front = released last);
+		  when cbResident goes over cbBudget the back of the list is deleted
+		  until it fits; textures in use are never evicted, so the budget
+		  can be exceeded while they are held
+		- uploads go through a TEXTUREBACKEND (upload + delete callbacks):
+		  GL in the demos, a mock in texcachebench.c so all of this runs
+		  headless
+		- cbBytes is what the backend says the texture costs (default
+		  width * height * 4)
+		- counters: nHits, nContentHits, nMisses, nEvictions, nFailures
+		- single threaded, like the GL context it feeds
+*/
+
+#ifndef TEXCACHE_C
+#define TEXCACHE_C
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hash.c"
+#include "bmp.c"
+
+typedef struct {
+	void* pContext;
+	// returns the handle, 0 if the upload failed; *pcbBytes comes in as
+	// width * height * 4, change it if the texture costs something else
+	unsigned int (*pfnUpload)(void* pContext, const BMPIMAGE* pImage, size_t* pcbBytes);
+	void (*pfnDelete)(void* pContext, unsigned int handle);
+} TEXTUREBACKEND;
+
+typedef struct {
+	unsigned int handle;    // 0 = free entry
+	size_t       cbBytes;
+	uint64_t     contentHash;
+	size_t       cbFile;
+	int          nRefs;
+	int          iPrev;     // LRU list while nRefs == 0, else -1
+	int          iNext;     // also the free list link
+} TEXTUREENTRY;
+
+typedef struct {
+	uint64_t hash;          // HashString of szPath
+	char*    szPath;        // NULL = empty slot
+	int      iEntry;
+} TEXTUREPATH;
+
+typedef struct {
+	TEXTUREBACKEND backend;
+
+	TEXTUREENTRY* pEntries;
+	int           nEntries;     // used + free
+	int           iFree;        // free entry list, -1 if none
+	int           iLruFront;    // released last
+	int           iLruBack;     // evicted first
+
+	TEXTUREPATH* pPaths;        // open addressing, linear probing
+	int          nPathSlots;    // power of 2
+	int          nPaths;
+
+	size_t cbBudget;
+	size_t cbResident;
+
+	// counters
+	unsigned long long nHits;
+	unsigned long long nContentHits;
+	unsigned long long nMisses;
+	unsigned long long nEvictions;
+	unsigned long long nFailures;
+} TEXTURECACHE;
+
+static void InitTextureCache(TEXTURECACHE* pCache, const TEXTUREBACKEND* pBackend, size_t cbBudget)
+{
+	memset(pCache, 0, sizeof(*pCache));
+	pCache->backend = *pBackend;
+	pCache->cbBudget = cbBudget;
+	pCache->iFree = -1;
+	pCache->iLruFront = -1;
+	pCache->iLruBack = -1;
+}
+
+static void LruUnlink(TEXTURECACHE* pCache, int i)
+{
+	TEXTUREENTRY* e = &pCache->pEntries[i];
+	if (e->iPrev >= 0) pCache->pEntries[e->iPrev].iNext = e->iNext; else pCache->iLruFront = e->iNext;
+	if (e->iNext >= 0) pCache->pEntries[e->iNext].iPrev = e->iPrev; else pCache->iLruBack = e->iPrev;
+	e->iPrev = e->iNext = -1;
+}
+
+static void LruPushFront(TEXTURECACHE* pCache, int i)
+{
+	TEXTUREENTRY* e = &pCache->pEntries[i];
+	e->iPrev = -1;
+	e->iNext = pCache->iLruFront;
+	if (pCache->iLruFront >= 0) pCache->pEntries[pCache->iLruFront].iPrev = i; else pCache->iLruBack = i;
+	pCache->iLruFront = i;
+}
+
+// slot of szPath, or of the empty slot where it would go
+static int FindPathSlot(const TEXTURECACHE* pCache, const char* szPath, uint64_t hash)
+{
+	int mask = pCache->nPathSlots - 1;
+	for (int s = (int)hash & mask;; s = (s + 1) & mask) {
+		const TEXTUREPATH* p = &pCache->pPaths[s];
+		if (!p->szPath || (p->hash == hash && strcmp(p->szPath, szPath) == 0)) {
+			return s;
+		}
+	}
+}
+
+// keeps the table at most half full, returns 0 if out of memory
+static int GrowPaths(TEXTURECACHE* pCache)
+{
+	if ((pCache->nPaths + 1) * 2 <= pCache->nPathSlots) {
+		return 1;
+	}
+	int nOld = pCache->nPathSlots;
+	TEXTUREPATH* pOld = pCache->pPaths;
+	int nSlots = nOld ? nOld * 2 : 16;
+	TEXTUREPATH* pNew = (TEXTUREPATH*)calloc(nSlots, sizeof(TEXTUREPATH));
+	if (!pNew) {
+		return 0;
+	}
+	pCache->pPaths = pNew;
+	pCache->nPathSlots = nSlots;
+	for (int s = 0; s < nOld; s++) {
+		if (pOld[s].szPath) {
+			pNew[FindPathSlot(pCache, pOld[s].szPath, pOld[s].hash)] = pOld[s];
+		}
+	}
+	free(pOld);
+	return 1;
+}
+
+// linear probing delete: pull later entries of the run back into the hole
+static void RemovePathSlot(TEXTURECACHE* pCache, int s)
+{
+	int mask = pCache->nPathSlots - 1;
+	free(pCache->pPaths[s].szPath);
+	pCache->pPaths[s].szPath = NULL;
+	pCache->nPaths--;
+
+	for (int j = (s + 1) & mask; pCache->pPaths[j].szPath; j = (j + 1) & mask) {
+		int home = (int)pCache->pPaths[j].hash & mask;
+		// j's entry can move to the hole if its home is not in (s, j]
+		if (((j - home) & mask) >= ((j - s) & mask)) {
+			pCache->pPaths[s] = pCache->pPaths[j];
+			pCache->pPaths[j].szPath = NULL;
+			s = j;
+		}
+	}
+}
+
+static void EvictTexture(TEXTURECACHE* pCache, int i)
+{
+	TEXTUREENTRY* e = &pCache->pEntries[i];
+
+	// every path that points at it (rare, so a scan of the table)
+	for (int s = 0; s < pCache->nPathSlots;) {
+		if (pCache->pPaths[s].szPath && pCache->pPaths[s].iEntry == i) {
+			RemovePathSlot(pCache, s); // may pull another slot into s, look again
+		} else {
+			s++;
+		}
+	}
+
+	LruUnlink(pCache, i);
+	pCache->backend.pfnDelete(pCache->backend.pContext, e->handle);
+	pCache->cbResident -= e->cbBytes;
+	e->handle = 0;
+	e->iNext = pCache->iFree;
+	pCache->iFree = i;
+}
+
+static void EnforceTextureBudget(TEXTURECACHE* pCache)
+{
+	while (pCache->cbResident > pCache->cbBudget && pCache->iLruBack >= 0) {
+		EvictTexture(pCache, pCache->iLruBack);
+		pCache->nEvictions++;
+	}
+}
+
+static void SetTextureBudget(TEXTURECACHE* pCache, size_t cbBudget)
+{
+	pCache->cbBudget = cbBudget;
+	EnforceTextureBudget(pCache);
+}
+
+static int AddPath(TEXTURECACHE* pCache, const char* szPath, uint64_t hash, int iEntry)
+{
+	size_t cb = strlen(szPath) + 1;
+	char* szCopy = (char*)malloc(cb);
+	if (!szCopy || !GrowPaths(pCache)) {
+		free(szCopy);
+		return 0;
+	}
+	memcpy(szCopy, szPath, cb);
+	TEXTUREPATH* p = &pCache->pPaths[FindPathSlot(pCache, szPath, hash)];
+	p->hash = hash;
+	p->szPath = szCopy;
+	p->iEntry = iEntry;
+	pCache->nPaths++;
+	return 1;
+}
+
+static int NewTextureEntry(TEXTURECACHE* pCache)
+{
+	if (pCache->iFree >= 0) {
+		int i = pCache->iFree;
+		pCache->iFree = pCache->pEntries[i].iNext;
+		return i;
+	}
+	TEXTUREENTRY* p = (TEXTUREENTRY*)realloc(pCache->pEntries, (pCache->nEntries + 1) * sizeof(TEXTUREENTRY));
+	if (!p) {
+		return -1;
+	}
+	pCache->pEntries = p;
+	return pCache->nEntries++;
+}
+
+static void AddTextureRef(TEXTURECACHE* pCache, int i)
+{
+	if (pCache->pEntries[i].nRefs++ == 0) {
+		LruUnlink(pCache, i);
+	}
+}
+
+/*
+	Handle of the texture at szPath, loaded and uploaded on the first call.
+	Returns 0 if the file can't be loaded or uploaded (counted in nFailures)
+*/
+static unsigned int AcquireTexture(TEXTURECACHE* pCache, const char* szPath)
+{
+	uint64_t pathHash = HashString(szPath, 0);
+
+	if (pCache->nPaths) {
+		TEXTUREPATH* p = &pCache->pPaths[FindPathSlot(pCache, szPath, pathHash)];
+		if (p->szPath) {
+			pCache->nHits++;
+			AddTextureRef(pCache, p->iEntry);
+			return pCache->pEntries[p->iEntry].handle;
+		}
+	}
+
+	MAPPEDFILE file;
+	if (!MapFile(szPath, &file)) {
+		pCache->nFailures++;
+		return 0;
+	}
+	uint64_t contentHash = HashBytes(file.pData, file.cbSize, 0);
+	size_t cbFile = file.cbSize;
+
+	// same bytes under another path (a miss costs a decode anyway, so a scan)
+	for (int i = 0; i < pCache->nEntries; i++) {
+		TEXTUREENTRY* e = &pCache->pEntries[i];
+		if (e->handle && e->contentHash == contentHash && e->cbFile == cbFile) {
+			UnmapFile(&file);
+			if (!AddPath(pCache, szPath, pathHash, i)) {
+				pCache->nFailures++;
+				return 0;
+			}
+			pCache->nContentHits++;
+			AddTextureRef(pCache, i);
+			return e->handle;
+		}
+	}
+
+	BMPIMAGE image;
+	if (!LoadBmpFromMemory(file.pData, file.cbSize, &image)) {
+		UnmapFile(&file);
+		pCache->nFailures++;
+		return 0;
+	}
+	size_t cbBytes = (size_t)image.pitch * image.height;
+	unsigned int handle = pCache->backend.pfnUpload(pCache->backend.pContext, &image, &cbBytes);
+	FreeBmp(&image);
+	UnmapFile(&file); // after the upload: the zero copy pixels were in it
+
+	int i = handle ? NewTextureEntry(pCache) : -1;
+	if (i < 0 || !AddPath(pCache, szPath, pathHash, i)) {
+		if (i >= 0) {
+			pCache->pEntries[i].handle = 0;
+			pCache->pEntries[i].iNext = pCache->iFree;
+			pCache->iFree = i;
+		}
+		if (handle) {
+			pCache->backend.pfnDelete(pCache->backend.pContext, handle);
+		}
+		pCache->nFailures++;
+		return 0;
+	}
+
+	TEXTUREENTRY* e = &pCache->pEntries[i];
+	e->handle = handle;
+	e->cbBytes = cbBytes;
+	e->contentHash = contentHash;
+	e->cbFile = cbFile;
+	e->nRefs = 1;
+	e->iPrev = e->iNext = -1;
+	pCache->cbResident += cbBytes;
+	pCache->nMisses++;
+
+	EnforceTextureBudget(pCache); // the new one is held, only older ones go
+	return handle;
+}
+
+// one AcquireTexture less on szPath; at 0 refs it can be evicted
+static void ReleaseTexture(TEXTURECACHE* pCache, const char* szPath)
+{
+	if (!pCache->nPaths) {
+		return;
+	}
+	TEXTUREPATH* p = &pCache->pPaths[FindPathSlot(pCache, szPath, HashString(szPath, 0))];
+	if (!p->szPath || pCache->pEntries[p->iEntry].nRefs <= 0) {
+		return;
+	}
+	int i = p->iEntry;
+	if (--pCache->pEntries[i].nRefs == 0) {
+		LruPushFront(pCache, i);
+		EnforceTextureBudget(pCache);
+	}
+}
+
+// deletes every texture, held or not
+static void FreeTextureCache(TEXTURECACHE* pCache)
+{
+	for (int i = 0; i < pCache->nEntries; i++) {
+		if (pCache->pEntries[i].handle) {
+			pCache->backend.pfnDelete(pCache->backend.pContext, pCache->pEntries[i].handle);
+		}
+	}
+	for (int s = 0; s < pCache->nPathSlots; s++) {
+		free(pCache->pPaths[s].szPath);
+	}
+	free(pCache->pEntries);
+	free(pCache->pPaths);
+
+	TEXTUREBACKEND backend = pCache->backend;
+	InitTextureCache(pCache, &backend, pCache->cbBudget);
+}
+
+#endif // TEXCACHE_C
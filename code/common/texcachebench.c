@@ -0,0 +1,326 @@
+/*
+	Headless test/benchmark for texcache.c with a mock upload backend
+	Notes:
+		- the mock hands out handles 1, 2, 3... and tracks which are alive,
+		  so double deletes, leaks and deleting a texture in use all show up
+		- DrawTextureGrass as it was: 3 textures every frame for 1000
+		  frames must be 3 uploads and 2997 hits
+		- a copy of dirt.bmp under another name shares dirt's texture
+		- budget: 12 generated 64x64 textures (16 KB each) under 64 KB, the
+		  least recently released go first, held ones never
+		- a missing / broken file gives 0 and counts as a failure
+		- speed: a frame of 3 textures, decode + upload every time (before)
+		  against the cache
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 texcachebench.c
+		linux:   cc -O2 texcachebench.c -o texcachebench -lm
+*/
+
+#include <stdio.h>
+#include "texcache.c"
+#include "pacing.c"
+
+#define MAX_HANDLES 4096
+
+typedef struct {
+	unsigned int nextHandle;
+	uint8_t      alive[MAX_HANDLES];
+	int          nAlive;
+	int          nUploads;
+	int          nDeletes;
+	int          nErrors;
+	uint8_t      checksum; // touches the pixels like a real upload would read them
+} MOCKGPU;
+
+static unsigned int MockUpload(void* pContext, const BMPIMAGE* pImage, size_t* pcbBytes)
+{
+	MOCKGPU* pGpu = (MOCKGPU*)pContext;
+	if (pGpu->nextHandle + 1 >= MAX_HANDLES) {
+		return 0;
+	}
+	for (int y = 0; y < pImage->height; y++) {
+		pGpu->checksum += pImage->pPixels[(size_t)pImage->pitch * y];
+	}
+	unsigned int handle = ++pGpu->nextHandle;
+	pGpu->alive[handle] = 1;
+	pGpu->nAlive++;
+	pGpu->nUploads++;
+	(void)pcbBytes; // keep width * height * 4
+	return handle;
+}
+
+static void MockDelete(void* pContext, unsigned int handle)
+{
+	MOCKGPU* pGpu = (MOCKGPU*)pContext;
+	if (handle >= MAX_HANDLES || !pGpu->alive[handle]) {
+		printf("MISMATCH delete of a dead handle %u\n", handle);
+		pGpu->nErrors++;
+		return;
+	}
+	pGpu->alive[handle] = 0;
+	pGpu->nAlive--;
+	pGpu->nDeletes++;
+}
+
+static MOCKGPU g_Gpu;
+
+static void InitMock(TEXTURECACHE* pCache, size_t cbBudget)
+{
+	TEXTUREBACKEND backend = { &g_Gpu, MockUpload, MockDelete };
+	memset(&g_Gpu, 0, sizeof(g_Gpu));
+	InitTextureCache(pCache, &backend, cbBudget);
+}
+
+static int WriteFile(const char* szPath, const void* p, size_t cb)
+{
+	FILE* f = fopen(szPath, "wb");
+	int bOk = f && fwrite(p, 1, cb, f) == cb;
+	if (f) {
+		fclose(f);
+	}
+	return bOk;
+}
+
+static int CopyFile_(const char* szFrom, const char* szTo)
+{
+	MAPPEDFILE file;
+	if (!MapFile(szFrom, &file)) {
+		return 0;
+	}
+	int bOk = WriteFile(szTo, file.pData, file.cbSize);
+	UnmapFile(&file);
+	return bOk;
+}
+
+// 64x64 24bpp, a different color per index
+static int WriteTestBmp(const char* szPath, int index)
+{
+	static uint8_t bmp[54 + 64 * 64 * 3];
+	memset(bmp, 0, sizeof(bmp));
+	bmp[0] = 'B'; bmp[1] = 'M';
+	bmp[10] = 54; bmp[14] = 40; bmp[18] = 64; bmp[22] = 64; bmp[26] = 1; bmp[28] = 24;
+	for (int i = 54; i < (int)sizeof(bmp); i++) {
+		bmp[i] = (uint8_t)(i * (index + 1));
+	}
+	return WriteFile(szPath, bmp, sizeof(bmp));
+}
+
+static int Expect(int bOk, const char* szWhat)
+{
+	if (!bOk || g_Gpu.nErrors) {
+		printf("MISMATCH %s\n", szWhat);
+		return 1;
+	}
+	return 0;
+}
+
+static const char* g_szGrass[3] = {
+	"../rotatingCube/dirt.bmp", "../rotatingCube/dirtgrass.bmp", "../rotatingCube/grass.bmp"
+};
+
+static int CheckFrames(void)
+{
+	TEXTURECACHE cache;
+	InitMock(&cache, 64 << 20);
+
+	unsigned int first[3];
+	for (int frame = 0; frame < 1000; frame++) {
+		for (int i = 0; i < 3; i++) {
+			unsigned int h = AcquireTexture(&cache, g_szGrass[i]);
+			if (frame == 0) {
+				first[i] = h;
+			}
+			if (!h || h != first[i]) {
+				printf("MISMATCH %s: handle %u, frame %d\n", g_szGrass[i], h, frame);
+				return 1;
+			}
+		}
+		for (int i = 0; i < 3; i++) {
+			ReleaseTexture(&cache, g_szGrass[i]);
+		}
+	}
+	if (Expect(g_Gpu.nUploads == 3 && cache.nMisses == 3 && cache.nHits == 2997 &&
+			   cache.cbResident == 3 * 16 * 16 * 4, "1000 frames of 3 textures")) {
+		return 1;
+	}
+
+	// same bytes, other path: no upload
+	if (!CopyFile_(g_szGrass[0], "texcache_copy.tmp")) {
+		printf("can't write texcache_copy.tmp\n");
+		return 1;
+	}
+	unsigned int h = AcquireTexture(&cache, "texcache_copy.tmp");
+	ReleaseTexture(&cache, "texcache_copy.tmp");
+	h = h == AcquireTexture(&cache, "texcache_copy.tmp") ? h : 0; // now a path hit
+	ReleaseTexture(&cache, "texcache_copy.tmp");
+	remove("texcache_copy.tmp");
+	if (Expect(h == first[0] && cache.nContentHits == 1 && g_Gpu.nUploads == 3, "content hit")) {
+		return 1;
+	}
+
+	// failures
+	unsigned long long nFailures = cache.nFailures;
+	WriteFile("texcache_bad.tmp", "BMnot really", 12);
+	if (Expect(!AcquireTexture(&cache, "texcache missing.bmp") && !AcquireTexture(&cache, "texcache_bad.tmp") &&
+			   cache.nFailures == nFailures + 2 && g_Gpu.nUploads == 3, "failed loads")) {
+		return 1;
+	}
+	remove("texcache_bad.tmp");
+	ReleaseTexture(&cache, "never acquired.bmp"); // ignored
+
+	FreeTextureCache(&cache);
+	if (Expect(g_Gpu.nAlive == 0, "FreeTextureCache left textures")) {
+		return 1;
+	}
+	printf("frames: 3 uploads for 3000 acquires, copy shared by content, failures counted: ok\n");
+	return 0;
+}
+
+static int CheckBudget(void)
+{
+	char szPath[12][32];
+	for (int i = 0; i < 12; i++) {
+		snprintf(szPath[i], sizeof(szPath[i]), "texcache_%d.tmp", i);
+		if (!WriteTestBmp(szPath[i], i)) {
+			printf("can't write %s\n", szPath[i]);
+			return 1;
+		}
+	}
+
+	const size_t cbTexture = 64 * 64 * 4;
+	TEXTURECACHE cache;
+	unsigned int handle[12];
+	InitMock(&cache, 4 * cbTexture);
+
+	// all 12 held: nothing can go, over the budget
+	for (int i = 0; i < 12; i++) {
+		handle[i] = AcquireTexture(&cache, szPath[i]);
+	}
+	if (Expect(cache.cbResident == 12 * cbTexture && cache.nEvictions == 0, "held textures evicted")) {
+		return 1;
+	}
+
+	// release 0..11 in order: each release evicts down to 4 free ones... and
+	// those are the ones released first
+	for (int i = 0; i < 12; i++) {
+		ReleaseTexture(&cache, szPath[i]);
+	}
+	if (Expect(cache.cbResident == 4 * cbTexture && cache.nEvictions == 8, "budget after releases")) {
+		return 1;
+	}
+	for (int i = 0; i < 12; i++) {
+		if (Expect(g_Gpu.alive[handle[i]] == (i >= 8), "LRU order")) {
+			printf("  texture %d\n", i);
+			return 1;
+		}
+	}
+
+	// touching 8 makes 9 the oldest
+	AcquireTexture(&cache, szPath[8]);
+	ReleaseTexture(&cache, szPath[8]);
+	unsigned int h0 = AcquireTexture(&cache, szPath[0]); // reloaded, evicts 9
+	if (Expect(h0 && h0 != handle[0] && !g_Gpu.alive[handle[9]] && g_Gpu.alive[handle[8]] &&
+			   cache.nMisses == 13, "LRU after a touch")) {
+		return 1;
+	}
+
+	// shrinking the budget evicts what is free, keeps what is held
+	SetTextureBudget(&cache, 0);
+	if (Expect(g_Gpu.nAlive == 1 && g_Gpu.alive[h0] && cache.cbResident == cbTexture, "budget 0")) {
+		return 1;
+	}
+	ReleaseTexture(&cache, szPath[0]);
+	if (Expect(g_Gpu.nAlive == 0 && cache.cbResident == 0 && cache.nPaths == 0, "budget 0 release")) {
+		return 1;
+	}
+
+	// churn: random acquire/release against a model of the refcounts
+	SetTextureBudget(&cache, 5 * cbTexture);
+	int refs[12] = { 0 };
+	unsigned int seed = 7;
+	for (int n = 0; n < 20000; n++) {
+		seed = seed * 1664525 + 1013904223;
+		int i = (seed >> 16) % 12;
+		if ((seed >> 8) & 1 || !refs[i]) {
+			handle[i] = AcquireTexture(&cache, szPath[i]);
+			refs[i]++;
+		} else {
+			ReleaseTexture(&cache, szPath[i]);
+			refs[i]--;
+		}
+		int nHeld = 0;
+		size_t cbHeld = 0;
+		for (int k = 0; k < 12; k++) {
+			if (refs[k] && !g_Gpu.alive[handle[k]]) {
+				printf("MISMATCH texture %d evicted while held\n", k);
+				return 1;
+			}
+			nHeld += refs[k] != 0;
+			cbHeld += refs[k] ? cbTexture : 0;
+		}
+		if (cache.cbResident > (cbHeld > 5 * cbTexture ? cbHeld : 5 * cbTexture) ||
+			cache.cbResident != (size_t)g_Gpu.nAlive * cbTexture || g_Gpu.nErrors) {
+			printf("MISMATCH churn step %d: %d alive, %d held\n", n, g_Gpu.nAlive, nHeld);
+			return 1;
+		}
+	}
+
+	printf("budget: %llu evictions, %llu misses, %llu hits over the churn: ok\n",
+		   cache.nEvictions, cache.nMisses, cache.nHits);
+	FreeTextureCache(&cache);
+	for (int i = 0; i < 12; i++) {
+		remove(szPath[i]);
+	}
+	return Expect(g_Gpu.nAlive == 0, "FreeTextureCache after churn");
+}
+
+static void BenchFrames(void)
+{
+	const int nFrames = 20000;
+	TEXTURECACHE cache;
+	InitMock(&cache, 64 << 20);
+
+	// before: every frame decodes and uploads (and never deletes)
+	double t0 = PaceNow();
+	for (int frame = 0; frame < nFrames; frame++) {
+		for (int i = 0; i < 3; i++) {
+			BMPIMAGE image;
+			size_t cb = 0;
+			if (LoadBmp(g_szGrass[i], &image)) {
+				MockUpload(&g_Gpu, &image, &cb);
+				g_Gpu.nextHandle = 0; // the mock runs out of handles otherwise
+				FreeBmp(&image);
+			}
+		}
+	}
+	double tLoad = PaceNow() - t0;
+	memset(&g_Gpu, 0, sizeof(g_Gpu));
+
+	t0 = PaceNow();
+	for (int frame = 0; frame < nFrames; frame++) {
+		for (int i = 0; i < 3; i++) {
+			AcquireTexture(&cache, g_szGrass[i]);
+		}
+		for (int i = 0; i < 3; i++) {
+			ReleaseTexture(&cache, g_szGrass[i]);
+		}
+	}
+	double tCache = PaceNow() - t0;
+
+	printf("\nns per frame of 3 textures (mock upload)\n");
+	printf("%-28s %10.0f\n", "decode + upload", tLoad * 1e9 / nFrames);
+	printf("%-28s %10.0f\n", "cache", tCache * 1e9 / nFrames);
+	FreeTextureCache(&cache);
+}
+
+int main(void)
+{
+	InitBmpDecoder();
+	if (CheckFrames() || CheckBudget()) {
+		return 1;
+	}
+	BenchFrames();
+	return 0;
+}
@@ -0,0 +1,288 @@
+/*
+	Asynchronous texture loading: decode on worker threads, upload on the render thread
+	Notes:
+		- LoadTextureAsync(path) returns at once with a placeholder handle
+		  (the backend makes it, a 1x1 texture in GL): bind and draw with it
+		  from the first frame, the real image goes into the same handle
+		  later, nothing has to swap handles
+		- the request goes to the decode workers through a lock-free queue
+		  (queue.c) and a semaphore wakes one of them; the worker maps and
+		  decodes the BMP (bmp.c) and pushes the result on a second queue
+		- PumpTextureUploads(budget) runs on the render thread once a frame:
+		  uploads finished images until the budget (seconds) is used up, at
+		  least one per call so a big texture can't stall the queue forever
+		- a finished image that missed the budget waits for the next frame;
+		  the workers never touch GL
+		- at most nCapacity requests in the queues (so the result queue never
+		  fills); past that they wait on a pending list (render thread only,
+		  in request order, the placeholder is already out) and
+		  PumpTextureUploads hands them to the workers as slots free up:
+		  the render thread never decodes
+		- a file that doesn't load keeps its placeholder (nFailed)
+		- pfnPrepare (optional) runs on the worker after the decode, for
+		  cpu work the upload needs (a mip chain, mip.c); what it returns
+		  comes to pfnUpload and then to pfnFreePrepared
+		- stats: uploads, failures, seconds spent uploading (total, worst
+		  single upload, worst frame), requested -> uploaded latency
+*/
+
+#ifndef TEXLOADER_C
+#define TEXLOADER_C
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.c"
+#include "queue.c"
+#include "bmp.c"
+#include "pacing.c"
+
+#define MAX_LOADER_THREADS 16
+
+typedef struct {
+	void* pContext;
+	// a handle that can be bound right away
+	unsigned int (*pfnCreatePlaceholder)(void* pContext);
+	// the decoded image into that handle, returns 0 on failure
+	int (*pfnUpload)(void* pContext, unsigned int handle, const BMPIMAGE* pImage, void* pPrepared);
+	// optional, on a worker thread: NULL is fine, pfnUpload gets NULL
+	void* (*pfnPrepare)(void* pContext, const BMPIMAGE* pImage);
+	void (*pfnFreePrepared)(void* pContext, void* pPrepared);
+} TEXTURELOADERBACKEND;
+
+typedef struct TEXTUREREQUEST {
+	struct TEXTUREREQUEST* pNext; // pending list
+	unsigned int handle;
+	int          bOk;
+	BMPIMAGE     image;
+	void*        pPrepared;
+	double       tRequested;
+	char         szPath[1]; // allocated to fit
+} TEXTUREREQUEST;
+
+typedef struct {
+	TEXTURELOADERBACKEND backend;
+
+	QUEUE         requests;    // render thread -> workers
+	QUEUE         decoded;     // workers -> render thread
+	SEMAPHORE     semRequests; // one count per queued request
+	THREAD        threads[MAX_LOADER_THREADS];
+	int           nThreads;
+	int           nCapacity;
+	int           nInFlight;   // requested, not uploaded yet (render thread only)
+	int           nQueued;     // of those, handed to the workers (<= nCapacity)
+	TEXTUREREQUEST* pPendingHead; // the rest, waiting for a slot
+	TEXTUREREQUEST* pPendingTail;
+
+	// stats, render thread
+	int    nRequested;
+	int    nUploaded;
+	int    nFailed;
+	int    nPendingMax;        // most requests waiting for a slot at once
+	double dUploadTotal;       // seconds in pfnUpload
+	double dUploadMax;         // worst single upload
+	double dPumpMax;           // worst PumpTextureUploads call
+	double dLatencyMax;        // worst requested -> uploaded
+} TEXTURELOADER;
+
+// decode, then the backend's cpu work; any thread
+static void DecodeTextureRequest(TEXTURELOADER* pLoader, TEXTUREREQUEST* pRequest)
+{
+	pRequest->bOk = LoadBmp(pRequest->szPath, &pRequest->image);
+	if (pRequest->bOk && pLoader->backend.pfnPrepare) {
+		pRequest->pPrepared = pLoader->backend.pfnPrepare(pLoader->backend.pContext, &pRequest->image);
+	}
+}
+
+static void FreeTextureRequest(TEXTURELOADER* pLoader, TEXTUREREQUEST* pRequest)
+{
+	if (pRequest->pPrepared) {
+		pLoader->backend.pfnFreePrepared(pLoader->backend.pContext, pRequest->pPrepared);
+	}
+	if (pRequest->bOk) {
+		FreeBmp(&pRequest->image);
+	}
+	free(pRequest);
+}
+
+static THREADPROC(TextureLoaderProc)
+{
+	TEXTURELOADER* pLoader = (TEXTURELOADER*)pContext;
+
+	for (;;) {
+		WaitSemaphore(&pLoader->semRequests);
+		TEXTUREREQUEST* pRequest = (TEXTUREREQUEST*)PopQueue(&pLoader->requests);
+		if (!pRequest) {
+			break; // a wake-up with nothing queued: DestroyTextureLoader
+		}
+		DecodeTextureRequest(pLoader, pRequest);
+		PushQueue(&pLoader->decoded, pRequest); // never full: nQueued <= nCapacity
+	}
+	return 0;
+}
+
+/*
+	nThreads decode workers (<= 0: one per cpu, minus the render thread, at
+	least 1), nCapacity requests in flight. Returns 0 on failure
+*/
+static int CreateTextureLoader(TEXTURELOADER* pLoader, const TEXTURELOADERBACKEND* pBackend,
+							   int nThreads, int nCapacity)
+{
+	memset(pLoader, 0, sizeof(*pLoader));
+	pLoader->backend = *pBackend;
+
+	if (nThreads <= 0) {
+		nThreads = GetCpuCount() - 1;
+	}
+	nThreads = nThreads < 1 ? 1 : nThreads > MAX_LOADER_THREADS ? MAX_LOADER_THREADS : nThreads;
+
+	if (!InitQueue(&pLoader->requests, nCapacity) || !InitQueue(&pLoader->decoded, nCapacity) ||
+		!InitSemaphore(&pLoader->semRequests, 0)) {
+		FreeQueue(&pLoader->requests);
+		FreeQueue(&pLoader->decoded);
+		return 0;
+	}
+	pLoader->nCapacity = nCapacity;
+
+	for (int i = 0; i < nThreads; i++) {
+		if (!StartThread(&pLoader->threads[i], TextureLoaderProc, pLoader)) {
+			break;
+		}
+		pLoader->nThreads++;
+	}
+	return pLoader->nThreads > 0;
+}
+
+static void FinishTextureRequest(TEXTURELOADER* pLoader, TEXTUREREQUEST* pRequest)
+{
+	if (pRequest->bOk) {
+		double t0 = PaceNow();
+		int bOk = pLoader->backend.pfnUpload(pLoader->backend.pContext, pRequest->handle, &pRequest->image,
+											 pRequest->pPrepared);
+		double t1 = PaceNow();
+		double dUpload = t1 - t0;
+		pLoader->dUploadTotal += dUpload;
+		pLoader->dUploadMax = dUpload > pLoader->dUploadMax ? dUpload : pLoader->dUploadMax;
+		pLoader->dLatencyMax = t1 - pRequest->tRequested > pLoader->dLatencyMax ? t1 - pRequest->tRequested
+																				 : pLoader->dLatencyMax;
+		if (bOk) {
+			pLoader->nUploaded++;
+		} else {
+			pLoader->nFailed++;
+		}
+	} else {
+		pLoader->nFailed++;
+	}
+	FreeTextureRequest(pLoader, pRequest);
+}
+
+// pending requests to the workers while there are free slots
+static void FeedTextureRequests(TEXTURELOADER* pLoader)
+{
+	while (pLoader->pPendingHead && pLoader->nQueued < pLoader->nCapacity) {
+		TEXTUREREQUEST* pRequest = pLoader->pPendingHead;
+		if (!PushQueue(&pLoader->requests, pRequest)) {
+			break;
+		}
+		pLoader->pPendingHead = pRequest->pNext;
+		if (!pLoader->pPendingHead) {
+			pLoader->pPendingTail = NULL;
+		}
+		pLoader->nQueued++;
+		PostSemaphore(&pLoader->semRequests, 1);
+	}
+
+	int nPending = pLoader->nInFlight - pLoader->nQueued;
+	pLoader->nPendingMax = nPending > pLoader->nPendingMax ? nPending : pLoader->nPendingMax;
+}
+
+// placeholder handle now, the image later (0 if even the placeholder failed)
+static unsigned int LoadTextureAsync(TEXTURELOADER* pLoader, const char* szPath)
+{
+	unsigned int handle = pLoader->backend.pfnCreatePlaceholder(pLoader->backend.pContext);
+	size_t cbPath = strlen(szPath);
+	TEXTUREREQUEST* pRequest = (TEXTUREREQUEST*)malloc(sizeof(TEXTUREREQUEST) + cbPath);
+	if (!handle || !pRequest) {
+		free(pRequest);
+		return handle;
+	}
+	memset(pRequest, 0, sizeof(*pRequest));
+	memcpy(pRequest->szPath, szPath, cbPath + 1);
+	pRequest->handle = handle;
+	pRequest->tRequested = PaceNow();
+	pLoader->nRequested++;
+
+	pLoader->nInFlight++;
+
+	// behind the ones already waiting, so they go out in request order
+	if (pLoader->pPendingTail) {
+		pLoader->pPendingTail->pNext = pRequest;
+	} else {
+		pLoader->pPendingHead = pRequest;
+	}
+	pLoader->pPendingTail = pRequest;
+	FeedTextureRequests(pLoader);
+	return handle;
+}
+
+/*
+	Uploads decoded images until dBudget seconds are spent (at least one),
+	then hands pending requests to the workers in the freed slots. Call once
+	a frame on the thread that owns the GL context, returns how many were
+	finished
+*/
+static int PumpTextureUploads(TEXTURELOADER* pLoader, double dBudget)
+{
+	double t0 = PaceNow();
+	int n = 0;
+
+	while (pLoader->nQueued > 0) {
+		if (n > 0 && PaceNow() - t0 >= dBudget) {
+			break;
+		}
+		TEXTUREREQUEST* pRequest = (TEXTUREREQUEST*)PopQueue(&pLoader->decoded);
+		if (!pRequest) {
+			break;
+		}
+		pLoader->nInFlight--;
+		pLoader->nQueued--;
+		FinishTextureRequest(pLoader, pRequest);
+		n++;
+	}
+	FeedTextureRequests(pLoader);
+
+	double dPump = PaceNow() - t0;
+	pLoader->dPumpMax = dPump > pLoader->dPumpMax ? dPump : pLoader->dPumpMax;
+	return n;
+}
+
+// in flight requests are dropped (their placeholders stay)
+static void DestroyTextureLoader(TEXTURELOADER* pLoader)
+{
+	// a wake-up per worker with the request queue drained makes them leave
+	TEXTUREREQUEST* pRequest;
+	while ((pRequest = pLoader->pPendingHead) != NULL) {
+		pLoader->pPendingHead = pRequest->pNext;
+		free(pRequest);
+	}
+	pLoader->pPendingTail = NULL;
+	while ((pRequest = (TEXTUREREQUEST*)PopQueue(&pLoader->requests)) != NULL) {
+		free(pRequest);
+	}
+	PostSemaphore(&pLoader->semRequests, pLoader->nThreads);
+	for (int i = 0; i < pLoader->nThreads; i++) {
+		JoinThread(pLoader->threads[i]);
+	}
+
+	while ((pRequest = (TEXTUREREQUEST*)PopQueue(&pLoader->decoded)) != NULL) {
+		FreeTextureRequest(pLoader, pRequest);
+	}
+	FreeQueue(&pLoader->requests);
+	FreeQueue(&pLoader->decoded);
+	FreeSemaphore(&pLoader->semRequests);
+	pLoader->nThreads = 0;
+	pLoader->nInFlight = 0;
+	pLoader->nQueued = 0;
+}
+
+#endif // TEXLOADER_C
@@ -0,0 +1,428 @@
+/*
+	Headless test/benchmark for texloader.c (and queue.c) with a mock backend
+	Notes:
+		- queue: 4 producer and 4 consumer threads push/pop 4 x 50000 items,
+		  every item must come out exactly once
+		- the mock backend gives placeholder handles at once and "uploads"
+		  with a memcpy into its own memory (a driver copies too), and keeps
+		  a checksum of every handle's pixels; its prepare step (on the
+		  workers) makes the same checksum, each must reach its upload and
+		  be freed
+		- 32 generated 512x512 24bpp files: every handle must end up with
+		  its file's pixels (checksum against a plain LoadBmp), exactly one
+		  upload each, a missing file keeps its placeholder
+		- also with 4 requests in the queues max (the rest wait on the pending
+		  list: nothing may be decoded on the caller, every frame must stay
+		  under the upload budget) and destroyed with requests still queued
+		  and pending (leaks: asan)
+		- time to first frame: everything loaded before the first frame
+		  (what LoadAndCreateTextures did) against async (placeholders,
+		  first frame right away); then the frames until the last upload
+		  with a 2 ms upload budget, cost of PumpTextureUploads per frame
+		- exits with 1 on a mismatch
+
+	build:
+		windows: cl /nologo /O2 texloaderbench.c
+		linux:   cc -O2 -pthread texloaderbench.c -o texloaderbench -lm
+*/
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <sched.h>
+#include <time.h>
+#endif
+#include "texloader.c"
+
+#define FILES     32
+#define SIDE      512
+#define BUDGET    0.002
+
+static void SleepMs(int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec ts = { 0, ms * 1000000L };
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// a spinning thread gives the cpu away (matters with fewer cpus than threads)
+static void YieldCpu(void)
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+/*
+	queue stress
+*/
+#define QUEUE_ITEMS 50000
+#define QUEUE_THREADS 4
+
+typedef struct {
+	QUEUE*         pQueue;
+	int            iThread;
+	volatile long* pPopped;
+	unsigned char* pSeen;
+	volatile long  nErrors;
+} QUEUETEST;
+
+static THREADPROC(QueueProducer)
+{
+	QUEUETEST* t = (QUEUETEST*)pContext;
+	for (long i = 0; i < QUEUE_ITEMS; i++) {
+		// item ids start at 1, NULL means empty
+		long id = 1 + t->iThread * QUEUE_ITEMS + i;
+		while (!PushQueue(t->pQueue, (void*)(intptr_t)id)) {
+			YieldCpu(); // full, a consumer will make room
+		}
+	}
+	return 0;
+}
+
+static THREADPROC(QueueConsumer)
+{
+	QUEUETEST* t = (QUEUETEST*)pContext;
+	while (ATOMIC_LOAD(t->pPopped) < QUEUE_ITEMS * QUEUE_THREADS) {
+		void* p = PopQueue(t->pQueue);
+		if (p) {
+			long id = (long)(intptr_t)p - 1;
+			if (id < 0 || id >= QUEUE_ITEMS * QUEUE_THREADS || t->pSeen[id]++) {
+				t->nErrors++;
+			}
+			ATOMIC_FETCH_ADD(t->pPopped, 1);
+		} else {
+			YieldCpu();
+		}
+	}
+	return 0;
+}
+
+static int CheckQueue(void)
+{
+	QUEUE queue;
+	volatile long nPopped = 0;
+	unsigned char* pSeen = (unsigned char*)calloc(QUEUE_ITEMS * QUEUE_THREADS, 1);
+	QUEUETEST producers[QUEUE_THREADS], consumers[QUEUE_THREADS];
+	THREAD threads[2 * QUEUE_THREADS];
+
+	if (!pSeen || !InitQueue(&queue, 64)) {
+		return 1;
+	}
+	for (int i = 0; i < QUEUE_THREADS; i++) {
+		QUEUETEST t = { &queue, i, &nPopped, pSeen, 0 };
+		producers[i] = consumers[i] = t;
+		StartThread(&threads[i], QueueProducer, &producers[i]);
+		StartThread(&threads[QUEUE_THREADS + i], QueueConsumer, &consumers[i]);
+	}
+	for (int i = 0; i < 2 * QUEUE_THREADS; i++) {
+		JoinThread(threads[i]);
+	}
+
+	long nErrors = 0, nMissing = 0;
+	for (int i = 0; i < QUEUE_THREADS; i++) {
+		nErrors += consumers[i].nErrors;
+	}
+	for (long i = 0; i < QUEUE_ITEMS * QUEUE_THREADS; i++) {
+		nMissing += pSeen[i] != 1;
+	}
+	int bEmpty = PopQueue(&queue) == NULL;
+	FreeQueue(&queue);
+	free(pSeen);
+	if (nErrors || nMissing || !bEmpty) {
+		printf("MISMATCH queue: %ld duplicates, %ld missing\n", nErrors, nMissing);
+		return 1;
+	}
+
+	// single thread: full and empty
+	InitQueue(&queue, 4);
+	int n = 0;
+	while (PushQueue(&queue, (void*)(intptr_t)(n + 1))) {
+		n++;
+	}
+	int bOrder = n == 4;
+	for (int i = 0; i < n; i++) {
+		bOrder &= PopQueue(&queue) == (void*)(intptr_t)(i + 1);
+	}
+	bOrder &= PopQueue(&queue) == NULL;
+	FreeQueue(&queue);
+	if (!bOrder) {
+		printf("MISMATCH queue full/empty/order\n");
+		return 1;
+	}
+
+	printf("queue: %d threads x %d items, each popped once: ok\n", 2 * QUEUE_THREADS, QUEUE_ITEMS);
+	return 0;
+}
+
+/*
+	mock backend
+*/
+#define MAX_HANDLES 256
+
+typedef struct {
+	unsigned int nHandles;
+	int          nUploads[MAX_HANDLES];
+	uint32_t     checksum[MAX_HANDLES];
+	uint8_t*     pMemory;  // where the "uploads" go
+	int          nBadPrepared;
+	volatile long nLivePrepared;
+} MOCKGPU;
+
+static uint32_t Checksum(const BMPIMAGE* pImage)
+{
+	uint32_t h = 2166136261u;
+	for (int y = 0; y < pImage->height; y++) {
+		const uint8_t* row = pImage->pPixels + (size_t)pImage->pitch * y;
+		for (int x = 0; x < pImage->width * 4; x += 61) {
+			h = (h ^ row[x]) * 16777619u;
+		}
+	}
+	return h ^ (uint32_t)pImage->width << 16 ^ (uint32_t)pImage->height;
+}
+
+static unsigned int MockPlaceholder(void* pContext)
+{
+	MOCKGPU* pGpu = (MOCKGPU*)pContext;
+	return pGpu->nHandles + 1 < MAX_HANDLES ? ++pGpu->nHandles : 0;
+}
+
+// the worker side: the checksum, uploads compare it with the pixels they get
+static void* MockPrepare(void* pContext, const BMPIMAGE* pImage)
+{
+	MOCKGPU* pGpu = (MOCKGPU*)pContext;
+	uint32_t* p = (uint32_t*)malloc(sizeof(uint32_t));
+	if (p) {
+		*p = Checksum(pImage);
+		ATOMIC_FETCH_ADD(&pGpu->nLivePrepared, 1);
+	}
+	return p;
+}
+
+static void MockFreePrepared(void* pContext, void* pPrepared)
+{
+	MOCKGPU* pGpu = (MOCKGPU*)pContext;
+	ATOMIC_FETCH_ADD(&pGpu->nLivePrepared, -1);
+	free(pPrepared);
+}
+
+static int MockUpload(void* pContext, unsigned int handle, const BMPIMAGE* pImage, void* pPrepared)
+{
+	MOCKGPU* pGpu = (MOCKGPU*)pContext;
+	memcpy(pGpu->pMemory, pImage->pPixels, (size_t)pImage->pitch * pImage->height);
+	pGpu->nUploads[handle]++;
+	pGpu->checksum[handle] = Checksum(pImage);
+	pGpu->nBadPrepared += pPrepared && *(uint32_t*)pPrepared != pGpu->checksum[handle];
+	return 1;
+}
+
+static MOCKGPU g_Gpu;
+static char g_szFiles[FILES][32];
+static uint32_t g_uExpected[FILES];
+
+static void ResetMock(TEXTURELOADERBACKEND* pBackend)
+{
+	uint8_t* pMemory = g_Gpu.pMemory;
+	memset(&g_Gpu, 0, sizeof(g_Gpu));
+	g_Gpu.pMemory = pMemory;
+	pBackend->pContext = &g_Gpu;
+	pBackend->pfnCreatePlaceholder = MockPlaceholder;
+	pBackend->pfnUpload = MockUpload;
+	pBackend->pfnPrepare = MockPrepare;
+	pBackend->pfnFreePrepared = MockFreePrepared;
+}
+
+static int WriteFiles(void)
+{
+	size_t cbRow = SIDE * 3, cb = 54 + cbRow * SIDE;
+	uint8_t* p = (uint8_t*)calloc(cb, 1);
+	if (!p) {
+		return 0;
+	}
+	p[0] = 'B'; p[1] = 'M';
+	p[10] = 54; p[14] = 40; p[19] = SIDE >> 8; p[23] = SIDE >> 8; p[26] = 1; p[28] = 24;
+	for (int f = 0; f < FILES; f++) {
+		for (size_t i = 54; i < cb; i++) {
+			p[i] = (uint8_t)(i * (f + 3) >> 4);
+		}
+		snprintf(g_szFiles[f], sizeof(g_szFiles[f]), "texloader_%d.tmp", f);
+		FILE* pf = fopen(g_szFiles[f], "wb");
+		if (!pf || fwrite(p, 1, cb, pf) != cb) {
+			free(p);
+			return 0;
+		}
+		fclose(pf);
+
+		BMPIMAGE image;
+		if (!LoadBmp(g_szFiles[f], &image)) {
+			free(p);
+			return 0;
+		}
+		g_uExpected[f] = Checksum(&image);
+		FreeBmp(&image);
+	}
+	free(p);
+	return 1;
+}
+
+// all files + one missing through the loader, nCapacity in flight
+static int CheckLoader(int nCapacity)
+{
+	TEXTURELOADERBACKEND backend;
+	TEXTURELOADER loader;
+	unsigned int handles[FILES + 1];
+
+	ResetMock(&backend);
+	if (!CreateTextureLoader(&loader, &backend, 0, nCapacity)) {
+		printf("can't create the loader\n");
+		return 1;
+	}
+	double t0 = PaceNow();
+	for (int f = 0; f < FILES; f++) {
+		handles[f] = LoadTextureAsync(&loader, g_szFiles[f]);
+	}
+	handles[FILES] = LoadTextureAsync(&loader, "texloader missing.bmp");
+	double dRequests = PaceNow() - t0;
+
+	// placeholders and a list, never a decode (one is several ms)
+	if (dRequests > BUDGET) {
+		printf("MISMATCH %d requests took %.2f ms on the caller\n", FILES + 1, dRequests * 1e3);
+		return 1;
+	}
+
+	int nFrames = 0;
+	while (loader.nInFlight > 0) {
+		PumpTextureUploads(&loader, BUDGET);
+		SleepMs(1);
+		nFrames++;
+	}
+
+	for (int f = 0; f <= FILES; f++) {
+		if (handles[f] != (unsigned int)f + 1) {
+			printf("MISMATCH placeholder %d is %u\n", f, handles[f]);
+			return 1;
+		}
+	}
+	for (int f = 0; f < FILES; f++) {
+		if (g_Gpu.nUploads[handles[f]] != 1 || g_Gpu.checksum[handles[f]] != g_uExpected[f]) {
+			printf("MISMATCH %s: %d uploads, checksum %08x\n", g_szFiles[f],
+				   g_Gpu.nUploads[handles[f]], g_Gpu.checksum[handles[f]]);
+			return 1;
+		}
+	}
+	if (g_Gpu.nUploads[handles[FILES]] != 0 || loader.nFailed != 1 || loader.nUploaded != FILES) {
+		printf("MISMATCH missing file: %d uploads, %d failed\n", g_Gpu.nUploads[handles[FILES]], loader.nFailed);
+		return 1;
+	}
+	if (g_Gpu.nBadPrepared || g_Gpu.nLivePrepared) {
+		printf("MISMATCH prepared: %d wrong, %ld not freed\n", g_Gpu.nBadPrepared, g_Gpu.nLivePrepared);
+		return 1;
+	}
+	if (nCapacity < FILES + 1 && loader.nPendingMax != FILES + 1 - nCapacity) {
+		printf("MISMATCH %d pending at most, expected %d\n", loader.nPendingMax, FILES + 1 - nCapacity);
+		return 1;
+	}
+	printf("loader, %2d in flight: %d uploads, %d pending at most, 1 failed, %d frames: ok\n",
+		   nCapacity, loader.nUploaded, loader.nPendingMax, nFrames);
+	DestroyTextureLoader(&loader);
+	return 0;
+}
+
+// destroyed with work queued, decoding and (nCapacity < FILES) pending: no leak, no crash
+static int CheckEarlyDestroy(int nCapacity)
+{
+	TEXTURELOADERBACKEND backend;
+	TEXTURELOADER loader;
+	ResetMock(&backend);
+	if (!CreateTextureLoader(&loader, &backend, 2, nCapacity)) {
+		return 1;
+	}
+	for (int f = 0; f < FILES; f++) {
+		LoadTextureAsync(&loader, g_szFiles[f]);
+	}
+	SleepMs(2);
+	PumpTextureUploads(&loader, BUDGET);
+	DestroyTextureLoader(&loader);
+	if (g_Gpu.nLivePrepared) {
+		printf("MISMATCH destroyed early: %ld prepared not freed\n", g_Gpu.nLivePrepared);
+		return 1;
+	}
+	return 0;
+}
+
+static void BenchFirstFrame(void)
+{
+	TEXTURELOADERBACKEND backend;
+	TEXTURELOADER loader;
+	unsigned int handles[FILES];
+
+	// before: every texture decoded and uploaded, then the first frame
+	ResetMock(&backend);
+	double t0 = PaceNow();
+	for (int f = 0; f < FILES; f++) {
+		BMPIMAGE image;
+		handles[f] = MockPlaceholder(&g_Gpu);
+		if (LoadBmp(g_szFiles[f], &image)) {
+			MockUpload(&g_Gpu, handles[f], &image, NULL);
+			FreeBmp(&image);
+		}
+	}
+	double dSync = PaceNow() - t0;
+
+	// async: placeholders, first frame, then frames until the last upload
+	ResetMock(&backend);
+	CreateTextureLoader(&loader, &backend, 0, 64);
+	t0 = PaceNow();
+	for (int f = 0; f < FILES; f++) {
+		handles[f] = LoadTextureAsync(&loader, g_szFiles[f]);
+	}
+	PumpTextureUploads(&loader, BUDGET);
+	double dFirst = PaceNow() - t0;
+
+	int nFrames = 1;
+	double dPumpTotal = 0.0;
+	while (loader.nInFlight > 0) {
+		SleepMs(1); // the rest of the frame: the workers get the cpu
+		double t1 = PaceNow();
+		PumpTextureUploads(&loader, BUDGET);
+		dPumpTotal += PaceNow() - t1;
+		nFrames++;
+	}
+	double dAll = PaceNow() - t0;
+
+	printf("\n%d textures %dx%d, %d decode threads, %.0f ms upload budget\n", FILES, SIDE, SIDE,
+		   loader.nThreads, BUDGET * 1e3);
+	printf("%-36s %9.2f ms\n", "time to first frame, sync", dSync * 1e3);
+	printf("%-36s %9.2f ms\n", "time to first frame, async", dFirst * 1e3);
+	printf("%-36s %9.2f ms (%d frames)\n", "async, all textures uploaded", dAll * 1e3, nFrames);
+	printf("%-36s %9.3f ms avg %9.3f ms max\n", "upload cost per frame", dPumpTotal * 1e3 / nFrames,
+		   loader.dPumpMax * 1e3);
+	printf("%-36s %9.3f ms max, %.2f ms request -> uploaded max\n", "single upload",
+		   loader.dUploadMax * 1e3, loader.dLatencyMax * 1e3);
+	DestroyTextureLoader(&loader);
+}
+
+int main(void)
+{
+	InitBmpDecoder();
+	g_Gpu.pMemory = (uint8_t*)malloc(SIDE * SIDE * 4);
+	if (!g_Gpu.pMemory || !WriteFiles()) {
+		printf("can't write the test files\n");
+		return 1;
+	}
+
+	int bFail = CheckQueue() || CheckLoader(64) || CheckLoader(4) || CheckEarlyDestroy(64) || CheckEarlyDestroy(4);
+	if (!bFail) {
+		BenchFirstFrame();
+	}
+
+	for (int f = 0; f < FILES; f++) {
+		remove(g_szFiles[f]);
+	}
+	free(g_Gpu.pMemory);
+	return bFail;
+}
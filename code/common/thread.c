@@ -0,0 +1,120 @@
+/*
+	Threads, semaphores and atomics, win32 or pthreads
+	Notes:
+		- just what the background loaders need: start/join a thread, a
+		  counting semaphore to sleep on, 32 bit atomics with acquire /
+		  release ordering
+		- ATOMIC_xxx work on volatile long (LONG on windows): loads and stores
+		  are ReadAcquire / WriteRelease (winnt.h), which carry the ordering
+		  themselves on every target (ldar / stlr on ARM64), not through
+		  /volatile:ms, which ARM64 does not default to
+		- THREADPROC is the thread body, returns nothing useful
+*/
+
+#ifndef THREAD_C
+#define THREAD_C
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE THREAD;
+typedef HANDLE SEMAPHORE;
+#define THREADPROC(name) DWORD WINAPI name(LPVOID pContext)
+#define ATOMIC_LOAD(p)            ReadAcquire((LONG const volatile*)(p))
+#define ATOMIC_STORE(p, v)        WriteRelease((LONG volatile*)(p), (v))
+#define ATOMIC_FETCH_ADD(p, v)    InterlockedExchangeAdd((volatile LONG*)(p), (v))
+#define ATOMIC_CAS(p, old, v)     (InterlockedCompareExchange((volatile LONG*)(p), (v), (old)) == (old))
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+typedef pthread_t THREAD;
+typedef sem_t SEMAPHORE;
+#define THREADPROC(name) void* name(void* pContext)
+#define ATOMIC_LOAD(p)            __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)        __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_FETCH_ADD(p, v)    __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_CAS(p, old, v)     __extension__({ long o_ = (old); \
+	__atomic_compare_exchange_n((p), &o_, (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); })
+#endif
+
+#ifdef _WIN32
+typedef LPTHREAD_START_ROUTINE PFNTHREADPROC;
+#else
+typedef void* (*PFNTHREADPROC)(void* pContext);
+#endif
+
+// returns 0 if the thread could not be created
+static int StartThread(THREAD* pThread, PFNTHREADPROC pfn, void* pContext)
+{
+#ifdef _WIN32
+	*pThread = CreateThread(NULL, 0, pfn, pContext, 0, NULL);
+	return *pThread != NULL;
+#else
+	return pthread_create(pThread, NULL, pfn, pContext) == 0;
+#endif
+}
+
+static void JoinThread(THREAD thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+static int InitSemaphore(SEMAPHORE* pSem, int nInitial)
+{
+#ifdef _WIN32
+	*pSem = CreateSemaphoreA(NULL, nInitial, 0x7FFFFFFF, NULL);
+	return *pSem != NULL;
+#else
+	return sem_init(pSem, 0, (unsigned int)nInitial) == 0;
+#endif
+}
+
+static void PostSemaphore(SEMAPHORE* pSem, int n)
+{
+#ifdef _WIN32
+	ReleaseSemaphore(*pSem, n, NULL);
+#else
+	while (n-- > 0) {
+		sem_post(pSem);
+	}
+#endif
+}
+
+static void WaitSemaphore(SEMAPHORE* pSem)
+{
+#ifdef _WIN32
+	WaitForSingleObject(*pSem, INFINITE);
+#else
+	while (sem_wait(pSem) != 0) {
+		// EINTR: a signal woke us, wait again
+	}
+#endif
+}
+
+static void FreeSemaphore(SEMAPHORE* pSem)
+{
+#ifdef _WIN32
+	CloseHandle(*pSem);
+#else
+	sem_destroy(pSem);
+#endif
+}
+
+static int GetCpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+#endif // THREAD_C
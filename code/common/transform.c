@@ -0,0 +1,409 @@
+/*
+	Transform hierarchy: parent/child transforms in flat arrays, world
+	matrices recomputed only under the nodes that changed
+	Notes:
+		- one node = an index; parent, local, world and depth are separate
+		  arrays (SoA), dirty is a bit per node; a pass reads parent + dirty
+		  for every node and touches the matrices only where something
+		  changed
+		- parents always come before their children: AddTransformNode
+		  appends and the parent must already exist, so one front to back
+		  pass sees a parent's new world before any of its children
+		- SortTransformTree reorders breadth first (roots, then depth 1,
+		  ..., the children of a node next to each other) and gives back
+		  the old -> new index table; after it the nodes of one depth are
+		  contiguous (pLevel), each level only needs the one before, so
+		  levels could be split across threads, and the children of a run
+		  of nodes are a run (pChild)
+		- SetTransformLocal marks the node dirty; UpdateTransformTree does
+		  world = parent world * local for every dirty node and every node
+		  under one (a recomputed node marks itself for its children, the
+		  flags are cleared at the end). In any order a first pass reads
+		  the flags from the lowest dirty index on and lists the nodes to
+		  redo in pUpdate, a second one multiplies only those; sorted, the
+		  dirty subtrees are runs of nodes, level after level, and only the
+		  runs are touched. A bit a node keeps the flags of 100k nodes in L1
+		  (12.5 KB), as bytes they were 100 KB and missed every frame after
+		  the matrices went through the cache
+		- matrices are affine (../common/affine.h), affine_to_mat4 at upload
+		- nUpdated is how many world matrices the last update recomputed
+
+	usage:
+		TRANSFORMTREE tree;
+		InitTransformTree(&tree);
+		int iCar = AddTransformNode(&tree, -1, &carLocal);
+		int iWheel = AddTransformNode(&tree, iCar, &wheelLocal);
+		...
+		SetTransformLocal(&tree, iCar, &newCarLocal);
+		UpdateTransformTree(&tree);
+		affine_to_mat4(&tree.pWorld[iWheel], M);
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "affine.h"
+
+// an affine is 48 bytes, the second half can be on the next cache line
+#if defined(MAT4_SSE)
+#define TRANSFORM_PREFETCH(p) (_mm_prefetch((const char*)(p), _MM_HINT_T0), \
+							   _mm_prefetch((const char*)(p) + 32, _MM_HINT_T0))
+#else
+#define TRANSFORM_PREFETCH(p) ((void)(p))
+#endif
+#define TRANSFORM_AHEAD 16 // nodes prefetched ahead of the update
+#define TRANSFORM_DIRTY_WORDS(n) (((n) + 63) / 64)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static int TransformLowestBit(uint64_t bits)
+{
+	unsigned long i;
+	_BitScanForward64(&i, bits);
+	return (int)i;
+}
+#else
+static int TransformLowestBit(uint64_t bits)
+{
+	return __builtin_ctzll(bits);
+}
+#endif
+
+typedef struct {
+	int      nNodes;
+	int      nCapacity;
+	int*     pParent;   // -1 for a root, always < the node's own index
+	int*     pDepth;    // 0 for a root
+	affine*  pLocal;    // relative to the parent
+	affine*  pWorld;    // parent world * local, valid after UpdateTransformTree
+	uint64_t* pDirty;   // bit i & 63 of word i >> 6: local changed since the last update
+	int      iFirstDirty; // no dirty node below it, nNodes (or more) when none
+	int*     pUpdate;   // scratch: the nodes the update recomputes, in index order
+
+	// after SortTransformTree: nodes of depth d are [pLevel[d], pLevel[d + 1]),
+	// the children of node i are [pChild[i], pChild[i + 1])
+	int*     pLevel;
+	int*     pChild;
+	int      nLevels;
+
+	// stats of the last update
+	int      nUpdated;
+} TRANSFORMTREE;
+
+static void InitTransformTree(TRANSFORMTREE* pTree)
+{
+	memset(pTree, 0, sizeof(*pTree));
+}
+
+static void FreeTransformTree(TRANSFORMTREE* pTree)
+{
+	free(pTree->pParent);
+	free(pTree->pDepth);
+	free(pTree->pLocal);
+	free(pTree->pWorld);
+	free(pTree->pDirty);
+	free(pTree->pUpdate);
+	free(pTree->pLevel);
+	free(pTree->pChild);
+	memset(pTree, 0, sizeof(*pTree));
+}
+
+// grows every array to nCapacity, returns 0 if out of memory (the tree is unchanged)
+static int ReserveTransformTree(TRANSFORMTREE* pTree, int nCapacity)
+{
+	if (nCapacity <= pTree->nCapacity) {
+		return 1;
+	}
+
+	int* pParent = (int*)realloc(pTree->pParent, nCapacity * sizeof(int));
+	if (pParent) pTree->pParent = pParent;
+	int* pDepth = (int*)realloc(pTree->pDepth, nCapacity * sizeof(int));
+	if (pDepth) pTree->pDepth = pDepth;
+	affine* pLocal = (affine*)realloc(pTree->pLocal, nCapacity * sizeof(affine));
+	if (pLocal) pTree->pLocal = pLocal;
+	affine* pWorld = (affine*)realloc(pTree->pWorld, nCapacity * sizeof(affine));
+	if (pWorld) pTree->pWorld = pWorld;
+	uint64_t* pDirty = (uint64_t*)realloc(pTree->pDirty, TRANSFORM_DIRTY_WORDS(nCapacity) * sizeof(uint64_t));
+	if (pDirty) {
+		int nOld = TRANSFORM_DIRTY_WORDS(pTree->nCapacity);
+		memset(pDirty + nOld, 0, (TRANSFORM_DIRTY_WORDS(nCapacity) - nOld) * sizeof(uint64_t));
+		pTree->pDirty = pDirty;
+	}
+	int* pUpdate = (int*)realloc(pTree->pUpdate, nCapacity * sizeof(int));
+	if (pUpdate) pTree->pUpdate = pUpdate;
+
+	if (!pParent || !pDepth || !pLocal || !pWorld || !pDirty || !pUpdate) {
+		return 0;
+	}
+	pTree->nCapacity = nCapacity;
+	return 1;
+}
+
+// appends a node under iParent (-1 for a root), returns its index or -1
+static int AddTransformNode(TRANSFORMTREE* pTree, int iParent, const affine* pLocal)
+{
+	if (iParent >= pTree->nNodes) {
+		return -1;
+	}
+	if (pTree->nNodes == pTree->nCapacity &&
+		!ReserveTransformTree(pTree, pTree->nCapacity ? pTree->nCapacity * 2 : 64)) {
+		return -1;
+	}
+
+	int i = pTree->nNodes++;
+	pTree->pParent[i] = iParent;
+	pTree->pDepth[i] = iParent < 0 ? 0 : pTree->pDepth[iParent] + 1;
+	pTree->pLocal[i] = *pLocal;
+	pTree->pDirty[i >> 6] |= 1ull << (i & 63);
+	if (i < pTree->iFirstDirty) {
+		pTree->iFirstDirty = i;
+	}
+	pTree->nLevels = 0; // not depth sorted any more
+	return i;
+}
+
+static void SetTransformLocal(TRANSFORMTREE* pTree, int i, const affine* pLocal)
+{
+	pTree->pLocal[i] = *pLocal;
+	pTree->pDirty[i >> 6] |= 1ull << (i & 63);
+	if (i < pTree->iFirstDirty) {
+		pTree->iFirstDirty = i;
+	}
+}
+
+static void UpdateTransformNode(TRANSFORMTREE* pTree, int i)
+{
+	int p = pTree->pParent[i];
+	if (p < 0) {
+		pTree->pWorld[i] = pTree->pLocal[i];
+	} else {
+		// world = parent world * local (affine_mul is B * A)
+		affine_mul(&pTree->pLocal[i], &pTree->pWorld[p], &pTree->pWorld[i]);
+	}
+}
+
+static void SetDirtyBits(uint64_t* pDirty, int i0, int i1)
+{
+	for (int w = i0 >> 6; i0 < i1; w++) {
+		int iEnd = w * 64 + 64 < i1 ? w * 64 + 64 : i1;
+		uint64_t bits = ~0ull << (i0 & 63);
+		if (iEnd & 63) {
+			bits &= ~(~0ull << (iEnd & 63));
+		}
+		pDirty[w] |= bits;
+		i0 = iEnd;
+	}
+}
+
+/*
+	Any order: the flags go down to the children and the nodes to redo
+	are appended to pUpdate (no branch on the flag, a 60/40 mix of dirty
+	and clean nodes mispredicted more than the multiplies cost), then
+	only the nodes in the list are multiplied, their matrices prefetched
+	TRANSFORM_AHEAD nodes ahead (with gaps in the indices the hardware
+	prefetcher doesn't follow the arrays any more)
+*/
+static int UpdateListedTransforms(TRANSFORMTREE* pTree)
+{
+	const int* pParent = pTree->pParent;
+	uint64_t* pDirty = pTree->pDirty;
+	int* pUpdate = pTree->pUpdate;
+	int n = pTree->nNodes, nUpdated = 0;
+	int wFirst = pTree->iFirstDirty >> 6, nWords = TRANSFORM_DIRTY_WORDS(n);
+
+	for (int w = wFirst; w < nWords; w++) {
+		int i = w == wFirst ? pTree->iFirstDirty : w * 64;
+		int iEnd = w * 64 + 64 < n ? w * 64 + 64 : n;
+		uint64_t word = pDirty[w];
+		for (uint64_t bit = 1ull << (i & 63); i < iEnd; i++, bit <<= 1) {
+			// a root reads its own bit, a parent in this word reads word (not in pDirty yet)
+			int p = pParent[i] < 0 ? i : pParent[i];
+			uint64_t parent = p >> 6 == w ? word : pDirty[p >> 6];
+			word |= (0 - (parent >> (p & 63) & 1)) & bit; // for the children
+			pUpdate[nUpdated] = i;
+			nUpdated += (word & bit) != 0;
+		}
+		pDirty[w] = word;
+	}
+
+	for (int k = 0; k < nUpdated; k++) {
+		if (k + TRANSFORM_AHEAD < nUpdated) {
+			int j = pUpdate[k + TRANSFORM_AHEAD], q = pParent[j];
+			TRANSFORM_PREFETCH(&pTree->pLocal[j]);
+			TRANSFORM_PREFETCH(&pTree->pWorld[j]);
+			if (q >= 0) {
+				TRANSFORM_PREFETCH(&pTree->pWorld[q]);
+			}
+		}
+		UpdateTransformNode(pTree, pUpdate[k]);
+	}
+	return nUpdated;
+}
+
+/*
+	Sorted (breadth first, the children of a node contiguous): everything
+	under a run of dirty nodes [i0, i1) is the run [pChild[i0], pChild[i1])
+	one level down. The set bits go by in runs: recompute the run front
+	to back, set the bits of its children, go on; nothing of the clean
+	nodes is read but their bits, and the matrices stream
+*/
+static int UpdateSortedTransforms(TRANSFORMTREE* pTree)
+{
+	uint64_t* pDirty = pTree->pDirty;
+	const int* pChild = pTree->pChild;
+	int n = pTree->nNodes, nUpdated = 0;
+
+	for (int w = pTree->iFirstDirty >> 6; w < TRANSFORM_DIRTY_WORDS(n); w++) {
+		uint64_t bits = pDirty[w];
+		while (bits) {
+			// a run of set bits [s, e) of this word
+			int s = TransformLowestBit(bits);
+			uint64_t clear = ~(bits >> s);
+			int e = clear ? s + TransformLowestBit(clear) : 64;
+			int i0 = w * 64 + s, i1 = w * 64 + e;
+			for (int i = i0; i < i1; i++) {
+				int j = i + TRANSFORM_AHEAD < n ? i + TRANSFORM_AHEAD : n - 1;
+				TRANSFORM_PREFETCH(&pTree->pLocal[j]);
+				TRANSFORM_PREFETCH(&pTree->pWorld[j]);
+				UpdateTransformNode(pTree, i);
+			}
+			SetDirtyBits(pDirty, pChild[i0], pChild[i1]);
+			nUpdated += e - s;
+			// the first levels have children further on in this word
+			bits = e < 64 ? pDirty[w] & ~0ull << e : 0;
+		}
+	}
+	return nUpdated;
+}
+
+/*
+	Recomputes the world matrix of every dirty node and of everything under
+	it, in index order (parents first). Returns how many were recomputed
+*/
+static int UpdateTransformTree(TRANSFORMTREE* pTree)
+{
+	int n = pTree->nNodes;
+
+	pTree->nUpdated = 0;
+	if (pTree->iFirstDirty >= n) {
+		return 0;
+	}
+
+	int nUpdated = pTree->nLevels ? UpdateSortedTransforms(pTree) : UpdateListedTransforms(pTree);
+
+	int wFirst = pTree->iFirstDirty >> 6;
+	memset(pTree->pDirty + wFirst, 0, (TRANSFORM_DIRTY_WORDS(n) - wFirst) * sizeof(uint64_t));
+	pTree->iFirstDirty = n;
+	pTree->nUpdated = nUpdated;
+	return nUpdated;
+}
+
+/*
+	Reorders the nodes breadth first (roots, then their children, ...: by
+	depth, and the children of a node contiguous, in insertion order) and
+	fills pLevel and pChild. pRemap (can be NULL) gets new index =
+	pRemap[old index]. Returns 0 if out of memory (the tree is unchanged)
+*/
+static int SortTransformTree(TRANSFORMTREE* pTree, int* pRemap)
+{
+	int n = pTree->nNodes, nLevels = 0;
+
+	for (int i = 0; i < n; i++) {
+		if (pTree->pDepth[i] + 1 > nLevels) {
+			nLevels = pTree->pDepth[i] + 1;
+		}
+	}
+
+	int nAlloc = n ? n : 1;
+	int* pLevel = (int*)calloc(nLevels + 1, sizeof(int));
+	int* pFirst = (int*)calloc(nAlloc + 1, sizeof(int));
+	int* pKids = (int*)malloc(nAlloc * sizeof(int));
+	int* pOrder = (int*)malloc(nAlloc * sizeof(int));
+	int* pNew = (int*)malloc(nAlloc * sizeof(int));
+	int* pChild = (int*)malloc((nAlloc + 1) * sizeof(int));
+	int* pParent = (int*)malloc(nAlloc * sizeof(int));
+	int* pDepth = (int*)malloc(nAlloc * sizeof(int));
+	affine* pLocal = (affine*)malloc(nAlloc * sizeof(affine));
+	affine* pWorld = (affine*)malloc(nAlloc * sizeof(affine));
+	uint64_t* pDirty = (uint64_t*)calloc(TRANSFORM_DIRTY_WORDS(nAlloc), sizeof(uint64_t));
+	int* pUpdate = (int*)malloc(nAlloc * sizeof(int));
+	if (!pLevel || !pFirst || !pKids || !pOrder || !pNew || !pChild || !pParent || !pDepth || !pLocal || !pWorld ||
+		!pDirty || !pUpdate) {
+		free(pLevel); free(pFirst); free(pKids); free(pOrder); free(pNew); free(pChild);
+		free(pParent); free(pDepth); free(pLocal); free(pWorld); free(pDirty); free(pUpdate);
+		return 0;
+	}
+
+	// level starts
+	for (int i = 0; i < n; i++) {
+		pLevel[pTree->pDepth[i] + 1]++;
+	}
+	for (int d = 0; d < nLevels; d++) {
+		pLevel[d + 1] += pLevel[d];
+	}
+
+	// the children of old node i are pKids[pFirst[i]] .. pKids[pFirst[i + 1] - 1]
+	for (int i = 0; i < n; i++) {
+		if (pTree->pParent[i] >= 0) {
+			pFirst[pTree->pParent[i] + 1]++;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		pFirst[i + 1] += pFirst[i];
+	}
+	memcpy(pNew, pFirst, n * sizeof(int)); // cursors
+	for (int i = 0; i < n; i++) {
+		if (pTree->pParent[i] >= 0) {
+			pKids[pNew[pTree->pParent[i]]++] = i;
+		}
+	}
+
+	// breadth first: the queue is the new order, a node's children go in as it comes out
+	int nQueued = 0;
+	for (int i = 0; i < n; i++) {
+		if (pTree->pParent[i] < 0) {
+			pOrder[nQueued++] = i;
+		}
+	}
+	for (int j = 0; j < n; j++) {
+		int i = pOrder[j];
+		pChild[j] = nQueued;
+		for (int k = pFirst[i]; k < pFirst[i + 1]; k++) {
+			pOrder[nQueued++] = pKids[k];
+		}
+		pNew[i] = j;
+	}
+	pChild[n] = n;
+
+	for (int i = 0; i < n; i++) {
+		int j = pNew[i], p = pTree->pParent[i];
+		pParent[j] = p < 0 ? -1 : pNew[p];
+		pDepth[j] = pTree->pDepth[i];
+		pLocal[j] = pTree->pLocal[i];
+		pWorld[j] = pTree->pWorld[i];
+		pDirty[j >> 6] |= (pTree->pDirty[i >> 6] >> (i & 63) & 1) << (j & 63);
+	}
+	if (pRemap) {
+		memcpy(pRemap, pNew, n * sizeof(int));
+	}
+
+	free(pTree->pParent); pTree->pParent = pParent;
+	free(pTree->pDepth);  pTree->pDepth = pDepth;
+	free(pTree->pLocal);  pTree->pLocal = pLocal;
+	free(pTree->pWorld);  pTree->pWorld = pWorld;
+	free(pTree->pDirty);  pTree->pDirty = pDirty;
+	free(pTree->pUpdate); pTree->pUpdate = pUpdate;
+	free(pTree->pLevel);  pTree->pLevel = pLevel;
+	free(pTree->pChild);  pTree->pChild = pChild;
+	free(pFirst);
+	free(pKids);
+	free(pOrder);
+	free(pNew);
+	pTree->nCapacity = nAlloc;
+	pTree->nLevels = nLevels;
+	if (pTree->iFirstDirty < n) {
+		pTree->iFirstDirty = 0; // the dirty nodes moved
+	}
+	return 1;
+}
@@ -0,0 +1,314 @@
+/*
+	Headless test/benchmark for transform.c (no window, runs on linux too)
+	Notes:
+		- 100k node random tree (each node's parent is a random earlier
+		  node, depth ~ ln n like a real scene: a few roots, wide levels)
+		- every frame 1%, 10% or 100% of the nodes get a new local
+		  transform, then UpdateTransformTree; the time is per frame and the
+		  recomputed count includes the subtrees under the changed nodes
+		- baselines: everything recomputed every frame (what rebuilding the
+		  matrices from scratch in Display does) and the naive per node
+		  walk up to the root
+		- insertion order and depth sorted (SortTransformTree)
+		- the lazy rows time a full recompute of the same frames too (in
+		  turns, the one that goes second finds the matrices in cache) and
+		  print lazy / full
+		- checks: the lazy world matrices bit for bit against a full
+		  recompute, before and after sorting and in every timed frame, the
+		  sorted children runs, and the recomputed count against the nodes
+		  that are changed or under a changed one; exits with 1 on a mismatch
+		  (the lazy / full ratio is only printed, it is wall clock)
+
+	build:
+		windows: cl /nologo /O2 transformbench.c
+		linux:   cc -O2 transformbench.c -o transformbench -lm
+*/
+
+#include <stdio.h>
+#include "transform.c"
+#include "pacing.c"
+
+#define NODES   100000
+#define POOL    1024
+#define FRAMES  50
+
+static volatile float g_fSink;
+
+static unsigned int g_uSeed = 1;
+
+static unsigned int RandomUint(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return g_uSeed >> 8;
+}
+
+static float RandomFloat(void)
+{
+	return (float)RandomUint() / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+// new locals come from a pool so the frames time the update, not the trig
+static affine g_Pool[POOL];
+
+static void BuildTree(TRANSFORMTREE* pTree)
+{
+	InitTransformTree(pTree);
+	ReserveTransformTree(pTree, NODES);
+	for (int i = 0; i < NODES; i++) {
+		int iParent = i < 8 ? -1 : (int)((unsigned long long)RandomUint() * i >> 24);
+		AddTransformNode(pTree, iParent, &g_Pool[RandomUint() % POOL]);
+	}
+	UpdateTransformTree(pTree);
+}
+
+// world matrices from scratch, same multiply order as the lazy pass
+static void FullRecompute(const TRANSFORMTREE* pTree, affine* pWorld)
+{
+	for (int i = 0; i < pTree->nNodes; i++) {
+		int p = pTree->pParent[i];
+		if (p < 0) {
+			pWorld[i] = pTree->pLocal[i];
+		} else {
+			affine_mul(&pTree->pLocal[i], &pWorld[p], &pWorld[i]);
+		}
+	}
+}
+
+// no cached parents: every node walks up to its root
+static void NaiveRecompute(const TRANSFORMTREE* pTree, affine* pWorld)
+{
+	for (int i = 0; i < pTree->nNodes; i++) {
+		affine W = pTree->pLocal[i];
+		for (int p = pTree->pParent[i]; p >= 0; p = pTree->pParent[p]) {
+			affine_mul(&W, &pTree->pLocal[p], &W);
+		}
+		pWorld[i] = W;
+	}
+}
+
+// pChanged (optional) gets a 1 for every node that got a new local
+static void ChangeNodes(TRANSFORMTREE* pTree, int nChanged, unsigned char* pChanged)
+{
+	for (int k = 0; k < nChanged; k++) {
+		int i = nChanged == pTree->nNodes ? k : (int)(RandomUint() % pTree->nNodes);
+		SetTransformLocal(pTree, i, &g_Pool[RandomUint() % POOL]);
+		if (pChanged) {
+			pChanged[i] = 1;
+		}
+	}
+}
+
+// what the update has to recompute: the changed nodes and everything under
+// them (parents come first in both orders); clears pChanged
+static int CountChanged(const TRANSFORMTREE* pTree, unsigned char* pChanged)
+{
+	int n = 0;
+	for (int i = 0; i < pTree->nNodes; i++) {
+		int p = pTree->pParent[i];
+		if (p >= 0 && pChanged[p]) {
+			pChanged[i] = 1;
+		}
+	}
+	for (int i = 0; i < pTree->nNodes; i++) {
+		n += pChanged[i];
+	}
+	memset(pChanged, 0, pTree->nNodes);
+	return n;
+}
+
+static int CompareWorld(const TRANSFORMTREE* pTree, const affine* pWorld, const char* szWhat)
+{
+	if (memcmp(pTree->pWorld, pWorld, pTree->nNodes * sizeof(affine)) != 0) {
+		printf("MISMATCH %s: lazy world matrices differ from a full recompute\n", szWhat);
+		return 1;
+	}
+	return 0;
+}
+
+static int CheckTree(affine* pWorld)
+{
+	TRANSFORMTREE tree;
+	BuildTree(&tree);
+
+	for (int frame = 0; frame < 20; frame++) {
+		ChangeNodes(&tree, 1 + frame * 50, NULL);
+		UpdateTransformTree(&tree);
+		FullRecompute(&tree, pWorld);
+		if (CompareWorld(&tree, pWorld, "insertion order")) {
+			return 1;
+		}
+	}
+
+	// the naive walk multiplies in another order, close but not bit exact
+	NaiveRecompute(&tree, pWorld);
+	double dNaive = 0.0;
+	for (int i = 0; i < tree.nNodes; i++) {
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 4; c++) {
+				double b = tree.pWorld[i].r[r][c];
+				dNaive = fmax(dNaive, fabs(pWorld[i].r[r][c] - b) / fmax(1.0, fabs(b)));
+			}
+		}
+	}
+
+	// sort with a change pending: the dirty flags move with the nodes
+	int* pRemap = (int*)malloc(NODES * sizeof(int));
+	SetTransformLocal(&tree, 3, &g_Pool[7]);
+	if (!pRemap || !SortTransformTree(&tree, pRemap)) {
+		printf("out of memory\n");
+		return 1;
+	}
+	for (int i = 0; i < tree.nNodes; i++) {
+		int p = tree.pParent[i];
+		if (p >= i || (p >= 0 && tree.pDepth[p] + 1 != tree.pDepth[i])) {
+			printf("MISMATCH node %d comes before its parent after sorting\n", i);
+			return 1;
+		}
+	}
+	for (int i = 0; i < tree.nNodes; i++) {
+		for (int c = tree.pChild[i]; c < tree.pChild[i + 1]; c++) {
+			if (tree.pParent[c] != i) {
+				printf("MISMATCH node %d is in the children of %d, its parent is %d\n", c, i, tree.pParent[c]);
+				return 1;
+			}
+		}
+		if (tree.pChild[i] > tree.pChild[i + 1] || (i > 0 && tree.pParent[i] < tree.pParent[i - 1])) {
+			printf("MISMATCH node %d: the children are not breadth first\n", i);
+			return 1;
+		}
+	}
+	for (int d = 0; d < tree.nLevels; d++) {
+		for (int i = tree.pLevel[d]; i < tree.pLevel[d + 1]; i++) {
+			if (tree.pDepth[i] != d) {
+				printf("MISMATCH level %d holds a node of depth %d\n", d, tree.pDepth[i]);
+				return 1;
+			}
+		}
+	}
+	UpdateTransformTree(&tree);
+	FullRecompute(&tree, pWorld);
+	if (CompareWorld(&tree, pWorld, "depth sorted")) {
+		return 1;
+	}
+	if (memcmp(&tree.pLocal[pRemap[3]], &g_Pool[7], sizeof(affine)) != 0) {
+		printf("MISMATCH the remap table does not follow the nodes\n");
+		return 1;
+	}
+
+	printf("lazy == full recompute (bit exact), naive walk %.3g from it, %d levels\n", dNaive, tree.nLevels);
+	free(pRemap);
+	FreeTransformTree(&tree);
+	if (dNaive > 1e-4) {
+		printf("MISMATCH naive walk over the bound\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	Lazy update against a full recompute of the same frames, taking turns
+	on which goes first so both find the same caches. Every frame the lazy
+	matrices must equal the full ones and the recomputed count what
+	CountChanged says. Returns 1 on a mismatch
+*/
+static int BenchLazy(TRANSFORMTREE* pTree, affine* pWorld, unsigned char* pChanged, const char* szOrder, int nPercent)
+{
+	int nChanged = NODES / 100 * nPercent;
+	double best = 1e9, bestFull = 1e9, nUpdated = 0.0;
+
+	for (int run = 0; run < 5; run++) {
+		double t = 0.0, tFull = 0.0;
+		nUpdated = 0.0;
+		for (int frame = 0; frame < FRAMES; frame++) {
+			ChangeNodes(pTree, nChanged, pChanged);
+			double t0 = PaceNow(), t1, t2;
+			if (frame & 1) {
+				FullRecompute(pTree, pWorld);
+				t1 = PaceNow();
+				UpdateTransformTree(pTree);
+				t2 = PaceNow();
+				tFull += t1 - t0;
+				t += t2 - t1;
+			} else {
+				UpdateTransformTree(pTree);
+				t1 = PaceNow();
+				FullRecompute(pTree, pWorld);
+				t2 = PaceNow();
+				t += t1 - t0;
+				tFull += t2 - t1;
+			}
+			nUpdated += pTree->nUpdated;
+
+			int nExpected = CountChanged(pTree, pChanged);
+			if (pTree->nUpdated != nExpected) {
+				printf("MISMATCH %s %d%% changed: %d recomputed, %d changed or under a changed node\n",
+					   szOrder, nPercent, pTree->nUpdated, nExpected);
+				return 1;
+			}
+			if (CompareWorld(pTree, pWorld, szOrder)) {
+				return 1;
+			}
+		}
+		best = t < best ? t : best;
+		bestFull = tFull < bestFull ? tFull : bestFull;
+	}
+	printf("%-14s %3d%% changed %10.3f ms %9.0f recomputed %6.2fx full\n", szOrder, nPercent,
+		   best * 1e3 / FRAMES, nUpdated / FRAMES, best / bestFull);
+	g_fSink += pTree->pWorld[NODES / 2].r[1][3] + pWorld[NODES / 2].r[1][3];
+	return 0;
+}
+
+typedef void (*PFNRECOMPUTE)(const TRANSFORMTREE* pTree, affine* pWorld);
+
+static void BenchFull(const TRANSFORMTREE* pTree, affine* pWorld, const char* szName, PFNRECOMPUTE pfn, int nFrames)
+{
+	double best = 1e9;
+	for (int run = 0; run < 5; run++) {
+		double t0 = PaceNow();
+		for (int frame = 0; frame < nFrames; frame++) {
+			pfn(pTree, pWorld);
+		}
+		double t = PaceNow() - t0;
+		best = t < best ? t : best;
+	}
+	printf("%-28s %10.3f ms %9d recomputed\n", szName, best * 1e3 / nFrames, NODES);
+	g_fSink += pWorld[NODES / 2].r[1][3];
+}
+
+int main(void)
+{
+	for (int i = 0; i < POOL; i++) {
+		affine_trs(&g_Pool[i], RandomFloat() * 10.0f, RandomFloat() * 10.0f, RandomFloat() * 10.0f,
+				   RandomFloat() * 4.0f, RandomFloat(), RandomFloat(), RandomFloat() + 1.5f,
+				   1.0f + RandomFloat() * 0.01f, 1.0f, 1.0f);
+	}
+
+	affine* pWorld = (affine*)malloc(NODES * sizeof(affine));
+	unsigned char* pChanged = (unsigned char*)calloc(NODES, 1);
+	if (!pWorld || !pChanged) {
+		return 1;
+	}
+	if (CheckTree(pWorld)) {
+		return 1;
+	}
+
+	TRANSFORMTREE tree;
+	BuildTree(&tree);
+
+	printf("\n%d nodes, ms per frame\n", NODES);
+	BenchFull(&tree, pWorld, "full recompute", FullRecompute, FRAMES);
+	BenchFull(&tree, pWorld, "naive walk to the root", NaiveRecompute, 5);
+	int failed = BenchLazy(&tree, pWorld, pChanged, "insertion", 1) ||
+				 BenchLazy(&tree, pWorld, pChanged, "insertion", 10) ||
+				 BenchLazy(&tree, pWorld, pChanged, "insertion", 100);
+
+	SortTransformTree(&tree, NULL);
+	failed = failed || BenchLazy(&tree, pWorld, pChanged, "depth sorted", 1) ||
+			 BenchLazy(&tree, pWorld, pChanged, "depth sorted", 10) ||
+			 BenchLazy(&tree, pWorld, pChanged, "depth sorted", 100);
+
+	FreeTransformTree(&tree);
+	free(pWorld);
+	free(pChanged);
+	return failed;
+}
@@ -0,0 +1,341 @@
+/*
+	Batched vertex transform: one mat4 applied to N positions in SoA layout
+	Notes:
+		- positions are structure of arrays (x[], y[], z[]), not {x,y,z} per
+		  vertex: a SIMD register then holds the same coordinate of 4/8/16
+		  vertices and the transform is just broadcasts of the 16 matrix
+		  elements and mul/add, no shuffles
+		- the mat4 is the one from mat4.h (column-major, M[3] is the
+		  translation), every vertex is (x, y, z, 1)
+		- three outputs:
+				VERTEX_WORLD   x,y,z = M * v, w is not computed (M is affine:
+				               a model matrix)
+				VERTEX_CLIP    x,y,z,w = M * v (M is projection * view * model)
+				VERTEX_SCREEN  clip, then the perspective divide and the
+				               viewport in the same pass: x,y in pixels, z in
+				               [near, far] of the depth range, w = 1 / w_clip
+				               (what a rasterizer needs to interpolate)
+		- VERTEX_SCREEN does not clip: a vertex with w_clip <= 0 (behind the
+		  eye) gives garbage or inf, cull/clip those on the clip output first
+		- scalar, SSE, AVX2 and AVX-512 kernels, InitVertexTransform() picks
+		  the widest one; the last n % lanes vertices go through the scalar one
+		- out can be the same arrays as in (transform in place)
+		- AllocVertices gives 64 byte aligned arrays, the kernels use unaligned
+		  loads so any float* works, aligned ones just never split a cache line
+		- single threaded: to use more cores give each worker a slice
+		  (pointers + i0, count) of the same arrays
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mat4.h"
+#include "cpu.c"
+
+#define VERTEX_WORLD   0
+#define VERTEX_CLIP    1
+#define VERTEX_SCREEN  2
+
+typedef struct {
+	float* x;
+	float* y;
+	float* z;
+	float* w;       // only written by VERTEX_CLIP and VERTEX_SCREEN
+	void*  pBlock;  // AllocVertices: the one allocation behind the arrays
+} VERTICES;
+
+// glViewport + glDepthRange
+typedef struct {
+	float x, y, cx, cy;
+	float zNear, zFar;
+} VIEWPORT;
+
+typedef void (*PFNTRANSFORMVERTICES)(const mat4 M, const VERTICES* pIn, VERTICES* pOut,
+									 int i0, int n, int iMode, const VIEWPORT* pViewport);
+
+// x,y,z (and w) arrays of n floats, 64 byte aligned, returns 0 if out of memory
+static int AllocVertices(VERTICES* pVerts, int n, int bW)
+{
+	size_t cbArray = ((size_t)n * sizeof(float) + 63) & ~(size_t)63;
+	uint8_t* p = (uint8_t*)malloc(cbArray * (bW ? 4 : 3) + 64);
+
+	memset(pVerts, 0, sizeof(*pVerts));
+	if (!p) {
+		return 0;
+	}
+	pVerts->pBlock = p;
+	p = (uint8_t*)(((uintptr_t)p + 63) & ~(uintptr_t)63);
+	pVerts->x = (float*)p;
+	pVerts->y = (float*)(p + cbArray);
+	pVerts->z = (float*)(p + cbArray * 2);
+	pVerts->w = bW ? (float*)(p + cbArray * 3) : NULL;
+	return 1;
+}
+
+static void FreeVertices(VERTICES* pVerts)
+{
+	free(pVerts->pBlock);
+	memset(pVerts, 0, sizeof(*pVerts));
+}
+
+/*
+	viewport as scale and offset:
+		xw = x + (ndc.x + 1) * cx / 2 = ndc.x * sx + ox
+		zw = ndc.z * (far - near) / 2 + (far + near) / 2
+*/
+typedef struct {
+	float sx, ox, sy, oy, sz, oz;
+} VIEWPORTXFORM;
+
+static void GetViewportXform(const VIEWPORT* pViewport, VIEWPORTXFORM* pXf)
+{
+	pXf->sx = pViewport->cx * 0.5f;
+	pXf->ox = pViewport->x + pViewport->cx * 0.5f;
+	pXf->sy = pViewport->cy * 0.5f;
+	pXf->oy = pViewport->y + pViewport->cy * 0.5f;
+	pXf->sz = (pViewport->zFar - pViewport->zNear) * 0.5f;
+	pXf->oz = (pViewport->zFar + pViewport->zNear) * 0.5f;
+}
+
+static void TransformVerticesScalar(const mat4 M, const VERTICES* pIn, VERTICES* pOut,
+									int i0, int n, int iMode, const VIEWPORT* pViewport)
+{
+	VIEWPORTXFORM xf = { 0 };
+	if (iMode == VERTEX_SCREEN) {
+		GetViewportXform(pViewport, &xf);
+	}
+
+	for (int i = i0; i < i0 + n; i++) {
+		float x = pIn->x[i], y = pIn->y[i], z = pIn->z[i];
+		float cx = M[0][0] * x + M[1][0] * y + M[2][0] * z + M[3][0];
+		float cy = M[0][1] * x + M[1][1] * y + M[2][1] * z + M[3][1];
+		float cz = M[0][2] * x + M[1][2] * y + M[2][2] * z + M[3][2];
+
+		if (iMode == VERTEX_WORLD) {
+			pOut->x[i] = cx;
+			pOut->y[i] = cy;
+			pOut->z[i] = cz;
+			continue;
+		}
+
+		float cw = M[0][3] * x + M[1][3] * y + M[2][3] * z + M[3][3];
+		if (iMode == VERTEX_CLIP) {
+			pOut->x[i] = cx;
+			pOut->y[i] = cy;
+			pOut->z[i] = cz;
+			pOut->w[i] = cw;
+		} else {
+			float rw = 1.0f / cw;
+			pOut->x[i] = cx * rw * xf.sx + xf.ox;
+			pOut->y[i] = cy * rw * xf.sy + xf.oy;
+			pOut->z[i] = cz * rw * xf.sz + xf.oz;
+			pOut->w[i] = rw;
+		}
+	}
+}
+
+#ifdef CPU_X86
+
+/*
+	The three SIMD kernels are the scalar loop with a wider float: m[j] is
+	matrix element j broadcast, the sums in the same order as the scalar
+	code. 1 / w is a real division, not rcp: the screen output must match
+	the scalar one and GL's, an rcp + newton step would be ~1 ulp off
+*/
+
+static void TransformVerticesSSE(const mat4 M, const VERTICES* pIn, VERTICES* pOut,
+								 int i0, int n, int iMode, const VIEWPORT* pViewport)
+{
+	const float* pM = &M[0][0];
+	VIEWPORTXFORM xf = { 0 };
+	__m128 m[16];
+	int i = i0, iEnd = i0 + n;
+
+	if (iMode == VERTEX_SCREEN) {
+		GetViewportXform(pViewport, &xf);
+	}
+	for (int j = 0; j < 16; j++) {
+		m[j] = _mm_set1_ps(pM[j]);
+	}
+
+	for (; i + 4 <= iEnd; i += 4) {
+		__m128 x = _mm_loadu_ps(pIn->x + i);
+		__m128 y = _mm_loadu_ps(pIn->y + i);
+		__m128 z = _mm_loadu_ps(pIn->z + i);
+		__m128 cx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x), _mm_mul_ps(m[4], y)), _mm_mul_ps(m[8], z)), m[12]);
+		__m128 cy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], x), _mm_mul_ps(m[5], y)), _mm_mul_ps(m[9], z)), m[13]);
+		__m128 cz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], x), _mm_mul_ps(m[6], y)), _mm_mul_ps(m[10], z)), m[14]);
+
+		if (iMode == VERTEX_WORLD) {
+			_mm_storeu_ps(pOut->x + i, cx);
+			_mm_storeu_ps(pOut->y + i, cy);
+			_mm_storeu_ps(pOut->z + i, cz);
+			continue;
+		}
+
+		__m128 cw = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3], x), _mm_mul_ps(m[7], y)), _mm_mul_ps(m[11], z)), m[15]);
+		if (iMode == VERTEX_CLIP) {
+			_mm_storeu_ps(pOut->x + i, cx);
+			_mm_storeu_ps(pOut->y + i, cy);
+			_mm_storeu_ps(pOut->z + i, cz);
+			_mm_storeu_ps(pOut->w + i, cw);
+		} else {
+			__m128 rw = _mm_div_ps(_mm_set1_ps(1.0f), cw);
+			_mm_storeu_ps(pOut->x + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cx, rw), _mm_set1_ps(xf.sx)), _mm_set1_ps(xf.ox)));
+			_mm_storeu_ps(pOut->y + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cy, rw), _mm_set1_ps(xf.sy)), _mm_set1_ps(xf.oy)));
+			_mm_storeu_ps(pOut->z + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cz, rw), _mm_set1_ps(xf.sz)), _mm_set1_ps(xf.oz)));
+			_mm_storeu_ps(pOut->w + i, rw);
+		}
+	}
+	TransformVerticesScalar(M, pIn, pOut, i, iEnd - i, iMode, pViewport);
+}
+
+TARGET_AVX2
+static void TransformVerticesAVX2(const mat4 M, const VERTICES* pIn, VERTICES* pOut,
+								  int i0, int n, int iMode, const VIEWPORT* pViewport)
+{
+	const float* pM = &M[0][0];
+	VIEWPORTXFORM xf = { 0 };
+	__m256 m[16];
+	int i = i0, iEnd = i0 + n;
+
+	if (iMode == VERTEX_SCREEN) {
+		GetViewportXform(pViewport, &xf);
+	}
+	for (int j = 0; j < 16; j++) {
+		m[j] = _mm256_set1_ps(pM[j]);
+	}
+
+	for (; i + 8 <= iEnd; i += 8) {
+		__m256 x = _mm256_loadu_ps(pIn->x + i);
+		__m256 y = _mm256_loadu_ps(pIn->y + i);
+		__m256 z = _mm256_loadu_ps(pIn->z + i);
+		__m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x), _mm256_mul_ps(m[4], y)), _mm256_mul_ps(m[8], z)), m[12]);
+		__m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[1], x), _mm256_mul_ps(m[5], y)), _mm256_mul_ps(m[9], z)), m[13]);
+		__m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[2], x), _mm256_mul_ps(m[6], y)), _mm256_mul_ps(m[10], z)), m[14]);
+
+		if (iMode == VERTEX_WORLD) {
+			_mm256_storeu_ps(pOut->x + i, cx);
+			_mm256_storeu_ps(pOut->y + i, cy);
+			_mm256_storeu_ps(pOut->z + i, cz);
+			continue;
+		}
+
+		__m256 cw = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[3], x), _mm256_mul_ps(m[7], y)), _mm256_mul_ps(m[11], z)), m[15]);
+		if (iMode == VERTEX_CLIP) {
+			_mm256_storeu_ps(pOut->x + i, cx);
+			_mm256_storeu_ps(pOut->y + i, cy);
+			_mm256_storeu_ps(pOut->z + i, cz);
+			_mm256_storeu_ps(pOut->w + i, cw);
+		} else {
+			__m256 rw = _mm256_div_ps(_mm256_set1_ps(1.0f), cw);
+			_mm256_storeu_ps(pOut->x + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(cx, rw), _mm256_set1_ps(xf.sx)), _mm256_set1_ps(xf.ox)));
+			_mm256_storeu_ps(pOut->y + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(cy, rw), _mm256_set1_ps(xf.sy)), _mm256_set1_ps(xf.oy)));
+			_mm256_storeu_ps(pOut->z + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(cz, rw), _mm256_set1_ps(xf.sz)), _mm256_set1_ps(xf.oz)));
+			_mm256_storeu_ps(pOut->w + i, rw);
+		}
+	}
+	TransformVerticesScalar(M, pIn, pOut, i, iEnd - i, iMode, pViewport);
+}
+
+TARGET_AVX512
+static void TransformVerticesAVX512(const mat4 M, const VERTICES* pIn, VERTICES* pOut,
+									int i0, int n, int iMode, const VIEWPORT* pViewport)
+{
+	const float* pM = &M[0][0];
+	VIEWPORTXFORM xf = { 0 };
+	__m512 m[16];
+	int i = i0, iEnd = i0 + n;
+
+	if (iMode == VERTEX_SCREEN) {
+		GetViewportXform(pViewport, &xf);
+	}
+	for (int j = 0; j < 16; j++) {
+		m[j] = _mm512_set1_ps(pM[j]);
+	}
+
+	for (; i + 16 <= iEnd; i += 16) {
+		__m512 x = _mm512_loadu_ps(pIn->x + i);
+		__m512 y = _mm512_loadu_ps(pIn->y + i);
+		__m512 z = _mm512_loadu_ps(pIn->z + i);
+		__m512 cx = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[0], x), _mm512_mul_ps(m[4], y)), _mm512_mul_ps(m[8], z)), m[12]);
+		__m512 cy = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[1], x), _mm512_mul_ps(m[5], y)), _mm512_mul_ps(m[9], z)), m[13]);
+		__m512 cz = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[2], x), _mm512_mul_ps(m[6], y)), _mm512_mul_ps(m[10], z)), m[14]);
+
+		if (iMode == VERTEX_WORLD) {
+			_mm512_storeu_ps(pOut->x + i, cx);
+			_mm512_storeu_ps(pOut->y + i, cy);
+			_mm512_storeu_ps(pOut->z + i, cz);
+			continue;
+		}
+
+		__m512 cw = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[3], x), _mm512_mul_ps(m[7], y)), _mm512_mul_ps(m[11], z)), m[15]);
+		if (iMode == VERTEX_CLIP) {
+			_mm512_storeu_ps(pOut->x + i, cx);
+			_mm512_storeu_ps(pOut->y + i, cy);
+			_mm512_storeu_ps(pOut->z + i, cz);
+			_mm512_storeu_ps(pOut->w + i, cw);
+		} else {
+			__m512 rw = _mm512_div_ps(_mm512_set1_ps(1.0f), cw);
+			_mm512_storeu_ps(pOut->x + i, _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(cx, rw), _mm512_set1_ps(xf.sx)), _mm512_set1_ps(xf.ox)));
+			_mm512_storeu_ps(pOut->y + i, _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(cy, rw), _mm512_set1_ps(xf.sy)), _mm512_set1_ps(xf.oy)));
+			_mm512_storeu_ps(pOut->z + i, _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(cz, rw), _mm512_set1_ps(xf.sz)), _mm512_set1_ps(xf.oz)));
+			_mm512_storeu_ps(pOut->w + i, rw);
+		}
+	}
+	TransformVerticesScalar(M, pIn, pOut, i, iEnd - i, iMode, pViewport);
+}
+
+#endif // CPU_X86
+
+typedef struct {
+	const char*          szName;
+	PFNTRANSFORMVERTICES pfn;
+	unsigned int         uRequired; // cpu feature bits needed to run it
+} VERTEXKERNEL;
+
+// ordered from the narrowest to the widest
+static const VERTEXKERNEL g_VertexKernels[] = {
+	{ "scalar", TransformVerticesScalar, 0 },
+#ifdef CPU_X86
+	{ "sse",    TransformVerticesSSE,    CPU_SSE2 },
+	{ "avx2",   TransformVerticesAVX2,   CPU_AVX2 },
+	{ "avx512", TransformVerticesAVX512, CPU_AVX512 },
+#endif
+};
+
+#define VERTEX_KERNEL_COUNT ((int)(sizeof(g_VertexKernels) / sizeof(g_VertexKernels[0])))
+
+static unsigned int g_uVertexCpu = 0;
+static PFNTRANSFORMVERTICES g_pfnTransformVertices = TransformVerticesScalar;
+static const char* g_szVertexKernel = "scalar";
+
+static int IsVertexKernelSupported(int i)
+{
+	return (g_VertexKernels[i].uRequired & g_uVertexCpu) == g_VertexKernels[i].uRequired;
+}
+
+// pick the widest kernel the cpu supports, returns its name
+static const char* InitVertexTransform(void)
+{
+	g_uVertexCpu = GetCpuFeatures();
+
+	for (int i = 0; i < VERTEX_KERNEL_COUNT; i++) {
+		if (IsVertexKernelSupported(i)) {
+			g_pfnTransformVertices = g_VertexKernels[i].pfn;
+			g_szVertexKernel = g_VertexKernels[i].szName;
+		}
+	}
+
+	return g_szVertexKernel;
+}
+
+/*
+	pOut[i] = M * pIn[i] for the n vertices from i0, iMode is one of
+	VERTEX_WORLD / VERTEX_CLIP / VERTEX_SCREEN (pViewport only for SCREEN)
+*/
+static void TransformVertices(const mat4 M, const VERTICES* pIn, VERTICES* pOut,
+							  int i0, int n, int iMode, const VIEWPORT* pViewport)
+{
+	g_pfnTransformVertices(M, pIn, pOut, i0, n, iMode, pViewport);
+}
@@ -0,0 +1,196 @@
+/*
+	Headless test/benchmark for vertex.c (no window, runs on linux too)
+	Notes:
+		- every kernel the cpu has against TransformVerticesScalar, for the
+		  three outputs, with a count that is not a multiple of 16 (tails) and
+		  from an odd first vertex (unaligned)
+		- VERTEX_SCREEN against the long way round (clip, divide, viewport)
+		- in place (out == in)
+		- speed: vertices per second on 1M and 4M vertices (a cube-ish cloud
+		  in front of the camera, so w > 0), best of a few runs
+		- exits with 1 if a kernel is more than a few ulp off
+
+	build:
+		windows: cl /nologo /O2 vertexbench.c
+		linux:   cc -O2 vertexbench.c -o vertexbench -lm
+*/
+
+#include <stdio.h>
+#include "vertex.c"
+#include "pacing.c"
+
+#define RUNS 5
+
+static volatile float g_fSink;
+
+static unsigned int g_uSeed = 1;
+
+static float RandomFloat(void)
+{
+	g_uSeed = g_uSeed * 1664525 + 1013904223;
+	return (float)(g_uSeed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static void RandomVertices(VERTICES* pVerts, int n)
+{
+	for (int i = 0; i < n; i++) {
+		pVerts->x[i] = RandomFloat() * 2.0f;
+		pVerts->y[i] = RandomFloat() * 2.0f;
+		pVerts->z[i] = RandomFloat() * 2.0f;
+	}
+}
+
+// the cube demo's camera: rotate, 5 units away, 45 degrees
+static void SceneMatrix(mat4 MVP, float fAngle, float fAspect)
+{
+	mat4 model, view, projection, T;
+
+	mat4_rotate(model, fAngle, 1.0f, 1.0f, 0.0f);
+	mat4_translate(view, 0.0f, 0.0f, -5.0f);
+	mat4_perspective(projection, 3.1415926f / 4.0f, fAspect, 0.1f, 100.0f);
+	// mat4_mul(A, B) is B * A in math notation
+	mat4_mul(model, view, T);
+	mat4_mul(T, projection, MVP);
+}
+
+// relative difference, with absolute near 0
+static double FloatError(float a, float b)
+{
+	double d = fabs((double)a - (double)b);
+	double m = fabs((double)b);
+	return m > 1.0 ? d / m : d;
+}
+
+static double CompareVertices(const VERTICES* a, const VERTICES* b, int i0, int n, int bW)
+{
+	double dMax = 0.0;
+	for (int i = i0; i < i0 + n; i++) {
+		double e = FloatError(a->x[i], b->x[i]);
+		e = fmax(e, FloatError(a->y[i], b->y[i]));
+		e = fmax(e, FloatError(a->z[i], b->z[i]));
+		if (bW) {
+			e = fmax(e, FloatError(a->w[i], b->w[i]));
+		}
+		dMax = fmax(dMax, e);
+	}
+	return dMax;
+}
+
+static const char* g_szModes[] = { "world", "clip", "screen" };
+
+static int CheckVertices(void)
+{
+	const int n = 1000 + 13, i0 = 3;
+	VERTICES in, ref, out;
+	VIEWPORT vp = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+	mat4 M, model;
+	int failed = 0;
+
+	if (!AllocVertices(&in, n + i0, 0) || !AllocVertices(&ref, n + i0, 1) || !AllocVertices(&out, n + i0, 1)) {
+		printf("out of memory\n");
+		return 1;
+	}
+	RandomVertices(&in, n + i0);
+	SceneMatrix(M, 0.7f, 16.0f / 9.0f);
+	mat4_rotate(model, 0.3f, 0.0f, 1.0f, 0.0f);
+	model[3][0] = 1.0f;
+	model[3][2] = -2.0f;
+
+	for (int k = 0; k < VERTEX_KERNEL_COUNT; k++) {
+		if (!IsVertexKernelSupported(k)) {
+			continue;
+		}
+		for (int iMode = VERTEX_WORLD; iMode <= VERTEX_SCREEN; iMode++) {
+			const float (*pM)[4] = iMode == VERTEX_WORLD ? model : M;
+			TransformVerticesScalar(pM, &in, &ref, i0, n, iMode, &vp);
+			g_VertexKernels[k].pfn(pM, &in, &out, i0, n, iMode, &vp);
+			double e = CompareVertices(&out, &ref, i0, n, iMode != VERTEX_WORLD);
+			// SIMD sums may be fused multiply-adds, a few ulp
+			if (e > 1e-5) {
+				printf("MISMATCH %s %s: error %.3g\n", g_VertexKernels[k].szName, g_szModes[iMode], e);
+				failed = 1;
+			}
+		}
+	}
+
+	// screen = clip, divide, viewport by hand
+	TransformVertices(M, &in, &ref, i0, n, VERTEX_CLIP, NULL);
+	for (int i = i0; i < i0 + n; i++) {
+		float w = ref.w[i];
+		ref.x[i] = (ref.x[i] / w + 1.0f) * 0.5f * vp.cx + vp.x;
+		ref.y[i] = (ref.y[i] / w + 1.0f) * 0.5f * vp.cy + vp.y;
+		ref.z[i] = (ref.z[i] / w) * 0.5f * (vp.zFar - vp.zNear) + (vp.zFar + vp.zNear) * 0.5f;
+		ref.w[i] = 1.0f / w;
+	}
+	TransformVertices(M, &in, &out, i0, n, VERTEX_SCREEN, &vp);
+	if (CompareVertices(&out, &ref, i0, n, 1) > 1e-4) {
+		printf("MISMATCH screen against clip + divide + viewport\n");
+		failed = 1;
+	}
+
+	// in place
+	TransformVertices(M, &in, &ref, i0, n, VERTEX_CLIP, NULL);
+	out.w = ref.w;
+	memcpy(out.x, in.x, (n + i0) * sizeof(float));
+	memcpy(out.y, in.y, (n + i0) * sizeof(float));
+	memcpy(out.z, in.z, (n + i0) * sizeof(float));
+	TransformVertices(M, &out, &out, i0, n, VERTEX_CLIP, NULL);
+	if (CompareVertices(&out, &ref, i0, n, 0) != 0.0) {
+		printf("MISMATCH in place\n");
+		failed = 1;
+	}
+
+	FreeVertices(&in);
+	FreeVertices(&ref);
+	FreeVertices(&out);
+	return failed;
+}
+
+static void BenchVertices(int n)
+{
+	VERTICES in, out;
+	VIEWPORT vp = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+	mat4 M;
+
+	if (!AllocVertices(&in, n, 0) || !AllocVertices(&out, n, 1)) {
+		printf("out of memory\n");
+		return;
+	}
+	RandomVertices(&in, n);
+	SceneMatrix(M, 0.7f, 16.0f / 9.0f);
+
+	printf("\n%d vertices, Mvertices/s (ns/vertex)\n", n);
+	printf("%-8s %18s %18s %18s\n", "kernel", "world", "clip", "screen");
+	for (int k = 0; k < VERTEX_KERNEL_COUNT; k++) {
+		if (!IsVertexKernelSupported(k)) {
+			continue;
+		}
+		printf("%-8s", g_VertexKernels[k].szName);
+		for (int iMode = VERTEX_WORLD; iMode <= VERTEX_SCREEN; iMode++) {
+			double dBest = 1e9;
+			for (int r = 0; r < RUNS; r++) {
+				double t0 = PaceNow();
+				g_VertexKernels[k].pfn(M, &in, &out, 0, n, iMode, &vp);
+				double dt = PaceNow() - t0;
+				dBest = dt < dBest ? dt : dBest;
+			}
+			g_fSink += out.x[n / 2];
+			printf(" %10.1f (%5.2f)", n / dBest * 1e-6, dBest * 1e9 / n);
+		}
+		printf("\n");
+	}
+
+	FreeVertices(&in);
+	FreeVertices(&out);
+}
+
+int main(void)
+{
+	printf("vertex kernel: %s\n", InitVertexTransform());
+	if (CheckVertices()) {
+		return 1;
+	}
+	BenchVertices(1 << 20);
+	BenchVertices(1 << 22);
+	return 0;
+}
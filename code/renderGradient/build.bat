@@ -1,2 +1,3 @@
 @echo OFF
-cl /nologo gradient.c /link user32.lib gdi32.lib
\ No newline at end of file
+cl /nologo gradient.c /link user32.lib gdi32.lib
+cl /nologo /O2 gradbench.c
\ No newline at end of file
@@ -0,0 +1,374 @@
+/*
+	Damage (dirty rectangle) tracking for the DIB surface
+	Notes:
+		- the surface is split in DAMAGE_TILE x DAMAGE_TILE tiles with one dirty
+		  byte each
+		- tiles get dirty in two ways:
+				AddDamageRect -> the renderer says what it wrote
+				DetectDamage  -> compares the frame against a copy of the previous
+								 one (SSE2, 4 pixels at a time, stops at the first
+								 difference of a tile) and refreshes the copy
+		- ResolveDamage merges dirty tiles in a few rectangles: runs of tiles on
+		  a tile row, then runs with the same columns on the next tile rows, and
+		  if there are still more than MAX_DAMAGE_RECTS the two rects whose union
+		  wastes less area are merged until they fit (or, with more than 4x that,
+		  just one bounding rect)
+		- per frame counters (damaged area, rects) are in DAMAGESTATS so we can
+		  see how many pixels the presentation really moves
+		- the tiles are in surface (physical) coordinates: with the scrolling
+		  ring buffer a new origin moves every pixel under the window even if
+		  only a strip of memory changed. SetDamageOrigin says where the
+		  surface sits, a new one damages everything (DamageAll)
+		- DamageAll skips the compare, so the copy no longer is what the window
+		  shows (bStale): the next DetectDamage takes the whole frame as the copy
+		  and damages everything once more
+		- the compare reads two frames, that is more memory traffic than
+		  rendering one: it has to buy a smaller present. When it does not
+		  (more than DAMAGE_BUSY_PERCENT of the tiles dirty) tracking backs
+		  off: the next 2, 4, .. DAMAGE_MAX_BACKOFF frames go out whole with
+		  no compare, then it tries again. The last of them takes the frame as
+		  the copy, so the compare starts right after the back off (no extra
+		  whole frame to resync)
+
+		(NOTE: explicit rects do not refresh the copy of the previous frame, the
+		 next DetectDamage will find those tiles dirty once more: one extra blit,
+		 never a missing one)
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DAMAGE_TILE      32
+#define MAX_DAMAGE_RECTS 16
+#define DAMAGE_BUSY_PERCENT 50 // a compare that finds more dirty tiles did not pay
+#define DAMAGE_MAX_BACKOFF  32 // longest run of frames without tracking
+
+typedef struct {
+	int x0, y0, x1, y1;	// [x0, x1) x [y0, y1) in surface pixels
+} DAMAGERECT;
+
+typedef struct {
+	int       nRects;           // last frame
+	long long llDamagedPixels;  // last frame, area covered by the rects
+	long long llTotalPixels;    // whole surface
+	long long llFrames;         // since InitDamage
+	long long llDamagedSum;     // damaged pixels summed over all frames
+	long long llUntracked;      // frames that went out whole because tracking backed off
+} DAMAGESTATS;
+
+typedef struct {
+	int         cx, cy;
+	int         nTilesX, nTilesY;
+	uint8_t*    pDirty;         // nTilesX * nTilesY
+	uint32_t*   pPrev;          // previous frame for DetectDamage (cx * cy, tight)
+	DAMAGERECT  rects[MAX_DAMAGE_RECTS];
+	int         nRects;
+	int         xOrigin, yOrigin; // physical pixel at the top-left of the window
+	int         bAll;           // this frame: every tile, nothing to compare
+	int         bStale;         // pPrev is not what the window shows
+	int         nSkip;          // frames left without tracking
+	int         nBackoff;       // frames the next back off skips
+	DAMAGESTATS stats;
+} DAMAGE;
+
+static int InitDamage(DAMAGE* pDamage, int cx, int cy)
+{
+	memset(pDamage, 0, sizeof(*pDamage));
+	pDamage->cx = cx;
+	pDamage->cy = cy;
+	pDamage->nTilesX = (cx + DAMAGE_TILE - 1) / DAMAGE_TILE;
+	pDamage->nTilesY = (cy + DAMAGE_TILE - 1) / DAMAGE_TILE;
+	pDamage->pDirty = (uint8_t*)calloc((size_t)pDamage->nTilesX * pDamage->nTilesY, 1);
+	pDamage->pPrev = (uint32_t*)calloc((size_t)cx * cy, sizeof(uint32_t));
+	pDamage->stats.llTotalPixels = (long long)cx * cy;
+	pDamage->bStale = 1; // nothing presented yet
+
+	return pDamage->pDirty != NULL && pDamage->pPrev != NULL;
+}
+
+static void FreeDamage(DAMAGE* pDamage)
+{
+	free(pDamage->pDirty);
+	free(pDamage->pPrev);
+	pDamage->pDirty = NULL;
+	pDamage->pPrev = NULL;
+}
+
+static void AddDamageRect(DAMAGE* pDamage, int x0, int y0, int x1, int y1)
+{
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x1 > pDamage->cx) x1 = pDamage->cx;
+	if (y1 > pDamage->cy) y1 = pDamage->cy;
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	for (int ty = y0 / DAMAGE_TILE; ty <= (y1 - 1) / DAMAGE_TILE; ty++) {
+		memset(pDamage->pDirty + ty * pDamage->nTilesX + x0 / DAMAGE_TILE, 1,
+			   (x1 - 1) / DAMAGE_TILE - x0 / DAMAGE_TILE + 1);
+	}
+}
+
+// the whole surface goes out this frame, DetectDamage has nothing to do
+static void DamageAll(DAMAGE* pDamage)
+{
+	memset(pDamage->pDirty, 1, (size_t)pDamage->nTilesX * pDamage->nTilesY);
+	pDamage->bAll = 1;
+	pDamage->bStale = 1;
+}
+
+// where the surface sits under the window (ring buffer origin, 0,0 when not scrolling)
+static void SetDamageOrigin(DAMAGE* pDamage, int xOrigin, int yOrigin)
+{
+	if (xOrigin != pDamage->xOrigin || yOrigin != pDamage->yOrigin) {
+		pDamage->xOrigin = xOrigin;
+		pDamage->yOrigin = yOrigin;
+		DamageAll(pDamage);
+	}
+}
+
+// the next frames go out whole without a compare, each back off twice as long as the last one
+static void BackOffDamage(DAMAGE* pDamage)
+{
+	pDamage->nBackoff = pDamage->nBackoff ? pDamage->nBackoff * 2 : 2;
+	if (pDamage->nBackoff > DAMAGE_MAX_BACKOFF) {
+		pDamage->nBackoff = DAMAGE_MAX_BACKOFF;
+	}
+	pDamage->nSkip = pDamage->nBackoff;
+}
+
+// TRUE if cx pixels of the two rows differ
+static int RowDiffers(const uint32_t* a, const uint32_t* b, int cx)
+{
+	int x = 0;
+#ifdef GRADIENT_X86
+	for (; x + 4 <= cx; x += 4) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(va, vb)) != 0xFFFF) {
+			return 1;
+		}
+	}
+#endif
+	for (; x < cx; x++) {
+		if (a[x] != b[x]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// every tile dirty and pBits becomes the copy of the previous frame
+static void ResyncDamage(DAMAGE* pDamage, const uint32_t* pBits, int iPitch)
+{
+	for (int y = 0; y < pDamage->cy; y++) {
+		memcpy(pDamage->pPrev + (intptr_t)y * pDamage->cx, (const uint8_t*)pBits + (intptr_t)y * iPitch,
+			   pDamage->cx * sizeof(uint32_t));
+	}
+	memset(pDamage->pDirty, 1, (size_t)pDamage->nTilesX * pDamage->nTilesY);
+	pDamage->bStale = 0;
+}
+
+// marks the tiles where pBits differs from the previous frame, and remembers pBits
+static void DetectDamage(DAMAGE* pDamage, const uint32_t* pBits, int iPitch)
+{
+	if (pDamage->bAll) {
+		return;
+	}
+	if (pDamage->nSkip > 0) {
+		pDamage->stats.llUntracked++;
+		if (--pDamage->nSkip > 0) {
+			DamageAll(pDamage);
+		} else {
+			ResyncDamage(pDamage, pBits, iPitch); // whole anyway, the next one compares
+		}
+		return;
+	}
+	if (pDamage->bStale) {
+		ResyncDamage(pDamage, pBits, iPitch);
+		return;
+	}
+
+	int nDirty = 0;
+	for (int ty = 0; ty < pDamage->nTilesY; ty++) {
+		int y0 = ty * DAMAGE_TILE;
+		int y1 = y0 + DAMAGE_TILE < pDamage->cy ? y0 + DAMAGE_TILE : pDamage->cy;
+		uint8_t* pFound = pDamage->pDirty + ty * pDamage->nTilesX;
+		int nFound = 0;
+
+		// row by row over the whole width (one stream through memory): a row
+		// that is the same everywhere is one compare, else the tiles not found
+		// yet are looked at one by one
+		for (int y = y0; y < y1 && nFound < pDamage->nTilesX; y++) {
+			const uint32_t* pCur = (const uint32_t*)((const uint8_t*)pBits + (intptr_t)y * iPitch);
+			const uint32_t* pOld = pDamage->pPrev + (intptr_t)y * pDamage->cx;
+			if (nFound == 0 && !RowDiffers(pCur, pOld, pDamage->cx)) {
+				continue;
+			}
+			for (int tx = 0; tx < pDamage->nTilesX; tx++) {
+				int x0 = tx * DAMAGE_TILE;
+				int cols = x0 + DAMAGE_TILE < pDamage->cx ? DAMAGE_TILE : pDamage->cx - x0;
+				if (!pFound[tx] && RowDiffers(pCur + x0, pOld + x0, cols)) {
+					pFound[tx] = 2; // 2: found here, copied below (1 came from AddDamageRect)
+					nFound++;
+				}
+			}
+		}
+		nDirty += nFound;
+		if (nFound == 0) {
+			continue;
+		}
+
+		// dirty tiles: the copy takes the whole tile
+		for (int tx = 0; tx < pDamage->nTilesX; tx++) {
+			if (pFound[tx] != 2) {
+				continue;
+			}
+			int x0 = tx * DAMAGE_TILE;
+			int cols = x0 + DAMAGE_TILE < pDamage->cx ? DAMAGE_TILE : pDamage->cx - x0;
+			pFound[tx] = 1;
+			for (int y = y0; y < y1; y++) {
+				memcpy(pDamage->pPrev + (intptr_t)y * pDamage->cx + x0,
+					   (const uint8_t*)pBits + (intptr_t)y * iPitch + x0 * sizeof(uint32_t),
+					   cols * sizeof(uint32_t));
+			}
+		}
+	}
+
+	// most of it changed: the present is about a whole one and the compare came on top
+	if (nDirty * 100 > pDamage->nTilesX * pDamage->nTilesY * DAMAGE_BUSY_PERCENT) {
+		BackOffDamage(pDamage);
+	} else {
+		pDamage->nBackoff = 0;
+	}
+}
+
+static long long DamageArea(const DAMAGERECT* r)
+{
+	return (long long)(r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static DAMAGERECT DamageUnion(const DAMAGERECT* a, const DAMAGERECT* b)
+{
+	DAMAGERECT r;
+	r.x0 = a->x0 < b->x0 ? a->x0 : b->x0;
+	r.y0 = a->y0 < b->y0 ? a->y0 : b->y0;
+	r.x1 = a->x1 > b->x1 ? a->x1 : b->x1;
+	r.y1 = a->y1 > b->y1 ? a->y1 : b->y1;
+	return r;
+}
+
+/*
+	Turns the dirty tiles into at most MAX_DAMAGE_RECTS rects (pDamage->rects),
+	clears the tiles and updates the stats. Returns the number of rects.
+*/
+static int ResolveDamage(DAMAGE* pDamage)
+{
+	// rects are built in tile units first, kept in a scratch big enough for
+	// every run of every tile row
+	int nMax = pDamage->nTilesX * pDamage->nTilesY;
+	DAMAGERECT stackRects[256];
+	DAMAGERECT* pRects = nMax <= 256 ? stackRects : (DAMAGERECT*)malloc(nMax * sizeof(DAMAGERECT));
+	int n = 0;
+	int iRowStart = 0; // first rect that touches the previous tile row
+
+	// no scratch: one rect around the whole surface, never a missing one
+	if (pRects == NULL) {
+		pRects = stackRects;
+		pRects[0].x0 = pRects[0].y0 = 0;
+		pRects[0].x1 = pDamage->nTilesX;
+		pRects[0].y1 = pDamage->nTilesY;
+		memset(pDamage->pDirty, 0, (size_t)nMax);
+		n = 1;
+	}
+
+	for (int ty = n ? pDamage->nTilesY : 0; ty < pDamage->nTilesY; ty++) {
+		uint8_t* pRow = pDamage->pDirty + ty * pDamage->nTilesX;
+		int iThisRow = n;
+
+		for (int tx = 0; tx < pDamage->nTilesX; ) {
+			if (!pRow[tx]) {
+				tx++;
+				continue;
+			}
+			int tx0 = tx;
+			while (tx < pDamage->nTilesX && pRow[tx]) {
+				tx++;
+			}
+
+			// same columns as a rect ending on the previous row: grow it down
+			int i = iRowStart;
+			for (; i < iThisRow; i++) {
+				if (pRects[i].x0 == tx0 && pRects[i].x1 == tx && pRects[i].y1 == ty) {
+					pRects[i].y1 = ty + 1;
+					break;
+				}
+			}
+			if (i == iThisRow) {
+				pRects[n].x0 = tx0;
+				pRects[n].x1 = tx;
+				pRects[n].y0 = ty;
+				pRects[n].y1 = ty + 1;
+				n++;
+			}
+		}
+		memset(pRow, 0, pDamage->nTilesX);
+
+		// rects that did not grow this row are closed, skip them next time
+		while (iRowStart < iThisRow && pRects[iRowStart].y1 != ty + 1) {
+			iRowStart++;
+		}
+	}
+
+	// way too many (noise all over the surface): one rect around everything,
+	// the pair search below is O(n^3)
+	if (n > MAX_DAMAGE_RECTS * 4) {
+		for (int i = 1; i < n; i++) {
+			pRects[0] = DamageUnion(&pRects[0], &pRects[i]);
+		}
+		n = 1;
+	}
+
+	// too many: merge the pair whose union adds the least area
+	while (n > MAX_DAMAGE_RECTS) {
+		int iBest = 0, jBest = 1;
+		long long llBest = -1;
+		for (int i = 0; i < n; i++) {
+			for (int j = i + 1; j < n; j++) {
+				DAMAGERECT u = DamageUnion(&pRects[i], &pRects[j]);
+				long long llWaste = DamageArea(&u) - DamageArea(&pRects[i]) - DamageArea(&pRects[j]);
+				if (llBest < 0 || llWaste < llBest) {
+					llBest = llWaste;
+					iBest = i;
+					jBest = j;
+				}
+			}
+		}
+		pRects[iBest] = DamageUnion(&pRects[iBest], &pRects[jBest]);
+		pRects[jBest] = pRects[--n];
+	}
+
+	// tiles -> pixels (the last tile row/column may be partial)
+	pDamage->stats.llDamagedPixels = 0;
+	for (int i = 0; i < n; i++) {
+		DAMAGERECT* r = &pDamage->rects[i];
+		r->x0 = pRects[i].x0 * DAMAGE_TILE;
+		r->y0 = pRects[i].y0 * DAMAGE_TILE;
+		r->x1 = pRects[i].x1 * DAMAGE_TILE < pDamage->cx ? pRects[i].x1 * DAMAGE_TILE : pDamage->cx;
+		r->y1 = pRects[i].y1 * DAMAGE_TILE < pDamage->cy ? pRects[i].y1 * DAMAGE_TILE : pDamage->cy;
+		pDamage->stats.llDamagedPixels += DamageArea(r);
+	}
+	if (pRects != stackRects) {
+		free(pRects);
+	}
+
+	pDamage->nRects = n;
+	pDamage->bAll = 0;
+	pDamage->stats.nRects = n;
+	pDamage->stats.llFrames++;
+	pDamage->stats.llDamagedSum += pDamage->stats.llDamagedPixels;
+
+	return n;
+}
@@ -0,0 +1,983 @@
+/*
+	Headless benchmark for the gradient renderer (no window, runs on linux too)
+	Notes:
+		- every kernel is first compared against GradientRowsScalar, the program
+		  exits with 1 if a single pixel differs
+		- then each kernel renders FRAMES frames and we print ms/frame and Mpixel/s
+		- thread scaling: the selected kernel on the worker pool with 1..N threads
+		  (N = cpu count, or the first argument: gradbench 16)
+		- scrolling surface: after random scrolls the unwrapped surface must equal
+		  a full render, then per-frame cost of full recompute vs (1,1) scrolling
+		- damage tracking: a small box moving over a static surface (detected or
+		  declared) and the full animation, damaged pixels per frame, the cost of
+		  tracking and presenting them (a copy to a window buffer, which must
+		  end up equal to the frame) against a full present. The box has to stay
+		  a box: more than 4x3 tiles per frame on average fails (the old and new
+		  position, unaligned); on the scrolling surface the window put together
+		  from the damage rects must equal a full present
+		- pixel conversion: every pair checked against the scalar rows (also in
+		  place), then GB/s (source + destination bytes) per pair at 1080p
+		- palette animation: per-frame cost of rotating 256 colors against the
+		  32bpp render of the same surface
+		- surface allocator: alignment/pitch checks, then a window drag (a few
+		  hundred resizes) with grow-only reuse against a fresh allocation per
+		  resize, and normal against huge pages: allocations, us per resize
+		  (alloc + first render) and page faults
+		- render scale: the controller against a synthetic cost (must settle in
+		  the band around the target, and with +-30% noise on the cost change
+		  the scale at most 3 times in 400 frames), then driving the real
+		  renderer on a 4K client area with a target of 1/3 of the full
+		  resolution cost (at most 3 changes in the second half)
+		- software scaler: every filter, SIMD against scalar and a scrolled ring
+		  buffer against the same picture unwrapped, then ms/frame scaling
+		  640x480 to 1080p and 4K on the worker pool
+
+	build:
+		windows: cl /nologo /O2 gradbench.c
+		linux:   cc -O2 -pthread gradbench.c -o gradbench -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "surface.c"
+#include "kernel.c"
+#include "workers.c"
+#include "scroll.c"
+#include "damage.c"
+#include "pixconv.c"
+#include "palette.c"
+#include "resolution.c"
+#include "scaler.c"
+#include "../common/pacing.c"
+
+#define FRAMES 200
+
+static volatile uint32_t g_uSink; // keeps results the compiler could throw away
+
+static const int g_Sizes[][2] = {
+	{ 640, 480 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+	{ 1001, 7 },	// odd width to exercise the tails
+};
+
+#define SIZE_COUNT ((int)(sizeof(g_Sizes) / sizeof(g_Sizes[0])))
+
+static int CheckKernels(void)
+{
+	int failed = 0;
+
+	for (int s = 0; s < SIZE_COUNT; s++) {
+		int cx = g_Sizes[s][0], cy = g_Sizes[s][1];
+		size_t size = (size_t)cx * cy * sizeof(uint32_t);
+		uint32_t* pRef = (uint32_t*)malloc(size);
+		uint32_t* pOut = (uint32_t*)malloc(size);
+
+		for (int k = 1; k < GRADIENT_KERNEL_COUNT; k++) {
+			if (!IsGradientKernelSupported(k)) {
+				continue;
+			}
+			// a few offsets, including negative ones and the 256 wrap
+			static const int offsets[][2] = { {0, 0}, {37, 5}, {255, 256}, {-3, -700}, {1000, 123} };
+			for (int o = 0; o < 5; o++) {
+				GradientRowsScalar(pRef, cx * 4, cx, 0, cy, offsets[o][0], offsets[o][1]);
+				memset(pOut, 0xCD, size);
+				g_GradientKernels[k].pfn(pOut, cx * 4, cx, 0, cy, offsets[o][0], offsets[o][1]);
+				if (memcmp(pRef, pOut, size) != 0) {
+					printf("MISMATCH %s %dx%d offset (%d,%d)\n", g_GradientKernels[k].szName,
+						   cx, cy, offsets[o][0], offsets[o][1]);
+					failed = 1;
+				}
+			}
+		}
+
+		free(pRef);
+		free(pOut);
+	}
+
+	return failed;
+}
+
+static void BenchKernels(void)
+{
+	printf("\n%-8s %-10s %12s %12s\n", "kernel", "size", "ms/frame", "Mpixel/s");
+
+	for (int s = 0; s < SIZE_COUNT - 1; s++) {
+		int cx = g_Sizes[s][0], cy = g_Sizes[s][1];
+		uint32_t* pBits = (uint32_t*)malloc((size_t)cx * cy * sizeof(uint32_t));
+
+		for (int k = 0; k < GRADIENT_KERNEL_COUNT; k++) {
+			if (!IsGradientKernelSupported(k)) {
+				continue;
+			}
+			g_GradientKernels[k].pfn(pBits, cx * 4, cx, 0, cy, 0, 0); // warm up
+
+			double t0 = PaceNow();
+			for (int f = 0; f < FRAMES; f++) {
+				g_GradientKernels[k].pfn(pBits, cx * 4, cx, 0, cy, f, f);
+			}
+			double ms = (PaceNow() - t0) * 1000.0 / FRAMES;
+
+			char szSize[32];
+			snprintf(szSize, sizeof(szSize), "%dx%d", cx, cy);
+			printf("%-8s %-10s %12.3f %12.1f\n", g_GradientKernels[k].szName, szSize,
+				   ms, (double)cx * cy / (ms * 1000.0));
+		}
+
+		free(pBits);
+	}
+}
+
+static int CheckTiled(int nThreads)
+{
+	int cx = 1001, cy = 333;
+	size_t size = (size_t)cx * cy * sizeof(uint32_t);
+	uint32_t* pRef = (uint32_t*)malloc(size);
+	uint32_t* pOut = (uint32_t*)malloc(size);
+	WORKERPOOL pool;
+	int failed;
+
+	CreateWorkerPool(&pool, nThreads);
+	GradientRowsScalar(pRef, cx * 4, cx, 0, cy, 17, 42);
+	memset(pOut, 0xCD, size);
+	RenderGradientTiled(&pool, pOut, cx * 4, cx, cy, 17, 42);
+	DestroyWorkerPool(&pool);
+
+	failed = memcmp(pRef, pOut, size) != 0;
+	if (failed) {
+		printf("MISMATCH tiled render with %d threads\n", nThreads);
+	}
+
+	free(pRef);
+	free(pOut);
+	return failed;
+}
+
+static void BenchThreads(int nMaxThreads)
+{
+	printf("\n%-8s %-10s %12s %12s %9s\n", "threads", "size", "ms/frame", "Mpixel/s", "speedup");
+
+	for (int s = 0; s < SIZE_COUNT - 1; s++) {
+		int cx = g_Sizes[s][0], cy = g_Sizes[s][1];
+		uint32_t* pBits = (uint32_t*)malloc((size_t)cx * cy * sizeof(uint32_t));
+		double msOne = 0.0;
+
+		for (int t = 1; t <= nMaxThreads; t++) {
+			WORKERPOOL pool;
+			CreateWorkerPool(&pool, t);
+			RenderGradientTiled(&pool, pBits, cx * 4, cx, cy, 0, 0); // warm up (page faults)
+
+			double t0 = PaceNow();
+			for (int f = 0; f < FRAMES; f++) {
+				RenderGradientTiled(&pool, pBits, cx * 4, cx, cy, f, f);
+			}
+			double ms = (PaceNow() - t0) * 1000.0 / FRAMES;
+			DestroyWorkerPool(&pool);
+
+			if (t == 1) {
+				msOne = ms;
+			}
+			char szSize[32];
+			snprintf(szSize, sizeof(szSize), "%dx%d", cx, cy);
+			printf("%-8d %-10s %12.3f %12.1f %8.2fx\n", t, szSize, ms,
+				   (double)cx * cy / (ms * 1000.0), msOne / ms);
+		}
+
+		free(pBits);
+	}
+}
+
+static int CheckScroll(void)
+{
+	int cx = 301, cy = 199;
+	size_t size = (size_t)cx * cy * sizeof(uint32_t);
+	uint32_t* pRing = (uint32_t*)malloc(size);
+	uint32_t* pRef = (uint32_t*)malloc(size);
+	uint32_t* pOut = (uint32_t*)malloc(size);
+	SCROLLSURFACE surface;
+	int x = 0, y = 0, failed = 0;
+
+	InitScrollSurface(&surface, pRing, cx * 4, cx, cy, g_pfnGradientRows);
+	srand(1234);
+	for (int i = 0; i < 500 && !failed; i++) {
+		// mostly small steps, sometimes a jump bigger than the surface
+		int range = (i % 50 == 0) ? 2000 : 16;
+		x += rand() % (2 * range + 1) - range;
+		y += rand() % (2 * range + 1) - range;
+		if (i == 250) {
+			SetScrollContent(&surface, GradientRowsScalar);
+		}
+
+		ScrollSurfaceTo(&surface, x, y);
+		ResolveScrollSurface(&surface, pOut, cx * 4);
+		GradientRowsScalar(pRef, cx * 4, cx, 0, cy, x, y);
+		if (memcmp(pRef, pOut, size) != 0) {
+			printf("MISMATCH scrolling surface at step %d (%d,%d)\n", i, x, y);
+			failed = 1;
+		}
+	}
+
+	free(pRing);
+	free(pRef);
+	free(pOut);
+	return failed;
+}
+
+static void BenchScroll(void)
+{
+	printf("\n%-10s %14s %14s %14s\n", "size", "full ms/frame", "scroll ms/frame", "pixels/frame");
+
+	for (int s = 1; s <= 2; s++) {
+		int cx = g_Sizes[s][0], cy = g_Sizes[s][1];
+		uint32_t* pBits = (uint32_t*)malloc((size_t)cx * cy * sizeof(uint32_t));
+		SCROLLSURFACE surface;
+
+		double t0 = PaceNow();
+		for (int f = 0; f < FRAMES; f++) {
+			g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, f, f);
+		}
+		double msFull = (PaceNow() - t0) * 1000.0 / FRAMES;
+
+		InitScrollSurface(&surface, pBits, cx * 4, cx, cy, g_pfnGradientRows);
+		ScrollSurfaceTo(&surface, 0, 0);
+		surface.llPixelsWritten = 0;
+
+		t0 = PaceNow();
+		for (int f = 1; f <= FRAMES; f++) {
+			ScrollSurfaceTo(&surface, f, f);
+		}
+		double msScroll = (PaceNow() - t0) * 1000.0 / FRAMES;
+
+		char szSize[32];
+		snprintf(szSize, sizeof(szSize), "%dx%d", cx, cy);
+		printf("%-10s %14.4f %14.4f %14lld\n", szSize, msFull, msScroll,
+			   surface.llPixelsWritten / FRAMES);
+
+		free(pBits);
+	}
+}
+
+static void DrawBox(uint32_t* pBits, int cx, int x0, int y0, int w, int h, uint32_t color)
+{
+	for (int y = y0; y < y0 + h; y++) {
+		for (int x = x0; x < x0 + w; x++) {
+			pBits[y * cx + x] = color;
+		}
+	}
+}
+
+// every pixel that differs between the two frames must be inside a damage rect
+static int CheckDamageCovers(const DAMAGE* pDamage, const uint32_t* pOld, const uint32_t* pNew)
+{
+	for (int y = 0; y < pDamage->cy; y++) {
+		for (int x = 0; x < pDamage->cx; x++) {
+			if (pOld[y * pDamage->cx + x] == pNew[y * pDamage->cx + x]) {
+				continue;
+			}
+			int i = 0;
+			for (; i < pDamage->nRects; i++) {
+				const DAMAGERECT* r = &pDamage->rects[i];
+				if (x >= r->x0 && x < r->x1 && y >= r->y0 && y < r->y1) {
+					break;
+				}
+			}
+			if (i == pDamage->nRects) {
+				printf("MISMATCH damage misses pixel (%d,%d)\n", x, y);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// what PresentSurface does with the damage rects: each rect through the pieces of the surface to the window
+static void PresentDamageRects(const DAMAGE* pDamage, const SCROLLPIECE* pieces, int nPieces,
+							   const uint32_t* pBits, uint32_t* pWindow)
+{
+	int cx = pDamage->cx;
+
+	for (int r = 0; r < pDamage->nRects; r++) {
+		const DAMAGERECT* pRect = &pDamage->rects[r];
+		for (int i = 0; i < nPieces; i++) {
+			int x0 = pieces[i].xSrc > pRect->x0 ? pieces[i].xSrc : pRect->x0;
+			int y0 = pieces[i].ySrc > pRect->y0 ? pieces[i].ySrc : pRect->y0;
+			int x1 = pieces[i].xSrc + pieces[i].cx < pRect->x1 ? pieces[i].xSrc + pieces[i].cx : pRect->x1;
+			int y1 = pieces[i].ySrc + pieces[i].cy < pRect->y1 ? pieces[i].ySrc + pieces[i].cy : pRect->y1;
+			if (x0 >= x1) {
+				continue;
+			}
+			for (int y = y0; y < y1; y++) {
+				memcpy(pWindow + (pieces[i].yDest + y - pieces[i].ySrc) * cx + pieces[i].xDest + x0 - pieces[i].xSrc,
+					   pBits + y * cx + x0, (size_t)(x1 - x0) * sizeof(uint32_t));
+			}
+		}
+	}
+}
+
+// damage on the scrolling surface: the window built from the damage rects must equal a full present
+static int CheckDamageScroll(void)
+{
+	int cx = 301, cy = 199;
+	size_t size = (size_t)cx * cy * sizeof(uint32_t);
+	uint32_t* pRing = (uint32_t*)malloc(size);
+	uint32_t* pRef = (uint32_t*)malloc(size);
+	uint32_t* pWindow = (uint32_t*)calloc(1, size);
+	SCROLLSURFACE surface;
+	SCROLLPIECE pieces[4];
+	DAMAGE damage;
+	int x = 0, y = 0, failed = 0;
+
+	InitScrollSurface(&surface, pRing, cx * 4, cx, cy, g_pfnGradientRows);
+	InitDamage(&damage, cx, cy);
+	srand(4321);
+	for (int i = 0; i < 300 && !failed; i++) {
+		// runs of scrolling, standing still and new content in place
+		int iPhase = (i / 20) % 3;
+		if (iPhase == 0) {
+			x += rand() % 33 - 16;
+			y += rand() % 33 - 16;
+		} else if (iPhase == 2 && i % 20 == 10) {
+			SetScrollContent(&surface, i % 40 ? GradientRowsScalar : g_pfnGradientRows);
+		}
+
+		ScrollSurfaceTo(&surface, x, y);
+		if (iPhase == 2 && i % 20 == 15) {
+			DrawBox(pRing, cx, 40, 30, 64, 48, 0x00FFFFFF); // a few tiles change, the origin stays
+		}
+		SetDamageOrigin(&damage, PositiveMod(x, cx), PositiveMod(y, cy));
+		DetectDamage(&damage, pRing, cx * 4);
+		ResolveDamage(&damage);
+		PresentDamageRects(&damage, pieces, ScrollSurfacePieces(&surface, pieces), pRing, pWindow);
+
+		ResolveScrollSurface(&surface, pRef, cx * 4);
+		if (memcmp(pRef, pWindow, size) != 0) {
+			printf("MISMATCH damage on the scrolling surface at step %d (%d,%d)\n", i, x, y);
+			failed = 1;
+		}
+	}
+
+	FreeDamage(&damage);
+	free(pRing);
+	free(pRef);
+	free(pWindow);
+	return failed;
+}
+
+static int BenchDamage(void)
+{
+	printf("\n%-10s %-8s %6s %11s %8s %9s %11s %9s %10s\n", "size", "content", "rects", "damaged px", "surface",
+		   "track us", "present us", "full us", "untracked");
+
+	for (int s = 0; s <= 2; s++) {
+		int cx = g_Sizes[s][0], cy = g_Sizes[s][1];
+		size_t size = (size_t)cx * cy * sizeof(uint32_t);
+		uint32_t* pBits = (uint32_t*)malloc(size);
+		uint32_t* pOld = (uint32_t*)malloc(size);
+		uint32_t* pWindow = (uint32_t*)malloc(size);
+		SCROLLPIECE whole = { 0, 0, 0, 0, cx, cy };
+		DAMAGE damage;
+
+		// a full present: the whole surface to the window, after the same work per frame as below
+		double t0, dFullUs = 0.0;
+		for (int f = 1; f <= FRAMES / 4; f++) {
+			memcpy(pOld, pBits, size);
+			g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, f, f);
+			t0 = PaceNow();
+			memcpy(pWindow, pBits, size);
+			dFullUs += (PaceNow() - t0) * 1e6 / (FRAMES / 4);
+		}
+
+		// 0: moving box found by DetectDamage, 1: the same box declared with
+		// AddDamageRect (no compare), 2: full animation
+		for (int iContent = 0; iContent <= 2; iContent++) {
+			static const char* szContent[] = { "box", "explicit", "animated" };
+			InitDamage(&damage, cx, cy);
+			g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, 0, 0);
+			DetectDamage(&damage, pBits, cx * 4);
+			ResolveDamage(&damage);
+			PresentDamageRects(&damage, &whole, 1, pBits, pWindow);
+			damage.stats.llFrames = damage.stats.llDamagedSum = damage.stats.llUntracked = 0;
+
+			double dTrack = 0.0, dPresent = 0.0;
+			for (int f = 1; f <= FRAMES; f++) {
+				memcpy(pOld, pBits, size);
+				int xBox = (f * 3) % (cx - 64), yBox = (f * 2) % (cy - 48);
+				int xOld = ((f - 1) * 3) % (cx - 64), yOld = ((f - 1) * 2) % (cy - 48);
+				if (iContent == 2) {
+					g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, f, f);
+				} else {
+					// a box moving over static content, the old position is cleared
+					g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, 0, 0);
+					DrawBox(pBits, cx, xBox, yBox, 64, 48, 0x00FFFFFF);
+				}
+
+				t0 = PaceNow();
+				if (iContent == 1) {
+					AddDamageRect(&damage, xOld, yOld, xOld + 64, yOld + 48);
+					AddDamageRect(&damage, xBox, yBox, xBox + 64, yBox + 48);
+				} else {
+					DetectDamage(&damage, pBits, cx * 4);
+				}
+				ResolveDamage(&damage);
+				double t1 = PaceNow();
+				PresentDamageRects(&damage, &whole, 1, pBits, pWindow);
+				double t2 = PaceNow();
+				dTrack += t1 - t0;
+				dPresent += t2 - t1;
+
+				if (f > 1 && f % 50 == 0 && CheckDamageCovers(&damage, pOld, pBits)) {
+					return 1;
+				}
+				if (memcmp(pWindow, pBits, size) != 0) {
+					printf("MISMATCH damage: %s frame %d, the window is not the frame\n", szContent[iContent], f);
+					return 1;
+				}
+			}
+
+			char szSize[32];
+			double dTrackUs = dTrack * 1e6 / FRAMES, dPresentUs = dPresent * 1e6 / FRAMES;
+			snprintf(szSize, sizeof(szSize), "%dx%d", cx, cy);
+			printf("%-10s %-8s %6d %11lld %7.1f%% %9.1f %11.1f %9.1f %10lld\n", szSize, szContent[iContent],
+				   damage.stats.nRects, damage.stats.llDamagedSum / damage.stats.llFrames,
+				   100.0 * damage.stats.llDamagedSum / (damage.stats.llFrames * damage.stats.llTotalPixels),
+				   dTrackUs, dPresentUs, dFullUs, damage.stats.llUntracked);
+			FreeDamage(&damage);
+
+			// a 64x48 box moving 3,2 pixels a frame: old and new position fit in 4x3 tiles
+			if (iContent != 2 && damage.stats.llDamagedSum / damage.stats.llFrames > 4 * 3 * DAMAGE_TILE * DAMAGE_TILE) {
+				printf("MISMATCH damage: %s %lld px/frame damaged, the box is at most %d\n", szContent[iContent],
+					   damage.stats.llDamagedSum / damage.stats.llFrames, 4 * 3 * DAMAGE_TILE * DAMAGE_TILE);
+				return 1;
+			}
+		}
+
+		free(pBits);
+		free(pOld);
+		free(pWindow);
+	}
+
+	return 0;
+}
+
+static int BppBytes(int iBpp)
+{
+	return iBpp == 15 ? 2 : iBpp / 8;
+}
+
+static int CheckPixelConversion(void)
+{
+	// odd width + padded pitches to exercise tails and strides
+	int cx = 333, cy = 17;
+	size_t size = (size_t)(cx + 16) * cy * 4;
+	uint8_t* pSrc = (uint8_t*)malloc(size);
+	uint8_t* pRef = (uint8_t*)malloc(size);
+	uint8_t* pOut = (uint8_t*)malloc(size);
+	uint8_t* pInPlace = (uint8_t*)malloc(size);
+	int failed = 0;
+
+	srand(99);
+	for (size_t i = 0; i < size; i++) {
+		pSrc[i] = (uint8_t)rand();
+	}
+
+	for (int i = 0; i < PIXEL_CONVERTER_COUNT; i++) {
+		const PIXELCONVERTER* pConv = &g_PixelConverters[i];
+		int iSrcPitch = DIB_PITCH(cx, pConv->iSrcBpp) + 4;
+		int iDstPitch = DIB_PITCH(cx, pConv->iDstBpp) + 4;
+		int bWiden = pConv->iDstBpp > pConv->iSrcBpp;
+		PFNCONVERTROW pfn = PickConvertRow(pConv);
+
+		memset(pRef, 0, size);
+		memset(pOut, 0, size);
+		ConvertRows(pConv->pfnScalar, bWiden, pRef, iDstPitch, pSrc, iSrcPitch, cx, cy, NULL);
+		ConvertRows(pfn, bWiden, pOut, iDstPitch, pSrc, iSrcPitch, cx, cy, NULL);
+
+		// in place: the source is laid out with its own pitch, the result with the dst one
+		memset(pInPlace, 0, size);
+		memcpy(pInPlace, pSrc, (size_t)iSrcPitch * cy);
+		ConvertRows(pfn, bWiden, pInPlace, iDstPitch, pInPlace, iSrcPitch, cx, cy, NULL);
+
+		for (int y = 0; y < cy; y++) {
+			size_t bytes = (size_t)cx * BppBytes(pConv->iDstBpp);
+			if (memcmp(pRef + y * iDstPitch, pOut + y * iDstPitch, bytes) != 0 ||
+				memcmp(pRef + y * iDstPitch, pInPlace + y * iDstPitch, bytes) != 0) {
+				printf("MISMATCH conversion %d -> %d row %d\n", pConv->iSrcBpp, pConv->iDstBpp, y);
+				failed = 1;
+				break;
+			}
+		}
+	}
+
+	// round trip through 565 must only drop the low bits of each channel
+	uint32_t white = 0x00FFFFFF, gray;
+	uint16_t w565;
+	ConvertPixels(&w565, 2, 16, &white, 4, 32, 1, 1, NULL);
+	ConvertPixels(&gray, 4, 32, &w565, 2, 16, 1, 1, NULL);
+	if (gray != white) {
+		printf("MISMATCH 565 round trip of white: %08x\n", (unsigned)gray);
+		failed = 1;
+	}
+
+	free(pSrc);
+	free(pRef);
+	free(pOut);
+	free(pInPlace);
+	return failed;
+}
+
+static void BenchPixelConversion(void)
+{
+	int cx = g_Sizes[1][0], cy = g_Sizes[1][1];
+	size_t size = (size_t)cx * cy * 4;
+	uint8_t* pSrc = (uint8_t*)malloc(size);
+	uint8_t* pDst = (uint8_t*)malloc(size);
+
+	printf("\n%-10s %12s %12s %12s\n", "convert", "scalar GB/s", "simd GB/s", "ms/frame");
+	g_pfnGradientRows((uint32_t*)pSrc, cx * 4, cx, 0, cy, 0, 0);
+
+	for (int i = 0; i < PIXEL_CONVERTER_COUNT; i++) {
+		const PIXELCONVERTER* pConv = &g_PixelConverters[i];
+		int iSrcPitch = DIB_PITCH(cx, pConv->iSrcBpp);
+		int iDstPitch = DIB_PITCH(cx, pConv->iDstBpp);
+		int bWiden = pConv->iDstBpp > pConv->iSrcBpp;
+		double bytes = (double)(iSrcPitch + iDstPitch) * cy;
+		double ms[2];
+
+		for (int bSimd = 0; bSimd <= 1; bSimd++) {
+			PFNCONVERTROW pfn = bSimd ? PickConvertRow(pConv) : pConv->pfnScalar;
+			ConvertRows(pfn, bWiden, pDst, iDstPitch, pSrc, iSrcPitch, cx, cy, NULL);
+
+			double t0 = PaceNow();
+			for (int f = 0; f < FRAMES / 4; f++) {
+				ConvertRows(pfn, bWiden, pDst, iDstPitch, pSrc, iSrcPitch, cx, cy, NULL);
+			}
+			ms[bSimd] = (PaceNow() - t0) * 1000.0 / (FRAMES / 4);
+		}
+
+		char szPair[32];
+		snprintf(szPair, sizeof(szPair), "%d -> %d", pConv->iSrcBpp, pConv->iDstBpp);
+		printf("%-10s %12.2f %12.2f %12.3f\n", szPair, bytes / (ms[0] * 1e6), bytes / (ms[1] * 1e6), ms[1]);
+	}
+
+	free(pSrc);
+	free(pDst);
+}
+
+static int CheckPalette(void)
+{
+	static const PALETTESTOP stops[] = { { 0, 0x00000000 }, { 100, 0x00FF8040 }, { 200, 0x0010FF10 } };
+	uint32_t base[256], colors[256];
+	uint8_t indices[64 * 8];
+
+	BuildPaletteRamp(base, stops, 3, 1);
+	if (base[0] != stops[0].color || base[100] != stops[1].color || base[200] != stops[2].color) {
+		printf("MISMATCH palette ramp does not hit its stops\n");
+		return 1;
+	}
+
+	RenderIndexRamp(indices, 64, 64, 8);
+	CyclePalette(colors, base, 77 + 300);
+	for (int y = 0; y < 8; y++) {
+		for (int x = 0; x < 64; x++) {
+			if (colors[indices[y * 64 + x]] != base[(x + y + 377) & 0xFF]) {
+				printf("MISMATCH palette cycling at (%d,%d)\n", x, y);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void BenchPalette(void)
+{
+	static const PALETTESTOP stops[] = { { 0, 0x00000000 }, { 128, 0x00FFFFFF } };
+	uint32_t base[256], colors[256];
+
+	printf("\n%-10s %16s %16s\n", "size", "32bpp ms/frame", "palette us/frame");
+	BuildPaletteRamp(base, stops, 2, 1);
+
+	for (int s = 0; s <= 2; s++) {
+		int cx = g_Sizes[s][0], cy = g_Sizes[s][1];
+		uint32_t* pBits = (uint32_t*)malloc((size_t)cx * cy * sizeof(uint32_t));
+
+		g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, 0, 0);
+		double t0 = PaceNow();
+		for (int f = 0; f < FRAMES; f++) {
+			g_pfnGradientRows(pBits, cx * 4, cx, 0, cy, f, f);
+		}
+		double msFull = (PaceNow() - t0) * 1000.0 / FRAMES;
+
+		// many more frames: one is far below the timer resolution
+		t0 = PaceNow();
+		for (int f = 0; f < FRAMES * 100; f++) {
+			CyclePalette(colors, base, 2 * f);
+		}
+		double usPalette = (PaceNow() - t0) * 1e6 / (FRAMES * 100);
+
+		char szSize[32];
+		snprintf(szSize, sizeof(szSize), "%dx%d", cx, cy);
+		printf("%-10s %16.3f %16.3f\n", szSize, msFull, usPalette);
+		g_uSink += colors[7];
+		free(pBits);
+	}
+}
+
+static int CheckSurface(void)
+{
+	static const int bpps[] = { 8, 15, 16, 24, 32 };
+	SURFACE surface;
+
+	memset(&surface, 0, sizeof(surface));
+	for (int b = 0; b < 5; b++) {
+		for (int cx = 1; cx < 300; cx += 37) {
+			int iBytes = SurfaceBytesPerPixel(bpps[b]);
+			if (!ResizeSurface(&surface, cx, 5, bpps[b], 0)) {
+				printf("MISMATCH surface allocation failed\n");
+				return 1;
+			}
+			if (((uintptr_t)surface.pBits % SURFACE_ALIGN) || surface.iPitch % SURFACE_ALIGN ||
+				surface.iPitch % iBytes || surface.iPitch < cx * iBytes ||
+				(size_t)surface.iPitch * 5 > surface.cbCapacity) {
+				printf("MISMATCH surface %dbpp cx %d: pitch %d\n", bpps[b], cx, surface.iPitch);
+				return 1;
+			}
+			// every row must be writable up to the pitch
+			memset(surface.pBits, 0xAB, (size_t)surface.iPitch * 5);
+		}
+	}
+	FreeSurface(&surface);
+
+	// shrinking and growing back within the capacity keeps the buffer
+	memset(&surface, 0, sizeof(surface));
+	ResizeSurface(&surface, 1000, 1000, 32, 0);
+	uint8_t* pFirst = surface.pBits;
+	ResizeSurface(&surface, 500, 700, 32, 0);
+	ResizeSurface(&surface, 1100, 1000, 32, 0);
+	if (surface.pBits != pFirst || surface.nAllocs != 1 || surface.nReuses != 2) {
+		printf("MISMATCH surface reuse: %d allocations, %d reuses\n", surface.nAllocs, surface.nReuses);
+		return 1;
+	}
+	FreeSurface(&surface);
+	return 0;
+}
+
+// resize + render sequence of a window edge dragged from 800x600 to 1920x1080 and back
+static void BenchSurface(void)
+{
+	static const struct { const char* szName; unsigned uFlags; } policies[] = {
+		{ "realloc",         SURFACE_NO_REUSE },
+		{ "grow-only",       0 },
+		{ "realloc huge",    SURFACE_NO_REUSE | SURFACE_HUGE_PAGES },
+		{ "grow-only huge",  SURFACE_HUGE_PAGES },
+	};
+
+	printf("\n%-16s %8s %8s %14s %14s %12s\n",
+		   "policy", "resizes", "allocs", "alloc us", "alloc+draw us", "page faults");
+
+	for (int p = 0; p < 4; p++) {
+		SURFACE surface;
+		double dAlloc = 0.0, dTotal = 0.0;
+		int nResizes = 0;
+
+		memset(&surface, 0, sizeof(surface));
+		long long llFaults0 = GetPageFaultCount();
+		for (int step = 0; step <= 280; step++) {
+			// out and back, with the little jitter a real drag has
+			int k = step <= 140 ? step : 280 - step;
+			int cx = 800 + k * 8 + (step % 3);
+			int cy = 600 + k * 34 / 10 - (step % 2);
+
+			double t0 = PaceNow();
+			if (!ResizeSurface(&surface, cx, cy, 32, policies[p].uFlags)) {
+				printf("%-16s out of memory\n", policies[p].szName);
+				break;
+			}
+			double t1 = PaceNow();
+			g_pfnGradientRows((uint32_t*)surface.pBits, surface.iPitch, cx, 0, cy, step, step);
+			double t2 = PaceNow();
+
+			dAlloc += t1 - t0;
+			dTotal += t2 - t0;
+			nResizes++;
+		}
+		long long llFaults = GetPageFaultCount() - llFaults0;
+		g_uSink += surface.pBits[0];
+
+		printf("%-16s %8d %8d %14.2f %14.2f %12lld%s\n", policies[p].szName, nResizes, surface.nAllocs,
+			   dAlloc * 1e6 / nResizes, dTotal * 1e6 / nResizes, llFaults,
+			   (policies[p].uFlags & SURFACE_HUGE_PAGES) && !surface.bHugePages ? " (no reserved huge pages)" : "");
+		FreeSurface(&surface);
+	}
+}
+
+#define RES_MAX_STEADY_CHANGES 3 // more under a steady load is oscillation
+
+// cost model: 10 ms for 1920x1080, linear in pixels
+static double SyntheticFrameMs(const RESOLUTION* pRes)
+{
+	return 10.0 * pRes->cx * pRes->cy / (1920.0 * 1080.0);
+}
+
+static int CheckResolution(void)
+{
+	static const double targets[] = { 2.0, 5.0, 9.0, 20.0 };
+	RESOLUTION res;
+
+	for (int t = 0; t < 4; t++) {
+		InitResolution(&res, targets[t]);
+		SetResolutionClient(&res, 1920, 1080);
+		res.bAuto = 1;
+		for (int f = 0; f < 300; f++) {
+			UpdateResolution(&res, SyntheticFrameMs(&res));
+		}
+
+		// settled: in the band, or at full scale when even that is cheap enough
+		double dRatio = SyntheticFrameMs(&res) / targets[t];
+		int bFull = res.fScale >= res.fMaxScale && dRatio < res.fHigh;
+		if (!bFull && (dRatio < res.fLow * 0.9 || dRatio > res.fHigh * 1.1)) {
+			printf("MISMATCH render scale: target %.1f ms, %dx%d costs %.2f ms\n",
+				   targets[t], res.cx, res.cy, SyntheticFrameMs(&res));
+			return 1;
+		}
+		if (res.cx % RES_QUANTUM || res.cy % RES_QUANTUM) {
+			printf("MISMATCH render scale: %dx%d not a multiple of %d\n", res.cx, res.cy, RES_QUANTUM);
+			return 1;
+		}
+
+		// the same load with +-30% noise on every frame: once settled it has to stay put
+		srand(99 + t);
+		for (int f = 0; f < 600; f++) {
+			if (f == 200) {
+				res.nChanges = 0;
+			}
+			UpdateResolution(&res, SyntheticFrameMs(&res) * (0.7 + 0.6 * rand() / RAND_MAX));
+		}
+		if (res.nChanges > RES_MAX_STEADY_CHANGES) {
+			printf("MISMATCH render scale: target %.1f ms, %d changes in 400 frames of a noisy steady load\n",
+				   targets[t], res.nChanges);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// the real thing: render + resize loop on a 4K client area, must not oscillate
+static int BenchResolution(void)
+{
+	const int cxClient = 3840, cyClient = 2160;
+	RESOLUTION res;
+	SURFACE surface;
+	double dFullMs, dSum = 0.0;
+	int nOver = 0, nFrames = 0, nChangesFirstHalf = 0;
+
+	memset(&surface, 0, sizeof(surface));
+	ResizeSurface(&surface, cxClient, cyClient, 32, 0);
+	g_pfnGradientRows((uint32_t*)surface.pBits, surface.iPitch, cxClient, 0, cyClient, 0, 0); // page faults
+	double t0 = PaceNow();
+	for (int f = 0; f < 20; f++) {
+		g_pfnGradientRows((uint32_t*)surface.pBits, surface.iPitch, cxClient, 0, cyClient, f, f);
+	}
+	dFullMs = (PaceNow() - t0) * 1000.0 / 20;
+
+	InitResolution(&res, dFullMs / 3.0);
+	SetResolutionClient(&res, cxClient, cyClient);
+	res.bAuto = 1;
+
+	printf("\nrender scale on %dx%d: full resolution %.3f ms, target %.3f ms\n",
+		   cxClient, cyClient, dFullMs, res.dTargetMs);
+	printf("%8s %8s %12s %12s\n", "frame", "scale", "surface", "ms/frame");
+
+	for (int f = 0; f < FRAMES; f++) {
+		t0 = PaceNow();
+		g_pfnGradientRows((uint32_t*)surface.pBits, surface.iPitch, res.cx, 0, res.cy, f, f);
+		double dMs = (PaceNow() - t0) * 1000.0;
+
+		if (f % 25 == 0 || f == FRAMES - 1) {
+			char szSize[32];
+			snprintf(szSize, sizeof(szSize), "%dx%d", res.cx, res.cy);
+			printf("%8d %8.3f %12s %12.3f\n", f, res.fScale, szSize, dMs);
+		}
+		if (f == FRAMES / 2) {
+			nChangesFirstHalf = res.nChanges;
+		}
+		if (f >= FRAMES / 2) {
+			dSum += dMs;
+			nOver += dMs > res.dTargetMs * res.fHigh;
+			nFrames++;
+		}
+		if (UpdateResolution(&res, dMs)) {
+			ResizeSurface(&surface, res.cx, res.cy, 32, 0);
+		}
+	}
+
+	int nChanges = res.nChanges - nChangesFirstHalf;
+	printf("second half: %.3f ms/frame average, %d of %d frames over the band, %d scale changes (%d in all), %d allocations\n",
+		   dSum / nFrames, nOver, nFrames, nChanges, res.nChanges, surface.nAllocs);
+	FreeSurface(&surface);
+	if (nChanges > RES_MAX_STEADY_CHANGES) {
+		printf("MISMATCH render scale: %d changes in the second half of a steady load\n", nChanges);
+		return 1;
+	}
+	return 0;
+}
+
+// scales the source with the scalar or the SIMD kernels into pDst (tight)
+static void ScaleOnce(WORKERPOOL* pPool, SCALER* pScaler, int iFilter, int bSimd,
+					  const uint32_t* pSrc, int cxSrc, int cySrc, int xOrigin, int yOrigin,
+					  uint32_t* pDst, int cxDst, int cyDst)
+{
+	PrepareScaler(pScaler, iFilter, cxSrc, cySrc, cxDst, cyDst, xOrigin, yOrigin, pPool->nThreads);
+	pScaler->bSimd = bSimd && (g_uCpuFeatures & CPU_SSE2);
+	RunScaler(pPool, pScaler, pSrc, cxSrc * 4, pDst, cxDst * 4);
+}
+
+static int CheckScaler(int nThreads)
+{
+	static const int sizes[][4] = {
+		{ 640, 480, 1920, 1080 },
+		{ 640, 480, 1001, 777 },	// odd sizes, tails
+		{ 640, 480, 320, 200 },		// down
+		{ 700, 500, 640, 480 },		// integer: k = 1, cropped
+		{ 333, 111, 1332, 444 },	// integer: k = 4
+		{ 300, 200, 900, 600 },		// integer: k = 3
+		{ 101, 77, 530, 400 },		// integer: k = 5, borders
+	};
+	WORKERPOOL pool;
+	SCALER scaler;
+	int failed = 0;
+
+	CreateWorkerPool(&pool, nThreads);
+	memset(&scaler, 0, sizeof(scaler));
+
+	for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])) && !failed; i++) {
+		int cxSrc = sizes[i][0], cySrc = sizes[i][1], cxDst = sizes[i][2], cyDst = sizes[i][3];
+		int xOrigin = cxSrc / 3, yOrigin = cySrc / 5;
+		uint32_t* pSrc = (uint32_t*)malloc((size_t)cxSrc * cySrc * 4);
+		uint32_t* pRing = (uint32_t*)malloc((size_t)cxSrc * cySrc * 4);
+		uint32_t* pRef = (uint32_t*)malloc((size_t)cxDst * cyDst * 4);
+		uint32_t* pOut = (uint32_t*)malloc((size_t)cxDst * cyDst * 4);
+
+		// random pixels (every channel, alpha too) and the same picture wrapped
+		uint32_t seed = 12345;
+		for (int p = 0; p < cxSrc * cySrc; p++) {
+			seed = seed * 1664525 + 1013904223;
+			pSrc[p] = seed;
+		}
+		for (int y = 0; y < cySrc; y++) {
+			for (int x = 0; x < cxSrc; x++) {
+				pRing[((y + yOrigin) % cySrc) * cxSrc + (x + xOrigin) % cxSrc] = pSrc[y * cxSrc + x];
+			}
+		}
+
+		for (int f = 0; f < SCALE_FILTER_COUNT && !failed; f++) {
+			ScaleOnce(&pool, &scaler, f, 0, pSrc, cxSrc, cySrc, 0, 0, pRef, cxDst, cyDst);
+			memset(pOut, 0xCD, (size_t)cxDst * cyDst * 4);
+			ScaleOnce(&pool, &scaler, f, 1, pSrc, cxSrc, cySrc, 0, 0, pOut, cxDst, cyDst);
+			if (memcmp(pRef, pOut, (size_t)cxDst * cyDst * 4)) {
+				printf("MISMATCH %s scaler simd %dx%d -> %dx%d\n", g_szScaleFilters[f], cxSrc, cySrc, cxDst, cyDst);
+				failed = 1;
+				break;
+			}
+			memset(pOut, 0xCD, (size_t)cxDst * cyDst * 4);
+			ScaleOnce(&pool, &scaler, f, 1, pRing, cxSrc, cySrc, xOrigin, yOrigin, pOut, cxDst, cyDst);
+			if (memcmp(pRef, pOut, (size_t)cxDst * cyDst * 4)) {
+				printf("MISMATCH %s scaler ring buffer %dx%d -> %dx%d\n", g_szScaleFilters[f], cxSrc, cySrc, cxDst, cyDst);
+				failed = 1;
+			}
+		}
+
+		// 1:1 nearest/bilinear must be a copy
+		if (!failed) {
+			uint32_t* pCopy = (uint32_t*)malloc((size_t)cxSrc * cySrc * 4);
+			ScaleOnce(&pool, &scaler, SCALE_BILINEAR, 1, pSrc, cxSrc, cySrc, 0, 0, pCopy, cxSrc, cySrc);
+			if (memcmp(pCopy, pSrc, (size_t)cxSrc * cySrc * 4)) {
+				printf("MISMATCH bilinear scaler 1:1 is not a copy\n");
+				failed = 1;
+			}
+			free(pCopy);
+		}
+
+		free(pSrc);
+		free(pRing);
+		free(pRef);
+		free(pOut);
+	}
+
+	FreeScaler(&scaler);
+	DestroyWorkerPool(&pool);
+	return failed;
+}
+
+static void BenchScaler(int nThreads)
+{
+	static const int dests[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const int cxSrc = 640, cySrc = 480;
+	uint32_t* pSrc = (uint32_t*)malloc((size_t)cxSrc * cySrc * 4);
+	WORKERPOOL pool;
+	SCALER scaler;
+
+	CreateWorkerPool(&pool, nThreads);
+	memset(&scaler, 0, sizeof(scaler));
+	g_pfnGradientRows(pSrc, cxSrc * 4, cxSrc, 0, cySrc, 0, 0);
+
+	printf("\nscaler %dx%d -> window, %d threads\n", cxSrc, cySrc, pool.nThreads);
+	printf("%-10s %-10s %14s %14s %10s\n", "window", "filter", "scalar ms", "simd ms", "Mpixel/s");
+
+	for (int d = 0; d < 2; d++) {
+		int cxDst = dests[d][0], cyDst = dests[d][1];
+		uint32_t* pDst = (uint32_t*)malloc((size_t)cxDst * cyDst * 4);
+
+		for (int f = 0; f < SCALE_FILTER_COUNT; f++) {
+			double ms[2];
+			for (int bSimd = 0; bSimd < 2; bSimd++) {
+				ScaleOnce(&pool, &scaler, f, bSimd, pSrc, cxSrc, cySrc, 0, 0, pDst, cxDst, cyDst);
+				double t0 = PaceNow();
+				for (int n = 0; n < FRAMES / 4; n++) {
+					RunScaler(&pool, &scaler, pSrc, cxSrc * 4, pDst, cxDst * 4);
+				}
+				ms[bSimd] = (PaceNow() - t0) * 1000.0 / (FRAMES / 4);
+			}
+			g_uSink += pDst[cxDst * cyDst / 2];
+
+			char szSize[32];
+			snprintf(szSize, sizeof(szSize), "%dx%d", cxDst, cyDst);
+			printf("%-10s %-10s %14.3f %14.3f %10.1f\n", szSize, g_szScaleFilters[f], ms[0], ms[1],
+				   (double)cxDst * cyDst / (ms[1] * 1000.0));
+		}
+		free(pDst);
+	}
+
+	FreeScaler(&scaler);
+	DestroyWorkerPool(&pool);
+	free(pSrc);
+}
+
+int main(int argc, char** argv)
+{
+	int nMaxThreads = argc > 1 ? atoi(argv[1]) : GetCpuCount();
+	if (nMaxThreads < 1) {
+		nMaxThreads = 1;
+	}
+
+	printf("selected kernel: %s\n", InitGradientKernel());
+
+	if (CheckKernels() || CheckTiled(nMaxThreads < 3 ? 3 : nMaxThreads) || CheckScroll() || CheckDamageScroll() || CheckPixelConversion() || CheckPalette() ||
+		CheckSurface() || CheckResolution() || CheckScaler(nMaxThreads < 3 ? 3 : nMaxThreads)) {
+		return 1;
+	}
+	printf("all kernels match the scalar reference\n");
+
+	BenchKernels();
+	BenchThreads(nMaxThreads);
+	BenchScroll();
+	BenchPixelConversion();
+	BenchPalette();
+	BenchSurface();
+	if (BenchResolution()) {
+		return 1;
+	}
+	BenchScaler(nMaxThreads);
+	return BenchDamage();
+}
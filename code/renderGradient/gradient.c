@@ -15,6 +15,30 @@
 		- Gradient renderer (OnCreate func)
 		- PeekMessage
 		- Animating window on the screen
+		- SIMD gradient kernels picked at startup (kernel.c, benchmark in gradbench.c)
+		- the surface is rendered in row bands by a persistent worker pool (workers.c)
+		- scrolling mode (key S): the surface is a ring buffer, each frame only the
+		  strips exposed by ++xOffset/++yOffset are generated (scroll.c)
+		- damage mode (key D, SPACE pauses): changed tiles are found comparing with
+		  the previous frame and only those rects are blitted (damage.c)
+		- present format (key F): the 32bpp surface is converted to 16/15/24/8bpp
+		  before the blit, a 16bpp blit moves half the bytes (pixconv.c)
+		- palette mode (key P): an 8bpp DIB written once, animated by rotating
+		  its 256 bmiColors (palette.c)
+		- the surfaces come from surface.c: 64 byte aligned rows, explicit pitch
+		  (biWidth covers the padding, we only blit cx columns), released with
+		  the call that matches the allocation
+		- the surface follows the client area (key W toggles back to a fixed
+		  640x480 stretched to the window), buffers only grow so resizing the
+		  window reuses them
+		- render scale: the surface can be a fraction of the client area (keys
+		  + and -, in 1/8 steps) or, with key R, the fraction is picked every
+		  frame to keep RenderGradient under RENDER_TARGET_MS (resolution.c)
+		- software scaler (key G: GDI -> nearest -> bilinear -> integer): the
+		  32bpp surface is scaled to a window sized buffer on the worker pool
+		  and blitted 1:1, StretchDIBits does not scale anything (scaler.c)
+		- frames are paced at FRAME_RATE by ../common/pacing.c (sleep + spin on
+		  an absolute schedule) instead of Sleep(1)
 
 
 */
@@ -24,18 +48,65 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h> 
+#include "surface.c"
+#include "kernel.c"
+#include "workers.c"
+#include "scroll.c"
+#include "damage.c"
+#include "pixconv.c"
+#include "palette.c"
+#include "resolution.c"
+#include "scaler.c"
+#include "../common/pacing.c"
 
 
 static char g_szAppName[] = TEXT("Gradient");
 static char g_szAppTitle[] = TEXT("random gradient");
 static BOOL Running;
 
-// definitely not a best practice!!
+// size of the surface when it does not follow the window
 #define	DIB_WIDTH   640 
 #define	DIB_HEIGHT  480
 
-BYTE* g_pBits = NULL; // bitmap surface stored in mem
+static SURFACE g_Surface; // bitmap surface stored in mem (g_Surface.pBits)
 LPBITMAPINFO g_lpBmi = NULL; // metadata for bitmap
+static BOOL g_bFollowWindow = TRUE; // surface size = client area * render scale
+static RESOLUTION g_Resolution; // render scale, fixed or automatic (key R)
+
+#define FRAME_RATE 60.0
+
+// RenderGradient budget for the automatic render scale
+#define RENDER_TARGET_MS 4.0
+static WORKERPOOL g_Pool; // render threads, alive for the whole program
+static SCROLLSURFACE g_Scroll; // ring buffer view of g_Surface used in scrolling mode
+static BOOL g_bScrolling = TRUE;
+static DAMAGE g_Damage; // dirty rects of the surface for partial presentation
+static BOOL g_bDamage = FALSE;
+static BOOL g_bPaused = FALSE;
+
+// we always render in 32bpp, the window can be fed another format (key F)
+static int g_iPresentBpp = 32;
+static SURFACE g_PresentSurface;
+static LPBITMAPINFO g_lpPresentBmi = NULL;
+
+// palette animation: indices written once, only bmiColors change per frame
+static BOOL g_bPalette = FALSE;
+static SURFACE g_IndexSurface;
+static LPBITMAPINFO g_lpIndexBmi = NULL;
+static uint32_t g_BasePalette[256];
+
+// software scaler: -1 lets StretchDIBits scale, else a SCALE_ filter into g_WindowSurface
+static int g_iScaler = -1;
+static SCALER g_Scaler;
+static SURFACE g_WindowSurface;
+static LPBITMAPINFO g_lpWindowBmi = NULL;
+static BOOL g_bWindowScaled = FALSE; // g_WindowSurface holds the last frame, scaled
+
+// offsets of the last frame, to redraw it right away when the surface changes size
+static int g_xLastOffset = 0;
+static int g_yLastOffset = 0;
+
+void RenderGradient(int xOffset, int yOffset);
 
 
 
@@ -52,6 +123,32 @@ static void __cdecl TRACE(const char *szString, ...)
     OutputDebugStringA(szDebugString);
 }
 
+/*
+	The header describes the whole pitch: GDI computes the row size from
+	biWidth, so the padding of the row is seen as extra columns that we never
+	blit (source rects stop at pSurface->cx)
+*/
+void SetDIBSize(LPBITMAPINFO lpBmi, const SURFACE* pSurface)
+{
+	lpBmi->bmiHeader.biWidth = pSurface->iPitch / SurfaceBytesPerPixel(pSurface->iBpp);
+	lpBmi->bmiHeader.biHeight = -(signed)pSurface->cy;		// <-- NEGATIVE MEANS TOP DOWN!!! (best practice)
+}
+
+// BITMAPINFO + palette (8 bpp) or color masks (15/16/32 bpp, BI_BITFIELDS)
+int BitmapInfoSize(int iBpp)
+{
+	switch(iBpp) {
+	case 8:		// 8 bpp
+		return sizeof(BITMAPINFO) + sizeof(RGBQUAD) * 256;
+
+	case 24:	// 24 bpp
+		return sizeof(BITMAPINFO);
+
+	default:	// 15/16/32 bpp
+		return sizeof(BITMAPINFO) + sizeof(DWORD) * 4;
+	}
+}
+
 /* 
 	Creating the bitmap according to bit per pixel selected(
 		- Initialize and allocate the Bitmap Info Header
@@ -59,39 +156,18 @@ static void __cdecl TRACE(const char *szString, ...)
 		- Allocting bitmap's Pixel infos
 	)
 
-	cx,cy -> bitmap dimension
-	iBpp  -> bit per pixel (8,16,24,32)
-	pBits -> [out] it will contain pointer to the buffer of pixels  
+	cx,cy    -> bitmap dimension
+	iBpp     -> bit per pixel (8,16,24,32)
+	pSurface -> [out] gets the buffer of pixels (surface.c, rows are 64 byte
+				aligned and iPitch apart)
 */
-LPBITMAPINFO CreateDIB(int cx, int cy, int iBpp, BYTE** pBits)
+LPBITMAPINFO CreateDIB(int cx, int cy, int iBpp, SURFACE* pSurface)
 {
 	LPBITMAPINFO lpBmi;
 	int iBmiSize; // BITMAPINFO + mask
-	int iSurfaceSize; // pixel buffer dimension
 
 	// Calculate the size of the bitmap info header.
-	switch(iBpp) {
-	case 8:		// 8 bpp
-		iBmiSize = sizeof(BITMAPINFO) + sizeof(RGBQUAD) * 256;
-		iSurfaceSize = cx * cy * sizeof(BYTE);
-		break;
-	
-	case 15:	// 15/16 bpp
-	case 16:
-		iBmiSize = sizeof(BITMAPINFO) + sizeof(DWORD) * 4;
-		iSurfaceSize = cx * cy * sizeof(WORD);
-		break;
-
-	case 24:	// 24 bpp
-		iBmiSize = sizeof(BITMAPINFO);
-		iSurfaceSize = cx * cy * (sizeof(BYTE) * 3);
-		break;
-
-	case 32:	// 32 bpp
-		iBmiSize = sizeof(BITMAPINFO) + sizeof(DWORD) * 4;
-		iSurfaceSize = cx * cy * sizeof(DWORD);
-		break;
-	}
+	iBmiSize = BitmapInfoSize(iBpp);
 
 	// Allocate memory for the bitmap info header.
 	if((lpBmi = (LPBITMAPINFO)malloc(iBmiSize)) == NULL) {
@@ -108,24 +184,17 @@ LPBITMAPINFO CreateDIB(int cx, int cy, int iBpp, BYTE** pBits)
 		//	return NULL;
 		//}
 
-	 *pBits = (BYTE*)VirtualAlloc(NULL,
-	 							  iSurfaceSize,
-	 				  		  	  MEM_COMMIT, // use the memory right now
-	 				  		      PAGE_READWRITE);
-	 
-
-	 if (*pBits == NULL){
-	 	TRACE("Error allocating memory for bitmap bits\n");
-	 	return NULL;
-	 }
-	
-
-	ZeroMemory(*pBits, iSurfaceSize);
+	// VirtualAlloc (mmap on linux) inside, fresh pages are already zero;
+	// the 32bpp render surface asks for huge pages, it is the one we stream through
+	if (!ResizeSurface(pSurface, cx, cy, iBpp, iBpp == 32 ? SURFACE_HUGE_PAGES : 0)) {
+		TRACE("Error allocating memory for bitmap bits\n");
+		free(lpBmi);
+		return NULL;
+	}
 
 	// Initialize bitmap info header
 	lpBmi->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-	lpBmi->bmiHeader.biWidth = cx;
-	lpBmi->bmiHeader.biHeight = -(signed)cy;		// <-- NEGATIVE MEANS TOP DOWN!!! (best practice)
+	SetDIBSize(lpBmi, pSurface);
 	lpBmi->bmiHeader.biPlanes = 1;
 	lpBmi->bmiHeader.biSizeImage = 0;
 	lpBmi->bmiHeader.biXPelsPerMeter = 0;
@@ -226,13 +295,140 @@ LPBITMAPINFO CreateDIB(int cx, int cy, int iBpp, BYTE** pBits)
 	return lpBmi;
 }
 
+// size of the BITMAPINFO CreateDIB allocated for this header
+int DIBInfoSize(LPBITMAPINFO lpBmi)
+{
+	return BitmapInfoSize(lpBmi->bmiHeader.biBitCount);
+}
+
+/*
+	Changes the format the window gets, 32 means the render surface itself,
+	anything else gets its own DIB that is filled by ConvertForPresent
+*/
+BOOL SetPresentFormat(int iBpp)
+{
+	FreeSurface(&g_PresentSurface);
+	if (g_lpPresentBmi) {
+		free(g_lpPresentBmi);
+		g_lpPresentBmi = NULL;
+	}
+
+	g_iPresentBpp = 32;
+	if (iBpp != 32) {
+		if((g_lpPresentBmi = CreateDIB(g_Surface.cx, g_Surface.cy, iBpp, &g_PresentSurface)) == NULL) {
+			return FALSE;
+		}
+		g_iPresentBpp = iBpp;
+	}
+
+	TRACE("present format: %dbpp\n", g_iPresentBpp);
+	return TRUE;
+}
+
+// converts the surface (or only pRect of it) to the present format
+void ConvertForPresent(const DAMAGERECT* pRect)
+{
+	int x0 = pRect ? pRect->x0 : 0;
+	int y0 = pRect ? pRect->y0 : 0;
+	int x1 = pRect ? pRect->x1 : g_Surface.cx;
+	int y1 = pRect ? pRect->y1 : g_Surface.cy;
+	int iPitch = g_PresentSurface.iPitch;
+	int iBytes = SurfaceBytesPerPixel(g_iPresentBpp);
+
+	if (g_iPresentBpp == 32) {
+		return;
+	}
+
+	ConvertPixels(g_PresentSurface.pBits + y0 * iPitch + x0 * iBytes, iPitch, g_iPresentBpp,
+				  g_Surface.pBits + y0 * g_Surface.iPitch + x0 * sizeof(DWORD), g_Surface.iPitch, 32,
+				  x1 - x0, y1 - y0, NULL);
+}
+
+/*
+	New size for every surface (WM_SIZE, key W). The buffers are reused when
+	they are big enough (see ResizeSurface), only the headers and the things
+	that depend on the size are rebuilt
+*/
+BOOL ResizeRenderSurfaces(int cx, int cy)
+{
+	if (cx < 1) cx = 1;
+	if (cy < 1) cy = 1;
+	if (cx == g_Surface.cx && cy == g_Surface.cy) {
+		return TRUE;
+	}
+
+	if (!ResizeSurface(&g_Surface, cx, cy, 32, SURFACE_HUGE_PAGES) ||
+		!ResizeSurface(&g_IndexSurface, cx, cy, 8, 0)) {
+		TRACE("Error allocating memory for bitmap bits\n");
+		return FALSE;
+	}
+	SetDIBSize(g_lpBmi, &g_Surface);
+	SetDIBSize(g_lpIndexBmi, &g_IndexSurface);
+	RenderIndexRamp(g_IndexSurface.pBits, g_IndexSurface.iPitch, cx, cy);
+
+	if (g_iPresentBpp != 32) {
+		if (!ResizeSurface(&g_PresentSurface, cx, cy, g_iPresentBpp, 0)) {
+			return FALSE;
+		}
+		SetDIBSize(g_lpPresentBmi, &g_PresentSurface);
+	}
+
+	FreeDamage(&g_Damage);
+	if (!InitDamage(&g_Damage, cx, cy)) {
+		TRACE("Error allocating damage tracking\n");
+		return FALSE;
+	}
+
+	// the ring buffer starts over (full redraw on the next frame)
+	InitScrollSurface(&g_Scroll, (uint32_t*)g_Surface.pBits, g_Surface.iPitch,
+					  cx, cy, g_pfnGradientRows);
+
+	// reused buffers still hold the old frame with the old pitch
+	RenderGradient(g_xLastOffset, g_yLastOffset);
+
+	TRACE("surface: %dx%d, pitch %d, %d allocations, %d reuses%s\n",
+		  cx, cy, g_Surface.iPitch, g_Surface.nAllocs, g_Surface.nReuses,
+		  g_Surface.bHugePages ? ", huge pages" : "");
+	return TRUE;
+}
+
 BOOL OnCreate(HWND hWnd, CREATESTRUCT FAR* lpCreateStruct)
 {
+	TRACE("gradient kernel: %s\n", InitGradientKernel());
+
+	// one render thread per cpu (the UI thread is one of them)
+	CreateWorkerPool(&g_Pool, 0);
+	TRACE("render threads: %d\n", g_Pool.nThreads);
+	InitResolution(&g_Resolution, RENDER_TARGET_MS);
+
 	// Create a new 32bpp DIB
-	if((g_lpBmi = CreateDIB(DIB_WIDTH, DIB_HEIGHT, 32, &g_pBits)) == NULL) {
+	if((g_lpBmi = CreateDIB(DIB_WIDTH, DIB_HEIGHT, 32, &g_Surface)) == NULL) {
 		return FALSE;
 	}
 
+	if (!InitDamage(&g_Damage, DIB_WIDTH, DIB_HEIGHT)) {
+		TRACE("Error allocating damage tracking\n");
+		return FALSE;
+	}
+
+	// 8bpp surface for the palette mode
+	if((g_lpIndexBmi = CreateDIB(DIB_WIDTH, DIB_HEIGHT, 8, &g_IndexSurface)) == NULL) {
+		return FALSE;
+	}
+	RenderIndexRamp(g_IndexSurface.pBits, g_IndexSurface.iPitch, DIB_WIDTH, DIB_HEIGHT);
+	{
+		static const PALETTESTOP stops[] = {
+			{   0, 0x00000000 },	// black
+			{  64, 0x00FF0000 },	// red
+			{ 128, 0x00FFFF00 },	// yellow
+			{ 192, 0x0000FF80 },	// green
+		};
+		BuildPaletteRamp(g_BasePalette, stops, 4, TRUE);
+	}
+
+	InitScrollSurface(&g_Scroll, (uint32_t*)g_Surface.pBits, g_Surface.iPitch,
+					  DIB_WIDTH, DIB_HEIGHT, g_pfnGradientRows);
+
 	// Write a pixel to the DIB surface
 	//DWORD* pixel = (DWORD*)g_pBits + (DIB_WIDTH / 2) + ((DIB_HEIGHT / 2) * DIB_WIDTH);
 	//*pixel = 0x00FFFFFF; 
@@ -244,25 +440,44 @@ BOOL OnCreate(HWND hWnd, CREATESTRUCT FAR* lpCreateStruct)
 void RenderGradient(int xOffset, int yOffset)
  {
 	// Write a gradient to the DIB surface
-	for (int y = 0; y < DIB_HEIGHT; y++) {
-    	for (int x = 0; x < DIB_WIDTH; x++) {
-        	DWORD* pixel = (DWORD*)g_pBits + x + y * DIB_WIDTH;
-        	BYTE r = (BYTE)(x + xOffset% 256);											// red depends on x value
-        	BYTE g = (BYTE)(y + yOffset% 256);   										// green depends on y value
-        	BYTE b = (BYTE)((x + xOffset) + (y + yOffset) << 16 % 256);					// blue depends on x and y values
-        	// pixel compisition 0x00RR0000 + 0x00GG00 + 0x0000BB
-        	// (NOTE: 0xAA000000 is set to zero so we ignore that )
-        	*pixel = (r << 16) | (g << 8) | b;
-    	}
+	// (the scalar loop that used to live here is GradientRowsScalar in kernel.c)
+	g_xLastOffset = xOffset;
+	g_yLastOffset = yOffset;
+	if (g_bPalette) {
+		CyclePalette((uint32_t*)g_lpIndexBmi->bmiColors, g_BasePalette, xOffset + yOffset);
+		return;
+	}
+
+	if (g_bScrolling) {
+		ScrollSurfaceTo(&g_Scroll, xOffset, yOffset);
+		return;
 	}
+
+	RenderGradientTiled(&g_Pool, (uint32_t*)g_Surface.pBits, g_Surface.iPitch,
+						g_Surface.cx, g_Surface.cy, xOffset, yOffset);
+	g_Scroll.bValid = FALSE; // the ring buffer layout is gone
 }
 
 void OnDestroy(HWND hWnd)
 {
-	if(g_pBits) {
-		free(g_pBits);
+	DestroyWorkerPool(&g_Pool);
+	FreeDamage(&g_Damage);
+	SetPresentFormat(32);
+
+	FreeScaler(&g_Scaler);
+	FreeSurface(&g_WindowSurface);
+	if(g_lpWindowBmi) {
+		free(g_lpWindowBmi);
+	}
+
+	FreeSurface(&g_IndexSurface);
+	if(g_lpIndexBmi) {
+		free(g_lpIndexBmi);
 	}
 
+	// VirtualAlloc'd, so VirtualFree (inside FreeSurface), not free()
+	FreeSurface(&g_Surface);
+
 	if(g_lpBmi) {
 		free(g_lpBmi);
 	}
@@ -271,6 +486,204 @@ void OnDestroy(HWND hWnd)
 	PostQuitMessage(0);
 }
 
+// the surface as the window sees it: 4 wrapped pieces when scrolling, else 1
+int GetSurfacePieces(SCROLLPIECE pieces[4])
+{
+	if (g_bScrolling && !g_bPalette) {
+		return ScrollSurfacePieces(&g_Scroll, pieces);
+	}
+
+	pieces[0].xDest = pieces[0].xSrc = 0;
+	pieces[0].yDest = pieces[0].ySrc = 0;
+	pieces[0].cx = g_Surface.cx;
+	pieces[0].cy = g_Surface.cy;
+	return 1;
+}
+
+// the software scaler is only for the 32bpp surface, GDI scales the other formats
+BOOL UseSoftwareScaler(void)
+{
+	return g_iScaler >= 0 && g_iPresentBpp == 32 && !g_bPalette;
+}
+
+/*
+	Scales the surface to g_WindowSurface (cxDest x cyDest) with the selected
+	filter. FALSE if the buffer or the tables can't be had: PresentSurface
+	lets StretchDIBits scale the surface instead
+*/
+BOOL ScaleForPresent(int cxDest, int cyDest)
+{
+	int xOrigin = 0, yOrigin = 0;
+
+	g_bWindowScaled = FALSE;
+
+	// the ring buffer is read in place, no need to unwrap it first
+	if (g_bScrolling) {
+		xOrigin = PositiveMod(g_Scroll.xScroll, g_Surface.cx);
+		yOrigin = PositiveMod(g_Scroll.yScroll, g_Surface.cy);
+	}
+
+	if (g_lpWindowBmi == NULL) {
+		if ((g_lpWindowBmi = CreateDIB(cxDest, cyDest, 32, &g_WindowSurface)) == NULL) {
+			TRACE("Error allocating the window sized surface\n");
+			return FALSE;
+		}
+	} else if (!ResizeSurface(&g_WindowSurface, cxDest, cyDest, 32, 0)) {
+		TRACE("Error allocating the window sized surface\n");
+		return FALSE;
+	}
+	SetDIBSize(g_lpWindowBmi, &g_WindowSurface);
+
+	if (!PrepareScaler(&g_Scaler, g_iScaler, g_Surface.cx, g_Surface.cy, cxDest, cyDest,
+					   xOrigin, yOrigin, g_Pool.nThreads)) {
+		TRACE("Error allocating scaler tables\n");
+		return FALSE;
+	}
+	RunScaler(&g_Pool, &g_Scaler, (uint32_t*)g_Surface.pBits, g_Surface.iPitch,
+			  (uint32_t*)g_WindowSurface.pBits, g_WindowSurface.iPitch);
+	g_bWindowScaled = TRUE;
+	return TRUE;
+}
+
+// surface (logical) position -> window position, as the scaler (bSoftware) or StretchDIBits put it
+void SurfaceToWindow(BOOL bSoftware, int x, int y, int cxDest, int cyDest, int* px, int* py)
+{
+	if (bSoftware && g_iScaler == SCALE_INTEGER) {
+		int k = g_Scaler.iFactor;
+		*px = (cxDest - g_Surface.cx * k) / 2 + x * k;
+		*py = (cyDest - g_Surface.cy * k) / 2 + y * k;
+		return;
+	}
+	*px = MulDiv(x, cxDest, g_Surface.cx);
+	*py = MulDiv(y, cyDest, g_Surface.cy);
+}
+
+/*
+	Blits the surface to the window, every piece on its own: StretchDIBits gets a
+	pointer to the first row of the piece and a header that says the bitmap is
+	only that many rows high (ySrc on top-down DIBs is measured from the bottom,
+	this way it is always 0)
+
+	pClip -> only this rect of the surface (damage rect), NULL for everything
+*/
+void PresentSurface(HDC hDC, int cxDest, int cyDest, const DAMAGERECT* pClip)
+{
+	SCROLLPIECE pieces[4];
+	BYTE bmiBuffer[sizeof(BITMAPINFO) + sizeof(RGBQUAD) * 256];
+	LPBITMAPINFO lpBmi = (LPBITMAPINFO)bmiBuffer;
+	int n = GetSurfacePieces(pieces);
+
+	// the render surface, its copy in the present format or the indexed one
+	const SURFACE* pShow = g_iPresentBpp == 32 ? &g_Surface : &g_PresentSurface;
+	LPBITMAPINFO lpShowBmi = g_iPresentBpp == 32 ? g_lpBmi : g_lpPresentBmi;
+	if (g_bPalette) {
+		pShow = &g_IndexSurface;
+		lpShowBmi = g_lpIndexBmi;
+	}
+
+	// software scaler: the window sized buffer goes 1:1; if it can't be had
+	// (no memory) StretchDIBits scales the surface as without the scaler
+	BOOL bSoftware = UseSoftwareScaler();
+	if (bSoftware && (!g_bWindowScaled || g_WindowSurface.cx != cxDest || g_WindowSurface.cy != cyDest)) {
+		bSoftware = ScaleForPresent(cxDest, cyDest);
+	}
+	if (bSoftware) {
+		pShow = &g_WindowSurface;
+		lpShowBmi = g_lpWindowBmi;
+		if (pClip == NULL) {
+			// already unwrapped and with the borders, in one go
+			n = 1;
+			pieces[0].xDest = pieces[0].xSrc = 0;
+			pieces[0].yDest = pieces[0].ySrc = 0;
+			pieces[0].cx = g_Surface.cx;
+			pieces[0].cy = g_Surface.cy;
+		}
+	}
+
+	CopyMemory(lpBmi, lpShowBmi, DIBInfoSize(lpShowBmi));
+
+	for (int i = 0; i < n; i++) {
+		int xSrc0 = pieces[i].xSrc, xSrc1 = pieces[i].xSrc + pieces[i].cx;
+		int ySrc0 = pieces[i].ySrc, ySrc1 = pieces[i].ySrc + pieces[i].cy;
+
+		if (pClip) {
+			xSrc0 = max(xSrc0, pClip->x0);
+			ySrc0 = max(ySrc0, pClip->y0);
+			xSrc1 = min(xSrc1, pClip->x1);
+			ySrc1 = min(ySrc1, pClip->y1);
+			if (xSrc0 >= xSrc1 || ySrc0 >= ySrc1) {
+				continue;
+			}
+		}
+
+		// where that part of the surface is in the window
+		int xLog = pieces[i].xDest + xSrc0 - pieces[i].xSrc;
+		int yLog = pieces[i].yDest + ySrc0 - pieces[i].ySrc;
+		int cx = xSrc1 - xSrc0, cy = ySrc1 - ySrc0;
+
+		// scale the edges, not the sizes, so the pieces meet without gaps
+		int x0, y0, x1, y1;
+		SurfaceToWindow(bSoftware, xLog, yLog, cxDest, cyDest, &x0, &y0);
+		SurfaceToWindow(bSoftware, xLog + cx, yLog + cy, cxDest, cyDest, &x1, &y1);
+
+		if (bSoftware) {
+			if (pClip == NULL) {
+				x0 = y0 = 0;
+				x1 = cxDest;
+				y1 = cyDest;
+			} else if (g_iScaler == SCALE_BILINEAR) {
+				// a surface pixel is blended into the window pixels one surface pixel around it
+				int dx = cxDest / g_Surface.cx + 1, dy = cyDest / g_Surface.cy + 1;
+				x0 = max(x0 - dx, 0);
+				y0 = max(y0 - dy, 0);
+				x1 = min(x1 + dx, cxDest);
+				y1 = min(y1 + dy, cyDest);
+			}
+			if (x0 >= x1 || y0 >= y1) {
+				continue;
+			}
+
+			lpBmi->bmiHeader.biHeight = -(y1 - y0);
+			StretchDIBits(hDC,
+						  x0, y0, x1 - x0, y1 - y0,
+						  x0, 0, x1 - x0, y1 - y0,	// 1:1, no scaling
+						  pShow->pBits + y0 * pShow->iPitch,
+						  lpBmi,
+						  DIB_RGB_COLORS, SRCCOPY);
+			continue;
+		}
+
+		lpBmi->bmiHeader.biHeight = -cy;
+		StretchDIBits(hDC,
+					  x0, y0, x1 - x0, y1 - y0,
+					  xSrc0, 0, cx, cy,
+					  pShow->pBits + ySrc0 * pShow->iPitch, // bitmap memory
+					  lpBmi, 		  		  // bitmap info
+					  DIB_RGB_COLORS, SRCCOPY);
+	}
+}
+
+// immediate mode: blit only the damaged rects of the last frame
+void PresentDamage(HWND hWnd)
+{
+	HDC hDC = GetDC(hWnd);
+	RECT rc;
+
+	GetClientRect(hWnd, &rc);
+	for (int i = 0; i < g_Damage.nRects; i++) {
+		PresentSurface(hDC, rc.right - rc.left, rc.bottom - rc.top, &g_Damage.rects[i]);
+	}
+	ReleaseDC(hWnd, hDC);
+
+	// average damaged area every ~2 seconds
+	if (g_Damage.stats.llFrames % 120 == 0) {
+		TRACE("damage: %d rects, %lld px last frame, %.1f%% of the surface on average, %lld frames untracked\n",
+			  g_Damage.stats.nRects, g_Damage.stats.llDamagedPixels,
+			  100.0 * g_Damage.stats.llDamagedSum / (g_Damage.stats.llFrames * g_Damage.stats.llTotalPixels),
+			  g_Damage.stats.llUntracked);
+	}
+}
+
 void OnPaint(HWND hWnd)
 {
 	static PAINTSTRUCT ps;
@@ -280,23 +693,109 @@ void OnPaint(HWND hWnd)
 
 	RECT rc;
 	GetClientRect(hWnd, &rc);
-	StretchDIBits(hDC, 
-				  0, 0, rc.right - rc.left, rc.bottom - rc.top, // window width and window height
-				  0, 0, DIB_WIDTH, DIB_HEIGHT, 
-				  (BYTE*)g_pBits, // bitmap memory
-				  g_lpBmi, 		  // bitmap info
-				  DIB_RGB_COLORS, SRCCOPY);
+	PresentSurface(hDC, rc.right - rc.left, rc.bottom - rc.top, NULL);
 
 	//SetDIBitsToDevice(hDC, 0, 0, DIB_WIDTH, DIB_HEIGHT, 0, 0, 0, DIB_HEIGHT, (BYTE*)g_pBits, g_lpBmi, DIB_RGB_COLORS);
 
 	EndPaint(hWnd, &ps);
 }
 
+void OnSize(HWND hWnd, UINT state, int cx, int cy)
+{
+	// minimized windows get 0x0, keep what we have
+	if (state != SIZE_MINIMIZED && cx > 0 && cy > 0) {
+		SetResolutionClient(&g_Resolution, cx, cy);
+		if (g_bFollowWindow) {
+			ResizeRenderSurfaces(g_Resolution.cx, g_Resolution.cy);
+			ConvertForPresent(NULL);
+		}
+	}
+}
+
 BOOL OnEraseBkgnd(HWND hWnd, HDC hdc)
 {
 	return TRUE;
 }
 
+void OnKey(HWND hWnd, UINT vk, BOOL fDown, int cRepeat, UINT flags)
+{
+	switch(vk) {
+	case 'S':	// scrolling surface on/off
+		g_bScrolling = !g_bScrolling;
+		TRACE("scrolling surface: %s\n", g_bScrolling ? "on" : "off");
+		break;
+
+	case 'D':	// damage tracking + partial presentation on/off
+		g_bDamage = !g_bDamage;
+		DamageAll(&g_Damage); // the window got whole frames meanwhile
+		TRACE("damage tracking: %s\n", g_bDamage ? "on" : "off");
+		break;
+
+	case 'F':	// next present format 32 -> 16 -> 15 -> 24 -> 8 -> 32
+		{
+			static const int formats[] = { 32, 16, 15, 24, 8 };
+			int i = 0;
+			while (formats[i] != g_iPresentBpp) {
+				i++;
+			}
+			SetPresentFormat(formats[(i + 1) % 5]);
+			ConvertForPresent(NULL);
+			InvalidateRect(hWnd, NULL, FALSE);
+		}
+		break;
+
+	case 'P':	// palette animation on/off
+		g_bPalette = !g_bPalette;
+		DamageAll(&g_Damage); // the window showed the other mode
+		TRACE("palette mode: %s\n", g_bPalette ? "on" : "off");
+		break;
+
+	case 'W':	// surface = client area * scale / fixed 640x480 stretched
+		g_bFollowWindow = !g_bFollowWindow;
+		if (g_bFollowWindow) {
+			ResizeRenderSurfaces(g_Resolution.cx, g_Resolution.cy);
+		} else {
+			ResizeRenderSurfaces(DIB_WIDTH, DIB_HEIGHT);
+		}
+		ConvertForPresent(NULL);
+		InvalidateRect(hWnd, NULL, FALSE);
+		break;
+
+	case 'R':	// automatic render scale on/off
+		g_Resolution.bAuto = !g_Resolution.bAuto;
+		TRACE("automatic render scale: %s (target %.1f ms)\n",
+			  g_Resolution.bAuto ? "on" : "off", g_Resolution.dTargetMs);
+		break;
+
+	case VK_OEM_PLUS:	// fixed render scale, 1/8 steps
+	case VK_OEM_MINUS:
+		g_Resolution.bAuto = FALSE;
+		SetResolutionScale(&g_Resolution, g_Resolution.fScale + (vk == VK_OEM_PLUS ? 0.125f : -0.125f));
+		TRACE("render scale: %.3f\n", g_Resolution.fScale);
+		if (g_bFollowWindow) {
+			ResizeRenderSurfaces(g_Resolution.cx, g_Resolution.cy);
+			ConvertForPresent(NULL);
+			InvalidateRect(hWnd, NULL, FALSE);
+		}
+		break;
+
+	case 'G':	// who scales the surface to the window: GDI -> nearest -> bilinear -> integer
+		g_iScaler = g_iScaler + 1 < SCALE_FILTER_COUNT ? g_iScaler + 1 : -1;
+		TRACE("scaler: %s\n", g_iScaler < 0 ? "StretchDIBits" : g_szScaleFilters[g_iScaler]);
+		if (UseSoftwareScaler()) {
+			RECT rc;
+			GetClientRect(hWnd, &rc);
+			ScaleForPresent(rc.right - rc.left, rc.bottom - rc.top);
+		}
+		InvalidateRect(hWnd, NULL, FALSE);
+		break;
+
+	case VK_SPACE:	// freeze the animation (static content, almost no damage)
+		g_bPaused = !g_bPaused;
+		break;
+	}
+}
+
 LRESULT CALLBACK WndProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
 {
 	switch(iMsg) {
@@ -304,7 +803,9 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
 		HANDLE_MSG(hWnd, WM_CREATE, OnCreate);
 		HANDLE_MSG(hWnd, WM_DESTROY, OnDestroy);
 		HANDLE_MSG(hWnd, WM_PAINT, OnPaint);
+		HANDLE_MSG(hWnd, WM_SIZE, OnSize);
 		HANDLE_MSG(hWnd, WM_ERASEBKGND, OnEraseBkgnd);
+		HANDLE_MSG(hWnd, WM_KEYDOWN, OnKey);
 	}
 
 	return DefWindowProc(hWnd, iMsg, wParam, lParam);	
@@ -351,6 +852,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	{
 		int xOffset = 0;
 		int yOffset = 0;
+		LONGLONG llRenderTicks = 0;
+		int nRenderFrames = 0;
+		FRAMEPACER pacer;
+
+		InitFramePacer(&pacer, FRAME_RATE);
 		Running = TRUE;
 		while(Running)
 		{	
@@ -366,7 +872,36 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 				DispatchMessage(&msg);
 			}
 
-			RenderGradient(xOffset, yOffset);
+			if (!g_bPaused) {
+				LARGE_INTEGER t0, t1;
+				QueryPerformanceCounter(&t0);
+				RenderGradient(xOffset, yOffset);
+				QueryPerformanceCounter(&t1);
+				llRenderTicks += t1.QuadPart - t0.QuadPart;
+
+				// automatic render scale: resize before the next frame if needed
+				if (g_bFollowWindow) {
+					LARGE_INTEGER freq;
+					QueryPerformanceFrequency(&freq);
+					if (UpdateResolution(&g_Resolution, 1000.0 * (t1.QuadPart - t0.QuadPart) / freq.QuadPart)) {
+						ResizeRenderSurfaces(g_Resolution.cx, g_Resolution.cy);
+						InvalidateRect(hWnd, NULL, FALSE);
+						TRACE("render scale: %.3f (%dx%d)\n", g_Resolution.fScale, g_Resolution.cx, g_Resolution.cy);
+					}
+				}
+
+				++xOffset;
+				++yOffset;
+
+				// cpu time spent rendering, averaged every 120 frames
+				if (++nRenderFrames == 120) {
+					LARGE_INTEGER freq;
+					QueryPerformanceFrequency(&freq);
+					TRACE("render: %.3f ms/frame\n", 1000.0 * llRenderTicks / freq.QuadPart / nRenderFrames);
+					llRenderTicks = 0;
+					nRenderFrames = 0;
+				}
+			}
 			
 		    // grab a screen DC and blit the DIB (immediate mode) ()
 		    //HDC hdc = GetDC(hWnd);
@@ -386,13 +921,53 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 		    //);
 		    //ReleaseDC(hWnd, hdc);
 
-			// invalidate mode (best practice)
-			InvalidateRect(hWnd, NULL, FALSE);
-			Sleep(1);
-
-			++xOffset;
-			++yOffset;
+			if (g_bPalette) {
+				// every pixel changes color, nothing to convert or track
+				InvalidateRect(hWnd, NULL, FALSE);
+			} else if (g_bDamage) {
+				// only what changed since the last frame goes to the window; a new
+				// ring buffer origin moves everything under it
+				if (g_bScrolling) {
+					SetDamageOrigin(&g_Damage, PositiveMod(g_Scroll.xScroll, g_Surface.cx),
+									PositiveMod(g_Scroll.yScroll, g_Surface.cy));
+				} else {
+					SetDamageOrigin(&g_Damage, 0, 0);
+				}
+				// paused: nothing was rendered, nothing to compare
+				if (!g_bPaused || g_Damage.bStale) {
+					DetectDamage(&g_Damage, (uint32_t*)g_Surface.pBits, g_Surface.iPitch);
+				}
+				ResolveDamage(&g_Damage);
+				for (int i = 0; i < g_Damage.nRects; i++) {
+					ConvertForPresent(&g_Damage.rects[i]);
+				}
+				if (UseSoftwareScaler() && g_Damage.nRects) {
+					RECT rc;
+					GetClientRect(hWnd, &rc);
+					ScaleForPresent(rc.right - rc.left, rc.bottom - rc.top);
+				}
+				PresentDamage(hWnd);
+			} else {
+				ConvertForPresent(NULL);
+				if (UseSoftwareScaler()) {
+					RECT rc;
+					GetClientRect(hWnd, &rc);
+					ScaleForPresent(rc.right - rc.left, rc.bottom - rc.top);
+				}
+				// invalidate mode (best practice)
+				InvalidateRect(hWnd, NULL, FALSE);
+			}
+			WaitNextFrame(&pacer);
+
+			// frame times every ~5 seconds
+			if (pacer.llFrames % 300 == 0) {
+				PACESTATS stats;
+				GetFramePacerStats(&pacer, &stats);
+				TRACE("frames: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, %lld missed deadlines\n",
+					  stats.p50, stats.p95, stats.p99, stats.llMissed);
+			}
 		}
+		FreeFramePacer(&pacer);
 	}
 
 	return msg.wParam;
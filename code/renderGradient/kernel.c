@@ -0,0 +1,173 @@
+/*
+	Gradient kernels (platform independent, no windows.h needed)
+	Notes:
+		- GradientRowsScalar is the original per-pixel loop from RenderGradient,
+		  kept as the bit-exact reference for the SIMD versions
+				(NOTE: in the blue term `+` and `%` bind before `<<`, so the value
+				 is always shifted left by 16 and the BYTE cast leaves 0)
+		- so every pixel is just 0x00RRGG00 with
+				RR = (x + xOffset) & 0xFF, GG = (y + yOffset) & 0xFF
+		- SSE2 writes 4 pixels, AVX2 8 and AVX-512 16 pixels per iteration
+		- InitGradientKernel() asks the cpu (GetCpuFeatures, ../common/cpu.c)
+		  once at startup and points g_pfnGradientRows to the widest kernel it
+		  can run
+
+	pBits  -> first pixel of the surface
+	iPitch -> bytes between two rows
+	y0,y1  -> rows [y0, y1) to write (so the surface can be split in bands)
+*/
+
+#include <stdint.h>
+
+#include "../common/cpu.c"
+
+#ifdef CPU_X86
+#define GRADIENT_X86 1
+#endif
+
+typedef void (*PFNGRADIENTROWS)(uint32_t* pBits, int iPitch, int cx,
+								int y0, int y1, int xOffset, int yOffset);
+
+#define ROW_PTR(pBits, iPitch, y) ((uint32_t*)((uint8_t*)(pBits) + (intptr_t)(y) * (iPitch)))
+
+static void GradientRowsScalar(uint32_t* pBits, int iPitch, int cx,
+							   int y0, int y1, int xOffset, int yOffset)
+{
+	for (int y = y0; y < y1; y++) {
+		for (int x = 0; x < cx; x++) {
+			uint32_t* pixel = ROW_PTR(pBits, iPitch, y) + x;
+			uint8_t r = (uint8_t)(x + xOffset% 256);										// red depends on x value
+			uint8_t g = (uint8_t)(y + yOffset% 256);										// green depends on y value
+			uint8_t b = (uint8_t)((uint32_t)((x + xOffset) + (y + yOffset)) << 16 % 256);				// blue depends on x and y values
+			*pixel = (r << 16) | (g << 8) | b;
+		}
+	}
+}
+
+// finishes the last (cx % lanes) pixels of a row for the SIMD kernels
+static void GradientTail(uint32_t* pRow, int x, int cx, int xOffset, uint32_t g)
+{
+	for (; x < cx; x++) {
+		pRow[x] = (((uint32_t)(x + xOffset) & 0xFF) << 16) | g;
+	}
+}
+
+#ifdef GRADIENT_X86
+
+static void GradientRowsSSE2(uint32_t* pBits, int iPitch, int cx,
+							 int y0, int y1, int xOffset, int yOffset)
+{
+	const __m128i vMask = _mm_set1_epi32(0xFF);
+	const __m128i vStep = _mm_set1_epi32(4);
+	const __m128i vStart = _mm_setr_epi32(xOffset, xOffset + 1, xOffset + 2, xOffset + 3);
+
+	for (int y = y0; y < y1; y++) {
+		uint32_t* pRow = ROW_PTR(pBits, iPitch, y);
+		uint32_t g = ((uint32_t)(y + yOffset) & 0xFF) << 8;
+		__m128i vG = _mm_set1_epi32((int)g);
+		__m128i vX = vStart;
+		int x = 0;
+
+		for (; x + 4 <= cx; x += 4) {
+			__m128i vR = _mm_slli_epi32(_mm_and_si128(vX, vMask), 16);
+			_mm_storeu_si128((__m128i*)(pRow + x), _mm_or_si128(vR, vG));
+			vX = _mm_add_epi32(vX, vStep);
+		}
+		GradientTail(pRow, x, cx, xOffset, g);
+	}
+}
+
+TARGET_AVX2
+static void GradientRowsAVX2(uint32_t* pBits, int iPitch, int cx,
+							 int y0, int y1, int xOffset, int yOffset)
+{
+	const __m256i vMask = _mm256_set1_epi32(0xFF);
+	const __m256i vStep = _mm256_set1_epi32(8);
+	const __m256i vStart = _mm256_add_epi32(_mm256_set1_epi32(xOffset),
+											_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+	for (int y = y0; y < y1; y++) {
+		uint32_t* pRow = ROW_PTR(pBits, iPitch, y);
+		uint32_t g = ((uint32_t)(y + yOffset) & 0xFF) << 8;
+		__m256i vG = _mm256_set1_epi32((int)g);
+		__m256i vX = vStart;
+		int x = 0;
+
+		for (; x + 8 <= cx; x += 8) {
+			__m256i vR = _mm256_slli_epi32(_mm256_and_si256(vX, vMask), 16);
+			_mm256_storeu_si256((__m256i*)(pRow + x), _mm256_or_si256(vR, vG));
+			vX = _mm256_add_epi32(vX, vStep);
+		}
+		GradientTail(pRow, x, cx, xOffset, g);
+	}
+}
+
+TARGET_AVX512
+static void GradientRowsAVX512(uint32_t* pBits, int iPitch, int cx,
+							   int y0, int y1, int xOffset, int yOffset)
+{
+	const __m512i vMask = _mm512_set1_epi32(0xFF);
+	const __m512i vStep = _mm512_set1_epi32(16);
+	const __m512i vStart = _mm512_add_epi32(_mm512_set1_epi32(xOffset),
+											_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+															  8, 9, 10, 11, 12, 13, 14, 15));
+
+	for (int y = y0; y < y1; y++) {
+		uint32_t* pRow = ROW_PTR(pBits, iPitch, y);
+		uint32_t g = ((uint32_t)(y + yOffset) & 0xFF) << 8;
+		__m512i vG = _mm512_set1_epi32((int)g);
+		__m512i vX = vStart;
+		int x = 0;
+
+		for (; x + 16 <= cx; x += 16) {
+			__m512i vR = _mm512_slli_epi32(_mm512_and_si512(vX, vMask), 16);
+			_mm512_storeu_si512((void*)(pRow + x), _mm512_or_si512(vR, vG));
+			vX = _mm512_add_epi32(vX, vStep);
+		}
+		GradientTail(pRow, x, cx, xOffset, g);
+	}
+}
+
+#endif // GRADIENT_X86
+
+typedef struct {
+	const char*     szName;
+	PFNGRADIENTROWS pfn;
+	unsigned int    uRequired; // cpu feature bits needed to run it
+} GRADIENTKERNEL;
+
+// ordered from the narrowest to the widest
+static const GRADIENTKERNEL g_GradientKernels[] = {
+	{ "scalar", GradientRowsScalar, 0 },
+#ifdef GRADIENT_X86
+	{ "sse2",   GradientRowsSSE2,   CPU_SSE2 },
+	{ "avx2",   GradientRowsAVX2,   CPU_AVX2 },
+	{ "avx512", GradientRowsAVX512, CPU_AVX512 },
+#endif
+};
+
+#define GRADIENT_KERNEL_COUNT ((int)(sizeof(g_GradientKernels) / sizeof(g_GradientKernels[0])))
+
+static unsigned int g_uCpuFeatures = 0;
+static PFNGRADIENTROWS g_pfnGradientRows = GradientRowsScalar;
+static const char* g_szGradientKernel = "scalar";
+
+static int IsGradientKernelSupported(int i)
+{
+	return (g_GradientKernels[i].uRequired & g_uCpuFeatures) == g_GradientKernels[i].uRequired;
+}
+
+// pick the widest kernel the cpu supports, returns its name
+static const char* InitGradientKernel(void)
+{
+	g_uCpuFeatures = GetCpuFeatures();
+
+	for (int i = 0; i < GRADIENT_KERNEL_COUNT; i++) {
+		if (IsGradientKernelSupported(i)) {
+			g_pfnGradientRows = g_GradientKernels[i].pfn;
+			g_szGradientKernel = g_GradientKernels[i].szName;
+		}
+	}
+
+	return g_szGradientKernel;
+}
@@ -0,0 +1,92 @@
+/*
+	Palette animation for the 8bpp DIB
+	Notes:
+		- the picture is written ONCE as palette indices, then every frame only the
+		  256 colors of bmiColors change: O(256) per frame instead of O(cx * cy)
+		- works for effects where the color is a function of one value that moves
+		  with time: here index = (x + y) & 0xFF, and ++xOffset, ++yOffset moves it
+		  by 2, so the palette is rotated by 2 entries per frame
+				(NOTE: the 32bpp gradient has an independent red and green so it
+				 needs 65536 colors, the indexed mode is the 1D version of it)
+		- BuildPaletteRamp makes a 256 color palette from a few color stops
+		  (linear interpolation, optionally wrapping from the last stop back to
+		  the first so the cycle has no seam)
+		- an RGBQUAD is B,G,R,0 in memory, which is a little-endian 0x00RRGGBB,
+		  so the palette is handled as uint32_t like the 32bpp pixels
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+	int      iIndex;   // 0..255, stops sorted by index
+	uint32_t color;    // 0x00RRGGBB
+} PALETTESTOP;
+
+static uint32_t LerpColor(uint32_t a, uint32_t b, int t, int range)
+{
+	uint32_t c = 0;
+
+	for (int shift = 0; shift <= 16; shift += 8) {
+		int ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+		int v = ca + ((cb - ca) * t + range / 2) / range;
+		c |= (uint32_t)v << shift;
+	}
+	return c;
+}
+
+/*
+	pPalette <- 256 colors going through the stops
+	bWrap    -> the entries after the last stop blend back into the first one
+				(for cycling), otherwise they repeat the end colors
+*/
+static void BuildPaletteRamp(uint32_t pPalette[256], const PALETTESTOP* pStops, int nStops, int bWrap)
+{
+	for (int i = 0; i < 256; i++) {
+		int j = 0;
+		while (j < nStops && pStops[j].iIndex <= i) {
+			j++;
+		}
+
+		// i is between stop j - 1 and stop j
+		if (j == 0 || j == nStops) {
+			const PALETTESTOP* pLast = &pStops[nStops - 1];
+			const PALETTESTOP* pFirst = &pStops[0];
+			if (!bWrap || nStops == 1) {
+				pPalette[i] = j == 0 ? pFirst->color : pLast->color;
+				continue;
+			}
+			int range = pFirst->iIndex + 256 - pLast->iIndex;
+			int t = (i - pLast->iIndex + 256) % 256;
+			pPalette[i] = LerpColor(pLast->color, pFirst->color, t, range);
+			continue;
+		}
+
+		const PALETTESTOP* a = &pStops[j - 1];
+		const PALETTESTOP* b = &pStops[j];
+		pPalette[i] = LerpColor(a->color, b->color, i - a->iIndex, b->iIndex - a->iIndex);
+	}
+}
+
+/*
+	Frame animation: pColors[i] = pBase[(i + iPhase) & 255], two memcpy
+	(pColors can be the bmiColors of the DIB)
+*/
+static void CyclePalette(uint32_t* pColors, const uint32_t pBase[256], int iPhase)
+{
+	int k = iPhase & 0xFF;
+
+	memcpy(pColors, pBase + k, (256 - k) * sizeof(uint32_t));
+	memcpy(pColors + 256 - k, pBase, k * sizeof(uint32_t));
+}
+
+// writes the indices once: index = (x + y) & 0xFF
+static void RenderIndexRamp(uint8_t* pBits, int iPitch, int cx, int cy)
+{
+	for (int y = 0; y < cy; y++) {
+		uint8_t* pRow = pBits + (intptr_t)y * iPitch;
+		for (int x = 0; x < cx; x++) {
+			pRow[x] = (uint8_t)(x + y);
+		}
+	}
+}
@@ -0,0 +1,419 @@
+/*
+	Pixel format conversion between ARGB32 and every CreateDIB format
+	Notes:
+		- formats are named by the iBpp of CreateDIB: 8 (palette, grayscale by
+		  default), 15 (555), 16 (565), 24 (BGR bytes), 32 (0x00RRGGBB)
+		- one side is always 32bpp, so 16bpp -> 8bpp goes through a 32bpp buffer
+		- rows are DIB_PITCH bytes apart by default (DWORD aligned, like GDI wants)
+		  but any pitch works
+		- SSE2 kernels for 555/565/gray, SSSE3 (pshufb) for 24bpp, 8bpp with a
+		  real palette is a table lookup (scalar, a gather is not faster here)
+		- 5/6 bit channels are expanded with bit replication so white stays white
+		  (0x1F -> 0xFF), gray is (77 R + 150 G + 29 B + 128) >> 8
+
+		In-place conversion (pDst == pSrc) works when:
+			- narrowing (32 -> 8/15/16/24): rows are done top-down, left to right,
+			  the dst pitch must be <= the src pitch
+			- widening (8/15/16/24 -> 32): rows are done bottom-up, right to left,
+			  the dst pitch must be >= the src pitch (the buffer must be big enough
+			  for the 32bpp image)
+		  every SIMD group loads its pixels before storing, and never stores over
+		  pixels not converted yet
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+// bytes in a DWORD aligned DIB row
+#define DIB_PITCH(cx, iBpp) ((((cx) * ((iBpp) == 15 ? 16 : (iBpp)) + 31) & ~31) >> 3)
+
+typedef void (*PFNCONVERTROW)(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette);
+
+/*
+	Scalar rows (the reference for the SIMD ones)
+*/
+static void Row32To565(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint16_t* d = (uint16_t*)pDst;
+	const uint32_t* s = (const uint32_t*)pSrc;
+
+	for (int x = 0; x < cx; x++) {
+		uint32_t p = s[x];
+		d[x] = (uint16_t)(((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F));
+	}
+}
+
+static void Row32To555(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint16_t* d = (uint16_t*)pDst;
+	const uint32_t* s = (const uint32_t*)pSrc;
+
+	for (int x = 0; x < cx; x++) {
+		uint32_t p = s[x];
+		d[x] = (uint16_t)(((p >> 9) & 0x7C00) | ((p >> 6) & 0x03E0) | ((p >> 3) & 0x001F));
+	}
+}
+
+static void Row32To24(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint8_t* d = (uint8_t*)pDst;
+	const uint32_t* s = (const uint32_t*)pSrc;
+
+	for (int x = 0; x < cx; x++) {
+		uint32_t p = s[x];
+		d[3 * x + 0] = (uint8_t)p;
+		d[3 * x + 1] = (uint8_t)(p >> 8);
+		d[3 * x + 2] = (uint8_t)(p >> 16);
+	}
+}
+
+static void Row32To8(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint8_t* d = (uint8_t*)pDst;
+	const uint32_t* s = (const uint32_t*)pSrc;
+
+	for (int x = 0; x < cx; x++) {
+		uint32_t p = s[x];
+		d[x] = (uint8_t)((77 * ((p >> 16) & 0xFF) + 150 * ((p >> 8) & 0xFF) + 29 * (p & 0xFF) + 128) >> 8);
+	}
+}
+
+static void Row32To32(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	memmove(pDst, pSrc, (size_t)cx * sizeof(uint32_t));
+}
+
+// widening rows go right to left (in-place safe)
+static void Row565To32(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint32_t* d = (uint32_t*)pDst;
+	const uint16_t* s = (const uint16_t*)pSrc;
+
+	for (int x = cx - 1; x >= 0; x--) {
+		uint32_t v = s[x];
+		uint32_t r = (v >> 11) & 0x1F, g = (v >> 5) & 0x3F, b = v & 0x1F;
+		d[x] = (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+	}
+}
+
+static void Row555To32(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint32_t* d = (uint32_t*)pDst;
+	const uint16_t* s = (const uint16_t*)pSrc;
+
+	for (int x = cx - 1; x >= 0; x--) {
+		uint32_t v = s[x];
+		uint32_t r = (v >> 10) & 0x1F, g = (v >> 5) & 0x1F, b = v & 0x1F;
+		d[x] = (((r << 3) | (r >> 2)) << 16) | (((g << 3) | (g >> 2)) << 8) | ((b << 3) | (b >> 2));
+	}
+}
+
+static void Row24To32(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint32_t* d = (uint32_t*)pDst;
+	const uint8_t* s = (const uint8_t*)pSrc;
+
+	for (int x = cx - 1; x >= 0; x--) {
+		d[x] = s[3 * x] | (s[3 * x + 1] << 8) | ((uint32_t)s[3 * x + 2] << 16);
+	}
+}
+
+// pPalette -> 256 0x00RRGGBB entries, NULL for the grayscale palette of CreateDIB
+static void Row8To32(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint32_t* d = (uint32_t*)pDst;
+	const uint8_t* s = (const uint8_t*)pSrc;
+
+	if (pPalette) {
+		for (int x = cx - 1; x >= 0; x--) {
+			d[x] = pPalette[s[x]];
+		}
+		return;
+	}
+	for (int x = cx - 1; x >= 0; x--) {
+		d[x] = s[x] * 0x00010101u;
+	}
+}
+
+#ifdef GRADIENT_X86
+
+/*
+	SIMD rows, same results as the scalar ones
+*/
+
+// 32 bit lanes -> sign extended low 16 bits, so packs_epi32 keeps the bits
+static __m128i Pack565Lanes(__m128i p, __m128i vMaskR, __m128i vMaskG, __m128i vMaskB,
+							int iShiftR, int iShiftG)
+{
+	__m128i v = _mm_or_si128(_mm_or_si128(
+					_mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(iShiftR)), vMaskR),
+					_mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(iShiftG)), vMaskG)),
+					_mm_and_si128(_mm_srli_epi32(p, 3), vMaskB));
+	return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+static void Row32To16SSE2(uint16_t* d, const uint32_t* s, int cx, int b565)
+{
+	const __m128i vMaskR = _mm_set1_epi32(b565 ? 0xF800 : 0x7C00);
+	const __m128i vMaskG = _mm_set1_epi32(b565 ? 0x07E0 : 0x03E0);
+	const __m128i vMaskB = _mm_set1_epi32(0x001F);
+	int iShiftR = b565 ? 8 : 9, iShiftG = b565 ? 5 : 6;
+	int x = 0;
+
+	for (; x + 8 <= cx; x += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(s + x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + x + 4));
+		a = Pack565Lanes(a, vMaskR, vMaskG, vMaskB, iShiftR, iShiftG);
+		b = Pack565Lanes(b, vMaskR, vMaskG, vMaskB, iShiftR, iShiftG);
+		_mm_storeu_si128((__m128i*)(d + x), _mm_packs_epi32(a, b));
+	}
+	if (b565) {
+		Row32To565(d + x, s + x, cx - x, NULL);
+	} else {
+		Row32To555(d + x, s + x, cx - x, NULL);
+	}
+}
+
+static void Row32To565SSE2(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	Row32To16SSE2((uint16_t*)pDst, (const uint32_t*)pSrc, cx, 1);
+}
+
+static void Row32To555SSE2(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	Row32To16SSE2((uint16_t*)pDst, (const uint32_t*)pSrc, cx, 0);
+}
+
+// 5 or 6 bit field already at the bottom of each 32 bit lane -> 8 bits
+static __m128i Expand5(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi32(v, 3), _mm_srli_epi32(v, 2));
+}
+
+static __m128i Expand6(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi32(v, 2), _mm_srli_epi32(v, 4));
+}
+
+static __m128i Unpack16Lanes(__m128i v, int b565)
+{
+	const __m128i vMask5 = _mm_set1_epi32(0x1F);
+	__m128i r, g, b;
+
+	if (b565) {
+		r = Expand5(_mm_and_si128(_mm_srli_epi32(v, 11), vMask5));
+		g = Expand6(_mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3F)));
+	} else {
+		r = Expand5(_mm_and_si128(_mm_srli_epi32(v, 10), vMask5));
+		g = Expand5(_mm_and_si128(_mm_srli_epi32(v, 5), vMask5));
+	}
+	b = Expand5(_mm_and_si128(v, vMask5));
+
+	return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+}
+
+static void Row16To32SSE2(uint32_t* d, const uint16_t* s, int cx, int b565)
+{
+	const __m128i vZero = _mm_setzero_si128();
+	int xSimd = cx & ~7;
+
+	// tail first: right to left
+	if (b565) {
+		Row565To32(d + xSimd, s + xSimd, cx - xSimd, NULL);
+	} else {
+		Row555To32(d + xSimd, s + xSimd, cx - xSimd, NULL);
+	}
+	for (int x = xSimd - 8; x >= 0; x -= 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + x));
+		__m128i lo = Unpack16Lanes(_mm_unpacklo_epi16(v, vZero), b565);
+		__m128i hi = Unpack16Lanes(_mm_unpackhi_epi16(v, vZero), b565);
+		_mm_storeu_si128((__m128i*)(d + x + 4), hi);
+		_mm_storeu_si128((__m128i*)(d + x), lo);
+	}
+}
+
+static void Row565To32SSE2(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	Row16To32SSE2((uint32_t*)pDst, (const uint16_t*)pSrc, cx, 1);
+}
+
+static void Row555To32SSE2(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	Row16To32SSE2((uint32_t*)pDst, (const uint16_t*)pSrc, cx, 0);
+}
+
+static __m128i GrayLanes(__m128i p)
+{
+	const __m128i vMask = _mm_set1_epi32(0xFF);
+	__m128i r = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(p, 16), vMask), _mm_set1_epi32(77));
+	__m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(p, 8), vMask), _mm_set1_epi32(150));
+	__m128i b = _mm_mullo_epi16(_mm_and_si128(p, vMask), _mm_set1_epi32(29));
+
+	// the sum is at most 65408, it still fits the low 16 bits of the lane
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(r, g), _mm_add_epi16(b, _mm_set1_epi32(128)));
+	return _mm_srli_epi32(sum, 8);
+}
+
+static void Row32To8SSE2(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint8_t* d = (uint8_t*)pDst;
+	const uint32_t* s = (const uint32_t*)pSrc;
+	int x = 0;
+
+	for (; x + 16 <= cx; x += 16) {
+		__m128i y0 = GrayLanes(_mm_loadu_si128((const __m128i*)(s + x)));
+		__m128i y1 = GrayLanes(_mm_loadu_si128((const __m128i*)(s + x + 4)));
+		__m128i y2 = GrayLanes(_mm_loadu_si128((const __m128i*)(s + x + 8)));
+		__m128i y3 = GrayLanes(_mm_loadu_si128((const __m128i*)(s + x + 12)));
+		__m128i v = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+		_mm_storeu_si128((__m128i*)(d + x), v);
+	}
+	Row32To8(d + x, s + x, cx - x, NULL);
+}
+
+static void Row8To32SSE2(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint32_t* d = (uint32_t*)pDst;
+	const uint8_t* s = (const uint8_t*)pSrc;
+	const __m128i vZero = _mm_setzero_si128();
+	int xSimd = cx & ~15;
+
+	if (pPalette) {
+		Row8To32(pDst, pSrc, cx, pPalette);
+		return;
+	}
+
+	Row8To32(d + xSimd, s + xSimd, cx - xSimd, NULL);
+	for (int x = xSimd - 16; x >= 0; x -= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + x));
+		__m128i lo = _mm_unpacklo_epi8(v, vZero);
+		__m128i hi = _mm_unpackhi_epi8(v, vZero);
+		__m128i q[4];
+		q[0] = _mm_unpacklo_epi16(lo, vZero);
+		q[1] = _mm_unpackhi_epi16(lo, vZero);
+		q[2] = _mm_unpacklo_epi16(hi, vZero);
+		q[3] = _mm_unpackhi_epi16(hi, vZero);
+		for (int i = 3; i >= 0; i--) {
+			__m128i g = _mm_or_si128(q[i], _mm_slli_epi32(q[i], 8));
+			_mm_storeu_si128((__m128i*)(d + x + 4 * i), _mm_or_si128(g, _mm_slli_epi32(q[i], 16)));
+		}
+	}
+}
+
+TARGET_SSSE3
+static void Row32To24SSSE3(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint8_t* d = (uint8_t*)pDst;
+	const uint32_t* s = (const uint32_t*)pSrc;
+	const __m128i vShuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	int x = 0;
+
+	// 4 pixels -> 12 bytes, but the store is 16: stop while it still fits the row
+	for (; 3 * x + 16 <= 3 * cx; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + x));
+		_mm_storeu_si128((__m128i*)(d + 3 * x), _mm_shuffle_epi8(v, vShuffle));
+	}
+	Row32To24(d + 3 * x, s + x, cx - x, NULL);
+}
+
+TARGET_SSSE3
+static void Row24To32SSSE3(void* pDst, const void* pSrc, int cx, const uint32_t* pPalette)
+{
+	uint32_t* d = (uint32_t*)pDst;
+	const uint8_t* s = (const uint8_t*)pSrc;
+	const __m128i vShuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	// groups of 4 pixels whose 16 byte load stays inside the row
+	int nGroups = 3 * cx >= 16 ? (3 * cx - 16) / 12 + 1 : 0;
+	int xSimd = nGroups * 4;
+
+	Row24To32(d + xSimd, s + 3 * xSimd, cx - xSimd, NULL);
+	for (int x = xSimd - 4; x >= 0; x -= 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + 3 * x));
+		_mm_storeu_si128((__m128i*)(d + x), _mm_shuffle_epi8(v, vShuffle));
+	}
+}
+
+#endif // GRADIENT_X86
+
+typedef struct {
+	int           iDstBpp, iSrcBpp;
+	PFNCONVERTROW pfnScalar;
+	PFNCONVERTROW pfnSimd;     // NULL when there is only the scalar one
+	unsigned int  uRequired;   // cpu feature bits for pfnSimd
+} PIXELCONVERTER;
+
+#ifdef GRADIENT_X86
+#define SIMD_ROW(pfn, uCpu) pfn, uCpu
+#else
+#define SIMD_ROW(pfn, uCpu) NULL, 0
+#endif
+
+static const PIXELCONVERTER g_PixelConverters[] = {
+	{ 16, 32, Row32To565, SIMD_ROW(Row32To565SSE2, CPU_SSE2) },
+	{ 15, 32, Row32To555, SIMD_ROW(Row32To555SSE2, CPU_SSE2) },
+	{ 24, 32, Row32To24,  SIMD_ROW(Row32To24SSSE3, CPU_SSSE3) },
+	{  8, 32, Row32To8,   SIMD_ROW(Row32To8SSE2,   CPU_SSE2) },
+	{ 32, 32, Row32To32,  NULL, 0 },
+	{ 32, 16, Row565To32, SIMD_ROW(Row565To32SSE2, CPU_SSE2) },
+	{ 32, 15, Row555To32, SIMD_ROW(Row555To32SSE2, CPU_SSE2) },
+	{ 32, 24, Row24To32,  SIMD_ROW(Row24To32SSSE3, CPU_SSSE3) },
+	{ 32,  8, Row8To32,   SIMD_ROW(Row8To32SSE2,   CPU_SSE2) },
+};
+
+#define PIXEL_CONVERTER_COUNT ((int)(sizeof(g_PixelConverters) / sizeof(g_PixelConverters[0])))
+
+static const PIXELCONVERTER* FindPixelConverter(int iDstBpp, int iSrcBpp)
+{
+	for (int i = 0; i < PIXEL_CONVERTER_COUNT; i++) {
+		if (g_PixelConverters[i].iDstBpp == iDstBpp && g_PixelConverters[i].iSrcBpp == iSrcBpp) {
+			return &g_PixelConverters[i];
+		}
+	}
+	return NULL;
+}
+
+// the row function ConvertPixels uses on this cpu
+static PFNCONVERTROW PickConvertRow(const PIXELCONVERTER* pConv)
+{
+	if (pConv->pfnSimd && (pConv->uRequired & g_uCpuFeatures) == pConv->uRequired) {
+		return pConv->pfnSimd;
+	}
+	return pConv->pfnScalar;
+}
+
+// runs a row function over the image in the order that keeps in-place safe
+static void ConvertRows(PFNCONVERTROW pfnRow, int bWiden,
+						void* pDst, int iDstPitch, const void* pSrc, int iSrcPitch,
+						int cx, int cy, const uint32_t* pPalette)
+{
+	if (bWiden) {
+		for (int y = cy - 1; y >= 0; y--) {
+			pfnRow((uint8_t*)pDst + (intptr_t)y * iDstPitch,
+				   (const uint8_t*)pSrc + (intptr_t)y * iSrcPitch, cx, pPalette);
+		}
+	} else {
+		for (int y = 0; y < cy; y++) {
+			pfnRow((uint8_t*)pDst + (intptr_t)y * iDstPitch,
+				   (const uint8_t*)pSrc + (intptr_t)y * iSrcPitch, cx, pPalette);
+		}
+	}
+}
+
+/*
+	Converts a cx by cy image, returns FALSE (0) for pairs without a 32bpp side
+
+	pPalette -> only for 8bpp -> 32bpp, NULL means grayscale
+*/
+static int ConvertPixels(void* pDst, int iDstPitch, int iDstBpp,
+						 const void* pSrc, int iSrcPitch, int iSrcBpp,
+						 int cx, int cy, const uint32_t* pPalette)
+{
+	const PIXELCONVERTER* pConv = FindPixelConverter(iDstBpp, iSrcBpp);
+
+	if (pConv == NULL) {
+		return 0;
+	}
+	ConvertRows(PickConvertRow(pConv), iDstBpp > iSrcBpp, pDst, iDstPitch, pSrc, iSrcPitch,
+				cx, cy, pPalette);
+	return 1;
+}
@@ -0,0 +1,188 @@
+/*
+	Render resolution controller (platform independent, no windows.h needed)
+	Notes:
+		- the render surface is the client area times fScale (1.0 = one surface
+		  pixel per window pixel, nothing for the GDI scaler to do)
+		- fixed mode: fScale is whatever the user set (SetResolutionScale)
+		- automatic mode (dynamic resolution scaling): after each frame we get its
+		  cost, keep an exponential average and, when it is out of the
+		  [fLow, fHigh] band around the target, move the scale so the average
+		  would land in the middle of the band (fAim), not on its edge: a
+		  frame cost has noise, aiming at 1.0 with the top at 1.05 was out of
+		  the band again after a few frames
+				(NOTE: the cost of a frame goes with the number of pixels, so the
+				 new scale is scale * sqrt(aim * target / average))
+		- hysteresis: the average has to stay out of the band on the same side
+		  for RES_CONFIRM frames (3x as long under it: too slow costs frames,
+		  too cheap only costs pixels), and a change is at most RES_MAX_DOWN /
+		  RES_MAX_UP of the scale (a wrong guess costs one small step) and at
+		  least RES_DEAD (no resize for nothing)
+		- a scale that was too expensive is a ceiling for RES_CEILING frames:
+		  the cost of a frame is not exactly quadratic in the scale (caches),
+		  going back up to it from below would only come down again
+		- changes are rate limited (RES_COOLDOWN frames) and the surface size is
+		  rounded to RES_QUANTUM pixels so the scale does not jitter every frame
+		  and the surface is not resized for one pixel
+		- UpdateResolution only says what size the surface should have, the
+		  caller resizes (ResizeSurface in surface.c reuses the buffer)
+*/
+
+#include <math.h>
+
+#define RES_QUANTUM  8      // surface sizes are multiples of this
+#define RES_COOLDOWN 15     // frames between two automatic changes
+#define RES_CONFIRM  8      // frames over the band before a change, 3x that under it
+#define RES_MAX_DOWN 0.8    // largest step down per change (scale factor)
+#define RES_MAX_UP   1.1    // largest step up
+#define RES_DEAD     0.02f  // smaller scale changes are dropped
+#define RES_CEILING  600    // frames a too expensive scale stays off limits
+
+typedef struct {
+	int    cxClient, cyClient;  // what the window shows
+	int    cx, cy;              // what we render
+	float  fScale;              // cx ~= cxClient * fScale
+	float  fMinScale, fMaxScale;
+	int    bAuto;               // dynamic resolution scaling
+
+	double dTargetMs;           // wanted frame cost
+	double dAverageMs;          // exponential average of the frame cost
+	float  fLow, fHigh;         // no change while average/target is in [fLow, fHigh]
+	float  fAim;                // a change aims at average/target = fAim
+	int    nCooldown;           // frames to wait before the next change
+	int    nOutside;            // frames out of the band, > 0 over it, < 0 under it
+	float  fCeiling;            // the last scale that was over the band
+	int    nCeiling;            // frames fCeiling still holds
+	int    nChanges;            // stats: automatic scale changes
+} RESOLUTION;
+
+static void InitResolution(RESOLUTION* pRes, double dTargetMs)
+{
+	pRes->cxClient = pRes->cyClient = 0;
+	pRes->cx = pRes->cy = 0;
+	pRes->fScale = 1.0f;
+	pRes->fMinScale = 0.25f;
+	pRes->fMaxScale = 1.0f;
+	pRes->bAuto = 0;
+	pRes->dTargetMs = dTargetMs;
+	pRes->dAverageMs = 0.0;
+	pRes->fLow = 0.75f;
+	pRes->fHigh = 1.05f;
+	pRes->fAim = 0.9f;
+	pRes->nCooldown = 0;
+	pRes->nOutside = 0;
+	pRes->fCeiling = 1.0f;
+	pRes->nCeiling = 0;
+	pRes->nChanges = 0;
+}
+
+static int ResolutionDim(int iClient, float fScale)
+{
+	int i = (int)(iClient * fScale + 0.5f);
+	i = (i + RES_QUANTUM / 2) / RES_QUANTUM * RES_QUANTUM;
+	if (i < RES_QUANTUM) {
+		i = iClient < RES_QUANTUM ? iClient : RES_QUANTUM;
+	}
+	return i > iClient ? iClient : i;
+}
+
+// recomputes cx, cy, returns TRUE (1) if they changed
+static int ApplyResolution(RESOLUTION* pRes)
+{
+	int cx = ResolutionDim(pRes->cxClient, pRes->fScale);
+	int cy = ResolutionDim(pRes->cyClient, pRes->fScale);
+
+	if (cx < 1) cx = 1;
+	if (cy < 1) cy = 1;
+	if (cx == pRes->cx && cy == pRes->cy) {
+		return 0;
+	}
+	pRes->cx = cx;
+	pRes->cy = cy;
+	return 1;
+}
+
+static int SetResolutionClient(RESOLUTION* pRes, int cxClient, int cyClient)
+{
+	pRes->cxClient = cxClient;
+	pRes->cyClient = cyClient;
+	return ApplyResolution(pRes);
+}
+
+static int SetResolutionScale(RESOLUTION* pRes, float fScale)
+{
+	if (fScale < pRes->fMinScale) fScale = pRes->fMinScale;
+	if (fScale > pRes->fMaxScale) fScale = pRes->fMaxScale;
+	pRes->fScale = fScale;
+	return ApplyResolution(pRes);
+}
+
+/*
+	Call once per frame with what the frame cost (ms, cpu time of the work that
+	depends on the surface size). Returns TRUE (1) when the surface has to be
+	resized to pRes->cx, pRes->cy
+*/
+static int UpdateResolution(RESOLUTION* pRes, double dFrameMs)
+{
+	// the first frame (or the first after a change) sets the average
+	if (pRes->dAverageMs <= 0.0) {
+		pRes->dAverageMs = dFrameMs;
+	} else {
+		pRes->dAverageMs += (dFrameMs - pRes->dAverageMs) * 0.1;
+	}
+
+	if (!pRes->bAuto) {
+		return 0;
+	}
+	if (pRes->nCeiling > 0) {
+		pRes->nCeiling--;
+	}
+	if (pRes->nCooldown > 0) {
+		pRes->nCooldown--;
+		return 0;
+	}
+
+	double dRatio = pRes->dAverageMs / pRes->dTargetMs;
+	if (dRatio >= pRes->fLow && dRatio <= pRes->fHigh) {
+		pRes->nOutside = 0;
+		return 0;
+	}
+
+	// out on the same side for a while, not a spike
+	if (dRatio > pRes->fHigh) {
+		pRes->nOutside = pRes->nOutside > 0 ? pRes->nOutside + 1 : 1;
+	} else {
+		pRes->nOutside = pRes->nOutside < 0 ? pRes->nOutside - 1 : -1;
+	}
+	if (pRes->nOutside < RES_CONFIRM && pRes->nOutside > -3 * RES_CONFIRM) {
+		return 0;
+	}
+
+	// area goes with the cost, one side with its square root
+	double dStep = sqrt(pRes->fAim / dRatio);
+	if (dStep < RES_MAX_DOWN) dStep = RES_MAX_DOWN;
+	if (dStep > RES_MAX_UP) dStep = RES_MAX_UP;
+
+	float fOld = pRes->fScale;
+	float fNew = (float)(pRes->fScale * dStep);
+	if (fNew < pRes->fMinScale) fNew = pRes->fMinScale;
+	if (fNew > pRes->fMaxScale) fNew = pRes->fMaxScale;
+	if (dStep > 1.0 && pRes->nCeiling > 0 && fNew > pRes->fCeiling - RES_DEAD) {
+		fNew = pRes->fCeiling - RES_DEAD;
+	}
+	if (fNew == fOld || (fabsf(fNew - fOld) < RES_DEAD && fNew > pRes->fMinScale && fNew < pRes->fMaxScale)) {
+		return 0;
+	}
+	if (dStep < 1.0) {
+		pRes->fCeiling = fOld;
+		pRes->nCeiling = RES_CEILING;
+	}
+	int bChanged = SetResolutionScale(pRes, fNew);
+	pRes->nOutside = 0;
+	if (pRes->fScale != fOld) {
+		// the average belongs to the old size, restart it from the prediction
+		pRes->dAverageMs *= (double)(pRes->fScale * pRes->fScale) / ((double)fOld * fOld);
+		pRes->nCooldown = RES_COOLDOWN;
+		pRes->nChanges++;
+	}
+	return bChanged;
+}
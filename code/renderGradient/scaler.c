@@ -0,0 +1,448 @@
+/*
+	Software scaler for the 32bpp surface (so presentation is a 1:1 blit)
+	Notes:
+		- three filters:
+				nearest  -> every window pixel takes the closest surface pixel
+				bilinear -> blend of the 4 closest, 8 bit weights
+				integer  -> every surface pixel becomes k x k window pixels, the
+							biggest k that fits, centered with black borders
+		- PrepareScaler builds, once per size change, a table per window column
+		  and per window row (source pixel, its right/lower neighbour and the
+		  weight of the neighbour), the row kernels only look things up
+		- the source can be the ring buffer of scroll.c: xOrigin, yOrigin say
+		  where its logical (0,0) is, the tables already hold physical positions
+		- bilinear is done in two passes: the two source rows are blended into a
+		  temporary row (SSE2, 4 pixels at a time), then pairs of that row are
+		  blended for each window pixel (SSE2, 2 pixels at a time)
+		- nearest uses the AVX2 gather (8 pixels at a time), integer takes 4
+		  source pixels at a time and writes their 4k copies with SSE2 stores
+		  (unpack for k = 2, shuffles for k = 3, a broadcast per pixel above)
+		- window rows mapped to the same source row(s) as the row above are a
+		  memcpy of it, a 3x upscale computes only one row in three
+		- RunScaler splits the window rows in bands over the worker pool, each
+		  band has its own temporary row; the scalar kernels are the reference
+		  the SIMD ones must match bit for bit
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCALE_NEAREST      0
+#define SCALE_BILINEAR     1
+#define SCALE_INTEGER      2
+#define SCALE_FILTER_COUNT 3
+
+static const char* g_szScaleFilters[SCALE_FILTER_COUNT] = { "nearest", "bilinear", "integer" };
+
+typedef struct {
+	int       iFilter;
+	int       cxSrc, cySrc;
+	int       cxDst, cyDst;
+	int       xOrigin, yOrigin;  // physical position of the logical (0,0) of the source
+	int       bSimd;             // FALSE -> scalar reference kernels
+
+	// per window column / row: physical source pixel (-1 = border), neighbour, weight of the neighbour
+	int*      pX0;
+	int*      pX1;
+	int*      pXW;
+	int*      pY0;
+	int*      pY1;
+	int*      pYW;
+	int       cxTables, cyTables;    // allocated entries
+
+	int       iFactor;           // integer filter
+	int       nBands, iBandHeight;
+	uint32_t* pTemp;             // nBands temporary rows of cxSrc pixels (bilinear)
+	size_t    cTemp;             // allocated pixels
+} SCALER;
+
+static void FreeScaler(SCALER* pScaler)
+{
+	free(pScaler->pX0); // all 6 tables
+	free(pScaler->pTemp);
+	memset(pScaler, 0, sizeof(*pScaler));
+}
+
+// logical -> physical on the ring buffer
+static int ScalerWrap(int i, int iOrigin, int n)
+{
+	i += iOrigin;
+	return i >= n ? i - n : i;
+}
+
+/*
+	Fills one axis: iDst window pixels over iSrc surface pixels
+*/
+static void BuildScaleTable(int iFilter, int iFactor, int iSrc, int iDst, int iOrigin,
+							int* p0, int* p1, int* pW)
+{
+	int iBorder = (iDst - iSrc * iFactor) / 2; // integer filter, < 0 crops the source
+
+	for (int i = 0; i < iDst; i++) {
+		int s0, s1, w = 0;
+
+		if (iFilter == SCALE_BILINEAR) {
+			// center of the window pixel in source pixels, 16.16, minus half a pixel
+			long long s16 = ((long long)(2 * i + 1) * iSrc << 16) / (2 * iDst) - 0x8000;
+			if (s16 < 0) {
+				s16 = 0;
+			}
+			s0 = (int)(s16 >> 16);
+			w = (int)(s16 >> 8) & 0xFF;
+			if (s0 >= iSrc - 1) {
+				s0 = iSrc - 1;
+				w = 0;
+			}
+			s1 = s0 + 1 < iSrc ? s0 + 1 : s0;
+		} else if (iFilter == SCALE_INTEGER) {
+			int d = i - iBorder;
+			if (d < 0 || d >= iSrc * iFactor) {
+				p0[i] = p1[i] = -1;
+				pW[i] = 0;
+				continue;
+			}
+			s0 = s1 = d / iFactor;
+		} else {
+			s0 = s1 = (int)((long long)(2 * i + 1) * iSrc / (2 * iDst));
+		}
+
+		p0[i] = ScalerWrap(s0, iOrigin, iSrc);
+		p1[i] = ScalerWrap(s1, iOrigin, iSrc);
+		pW[i] = w;
+	}
+}
+
+/*
+	Gets the scaler ready for this frame, the tables are rebuilt only when
+	something changed (origin included, that is O(cxDst + cyDst)).
+	Returns FALSE (0) if out of memory
+*/
+static int PrepareScaler(SCALER* pScaler, int iFilter, int cxSrc, int cySrc, int cxDst, int cyDst,
+						 int xOrigin, int yOrigin, int nThreads)
+{
+	if (pScaler->pX0 && pScaler->iFilter == iFilter &&
+		pScaler->cxSrc == cxSrc && pScaler->cySrc == cySrc &&
+		pScaler->cxDst == cxDst && pScaler->cyDst == cyDst &&
+		pScaler->xOrigin == xOrigin && pScaler->yOrigin == yOrigin) {
+		return 1;
+	}
+
+	// one block for the 6 tables, grow-only
+	if (cxDst > pScaler->cxTables || cyDst > pScaler->cyTables) {
+		int* p = (int*)malloc(3 * ((size_t)cxDst + cyDst) * sizeof(int));
+		if (p == NULL) {
+			return 0;
+		}
+		free(pScaler->pX0);
+		pScaler->pX0 = p;
+		pScaler->cxTables = cxDst;
+		pScaler->cyTables = cyDst;
+	}
+	pScaler->pX1 = pScaler->pX0 + cxDst;
+	pScaler->pXW = pScaler->pX1 + cxDst;
+	pScaler->pY0 = pScaler->pXW + cxDst;
+	pScaler->pY1 = pScaler->pY0 + cyDst;
+	pScaler->pYW = pScaler->pY1 + cyDst;
+
+	pScaler->iFilter = iFilter;
+	pScaler->cxSrc = cxSrc;
+	pScaler->cySrc = cySrc;
+	pScaler->cxDst = cxDst;
+	pScaler->cyDst = cyDst;
+	pScaler->xOrigin = xOrigin;
+	pScaler->yOrigin = yOrigin;
+
+	pScaler->iFactor = 1;
+	if (iFilter == SCALE_INTEGER) {
+		int kx = cxDst / cxSrc, ky = cyDst / cySrc;
+		pScaler->iFactor = kx < ky ? kx : ky;
+		if (pScaler->iFactor < 1) {
+			pScaler->iFactor = 1;
+		}
+	}
+
+	BuildScaleTable(iFilter, pScaler->iFactor, cxSrc, cxDst, xOrigin, pScaler->pX0, pScaler->pX1, pScaler->pXW);
+	BuildScaleTable(iFilter, pScaler->iFactor, cySrc, cyDst, yOrigin, pScaler->pY0, pScaler->pY1, pScaler->pYW);
+
+	// bands like RenderGradientTiled: ~4 per thread, at least 8 rows
+	int nBands = nThreads * 4;
+	pScaler->iBandHeight = (cyDst + nBands - 1) / nBands;
+	if (pScaler->iBandHeight < 8) {
+		pScaler->iBandHeight = 8;
+	}
+	pScaler->nBands = (cyDst + pScaler->iBandHeight - 1) / pScaler->iBandHeight;
+
+	if (iFilter == SCALE_BILINEAR && (size_t)pScaler->nBands * cxSrc > pScaler->cTemp) {
+		free(pScaler->pTemp);
+		pScaler->cTemp = (size_t)pScaler->nBands * cxSrc;
+		pScaler->pTemp = (uint32_t*)malloc(pScaler->cTemp * sizeof(uint32_t));
+		if (pScaler->pTemp == NULL) {
+			pScaler->cTemp = 0;
+			pScaler->iFilter = -1; // force a rebuild next time
+			return 0;
+		}
+	}
+
+	pScaler->bSimd = (g_uCpuFeatures & CPU_SSE2) != 0;
+	return 1;
+}
+
+/*
+	Scalar reference kernels
+*/
+
+// per channel a + (b - a) * w / 256, as (a * (256 - w) + b * w) >> 8
+static uint32_t LerpPixel(uint32_t a, uint32_t b, int w)
+{
+	uint32_t c = 0;
+
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+		c |= ((ca * (256 - w) + cb * w) >> 8) << shift;
+	}
+	return c;
+}
+
+static void NearestRow(uint32_t* pDst, const uint32_t* pSrc, const int* pX0, int cx)
+{
+	for (int x = 0; x < cx; x++) {
+		pDst[x] = pX0[x] < 0 ? 0 : pSrc[pX0[x]];
+	}
+}
+
+static void BlendRows(uint32_t* pDst, const uint32_t* pA, const uint32_t* pB, int w, int cx)
+{
+	for (int x = 0; x < cx; x++) {
+		pDst[x] = LerpPixel(pA[x], pB[x], w);
+	}
+}
+
+static void BilinearRow(uint32_t* pDst, const uint32_t* pSrc, const int* pX0, const int* pX1, const int* pXW, int cx)
+{
+	for (int x = 0; x < cx; x++) {
+		pDst[x] = LerpPixel(pSrc[pX0[x]], pSrc[pX1[x]], pXW[x]);
+	}
+}
+
+#ifdef GRADIENT_X86
+
+TARGET_AVX2
+static void NearestRowAVX2(uint32_t* pDst, const uint32_t* pSrc, const int* pX0, int cx)
+{
+	int x = 0;
+	for (; x + 8 <= cx; x += 8) {
+		__m256i vIndex = _mm256_loadu_si256((const __m256i*)(pX0 + x));
+		_mm256_storeu_si256((__m256i*)(pDst + x), _mm256_i32gather_epi32((const int*)pSrc, vIndex, 4));
+	}
+	NearestRow(pDst + x, pSrc, pX0 + x, cx - x);
+}
+
+static void BlendRowsSSE2(uint32_t* pDst, const uint32_t* pA, const uint32_t* pB, int w, int cx)
+{
+	const __m128i vZero = _mm_setzero_si128();
+	const __m128i vWa = _mm_set1_epi16((short)(256 - w));
+	const __m128i vWb = _mm_set1_epi16((short)w);
+	int x = 0;
+
+	for (; x + 4 <= cx; x += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(pA + x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pB + x));
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, vZero), vWa),
+								   _mm_mullo_epi16(_mm_unpacklo_epi8(b, vZero), vWb));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, vZero), vWa),
+								   _mm_mullo_epi16(_mm_unpackhi_epi8(b, vZero), vWb));
+		_mm_storeu_si128((__m128i*)(pDst + x),
+						 _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	BlendRows(pDst + x, pA + x, pB + x, w, cx - x);
+}
+
+static void BilinearRowSSE2(uint32_t* pDst, const uint32_t* pSrc, const int* pX0, const int* pX1, const int* pXW, int cx)
+{
+	const __m128i vZero = _mm_setzero_si128();
+	const __m128i v256 = _mm_set1_epi16(256);
+	int x = 0;
+
+	// two window pixels: [left0, left1] blended with [right0, right1]
+	for (; x + 2 <= cx; x += 2) {
+		__m128i vLeft = _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)pSrc[pX0[x]]),
+										   _mm_cvtsi32_si128((int)pSrc[pX0[x + 1]]));
+		__m128i vRight = _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)pSrc[pX1[x]]),
+											_mm_cvtsi32_si128((int)pSrc[pX1[x + 1]]));
+		__m128i vW = _mm_set_epi16((short)pXW[x + 1], (short)pXW[x + 1], (short)pXW[x + 1], (short)pXW[x + 1],
+								   (short)pXW[x], (short)pXW[x], (short)pXW[x], (short)pXW[x]);
+		__m128i v = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vLeft, vZero), _mm_sub_epi16(v256, vW)),
+								  _mm_mullo_epi16(_mm_unpacklo_epi8(vRight, vZero), vW));
+		_mm_storel_epi64((__m128i*)(pDst + x), _mm_packus_epi16(_mm_srli_epi16(v, 8), vZero));
+	}
+	BilinearRow(pDst + x, pSrc, pX0 + x, pX1 + x, pXW + x, cx - x);
+}
+
+static void IntegerRowSSE2(uint32_t* pDst, const uint32_t* pSrc, const int* pX0, int cx, int k)
+{
+	int x = 0;
+
+	while (x < cx) {
+		// border: black up to the next mapped pixel
+		if (pX0[x] < 0) {
+			int x1 = x + 1;
+			while (x1 < cx && pX0[x1] < 0) {
+				x1++;
+			}
+			memset(pDst + x, 0, (x1 - x) * sizeof(uint32_t));
+			x = x1;
+			continue;
+		}
+
+		// start of a group of k, 4 contiguous source pixels: 4k window pixels
+		if (k > 1 && x + 4 * k <= cx && pX0[x + 4 * k - 1] == pX0[x] + 3 && (x == 0 || pX0[x - 1] != pX0[x])) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + pX0[x]));
+			if (k == 2) {
+				_mm_storeu_si128((__m128i*)(pDst + x), _mm_unpacklo_epi32(v, v));
+				_mm_storeu_si128((__m128i*)(pDst + x + 4), _mm_unpackhi_epi32(v, v));
+			} else if (k == 3) {
+				// a a a b | b b c c | c d d d
+				_mm_storeu_si128((__m128i*)(pDst + x), _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+				_mm_storeu_si128((__m128i*)(pDst + x + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+				_mm_storeu_si128((__m128i*)(pDst + x + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+			} else {
+				// each source pixel broadcast, its k copies in 4 wide stores (the
+				// last one overlaps the one before when k is not a multiple of 4)
+				__m128i vPixel[4];
+				vPixel[0] = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 0, 0, 0));
+				vPixel[1] = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1));
+				vPixel[2] = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 2, 2));
+				vPixel[3] = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+				for (int j = 0; j < 4; j++) {
+					uint32_t* p = pDst + x + j * k;
+					int i = 0;
+					for (; i + 4 <= k; i += 4) {
+						_mm_storeu_si128((__m128i*)(p + i), vPixel[j]);
+					}
+					if (i < k) {
+						_mm_storeu_si128((__m128i*)(p + k - 4), vPixel[j]);
+					}
+				}
+			}
+			x += 4 * k;
+			continue;
+		}
+
+		// the copies of one source pixel, 4 at a time
+		int i = pX0[x];
+		int x1 = x + 1;
+		while (x1 < cx && pX0[x1] == i) {
+			x1++;
+		}
+		__m128i v = _mm_set1_epi32((int)pSrc[i]);
+		for (; x + 4 <= x1; x += 4) {
+			_mm_storeu_si128((__m128i*)(pDst + x), v);
+		}
+		for (; x < x1; x++) {
+			pDst[x] = pSrc[i];
+		}
+	}
+}
+
+#endif // GRADIENT_X86
+
+typedef struct {
+	const SCALER*   pScaler;
+	const uint32_t* pSrc;
+	int             iSrcPitch;
+	uint32_t*       pDst;
+	int             iDstPitch;
+} SCALEJOB;
+
+#define SCALE_ROW(p, iPitch, y) ((uint32_t*)((uint8_t*)(p) + (intptr_t)(y) * (iPitch)))
+
+// same source row(s) and weight as the window row above
+static int SameScaleRow(const SCALER* s, int y)
+{
+	return s->pY0[y] == s->pY0[y - 1] && s->pY1[y] == s->pY1[y - 1] && s->pYW[y] == s->pYW[y - 1];
+}
+
+static void ScaleBandJob(void* pContext, int iJob, int nJobs)
+{
+	SCALEJOB* pJob = (SCALEJOB*)pContext;
+	const SCALER* s = pJob->pScaler;
+	int y0 = iJob * s->iBandHeight;
+	int y1 = y0 + s->iBandHeight < s->cyDst ? y0 + s->iBandHeight : s->cyDst;
+	int bSimd = s->bSimd;
+	int bAvx2 = bSimd && (g_uCpuFeatures & CPU_AVX2);
+
+	for (int y = y0; y < y1; y++) {
+		uint32_t* pDst = SCALE_ROW(pJob->pDst, pJob->iDstPitch, y);
+
+		if (s->pY0[y] < 0) {
+			memset(pDst, 0, s->cxDst * sizeof(uint32_t));
+			continue;
+		}
+		if (y > y0 && SameScaleRow(s, y)) {
+			memcpy(pDst, SCALE_ROW(pJob->pDst, pJob->iDstPitch, y - 1), s->cxDst * sizeof(uint32_t));
+			continue;
+		}
+
+		const uint32_t* pRow = SCALE_ROW(pJob->pSrc, pJob->iSrcPitch, s->pY0[y]);
+
+		switch (s->iFilter) {
+		case SCALE_BILINEAR:
+			if (s->pYW[y]) {
+				// blend the two source rows first, then work on that
+				uint32_t* pTemp = s->pTemp + (size_t)iJob * s->cxSrc;
+				const uint32_t* pNext = SCALE_ROW(pJob->pSrc, pJob->iSrcPitch, s->pY1[y]);
+#ifdef GRADIENT_X86
+				if (bSimd) {
+					BlendRowsSSE2(pTemp, pRow, pNext, s->pYW[y], s->cxSrc);
+				} else
+#endif
+				BlendRows(pTemp, pRow, pNext, s->pYW[y], s->cxSrc);
+				pRow = pTemp;
+			}
+#ifdef GRADIENT_X86
+			if (bSimd) {
+				BilinearRowSSE2(pDst, pRow, s->pX0, s->pX1, s->pXW, s->cxDst);
+				break;
+			}
+#endif
+			BilinearRow(pDst, pRow, s->pX0, s->pX1, s->pXW, s->cxDst);
+			break;
+
+		case SCALE_INTEGER:
+#ifdef GRADIENT_X86
+			if (bSimd) {
+				IntegerRowSSE2(pDst, pRow, s->pX0, s->cxDst, s->iFactor);
+				break;
+			}
+#endif
+			NearestRow(pDst, pRow, s->pX0, s->cxDst);
+			break;
+
+		default:
+#ifdef GRADIENT_X86
+			if (bAvx2) {
+				NearestRowAVX2(pDst, pRow, s->pX0, s->cxDst);
+				break;
+			}
+#endif
+			NearestRow(pDst, pRow, s->pX0, s->cxDst);
+			break;
+		}
+	}
+}
+
+// pSrc (cxSrc x cySrc of PrepareScaler) -> pDst (cxDst x cyDst), on the pool
+static void RunScaler(WORKERPOOL* pPool, const SCALER* pScaler,
+					  const uint32_t* pSrc, int iSrcPitch, uint32_t* pDst, int iDstPitch)
+{
+	SCALEJOB job;
+
+	job.pScaler = pScaler;
+	job.pSrc = pSrc;
+	job.iSrcPitch = iSrcPitch;
+	job.pDst = pDst;
+	job.iDstPitch = iDstPitch;
+
+	RunWorkerPool(pPool, ScaleBandJob, &job, pScaler->nBands);
+}
@@ -0,0 +1,182 @@
+/*
+	Scrolling surface (ring buffer with a logical origin)
+	Notes:
+		- the content is a function of the absolute position: the pixel at
+		  (X, Y) always lives at the physical pixel (X mod cx, Y mod cy)
+		- the window shows the absolute rect [xScroll, xScroll + cx) x [yScroll, yScroll + cy)
+		  so scrolling by (dx, dy) only exposes one column strip and one row strip,
+		  everything else is already in the right physical place
+		- the content function is a kernel with the PFNGRADIENTROWS signature
+		  (it writes f(x + xOffset, y + yOffset)), changing it means a full recompute
+		- ScrollSurfacePieces splits the wrapped surface in up to 4 rects to present
+		  (no copy), ResolveScrollSurface copies it to a linear buffer instead
+
+		   physical surface               what the window shows
+		  +--------+---------+            +---------+--------+
+		  |   D    |    C    |            |    A    |   B    |
+		  +--------+---------+  (ox,oy)   +---------+--------+
+		  |   B    |    A    |            |    C    |   D    |
+		  +--------+---------+            +---------+--------+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+	uint32_t*       pBits;
+	int             iPitch;            // bytes per row
+	int             cx, cy;
+	int             xScroll, yScroll;  // absolute position of the top-left visible pixel
+	PFNGRADIENTROWS pfnContent;
+	int             bValid;            // FALSE -> next scroll recomputes everything
+
+	long long       llPixelsWritten;   // stats: pixels generated since the last reset
+	int             nFullRedraws;
+} SCROLLSURFACE;
+
+// a piece of the wrapped surface: dest is in window (logical) coordinates
+typedef struct {
+	int xDest, yDest;
+	int xSrc, ySrc;    // physical position in the surface
+	int cx, cy;
+} SCROLLPIECE;
+
+static int PositiveMod(int a, int m)
+{
+	int r = a % m;
+	return r < 0 ? r + m : r;
+}
+
+static void InitScrollSurface(SCROLLSURFACE* pSurface, uint32_t* pBits, int iPitch,
+							  int cx, int cy, PFNGRADIENTROWS pfnContent)
+{
+	memset(pSurface, 0, sizeof(*pSurface));
+	pSurface->pBits = pBits;
+	pSurface->iPitch = iPitch;
+	pSurface->cx = cx;
+	pSurface->cy = cy;
+	pSurface->pfnContent = pfnContent;
+}
+
+// new content function: the next ScrollSurfaceTo redraws the whole surface
+static void SetScrollContent(SCROLLSURFACE* pSurface, PFNGRADIENTROWS pfnContent)
+{
+	pSurface->pfnContent = pfnContent;
+	pSurface->bValid = 0;
+}
+
+/*
+	Generates the absolute rect [X0, X1) x [Y0, Y1) (at most cx by cy pixels)
+	splitting it where it wraps around the physical edges
+*/
+static void FillScrollRect(SCROLLSURFACE* pSurface, int X0, int Y0, int X1, int Y1)
+{
+	int Y = Y0;
+
+	while (Y < Y1) {
+		int py = PositiveMod(Y, pSurface->cy);
+		int rows = pSurface->cy - py;
+		if (rows > Y1 - Y) {
+			rows = Y1 - Y;
+		}
+
+		int X = X0;
+		while (X < X1) {
+			int px = PositiveMod(X, pSurface->cx);
+			int cols = pSurface->cx - px;
+			if (cols > X1 - X) {
+				cols = X1 - X;
+			}
+
+			// the kernel writes f(x + xOffset, y + yOffset) for x from 0 and rows
+			// y0..y1 relative to the pointer, so move the pointer to column px
+			pSurface->pfnContent(pSurface->pBits + px, pSurface->iPitch, cols,
+								 py, py + rows, X, Y - py);
+			pSurface->llPixelsWritten += (long long)cols * rows;
+			X += cols;
+		}
+		Y += rows;
+	}
+}
+
+// moves the view to the absolute position (x, y) generating only what became visible
+static void ScrollSurfaceTo(SCROLLSURFACE* pSurface, int x, int y)
+{
+	int cx = pSurface->cx, cy = pSurface->cy;
+	int xOld = pSurface->xScroll, yOld = pSurface->yScroll;
+	int dx = x - xOld, dy = y - yOld;
+
+	pSurface->xScroll = x;
+	pSurface->yScroll = y;
+
+	if (!pSurface->bValid || dx >= cx || -dx >= cx || dy >= cy || -dy >= cy) {
+		FillScrollRect(pSurface, x, y, x + cx, y + cy);
+		pSurface->bValid = 1;
+		pSurface->nFullRedraws++;
+		return;
+	}
+
+	// column strip, full height of the new view
+	if (dx > 0) {
+		FillScrollRect(pSurface, xOld + cx, y, x + cx, y + cy);
+	} else if (dx < 0) {
+		FillScrollRect(pSurface, x, y, xOld, y + cy);
+	}
+
+	// row strip, only the columns the column strip did not cover
+	int xKeep0 = dx > 0 ? x : xOld;
+	int xKeep1 = dx > 0 ? xOld + cx : x + cx;
+	if (dy > 0) {
+		FillScrollRect(pSurface, xKeep0, yOld + cy, xKeep1, y + cy);
+	} else if (dy < 0) {
+		FillScrollRect(pSurface, xKeep0, y, xKeep1, yOld);
+	}
+}
+
+// splits the visible image in at most 4 physical rects, returns how many
+static int ScrollSurfacePieces(const SCROLLSURFACE* pSurface, SCROLLPIECE pieces[4])
+{
+	int ox = PositiveMod(pSurface->xScroll, pSurface->cx);
+	int oy = PositiveMod(pSurface->yScroll, pSurface->cy);
+	int xSplit = pSurface->cx - ox; // window x where the physical x wraps to 0
+	int ySplit = pSurface->cy - oy;
+	int n = 0;
+
+	for (int j = 0; j < 2; j++) {
+		int yDest = j ? ySplit : 0;
+		int rows = j ? oy : ySplit;
+		if (rows == 0) {
+			continue;
+		}
+		for (int i = 0; i < 2; i++) {
+			int cols = i ? ox : xSplit;
+			if (cols == 0) {
+				continue;
+			}
+			pieces[n].xDest = i ? xSplit : 0;
+			pieces[n].yDest = yDest;
+			pieces[n].xSrc = i ? 0 : ox;
+			pieces[n].ySrc = j ? 0 : oy;
+			pieces[n].cx = cols;
+			pieces[n].cy = rows;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+// copies the visible image unwrapped into pDst (cx by cy pixels)
+static void ResolveScrollSurface(const SCROLLSURFACE* pSurface, uint32_t* pDst, int iDstPitch)
+{
+	SCROLLPIECE pieces[4];
+	int n = ScrollSurfacePieces(pSurface, pieces);
+
+	for (int i = 0; i < n; i++) {
+		for (int y = 0; y < pieces[i].cy; y++) {
+			memcpy(ROW_PTR(pDst, iDstPitch, pieces[i].yDest + y) + pieces[i].xDest,
+				   ROW_PTR(pSurface->pBits, pSurface->iPitch, pieces[i].ySrc + y) + pieces[i].xSrc,
+				   (size_t)pieces[i].cx * sizeof(uint32_t));
+		}
+	}
+}
@@ -0,0 +1,184 @@
+/*
+	Surface allocator: aligned, pitched, resizable pixel buffers
+	Notes:
+		- rows start on 64 byte boundaries (one cache line, one AVX-512 store) and
+		  are iPitch bytes apart; the pitch is also a multiple of the pixel size
+		  so GDI can see the padding as extra columns (biWidth = iPitch / bytes)
+		- memory comes straight from the OS (VirtualAlloc / mmap), page aligned,
+		  and goes back with the matching call (VirtualFree / munmap)
+		- ResizeSurface is grow-only: if the new size fits the capacity the
+		  buffer is kept and only cx, cy, iPitch change, when it does not fit
+		  we allocate 25% more than asked so dragging the window edge does not
+		  reallocate on every WM_SIZE
+		- SURFACE_HUGE_PAGES asks for 2MB pages (MAP_HUGETLB, then
+		  madvise(MADV_HUGEPAGE); MEM_LARGE_PAGES on windows, which needs the
+		  "Lock pages in memory" privilege), falling back to normal pages
+		- GetPageFaultCount is for the benchmark: first touch of fresh pages is
+		  where most of the allocation cost really is
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#define SURFACE_ALIGN       64
+#define SURFACE_HUGE_PAGES  0x1   // try 2MB pages
+#define SURFACE_NO_REUSE    0x2   // always reallocate (to compare in the benchmark)
+
+typedef struct {
+	uint8_t* pBits;        // first row, SURFACE_ALIGN aligned
+	int      cx, cy;
+	int      iBpp;         // 8, 15, 16, 24, 32 like CreateDIB
+	int      iPitch;       // bytes per row
+	size_t   cbCapacity;   // bytes really allocated
+	int      bHugePages;   // the allocation got huge pages
+	unsigned uFlags;
+
+	int      nAllocs;      // stats: OS allocations
+	int      nReuses;      // stats: resizes served by the current buffer
+} SURFACE;
+
+static int SurfaceBytesPerPixel(int iBpp)
+{
+	return iBpp == 15 ? 2 : iBpp / 8;
+}
+
+// row size rounded to 64 bytes, and to a whole number of pixels (24bpp -> 192)
+static int SurfacePitch(int cx, int iBpp)
+{
+	int iBytes = SurfaceBytesPerPixel(iBpp);
+	int iAlign = iBytes == 3 ? SURFACE_ALIGN * 3 : SURFACE_ALIGN;
+	return (cx * iBytes + iAlign - 1) / iAlign * iAlign;
+}
+
+static long long GetPageFaultCount(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	pmc.cb = sizeof(pmc);
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.PageFaultCount;
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt + ru.ru_majflt;
+#endif
+}
+
+#define HUGE_PAGE_SIZE (2u * 1024 * 1024)
+
+static void* AllocPages(size_t cb, int bHuge, int* pbGotHuge)
+{
+	void* p = NULL;
+	*pbGotHuge = 0;
+
+#ifdef _WIN32
+	if (bHuge) {
+		SIZE_T large = GetLargePageMinimum();
+		if (large) {
+			p = VirtualAlloc(NULL, (cb + large - 1) / large * large,
+							 MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			*pbGotHuge = p != NULL;
+		}
+	}
+	if (p == NULL) {
+		p = VirtualAlloc(NULL, cb, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+#else
+	if (bHuge) {
+#ifdef MAP_HUGETLB
+		size_t cbHuge = (cb + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		p = mmap(NULL, cbHuge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p == MAP_FAILED) {
+			p = NULL;
+		}
+		*pbGotHuge = p != NULL;
+#endif
+	}
+	if (p == NULL) {
+		p = mmap(NULL, cb, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			return NULL;
+		}
+#ifdef MADV_HUGEPAGE
+		// no reserved huge pages: let transparent huge pages back it if they can
+		if (bHuge) {
+			madvise(p, cb, MADV_HUGEPAGE);
+		}
+#endif
+	}
+#endif
+
+	return p;
+}
+
+static void FreePages(void* p, size_t cb, int bHuge)
+{
+#ifdef _WIN32
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	if (bHuge) {
+		cb = (cb + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	}
+	munmap(p, cb);
+#endif
+}
+
+static void FreeSurface(SURFACE* pSurface)
+{
+	if (pSurface->pBits) {
+		FreePages(pSurface->pBits, pSurface->cbCapacity, pSurface->bHugePages);
+	}
+	pSurface->pBits = NULL;
+	pSurface->cbCapacity = 0;
+	pSurface->cx = pSurface->cy = 0;
+}
+
+/*
+	(Re)sizes the surface to cx by cy pixels of iBpp, keeps the buffer when it
+	is big enough. The content is NOT kept (fresh memory is zero, reused memory
+	has the old pixels with the old pitch). Returns FALSE (0) if out of memory.
+*/
+static int ResizeSurface(SURFACE* pSurface, int cx, int cy, int iBpp, unsigned uFlags)
+{
+	int iPitch = SurfacePitch(cx, iBpp);
+	size_t cbNeeded = (size_t)iPitch * cy;
+
+	pSurface->uFlags = uFlags;
+	if (pSurface->pBits && cbNeeded <= pSurface->cbCapacity && !(uFlags & SURFACE_NO_REUSE)) {
+		pSurface->nReuses++;
+	} else {
+		// grow by 25% more than needed, unless asked for exact reallocation
+		size_t cbAlloc = (uFlags & SURFACE_NO_REUSE) ? cbNeeded : cbNeeded + cbNeeded / 4;
+		int bGotHuge;
+		void* p;
+
+		if (cbAlloc == 0) {
+			cbAlloc = SURFACE_ALIGN;
+		}
+		p = AllocPages(cbAlloc, (uFlags & SURFACE_HUGE_PAGES) != 0, &bGotHuge);
+		if (p == NULL) {
+			return 0;
+		}
+
+		FreeSurface(pSurface);
+		pSurface->pBits = (uint8_t*)p;
+		pSurface->cbCapacity = cbAlloc;
+		pSurface->bHugePages = bGotHuge;
+		pSurface->nAllocs++;
+	}
+
+	pSurface->cx = cx;
+	pSurface->cy = cy;
+	pSurface->iBpp = iBpp;
+	pSurface->iPitch = iPitch;
+	return 1;
+}
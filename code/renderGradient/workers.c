@@ -0,0 +1,265 @@
+/*
+	Persistent worker pool (win32 threads or pthreads)
+	Notes:
+		- threads are created once (CreateWorkerPool) and sleep on a condition
+		  variable between frames, so no thread is created per frame
+		- RunWorkerPool hands out nJobs jobs (row bands of the surface) through an
+		  atomic counter, the calling thread works too, and it returns only when
+		  every job is done (the end of frame barrier)
+		- a "generation" counter tells sleeping workers that a new frame started
+		- RenderGradientTiled splits the surface in bands of rows for the kernels
+		  in kernel.c (bands never share a row so nobody writes the same cache line
+		  except at the band edges)
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE             WORKERTHREAD;
+typedef SRWLOCK            WORKERLOCK;
+typedef CONDITION_VARIABLE WORKERCOND;
+#define LockWorkers(p)          AcquireSRWLockExclusive(&(p)->lock)
+#define UnlockWorkers(p)        ReleaseSRWLockExclusive(&(p)->lock)
+#define WaitWorkers(p, cond)    SleepConditionVariableSRW(&(p)->cond, &(p)->lock, INFINITE, 0)
+#define WakeAllWorkers(p, cond) WakeAllConditionVariable(&(p)->cond)
+#define AtomicFetchAdd(p, v)    InterlockedExchangeAdd((volatile LONG*)(p), (v))
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t          WORKERTHREAD;
+typedef pthread_mutex_t    WORKERLOCK;
+typedef pthread_cond_t     WORKERCOND;
+#define LockWorkers(p)          pthread_mutex_lock(&(p)->lock)
+#define UnlockWorkers(p)        pthread_mutex_unlock(&(p)->lock)
+#define WaitWorkers(p, cond)    pthread_cond_wait(&(p)->cond, &(p)->lock)
+#define WakeAllWorkers(p, cond) pthread_cond_broadcast(&(p)->cond)
+#define AtomicFetchAdd(p, v)    __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#endif
+
+#define MAX_WORKERS 64
+
+// job callback: iJob in [0, nJobs)
+typedef void (*PFNWORKERJOB)(void* pContext, int iJob, int nJobs);
+
+typedef struct {
+	int           nThreads;     // threads doing work, including the caller of RunWorkerPool
+	WORKERTHREAD  threads[MAX_WORKERS];
+	WORKERLOCK    lock;
+	WORKERCOND    condStart;    // a new frame (generation) is available
+	WORKERCOND    condDone;     // the last worker left the frame
+
+	// current frame, written under lock
+	PFNWORKERJOB  pfnJob;
+	void*         pContext;
+	int           nJobs;
+	unsigned int  uGeneration;
+	int           nBusy;        // workers still inside the current frame
+	int           bQuit;
+
+	volatile long lNextJob;     // next job index to grab
+} WORKERPOOL;
+
+static int GetCpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void DrainJobs(WORKERPOOL* pPool, PFNWORKERJOB pfnJob, void* pContext, int nJobs)
+{
+	for (;;) {
+		int iJob = (int)AtomicFetchAdd(&pPool->lNextJob, 1);
+		if (iJob >= nJobs) {
+			break;
+		}
+		pfnJob(pContext, iJob, nJobs);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI WorkerProc(LPVOID lpParam)
+#else
+static void* WorkerProc(void* lpParam)
+#endif
+{
+	WORKERPOOL* pPool = (WORKERPOOL*)lpParam;
+	unsigned int uSeen = 0;
+
+	LockWorkers(pPool);
+	for (;;) {
+		while (!pPool->bQuit && pPool->uGeneration == uSeen) {
+			WaitWorkers(pPool, condStart);
+		}
+		if (pPool->bQuit) {
+			break;
+		}
+		uSeen = pPool->uGeneration;
+		PFNWORKERJOB pfnJob = pPool->pfnJob;
+		void* pContext = pPool->pContext;
+		int nJobs = pPool->nJobs;
+		UnlockWorkers(pPool);
+
+		DrainJobs(pPool, pfnJob, pContext, nJobs);
+
+		LockWorkers(pPool);
+		if (--pPool->nBusy == 0) {
+			WakeAllWorkers(pPool, condDone);
+		}
+	}
+	UnlockWorkers(pPool);
+
+	return 0;
+}
+
+/*
+	nThreads -> how many threads render, the caller counts as one
+				(<= 0 means one per cpu)
+*/
+static int CreateWorkerPool(WORKERPOOL* pPool, int nThreads)
+{
+	memset(pPool, 0, sizeof(*pPool));
+
+	if (nThreads <= 0) {
+		nThreads = GetCpuCount();
+	}
+	if (nThreads > MAX_WORKERS) {
+		nThreads = MAX_WORKERS;
+	}
+	pPool->nThreads = 1;
+
+#ifdef _WIN32
+	InitializeSRWLock(&pPool->lock);
+	InitializeConditionVariable(&pPool->condStart);
+	InitializeConditionVariable(&pPool->condDone);
+#else
+	pthread_mutex_init(&pPool->lock, NULL);
+	pthread_cond_init(&pPool->condStart, NULL);
+	pthread_cond_init(&pPool->condDone, NULL);
+#endif
+
+	// threads[0] is unused: that slot is the thread calling RunWorkerPool
+	for (int i = 1; i < nThreads; i++) {
+#ifdef _WIN32
+		pPool->threads[i] = CreateThread(NULL, 0, WorkerProc, pPool, 0, NULL);
+		if (pPool->threads[i] == NULL) {
+			break;
+		}
+#else
+		if (pthread_create(&pPool->threads[i], NULL, WorkerProc, pPool) != 0) {
+			break;
+		}
+#endif
+		pPool->nThreads++;
+	}
+
+	return pPool->nThreads == nThreads;
+}
+
+static void DestroyWorkerPool(WORKERPOOL* pPool)
+{
+	LockWorkers(pPool);
+	pPool->bQuit = 1;
+	WakeAllWorkers(pPool, condStart);
+	UnlockWorkers(pPool);
+
+	for (int i = 1; i < pPool->nThreads; i++) {
+#ifdef _WIN32
+		WaitForSingleObject(pPool->threads[i], INFINITE);
+		CloseHandle(pPool->threads[i]);
+#else
+		pthread_join(pPool->threads[i], NULL);
+#endif
+	}
+
+#ifndef _WIN32
+	pthread_mutex_destroy(&pPool->lock);
+	pthread_cond_destroy(&pPool->condStart);
+	pthread_cond_destroy(&pPool->condDone);
+#endif
+	pPool->nThreads = 0;
+}
+
+// runs nJobs jobs on the pool and waits for all of them (frame barrier)
+static void RunWorkerPool(WORKERPOOL* pPool, PFNWORKERJOB pfnJob, void* pContext, int nJobs)
+{
+	if (pPool->nThreads <= 1 || nJobs <= 1) {
+		for (int i = 0; i < nJobs; i++) {
+			pfnJob(pContext, i, nJobs);
+		}
+		return;
+	}
+
+	LockWorkers(pPool);
+	pPool->pfnJob = pfnJob;
+	pPool->pContext = pContext;
+	pPool->nJobs = nJobs;
+	pPool->lNextJob = 0;
+	pPool->nBusy = pPool->nThreads - 1;
+	pPool->uGeneration++;
+	WakeAllWorkers(pPool, condStart);
+	UnlockWorkers(pPool);
+
+	DrainJobs(pPool, pfnJob, pContext, nJobs);
+
+	LockWorkers(pPool);
+	while (pPool->nBusy > 0) {
+		WaitWorkers(pPool, condDone);
+	}
+	UnlockWorkers(pPool);
+}
+
+/*
+	Tiled gradient rendering on top of the pool
+*/
+typedef struct {
+	uint32_t* pBits;
+	int       iPitch;
+	int       cx, cy;
+	int       iBandHeight;
+	int       xOffset, yOffset;
+} GRADIENTJOB;
+
+static void GradientBandJob(void* pContext, int iJob, int nJobs)
+{
+	GRADIENTJOB* pJob = (GRADIENTJOB*)pContext;
+	int y0 = iJob * pJob->iBandHeight;
+	int y1 = y0 + pJob->iBandHeight;
+
+	if (y1 > pJob->cy) {
+		y1 = pJob->cy;
+	}
+	g_pfnGradientRows(pJob->pBits, pJob->iPitch, pJob->cx, y0, y1, pJob->xOffset, pJob->yOffset);
+}
+
+static void RenderGradientTiled(WORKERPOOL* pPool, uint32_t* pBits, int iPitch, int cx, int cy,
+								int xOffset, int yOffset)
+{
+	GRADIENTJOB job;
+
+	// ~4 bands per thread so a slow thread can be helped by the others,
+	// but never less than 8 rows per band
+	int nBands = pPool->nThreads * 4;
+	job.iBandHeight = (cy + nBands - 1) / nBands;
+	if (job.iBandHeight < 8) {
+		job.iBandHeight = 8;
+	}
+	nBands = (cy + job.iBandHeight - 1) / job.iBandHeight;
+
+	job.pBits = pBits;
+	job.iPitch = iPitch;
+	job.cx = cx;
+	job.cy = cy;
+	job.xOffset = xOffset;
+	job.yOffset = yOffset;
+
+	RunWorkerPool(pPool, GradientBandJob, &job, nBands);
+}
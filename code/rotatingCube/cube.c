@@ -15,11 +15,25 @@
 #include <windowsx.h>
 #include <gl/gl.h>
 #include <math.h>
+#include "../common/pacing.c"
+#include "../common/quat.h"
+#include "../common/transform.c"
+#include "../common/texcache.c"
+#include "../common/atlas.c"
 
 static BOOL Running = TRUE;
 static HGLRC OpenGLRC;
-static float Angle = 0.0f; // cube rotation angle
-static DWORD lastTime = 0; // last frame timestamp
+static quat Orientation = QUAT_IDENTITY_INIT; // cube rotation
+static TRANSFORMTREE Scene; // camera -> cube, world matrices only redone when a local changes
+static int iCameraNode = -1, iCubeNode = -1;
+static double lastTime = 0.0; // last frame timestamp
+static TEXTURECACHE Textures; // one GL texture per bmp, not one per frame
+
+// the grass block's 3 textures in one, DrawTextureGrass binds it once
+enum { TILE_DIRT, TILE_DIRTGRASS, TILE_GRASS, TILE_COUNT };
+static const char* TilePaths[TILE_COUNT] = { ".\\dirt.bmp", ".\\dirtgrass.bmp", ".\\grass.bmp" };
+static ATLAS BlockAtlas;
+static GLuint BlockAtlasTexture = 0;
 
 static	GLubyte faceColors[6][3] = {
 	    {255, 0, 0},     // Front  
@@ -87,58 +101,11 @@ void DestroyOpenGL(HGLRC OpenGLRC)
 }
 
 
-GLuint LoadTextureFromBMP(const char* filename) 
+// texture cache backend: the cache maps and decodes the BMP (top row first,
+// 4 bytes per pixel), this only creates the GL texture
+unsigned int UploadTextureBMP(void* context, const BMPIMAGE* image, size_t* bytes) 
 {
-    HBITMAP hBitmap;
-    BITMAP bmp;
     GLuint textureID;
-    HDC hdc = GetDC(NULL);
-    HDC memDC = CreateCompatibleDC(hdc);
-
-    // Load the image using Win32 API
-    hBitmap = (HBITMAP)LoadImageA(
-        NULL, filename, IMAGE_BITMAP, 0, 0,
-        LR_LOADFROMFILE | LR_CREATEDIBSECTION
-    );
-
-    if (!hBitmap) {
-        MessageBoxA(0, "Failed to load BMP file", "Error", MB_OK);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, hdc);
-        return 0;
-    }
-
-    // Get basic bitmap info
-    GetObject(hBitmap, sizeof(BITMAP), &bmp);
-
-    int width = bmp.bmWidth;
-    int height = bmp.bmHeight;
-    int imageSize = width * height * 3;
-
-    // Create buffer for pixel data
-    BYTE* pixels = (BYTE*)malloc(imageSize);
-
-    if (!pixels) {
-        MessageBoxA(0, "Failed to allocate memory", "Error", MB_OK);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, hdc);
-        return 0;
-    }
-
-    // Prepare BITMAPINFO
-    BITMAPINFO bi;
-    ZeroMemory(&bi, sizeof(bi));
-    bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bi.bmiHeader.biWidth = width;
-    bi.bmiHeader.biHeight = -height; // Negative to avoid flipping
-    bi.bmiHeader.biPlanes = 1;
-    bi.bmiHeader.biBitCount = 24;
-    bi.bmiHeader.biCompression = BI_RGB;
-
-    // Select bitmap into memDC and extract bits
-    SelectObject(memDC, hBitmap);
-    GetDIBits(memDC, hBitmap, 0, height, pixels, &bi, DIB_RGB_COLORS);
 
     // Generate texture
     glGenTextures(1, &textureID);
@@ -158,23 +125,79 @@ GLuint LoadTextureFromBMP(const char* filename)
         GL_TEXTURE_2D,
         0,
         GL_RGB,
-        width,
-        height,
+        image->width,
+        image->height,
         0,
-        GL_BGR_EXT,
+        image->format == BMP_BGRA ? GL_BGRA_EXT : GL_RGBA,
         GL_UNSIGNED_BYTE,
-        pixels
+        image->pPixels
     );
 
-    // Cleanup
-    free(pixels);
-    DeleteObject(hBitmap);
-    DeleteDC(memDC);
-    ReleaseDC(NULL, hdc);
-
     return textureID;
 }
 
+void DeleteTextureBMP(void* context, unsigned int texture)
+{
+    glDeleteTextures(1, &texture);
+}
+
+// packs the block textures into one GL texture (2 pixel gutters: edge
+// pixels repeated, so filtering never picks up the neighbour tile)
+int BuildBlockAtlas(void)
+{
+    BMPIMAGE images[TILE_COUNT];
+    int sizes[2 * TILE_COUNT];
+    int loaded = 0;
+
+    for (; loaded < TILE_COUNT; loaded++) {
+        if (!LoadBmp(TilePaths[loaded], &images[loaded])) {
+            break;
+        }
+        sizes[2 * loaded] = images[loaded].width;
+        sizes[2 * loaded + 1] = images[loaded].height;
+    }
+
+    uint8_t* pixels = NULL;
+    if (loaded == TILE_COUNT && PackAtlas(&BlockAtlas, sizes, TILE_COUNT, 2, 1024)) {
+        pixels = (uint8_t*)calloc((size_t)BlockAtlas.width * BlockAtlas.height, 4);
+    }
+    if (pixels) {
+        for (int i = 0; i < TILE_COUNT; i++) {
+            BlitAtlasTile(&BlockAtlas, i, pixels, BlockAtlas.width * 4, images[i].pPixels, images[i].pitch,
+                          images[i].format != BMP_RGBA);
+        }
+        glGenTextures(1, &BlockAtlasTexture);
+        glBindTexture(GL_TEXTURE_2D, BlockAtlasTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, BlockAtlas.width, BlockAtlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        free(pixels);
+    }
+
+    while (loaded-- > 0) {
+        FreeBmp(&images[loaded]);
+    }
+    return BlockAtlasTexture != 0;
+}
+
+void FreeBlockAtlas(void)
+{
+    if (BlockAtlasTexture) {
+        glDeleteTextures(1, &BlockAtlasTexture);
+        BlockAtlasTexture = 0;
+    }
+    FreeAtlas(&BlockAtlas);
+}
+
+// a vertex with tile's own texcoord (u, v) moved into the atlas
+static void AtlasVertex(int tile, float u, float v, float x, float y, float z)
+{
+    float uv[2];
+    AtlasTexCoord(&BlockAtlas, tile, u, v, uv);
+    glTexCoord2f(uv[0], uv[1]);
+    glVertex3f(x, y, z);
+}
+
 
 void SetPerspective(float fovY, float aspect, float zNear, float zFar)
 {
@@ -343,7 +366,7 @@ void DrawRainbowCube()
 
 void DrawTextureCube(const char* filename)
 {
-	GLuint texture = LoadTextureFromBMP(filename);
+	GLuint texture = AcquireTexture(&Textures, filename); // uploaded on the first frame only
 
 	// Enable texturing
 	glEnable(GL_TEXTURE_2D);
@@ -431,132 +454,62 @@ void DrawTextureCube(const char* filename)
 	glVertex3f(-1, -1, 1);
 	
 	glEnd();
+
+	ReleaseTexture(&Textures, filename);
 }
 
 void DrawTextureGrass()
 {
-	GLuint bTexture = LoadTextureFromBMP(".\\dirt.bmp");
-	GLuint sTexture = LoadTextureFromBMP(".\\dirtgrass.bmp");
-	GLuint tTexture = LoadTextureFromBMP(".\\grass.bmp");
-
-	// Enable texturing
+	// one texture, one glBegin/glEnd for all 6 faces (was a bind and a
+	// glBegin/glEnd per face)
 	glEnable(GL_TEXTURE_2D);
-		
-	
-	// Front face (z+)
-	glBindTexture(GL_TEXTURE_2D, sTexture);
+	glBindTexture(GL_TEXTURE_2D, BlockAtlasTexture);
 	glBegin(GL_QUADS);
 
-	glTexCoord2f(0, 0);
-	glVertex3f(1, 1, 1);
-	
-	glTexCoord2f(1, 0); 
-	glVertex3f(-1, 1, 1);
-	
-	glTexCoord2f(1, 1);
-	glVertex3f(-1, -1, 1);
-	
-	glTexCoord2f(0, 1);
-	glVertex3f(1, -1, 1);
-	
-	glEnd();
-	 
+	// Front face (z+)
+	AtlasVertex(TILE_DIRTGRASS, 0, 0, 1, 1, 1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 0, -1, 1, 1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 1, -1, -1, 1);
+	AtlasVertex(TILE_DIRTGRASS, 0, 1, 1, -1, 1);
+
 	// Back face (z-)
-	glBindTexture(GL_TEXTURE_2D, sTexture);
-	glBegin(GL_QUADS);
+	AtlasVertex(TILE_DIRTGRASS, 1, 0, -1, 1, -1);
+	AtlasVertex(TILE_DIRTGRASS, 0, 0, 1, 1, -1);
+	AtlasVertex(TILE_DIRTGRASS, 0, 1, 1, -1, -1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 1, -1, -1, -1);
 
-	glTexCoord2f(1, 0);
-	glVertex3f(-1, 1, -1);
-	
-	glTexCoord2f(0, 0);
-	glVertex3f(1, 1, -1);
-	
-	glTexCoord2f(0, 1);
-	glVertex3f(1, -1, -1);
-	
-	glTexCoord2f(1, 1);
-	glVertex3f(-1, -1, -1);
-	
-	glEnd();
-	
 	// Left face (x-)
-	glBindTexture(GL_TEXTURE_2D, sTexture);
-	glBegin(GL_QUADS);
-	
-	glTexCoord2f(0, 1);
-	glVertex3f(-1, -1, -1);
-	
-	glTexCoord2f(1, 1);
-	glVertex3f(-1, -1, 1); 
-	
-	glTexCoord2f(1, 0);
-	glVertex3f(-1, 1, 1); 
-	
-	glTexCoord2f(0, 0);
-	glVertex3f(-1, 1, -1); 
-	
-	glEnd();
+	AtlasVertex(TILE_DIRTGRASS, 0, 1, -1, -1, -1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 1, -1, -1, 1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 0, -1, 1, 1);
+	AtlasVertex(TILE_DIRTGRASS, 0, 0, -1, 1, -1);
 
 	// Right face (x+)
-	glBindTexture(GL_TEXTURE_2D, sTexture);
-	glBegin(GL_QUADS);
-
-	glTexCoord2f(0, 0);
-	glVertex3f(1, 1, 1);
-	
-	glTexCoord2f(1, 0);
-	glVertex3f(1, 1, -1);
-	
-	glTexCoord2f(1, 1);
-	glVertex3f(1, -1, -1);
-	
-	glTexCoord2f(0, 1);
-	glVertex3f(1, -1, 1);
-	
-	glEnd();
+	AtlasVertex(TILE_DIRTGRASS, 0, 0, 1, 1, 1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 0, 1, 1, -1);
+	AtlasVertex(TILE_DIRTGRASS, 1, 1, 1, -1, -1);
+	AtlasVertex(TILE_DIRTGRASS, 0, 1, 1, -1, 1);
 
 	// Top face (y+)
-	glBindTexture(GL_TEXTURE_2D, tTexture);
-	glBegin(GL_QUADS);
-
-	glTexCoord2f(0, 0);
-	glVertex3f(-1, 1, -1);
-	
-	glTexCoord2f(1, 0);
-	glVertex3f(-1, 1, 1);
-	
-	glTexCoord2f(1, 1);
-	glVertex3f(1, 1, 1);
-	
-	glTexCoord2f(0, 1);
-	glVertex3f(1, 1, -1);
-	
-	glEnd();
+	AtlasVertex(TILE_GRASS, 0, 0, -1, 1, -1);
+	AtlasVertex(TILE_GRASS, 1, 0, -1, 1, 1);
+	AtlasVertex(TILE_GRASS, 1, 1, 1, 1, 1);
+	AtlasVertex(TILE_GRASS, 0, 1, 1, 1, -1);
 
 	// Bottom face (y-)
-	glBindTexture(GL_TEXTURE_2D, bTexture);
-	glBegin(GL_QUADS);
+	AtlasVertex(TILE_DIRT, 0, 0, -1, -1, -1);
+	AtlasVertex(TILE_DIRT, 1, 0, 1, -1, -1);
+	AtlasVertex(TILE_DIRT, 1, 1, 1, -1, 1);
+	AtlasVertex(TILE_DIRT, 0, 1, -1, -1, 1);
 
-	glTexCoord2f(0, 0);
-	glVertex3f(-1, -1, -1);
-	
-	glTexCoord2f(1, 0);
-	glVertex3f(1, -1, -1);
-	
-	glTexCoord2f(1, 1);
-	glVertex3f(1, -1, 1);
-	
-	glTexCoord2f(0, 1);
-	glVertex3f(-1, -1, 1);
-	
 	glEnd();
 }
 
 void DisplayBufferInWindow(HDC DeviceContext, int WindowWidth, int WindowHeight)
 {
 	// framerate handling
-	DWORD currentTime = GetTickCount(); 
-	float deltaTime = (currentTime - lastTime) / 1000.0f;
+	double currentTime = PaceNow(); // high resolution, GetTickCount moves in ~16ms steps
+	float deltaTime = (float)(currentTime - lastTime);
 	lastTime = currentTime;
 
 	//Platform independet OpenGL functions:
@@ -568,10 +521,22 @@ void DisplayBufferInWindow(HDC DeviceContext, int WindowWidth, int WindowHeight)
 	SetPerspective(45.0f, (float)WindowWidth / (float)WindowHeight, 0.1f, 100.0f);
 
 	// transformation setup
+	if (iCameraNode < 0) {
+		affine back, identity = AFFINE_IDENTITY_INIT;
+		affine_translate(&back, 0.0f, 0.0f, -5.0f); // move cube back
+		InitTransformTree(&Scene);
+		iCameraNode = AddTransformNode(&Scene, -1, &back);
+		iCubeNode = AddTransformNode(&Scene, iCameraNode, &identity);
+	}
+	mat4 rotation, modelView;
+	affine local;
+	quat_to_mat4(Orientation, rotation);
+	affine_from_mat4(rotation, &local);
+	SetTransformLocal(&Scene, iCubeNode, &local); // rotate cube
+	UpdateTransformTree(&Scene); // the camera node is clean, only the cube is recomputed
+	affine_to_mat4(&Scene.pWorld[iCubeNode], modelView);
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glTranslatef(0.0f, 0.0f, -5.0f); // move cube back
-	glRotatef(Angle, 1.0f, 1.0f, 0.0f); // rotate cube
+	glLoadMatrixf(&modelView[0][0]);
 
 
 	glClearColor(0.129837f, 0.283764f, 0.54235f, 0.0f); // specify clear values for the color buffers
@@ -589,8 +554,10 @@ void DisplayBufferInWindow(HDC DeviceContext, int WindowWidth, int WindowHeight)
 	// referenced by the specified device context includes a back buffer.
 	SwapBuffers(DeviceContext); 
 
-	Angle += 90.0f * deltaTime; // 90 degrees per second
-	if(Angle >= 360.0f) Angle -= 360.0f;
+	// 90 degrees per second around (1,1,0): one small step per frame, no
+	// angle to wrap and no trig on the accumulated rotation
+	quat step = quat_from_axis_angle(1.0f, 1.0f, 0.0f, 1.5707963f * deltaTime);
+	Orientation = quat_normalize(quat_mul(step, Orientation));
 }
 
 void OnDestroy(HWND hWnd)
@@ -672,6 +639,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 {
 	
 	MSG msg;
+	FRAMEPACER pacer; // replaces Sleep(10): fixed frame rate, see ../common/pacing.c
 	HWND hWnd;
 	WNDCLASSEX wc;
 
@@ -706,11 +674,17 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	);
 
 	OpenGLRC = InitOpenGL(hWnd);
+	InitBmpDecoder(); // SSSE3 swizzle for the 24bpp textures
+	TEXTUREBACKEND backend = { NULL, UploadTextureBMP, DeleteTextureBMP };
+	InitTextureCache(&Textures, &backend, 64 << 20);
+	BuildBlockAtlas(); // for DrawTextureGrass
 	
 	if(OpenGLRC)
 	{
 		
-        lastTime = GetTickCount();
+        lastTime = PaceNow();
+
+		InitFramePacer(&pacer, 60.0);
 
 		Running = TRUE;
 		while(Running)
@@ -729,9 +703,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 			}
 
 			InvalidateRect(hWnd, NULL, FALSE);
-			Sleep(10);
+			WaitNextFrame(&pacer); // 60 fps on an absolute schedule
 		}
 
+		FreeFramePacer(&pacer);
+		FreeTransformTree(&Scene);
+		FreeTextureCache(&Textures); // while the GL context is still current
+		FreeBlockAtlas();
+
 		DestroyOpenGL(OpenGLRC);
 	}
 
@@ -5,15 +5,20 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "glextloader.c"
-#include "matrix.c"
+#include "../../common/mat4.h"
+#include "../../common/pacing.c"
+#include "../../common/bmp.c"
+#include "../../common/mip.c"
+#include "../../common/bc.c"
 
 static BOOL Running = FALSE;
 static HGLRC OpenGLRC = NULL;
-static DWORD lastTime = 0;
+static double lastTime = 0.0;
 static float  Angle = 0.0f;
 static unsigned int VBO = NULL;
 static unsigned int VAO = NULL;
 static unsigned int shaderProgram = NULL;
+static BOOL CompressTextures = FALSE; // BC1 / BC3 uploads, set once the context says it has S3TC
 
 /*
 	notes: initCube bindText compileAndLinkShaders are not used!!
@@ -59,109 +64,107 @@ void getScreenDim_Win32(HWND hWnd, int* width, int* height)
     height = rect.bottom - rect.top;
     printf("w: %d, h: %d\n", width, height);
 }
-GLuint LoadTextureFromBMP_Win32(const char* filename)
+// whole word match in the extension string (one name can be the start of another)
+BOOL HasGLExtension(const char* name)
 {
-    HBITMAP    hBitmap = NULL;
-    BITMAP     bmp;
-    BYTE       *pixels = NULL;
-    GLuint     texID = 0;
-    HDC        screenDC = NULL;
-    HDC        memDC = NULL;
-
-    // Acquire DCs
-    screenDC = GetDC(NULL);
-    if (!screenDC) {
-        fprintf(stderr, "Error: GetDC failed\n");
-        return 0;
-    }
-    memDC = CreateCompatibleDC(screenDC);
-    if (!memDC) {
-        fprintf(stderr, "Error: CreateCompatibleDC failed\n");
-        ReleaseDC(NULL, screenDC);
-        return 0;
+    const char* list = (const char*)glGetString(GL_EXTENSIONS);
+    size_t n = strlen(name);
+    for (const char* p = list; p && (p = strstr(p, name)) != NULL; p += n) {
+        if ((p == list || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0')) {
+            return TRUE;
+        }
     }
+    return FALSE;
+}
 
-    // Load BMP into DIB section (24-bit)
-    hBitmap = (HBITMAP)LoadImageA(
-        NULL, filename, IMAGE_BITMAP,
-        0, 0, LR_LOADFROMFILE | LR_CREATEDIBSECTION
-    );
-    if (!hBitmap) {
-        fprintf(stderr, "Error: could not load BMP \"%s\"\n", filename);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
+// every level block compressed (encoded once, then read from bccache/, see ../common/bc.c); 0 if any level failed
+int UploadCompressedMips(const MIPCHAIN* chain, const BMPIMAGE* image)
+{
+    BCIMAGE blocks[MIP_MAX_LEVELS];
+    int     format = image->bHasAlpha ? BC_BC3 : BC_BC1, n = 0;
+
+    for (; n < chain->nLevels; n++) {
+        const MIPLEVEL* level = &chain->levels[n];
+        if (!EncodeBcImageCached(&blocks[n], "bccache", level->pPixels, level->width, level->height, level->pitch,
+                                 image->format == BMP_BGRA, format, BC_NORMAL, 0)) {
+            break;
+        }
     }
-
-    // Query bitmap info
-    GetObject(hBitmap, sizeof(bmp), &bmp);
-    if (bmp.bmBitsPixel != 24) {
-        fprintf(stderr, "Error: only 24-bit BMP supported (found %u bpp)\n",
-                bmp.bmBitsPixel);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
+    if (n == chain->nLevels) {
+        for (int i = 0; i < n; i++) {
+            glCompressedTexImage2D(
+                GL_TEXTURE_2D,
+                i,
+                format == BC_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                blocks[i].width,
+                blocks[i].height,
+                0,
+                (GLsizei)blocks[i].cbData,
+                blocks[i].pData
+            );
+        }
     }
-
-    // Allocate pixel buffer
-    pixels = (BYTE*)malloc(bmp.bmWidth * bmp.bmHeight * 3);
-    if (!pixels) {
-        fprintf(stderr, "Error: malloc(%u) failed\n",
-                bmp.bmWidth * bmp.bmHeight * 3u);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
-        return 0;
+    for (int i = 0; i < n; i++) {
+        FreeBcImage(&blocks[i]);
     }
+    return n == chain->nLevels;
+}
+
+GLuint LoadTextureFromBMP(const char* filename)
+{
+    BMPIMAGE   image;
+    MIPCHAIN   chain;
+    GLuint     texID = 0;
 
-    // Prepare BITMAPINFO for top-down BGR read
-    BITMAPINFO bi;
-    ZeroMemory(&bi, sizeof(bi));
-    bi.bmiHeader.biSize        = sizeof(bi.bmiHeader);
-    bi.bmiHeader.biWidth       = bmp.bmWidth;
-    bi.bmiHeader.biHeight      = -bmp.bmHeight;  // negative for top-down
-    bi.bmiHeader.biPlanes      = 1;
-    bi.bmiHeader.biBitCount    = 24;
-    bi.bmiHeader.biCompression = BI_RGB;
-
-    // Extract bits
-    SelectObject(memDC, hBitmap);
-    if (!GetDIBits(memDC, hBitmap, 0, bmp.bmHeight, pixels, &bi, DIB_RGB_COLORS)) {
-        fprintf(stderr, "Error: GetDIBits failed\n");
-        free(pixels);
-        DeleteObject(hBitmap);
-        DeleteDC(memDC);
-        ReleaseDC(NULL, screenDC);
+    // mapped and decoded without GDI: top row first, 4 bytes per pixel
+    if (!LoadBmp(filename, &image)) {
+        fprintf(stderr, "Error: could not load BMP \"%s\": %s\n", filename, image.szError);
         return 0;
     }
 
     // Create and upload OpenGL texture
     glGenTextures(1, &texID);
     glBindTexture(GL_TEXTURE_2D, texID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGB8,
-        bmp.bmWidth,
-        bmp.bmHeight,
-        0,
-        GL_BGR,
-        GL_UNSIGNED_BYTE,
-        pixels
-    );
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // every level on the cpu, filtered in linear light: glGenerateMipmap
+    // averages the sRGB bytes on some drivers, distant texels come out dark
+    if (BuildMipChain(&chain, image.pPixels, image.width, image.height, image.pitch, MIP_KAISER, 1, 0)) {
+        // 0.5 (BC1) or 1 (BC3) byte a texel instead of 3 or 4, in memory and over the bus
+        if (!CompressTextures || !UploadCompressedMips(&chain, &image)) {
+            for (int i = 0; i < chain.nLevels; i++) {
+                glTexImage2D(
+                    GL_TEXTURE_2D,
+                    i,
+                    GL_RGB8,
+                    chain.levels[i].width,
+                    chain.levels[i].height,
+                    0,
+                    image.format == BMP_BGRA ? GL_BGRA : GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    chain.levels[i].pPixels
+                );
+            }
+        }
+        FreeMipChain(&chain);
+    } else {
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            GL_RGB8,
+            image.width,
+            image.height,
+            0,
+            image.format == BMP_BGRA ? GL_BGRA : GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            image.pPixels
+        );
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
-    // Cleanup GDI & memory
-    free(pixels);
-    DeleteObject(hBitmap);
-    DeleteDC(memDC);
-    ReleaseDC(NULL, screenDC);
+    FreeBmp(&image);
 
     return texID;
 }
@@ -231,7 +234,7 @@ void LoadAndCreateTextures()
     CheckGLErrors("Texture filtering");
 
     // load image, create texture and generate mipmaps
-    GLuint data = LoadTextureFromBMP_Win32("dirt.bmp");
+    GLuint data = LoadTextureFromBMP("dirt.bmp");
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
     CheckGLErrors("Image load and texture creation");
@@ -288,8 +291,8 @@ void initCubeVertex()
 void Display(HDC DeviceContext, HWND hWnd, width, height)
 {
     // time setup
-	DWORD currentTime = GetTickCount(); 
-    float deltaTime = (currentTime - lastTime) * 0.001f;
+	double currentTime = PaceNow(); // high resolution, GetTickCount moves in ~16ms steps
+    float deltaTime = (float)(currentTime - lastTime);
     lastTime = currentTime;
 
     SetupViewport(hWnd);
@@ -450,6 +453,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine, int iCmdShow)
 {
 	MSG msg;
+	FRAMEPACER pacer; // replaces Sleep(10): fixed frame rate, see ../common/pacing.c
 	HWND hWnd;
 	WNDCLASSEX wc;
 
@@ -486,6 +490,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	DebugConsole();
 
 	OpenGLRC = InitOpenGL(hWnd);
+	InitBmpDecoder(); // SSSE3 swizzle for the 24bpp textures
+	InitMipKernels(); // mips on the cpu, see ../common/mip.c
+	InitBcEncoder(); // texture blocks on the cpu, see ../common/bc.c
+	CompressTextures = glCompressedTexImage2D && HasGLExtension("GL_EXT_texture_compression_s3tc");
     CompileAndLinkShaders();
     initCubeVertex();
     BindVertexArrays();
@@ -495,7 +503,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 	if(OpenGLRC)
 	{
 		
-        lastTime = GetTickCount();
+        lastTime = PaceNow();
+
+		InitFramePacer(&pacer, 60.0);
 
 		Running = TRUE;
 		while(Running)
@@ -514,9 +524,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 			}
 
 			InvalidateRect(hWnd, NULL, FALSE);
-			Sleep(10);
+			WaitNextFrame(&pacer); // 60 fps on an absolute schedule
 		}
 
+		FreeFramePacer(&pacer);
+
 		DestroyOpenGL(OpenGLRC);
 	}
 
@@ -43,6 +43,7 @@ static void (*glBindAttribLocation)(GLuint, GLuint,GLchar*) = NULL;
 // Let's try to ship our own gl.h just like glext.h
 #ifdef _WIN32
 static PFNGLACTIVETEXTUREPROC glActiveTexture = NULL;
+static PFNGLCOMPRESSEDTEXIMAGE2DPROC glCompressedTexImage2D = NULL;
 #endif // _WIN32
 
 static void load_gl_extensions(void)
@@ -82,6 +83,7 @@ static void load_gl_extensions(void)
     glUniform4f               = (PFNGLUNIFORM4FPROC) wglGetProcAddress("glUniform4f");
 #ifdef _WIN32
     glActiveTexture           = (PFNGLACTIVETEXTUREPROC) wglGetProcAddress("glActiveTexture");
+    glCompressedTexImage2D    = (PFNGLCOMPRESSEDTEXIMAGE2DPROC) wglGetProcAddress("glCompressedTexImage2D");
 #endif // _WIN32
 
     glDisableVertexAttribArray = (void (*)(GLuint)) wglGetProcAddress("glDisableVertexAttribArray");